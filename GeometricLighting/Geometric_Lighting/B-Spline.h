@@ -1,5 +1,6 @@
 #pragma once
 #include "RenderShape.h"
+#include "MeshExporter.h"
 
 #include <vector>
 
@@ -18,10 +19,31 @@ public:
 		glm::vec3 controlPointPos4, glm::vec3 controlPointPos5, glm::vec3 controlPointPos6, glm::vec3 controlPointPos7,
 		glm::vec3 controlPointPos8, glm::vec3 controlPointPos9, glm::vec3 controlPointPos10, glm::vec3 controlPointPos11,
 		glm::vec3 controlPointPos12, glm::vec3 controlPointPos13, glm::vec3 controlPointPos14, glm::vec3 controlPointPos15);
+	void SetControlPoints(int patch, const glm::vec3* controlPoints);
 
 	Transform& transform(); 
+	int numPatches();
+	Patch* patch(int index);
+
+	// World space box around the spline as of the last Update. Bezier patches lie inside the
+	// convex hull of their control points, so the box around those is enough.
+	void Bounds(glm::vec3& minPos, glm::vec3& maxPos);
+
+	// Hands out each patch's control points, for exporting or storing the spline
+	PatchSource patchSource();
+
+	// Turns drawing of every patch on or off
+	void SetVisible(bool visible);
+
+	// Draws every patch into the views whose bits are set, or turns drawing off with none
+	void SetViewMask(unsigned int viewMask);
+	void SetColor(glm::vec4 color);
 private:
 	Transform _transform;
 
+	glm::vec3 _localMin;
+	glm::vec3 _localMax;
+	bool _boundsDirty;
+
 	std::vector<Patch*>* _spline;
 };
\ No newline at end of file
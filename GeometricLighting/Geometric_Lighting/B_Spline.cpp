@@ -1,5 +1,9 @@
 #include "B-Spline.h"
 #include "Patch.h"
+#include "PatchEvaluator.h"
+
+#include <algorithm>
+#include <cfloat>
 
 B_Spline::B_Spline(Shader shader, int numPatches)
 {
@@ -22,6 +26,8 @@ B_Spline::B_Spline(Shader shader, int numPatches)
 
 	_transform.rotationOrigin = glm::vec3();
 	_transform.scaleOrigin = glm::vec3();
+
+	_boundsDirty = true;
 }
 B_Spline::~B_Spline()
 {
@@ -47,9 +53,9 @@ void B_Spline::Update(float dt)
 	glm::mat4 scaleOriginMat = glm::translate(glm::mat4(), _transform.scaleOrigin);
 	glm::mat4 scaleMat = scaleOriginMat * glm::scale(glm::mat4(), _transform.scale) * glm::inverse(scaleOriginMat);
 
-	glm::mat4 *parentModelMat = _transform.parent ? &_transform.parent->modelMat : &glm::mat4();
+	glm::mat4 parentModelMat = _transform.parent ? _transform.parent->modelMat : glm::mat4();
 
-	_transform.modelMat = (*parentModelMat) * (translateMat * scaleMat* rotateMat);
+	_transform.modelMat = parentModelMat * (translateMat * scaleMat* rotateMat);
 
 	unsigned int size = _spline->size();
 	for (unsigned int i = 0; i < size; ++i)
@@ -84,6 +90,74 @@ void B_Spline::SetControlPoints(int patch,
 	(*_spline)[patch]->SetControlPoint(14, controlPointPos14);
 	(*_spline)[patch]->SetControlPoint(15, controlPointPos15);
 	(*_spline)[patch]->Update(0.0f, true);
+	_boundsDirty = true;
+}
+
+void B_Spline::SetControlPoints(int patch, const glm::vec3* controlPoints)
+{
+	for (int i = 0; i < 16; ++i)
+	{
+		(*_spline)[patch]->SetControlPoint(i, controlPoints[i]);
+	}
+	(*_spline)[patch]->Update(0.0f, true);
+	_boundsDirty = true;
+}
+
+void B_Spline::Bounds(glm::vec3& minPos, glm::vec3& maxPos)
+{
+	if (_boundsDirty)
+	{
+		_localMin = glm::vec3(FLT_MAX);
+		_localMax = glm::vec3(-FLT_MAX);
+		unsigned int size = _spline->size();
+		for (unsigned int i = 0; i < size; ++i)
+		{
+			glm::vec3 patchMin, patchMax;
+			PatchEvaluator::Bounds((*_spline)[i]->controlPoints(), patchMin, patchMax);
+			_localMin = glm::min(_localMin, patchMin);
+			_localMax = glm::max(_localMax, patchMax);
+		}
+		_boundsDirty = false;
+	}
+
+	PatchEvaluator::TransformBounds(_transform.modelMat, _localMin, _localMax, minPos, maxPos);
+}
+
+void B_Spline::SetVisible(bool visible)
+{
+	SetViewMask(visible ? ~0u : 0u);
+}
+
+void B_Spline::SetViewMask(unsigned int viewMask)
+{
+	unsigned int size = _spline->size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		RenderShape* shape = (*_spline)[i]->shape();
+		shape->active() = viewMask != 0;
+		shape->viewMask() = viewMask;
+	}
+}
+
+void B_Spline::SetColor(glm::vec4 color)
+{
+	unsigned int size = _spline->size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		(*_spline)[i]->shape()->color(color);
+	}
+}
+
+PatchSource B_Spline::patchSource()
+{
+	std::vector<Patch*>* spline = _spline;
+	return [spline](int patch, glm::vec3* controlPoints)
+	{
+		const glm::vec3* src = (*spline)[patch]->controlPoints();
+		std::copy(src, src + 16, controlPoints);
+	};
 }
 
-Transform& B_Spline::transform() { return _transform; }
\ No newline at end of file
+Transform& B_Spline::transform() { return _transform; }
+int B_Spline::numPatches() { return _spline->size(); }
+Patch* B_Spline::patch(int index) { return (*_spline)[index]; }
\ No newline at end of file
@@ -0,0 +1,147 @@
+#include "BptFile.h"
+
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Copies the next whitespace separated token out of the mapping, which isn't terminated, so
+// strtod and strtol can read it
+static bool NextToken(const char*& p, const char* end, char* token, size_t tokenSize)
+{
+	while (p < end && IsSpace(*p))
+		++p;
+	const char* start = p;
+	while (p < end && !IsSpace(*p))
+		++p;
+	size_t length = (size_t)(p - start);
+	if (length == 0 || length >= tokenSize)
+		return false;
+	memcpy(token, start, length);
+	token[length] = 0;
+	return true;
+}
+
+static bool ReadInt(const char*& p, const char* end, int& value)
+{
+	char token[32];
+	char* last;
+	if (!NextToken(p, end, token, sizeof(token)))
+		return false;
+	value = (int)strtol(token, &last, 10);
+	return *last == 0;
+}
+
+static bool ReadFloat(const char*& p, const char* end, float& value)
+{
+	char token[64];
+	char* last;
+	if (!NextToken(p, end, token, sizeof(token)))
+		return false;
+	value = strtof(token, &last);
+	return *last == 0;
+}
+
+bool BptFile::Load(const char* fileName, std::vector<glm::vec3>& controlPoints)
+{
+	BptReader reader;
+	return reader.Open(fileName) && reader.Read(reader.numPatches(), controlPoints);
+}
+
+bool BptFile::Save(const char* fileName, const std::vector<glm::vec3>& controlPoints)
+{
+	std::ofstream file(fileName);
+	if (!file)
+		return false;
+
+	unsigned int numPatches = controlPoints.size() / 16;
+	file << numPatches << "\n" << std::setprecision(9);
+	for (unsigned int p = 0; p < numPatches; ++p)
+	{
+		file << "3 3\n";
+		for (int i = 0; i < 16; ++i)
+		{
+			const glm::vec3& point = controlPoints[p * 16 + i];
+			file << point.x << " " << point.y << " " << point.z << "\n";
+		}
+	}
+	return file.good();
+}
+
+BptReader::BptReader()
+{
+	_first = nullptr;
+	_cursor = nullptr;
+	_numPatches = 0;
+	_nextPatch = 0;
+}
+
+bool BptReader::Open(const char* fileName)
+{
+	Close();
+	if (!_file.Open(fileName))
+		return false;
+
+	const char* p = _file.data();
+	if (!ReadInt(p, _file.data() + _file.size(), _numPatches) || _numPatches < 0)
+	{
+		Close();
+		return false;
+	}
+	_first = p;
+	_cursor = p;
+	return true;
+}
+
+void BptReader::Close()
+{
+	_file.Close();
+	_first = nullptr;
+	_cursor = nullptr;
+	_numPatches = 0;
+	_nextPatch = 0;
+}
+
+bool BptReader::Read(int count, std::vector<glm::vec3>& controlPoints)
+{
+	controlPoints.clear();
+	if (!_file.isOpen())
+		return false;
+
+	count = std::min(count, _numPatches - _nextPatch);
+	controlPoints.reserve((size_t)count * 16);
+	const char* end = _file.data() + _file.size();
+	for (int p = 0; p < count; ++p)
+	{
+		int degreeU, degreeV;
+		if (!ReadInt(_cursor, end, degreeU) || !ReadInt(_cursor, end, degreeV) || degreeU != 3 || degreeV != 3)
+			return false;
+
+		for (int i = 0; i < 16; ++i)
+		{
+			glm::vec3 point;
+			if (!ReadFloat(_cursor, end, point.x) || !ReadFloat(_cursor, end, point.y) || !ReadFloat(_cursor, end, point.z))
+				return false;
+			controlPoints.push_back(point);
+		}
+		_nextPatch++;
+	}
+	return true;
+}
+
+void BptReader::Rewind()
+{
+	_cursor = _first;
+	_nextPatch = 0;
+}
+
+int BptReader::numPatches() const
+{
+	return _numPatches;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+// Reads and writes Bezier patch files in the .bpt text format the teapot data comes from
+// (http://www.holmes3d.net/graphics/teapot/). The file starts with the number of patches,
+// then each patch is its degree in u and v followed by its control points, one per line.
+// Only bicubic (3 3) patches are supported; control points are stored 16 per patch.
+class BptFile
+{
+public:
+	static bool Load(const char* fileName, std::vector<glm::vec3>& controlPoints);
+	static bool Save(const char* fileName, const std::vector<glm::vec3>& controlPoints);
+};
+
+// Reads a .bpt file a batch of patches at a time, for inputs too large to hold in memory at
+// once. The file is mapped and parsed in place, so pages already read can be dropped by the OS.
+class BptReader
+{
+public:
+	BptReader();
+
+	// Maps the file and reads the number of patches
+	bool Open(const char* fileName);
+	void Close();
+
+	// Replaces controlPoints with the next count patches, or what is left of the file. False
+	// if the file is malformed.
+	bool Read(int count, std::vector<glm::vec3>& controlPoints);
+
+	// Back to the first patch
+	void Rewind();
+
+	int numPatches() const;
+
+private:
+	MappedFile _file;
+	const char* _first;
+	const char* _cursor;
+	int _numPatches;
+	int _nextPatch;
+};
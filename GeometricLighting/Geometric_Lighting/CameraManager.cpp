@@ -1,15 +1,43 @@
 #include "CameraManager.h"
+#include "GLState.h"
 #include "InputManager.h"
 
 glm::mat4 CameraManager::_proj;
 glm::mat4 CameraManager::_view;
 glm::vec4 CameraManager::_camPos;
 glm::vec2 CameraManager::_position;
+glm::vec3 CameraManager::_target;
+float CameraManager::_distance = 5.0f;
+float CameraManager::_fov = 60.0f;
+float CameraManager::_aspectRatio = 1.0f;
+float CameraManager::_far = 100.0f;
+CameraLayout CameraManager::_layout = CameraLayout::Single;
+CameraView CameraManager::_views[CameraManager::MAX_VIEWS];
+int CameraManager::_numViews = 1;
 
 void CameraManager::Init(float aspectRatio, float fov, float near, float far)
 {
 	_proj = glm::perspectiveFov(fov, aspectRatio, 1.0f / aspectRatio, near, far);
 	_position = glm::vec2(0.0f, 0.0f);
+	_fov = fov;
+	_aspectRatio = aspectRatio;
+	_far = far;
+}
+
+// An orthographic view of the target from along direction, as wide as the orbiting camera sees
+// at the target and deep enough to take in everything it can see
+static CameraView OrthographicView(const glm::vec3& target, const glm::vec3& direction, const glm::vec3& up, float distance, float fov, float aspectRatio, float far, const glm::vec4& viewport)
+{
+	float halfHeight = distance * tan(glm::radians(fov * 0.5f));
+	float halfWidth = halfHeight * aspectRatio;
+	glm::vec3 eye = target + direction * distance;
+
+	CameraView view;
+	view.view = glm::lookAt(eye, target, up);
+	view.proj = glm::ortho(-halfWidth, halfWidth, -halfHeight, halfHeight, -far, far);
+	view.camPos = glm::vec4(eye, 1.0f);
+	view.viewport = viewport;
+	return view;
 }
 
 // If the user is holding down the left mouse button, the program locks the cursor and updates the 
@@ -33,9 +61,47 @@ void CameraManager::Update(float dt)
 	glm::mat4 bearingMat = glm::mat4_cast(glm::angleAxis(_position.x, glm::vec3(0.0f, 1.0f, 0.0f)));
 	glm::mat4 eleMat = glm::mat4_cast(glm::angleAxis(_position.y, glm::vec3(1.0f, 0.0f, 0.0f)));
 	glm::mat4 rotMat = eleMat * bearingMat;
-	_camPos = glm::vec4(0.0f, 0.0f, -5.0f, 1.0f) * rotMat;
+	_camPos = glm::vec4(0.0f, 0.0f, -_distance, 1.0f) * rotMat + glm::vec4(_target, 0.0f);
+
+	_view = glm::lookAt(glm::vec3(_camPos), _target, glm::vec3(0.0f, 1.0f, 0.0f));
 
-	_view = glm::lookAt(glm::vec3(_camPos), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	CameraView orbit;
+	orbit.view = _view;
+	orbit.proj = _proj;
+	orbit.camPos = _camPos;
+	if (_layout == CameraLayout::Single)
+	{
+		orbit.viewport = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+		_views[0] = orbit;
+		_numViews = 1;
+		return;
+	}
+
+	// Top left, top right, bottom left and bottom right, the way modelling packages lay them out.
+	// Every quarter has the window's aspect ratio, so the projections don't change.
+	_views[0] = OrthographicView(_target, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), _distance, _fov, _aspectRatio, _far, glm::vec4(0.0f, 0.5f, 0.5f, 0.5f));
+	_views[1] = OrthographicView(_target, glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f), _distance, _fov, _aspectRatio, _far, glm::vec4(0.5f, 0.5f, 0.5f, 0.5f));
+	_views[2] = OrthographicView(_target, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), _distance, _fov, _aspectRatio, _far, glm::vec4(0.0f, 0.0f, 0.5f, 0.5f));
+	orbit.viewport = glm::vec4(0.5f, 0.0f, 0.5f, 0.5f);
+	_views[3] = orbit;
+	_numViews = 4;
+}
+
+void CameraManager::LookAt(const glm::vec3& position, const glm::vec3& target)
+{
+	// Update puts the camera at distance * (cos e sin b, -sin e, -cos e cos b) from the target
+	// for bearing b and elevation e
+	glm::vec3 offset = position - target;
+	_target = target;
+	_distance = glm::length(offset);
+	if (_distance <= 0.0f)
+	{
+		_distance = 5.0f;
+		_position = glm::vec2(0.0f, 0.0f);
+		return;
+	}
+	_position.x = glm::degrees(atan2(offset.x, -offset.z));
+	_position.y = glm::degrees(asin(glm::clamp(-offset.y / _distance, -1.0f, 1.0f)));
 }
 
 glm::mat4 CameraManager::ProjMat()
@@ -51,4 +117,63 @@ glm::mat4 CameraManager::ViewMat()
 glm::vec4 CameraManager::CamPos()
 {
 	return _camPos;
-}
\ No newline at end of file
+}
+
+void CameraManager::SetLayout(CameraLayout layout)
+{
+	_layout = layout;
+}
+
+CameraLayout CameraManager::layout()
+{
+	return _layout;
+}
+
+int CameraManager::numViews()
+{
+	return _numViews;
+}
+
+const CameraView& CameraManager::View(int index)
+{
+	return _views[index];
+}
+
+glm::mat4 CameraManager::ViewProjMat(int index)
+{
+	return _views[index].proj * _views[index].view;
+}
+
+glm::mat4 CameraManager::DrawProjMat()
+{
+	return _numViews > 1 ? glm::mat4() : _proj;
+}
+
+glm::mat4 CameraManager::DrawViewMat()
+{
+	return _numViews > 1 ? glm::mat4() : _view;
+}
+
+void CameraManager::BindViews(GLuint program, int width, int height)
+{
+	glm::mat4 viewProjMats[MAX_VIEWS];
+	glm::mat4 projMats[MAX_VIEWS];
+	glm::vec3 camPositions[MAX_VIEWS];
+	for (int i = 0; i < _numViews; ++i)
+	{
+		viewProjMats[i] = ViewProjMat(i);
+		projMats[i] = _views[i].proj;
+		camPositions[i] = glm::vec3(_views[i].camPos);
+
+		const glm::vec4& viewport = _views[i].viewport;
+		glViewportIndexedf(i, viewport.x * width, viewport.y * height, viewport.z * width, viewport.w * height);
+	}
+
+	GLState::Uniform1i(glGetUniformLocation(program, "viewCount"), _numViews);
+	GLState::UniformMatrix4fv(glGetUniformLocation(program, "viewProjMats"), _numViews, GL_FALSE, glm::value_ptr(viewProjMats[0]));
+	GLState::UniformMatrix4fv(glGetUniformLocation(program, "projMats"), _numViews, GL_FALSE, glm::value_ptr(projMats[0]));
+
+	// The fragment shader's own copies, which LightManager::Bind only fills the first of
+	GLState::UniformMatrix4fv(glGetUniformLocation(program, "projMat"), _numViews, GL_FALSE, glm::value_ptr(projMats[0]));
+	GLState::Uniform3fv(glGetUniformLocation(program, "cameraPos"), _numViews, glm::value_ptr(camPositions[0]));
+}
@@ -1,20 +1,76 @@
 #pragma once
 
-#include <GLM\gtc\type_ptr.hpp>
-#include <GLM\gtc\matrix_transform.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLM/gtc/type_ptr.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+
+// How the window is split between views
+enum class CameraLayout
+{
+	// The orbiting camera over the whole window
+	Single,
+
+	// Top, front and side views, orthographic and centered on the camera's target, and the
+	// orbiting camera, each in a quarter of the window
+	Quad
+};
+
+struct CameraView
+{
+	glm::mat4 view;
+	glm::mat4 proj;
+	glm::vec4 camPos;
+
+	// Lower left corner and size, as fractions of the window
+	glm::vec4 viewport;
+};
 
 class CameraManager
 {
 public:
+	// As many views as gShader.glsl draws at once
+	static const int MAX_VIEWS = 4;
+
 	static void Init(float aspectRatio, float fov, float near, float far);
 	static void Update(float dt);
+
+	// Places the camera, which keeps orbiting its target at the same distance from then on
+	static void LookAt(const glm::vec3& position, const glm::vec3& target);
+
+	// The orbiting camera, whatever the layout
 	static glm::mat4 ViewMat();
 	static glm::mat4 ProjMat();
 	static glm::vec4 CamPos();
+
+	// The views are laid out again on the next Update
+	static void SetLayout(CameraLayout layout);
+	static CameraLayout layout();
+	static int numViews();
+	static const CameraView& View(int index);
+	static glm::mat4 ViewProjMat(int index);
+
+	// What shapes are drawn with: the orbiting camera's matrices with one view, identity with
+	// several, where the geometry shader takes world space into each view itself
+	static glm::mat4 DrawProjMat();
+	static glm::mat4 DrawViewMat();
+
+	// Hands every view to the geometry and fragment shaders of a program linked with
+	// gShader.glsl, and sets a viewport for each. Call after LightManager::Bind.
+	static void BindViews(GLuint program, int width, int height);
 private:
 	static glm::mat4 _proj;
 	static glm::mat4 _view;
 	static glm::vec4 _camPos;
 
 	static glm::vec2 _position;
-};
\ No newline at end of file
+	static glm::vec3 _target;
+	static float _distance;
+
+	static float _fov;
+	static float _aspectRatio;
+	static float _far;
+
+	static CameraLayout _layout;
+	static CameraView _views[MAX_VIEWS];
+	static int _numViews;
+};
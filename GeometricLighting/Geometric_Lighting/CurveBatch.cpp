@@ -0,0 +1,108 @@
+#include "CurveBatch.h"
+#include "GLState.h"
+#include "RenderManager.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+
+#include <iostream>
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+CurveBatch::CurveBatch(Shader shader, int numCurves, const CurveTessellationOptions& options, glm::vec4 color)
+{
+	_numCurves = numCurves;
+	_options = options;
+	_dirty = true;
+
+	_controlPoints.resize(numCurves * 4);
+	_radii.resize(numCurves * 2);
+	_verts.resize((size_t)numCurves * CurveTessellator::NumVerts(options) * PatchEvaluator::FLOATS_PER_VERT);
+
+	_pool = new WorkerPool();
+
+	std::vector<GLuint> elements((size_t)numCurves * CurveTessellator::NumElements(options));
+	CurveTessellator::GenerateElements(numCurves, options, elements.data());
+
+	glGenVertexArrays(1, &_vao);
+	GLState::BindVertexArray(_vao);
+
+	glGenBuffers(1, &_vbo);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * _verts.size(), NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &_ebo);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * elements.size(), elements.data(), GL_STATIC_DRAW);
+
+	// Bind buffer data to shader values
+	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
+	glEnableVertexAttribArray(posAttrib);
+	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+
+	GLint normAttrib = glGetAttribLocation(shader.shaderPointer, "normal");
+	glEnableVertexAttribArray(normAttrib);
+	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+	GLState::BindVertexArray(0);
+
+	_shape = new RenderShape(_vao, (GLsizei)elements.size(), GL_TRIANGLES, shader, color);
+	RenderManager::AddShape(_shape);
+}
+CurveBatch::~CurveBatch()
+{
+	delete _pool;
+	GLState::DeleteBuffers(1, &_vbo);
+	GLState::DeleteBuffers(1, &_ebo);
+	GLState::DeleteVertexArrays(1, &_vao);
+}
+
+void CurveBatch::SetCurve(int curve, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float rootRadius, float tipRadius)
+{
+	glm::vec3* cp = &_controlPoints[curve * 4];
+	cp[0] = p0;
+	cp[1] = p1;
+	cp[2] = p2;
+	cp[3] = p3;
+	_radii[curve * 2] = rootRadius;
+	_radii[curve * 2 + 1] = tipRadius;
+	_dirty = true;
+}
+
+void CurveBatch::Update(const glm::vec3& cameraPos)
+{
+	if (!_dirty && _options.style == CurveStyle::Tube)
+		return;
+	_dirty = false;
+
+	Clock::time_point start = Clock::now();
+
+	_options.cameraPos = cameraPos;
+	CurveTessellator::Tessellate(*_pool, _controlPoints.data(), _radii.data(), _numCurves, _options, _verts.data());
+
+	Clock::time_point tessellated = Clock::now();
+
+	// Orphan the old storage first so the driver doesn't wait for draws still reading it
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * _verts.size(), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * _verts.size(), _verts.data());
+
+	_stats.curvesTessellated += _numCurves;
+	_stats.updates++;
+	_stats.tessellateSeconds += std::chrono::duration<double>(tessellated - start).count();
+	_stats.uploadSeconds += std::chrono::duration<double>(Clock::now() - tessellated).count();
+}
+
+int CurveBatch::numCurves() { return _numCurves; }
+CurveBatchStats CurveBatch::Stats() { return _stats; }
+
+void CurveBatch::PrintStats()
+{
+	std::cout << "Curves: " << _numCurves << " " << (_options.style == CurveStyle::Tube ? "tubes" : "ribbons") << ", "
+		<< _stats.updates << " updates, " << _pool->numThreads() << " threads" << std::endl;
+	if (_stats.tessellateSeconds > 0.0)
+	{
+		std::cout << "  " << _stats.curvesTessellated / (_stats.tessellateSeconds * 1000.0) << " curves/ms tessellated, "
+			<< _stats.uploadSeconds * 1000.0 / _stats.updates << " ms per upload" << std::endl;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "RenderShape.h"
+#include "CurveTessellator.h"
+
+#include <GLEW/GL/glew.h>
+#include <vector>
+
+class WorkerPool;
+
+struct CurveBatchStats
+{
+	unsigned long long curvesTessellated = 0;
+	unsigned int updates = 0;
+	double tessellateSeconds = 0.0;
+	double uploadSeconds = 0.0;
+};
+
+// Many cubic Bezier curves (hair strands, cables, grass) drawn as one shape. All curves are
+// tessellated together by CurveTessellator on a worker pool into one vertex buffer, with one
+// shared element buffer, so the whole batch is a single draw call however many curves it has.
+// Ribbons are rebuilt every update to keep facing the camera, tubes only when a curve changes.
+class CurveBatch
+{
+public:
+	CurveBatch(Shader shader, int numCurves, const CurveTessellationOptions& options, glm::vec4 color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+	~CurveBatch();
+
+	// Positions are in world space, the radius is blended from root to tip
+	void SetCurve(int curve, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float rootRadius, float tipRadius);
+
+	void Update(const glm::vec3& cameraPos);
+
+	int numCurves();
+	CurveBatchStats Stats();
+	void PrintStats();
+
+private:
+	int _numCurves;
+	CurveTessellationOptions _options;
+	bool _dirty;
+
+	std::vector<glm::vec3> _controlPoints;
+	std::vector<float> _radii;
+	std::vector<float> _verts;
+
+	WorkerPool* _pool;
+	RenderShape* _shape;
+	GLuint _vao;
+	GLuint _vbo;
+	GLuint _ebo;
+
+	CurveBatchStats _stats;
+};
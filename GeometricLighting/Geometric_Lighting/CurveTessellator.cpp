@@ -0,0 +1,232 @@
+#include "CurveTessellator.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+// Weighted sum of four lane vectors
+static inline Lanes3 Blend4(const Lanes3* p, float f0, float f1, float f2, float f3)
+{
+	Lanes w0 = Splat(f0), w1 = Splat(f1), w2 = Splat(f2), w3 = Splat(f3);
+	Lanes3 r;
+	r.x = Add(Add(Mul(p[0].x, w0), Mul(p[1].x, w1)), Add(Mul(p[2].x, w2), Mul(p[3].x, w3)));
+	r.y = Add(Add(Mul(p[0].y, w0), Mul(p[1].y, w1)), Add(Mul(p[2].y, w2), Mul(p[3].y, w3)));
+	r.z = Add(Add(Mul(p[0].z, w0), Mul(p[1].z, w1)), Add(Mul(p[2].z, w2), Mul(p[3].z, w3)));
+	return r;
+}
+
+static inline Lanes3 Blend3(const Lanes3* p, float f0, float f1, float f2)
+{
+	Lanes w0 = Splat(f0), w1 = Splat(f1), w2 = Splat(f2);
+	Lanes3 r;
+	r.x = Add(Add(Mul(p[0].x, w0), Mul(p[1].x, w1)), Mul(p[2].x, w2));
+	r.y = Add(Add(Mul(p[0].y, w0), Mul(p[1].y, w1)), Mul(p[2].y, w2));
+	r.z = Add(Add(Mul(p[0].z, w0), Mul(p[1].z, w1)), Mul(p[2].z, w2));
+	return r;
+}
+
+// Writes one vertex for each curve of the batch that exists
+static inline void ScatterVertex(float* verts, int vertsPerCurve, int firstCurve, int numLanes, int vertIndex, const Lanes3& position, const Lanes3& normal)
+{
+	float px[4], py[4], pz[4], nx[4], ny[4], nz[4];
+	Store(px, position.x); Store(py, position.y); Store(pz, position.z);
+	Store(nx, normal.x); Store(ny, normal.y); Store(nz, normal.z);
+
+	for (int lane = 0; lane < numLanes; ++lane)
+	{
+		float* vert = verts + ((size_t)(firstCurve + lane) * vertsPerCurve + vertIndex) * PatchEvaluator::FLOATS_PER_VERT;
+		vert[0] = px[lane];
+		vert[1] = py[lane];
+		vert[2] = pz[lane];
+		vert[3] = nx[lane];
+		vert[4] = ny[lane];
+		vert[5] = nz[lane];
+	}
+}
+
+static void TessellateBatches(const glm::vec3* controlPoints, const float* radii, int numCurves, const CurveTessellationOptions& options, float* verts, int firstBatch, int endBatch)
+{
+	int segments = std::max(options.segments, 1);
+	int sides = std::max(options.sides, 3);
+	int vertsPerCurve = CurveTessellator::NumVerts(options);
+	bool tube = options.style == CurveStyle::Tube;
+
+	// Ring directions around a tube, the same for every ring of every curve
+	const int MAX_STACK_SIDES = 64;
+	float stackRing[MAX_STACK_SIDES * 2];
+	std::vector<float> heapRing;
+	float* ring = stackRing;
+	if (sides > MAX_STACK_SIDES)
+	{
+		heapRing.resize(sides * 2);
+		ring = &heapRing[0];
+	}
+	for (int s = 0; s < sides; ++s)
+	{
+		float angle = 6.28318531f * s / sides;
+		ring[s * 2] = std::cos(angle);
+		ring[s * 2 + 1] = std::sin(angle);
+	}
+
+	Lanes3 camera = { Splat(options.cameraPos.x), Splat(options.cameraPos.y), Splat(options.cameraPos.z) };
+
+	for (int batch = firstBatch; batch < endBatch; ++batch)
+	{
+		int firstCurve = batch * 4;
+		int numLanes = std::min(4, numCurves - firstCurve);
+
+		// Gather the batch into lanes. Missing curves at the end repeat the last one and are
+		// simply not written out.
+		float gather[4][3][4];
+		float rootRadius[4], tipRadius[4], startNormal[3][4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			int curve = firstCurve + std::min(lane, numLanes - 1);
+			const glm::vec3* cp = controlPoints + curve * 4;
+			for (int k = 0; k < 4; ++k)
+			{
+				gather[k][0][lane] = cp[k].x;
+				gather[k][1][lane] = cp[k].y;
+				gather[k][2][lane] = cp[k].z;
+			}
+			rootRadius[lane] = radii[curve * 2];
+			tipRadius[lane] = radii[curve * 2 + 1];
+
+			// The first ring of a tube needs some normal to start from. Any direction
+			// perpendicular to the curve will do, as long as it isn't found from a vector
+			// nearly parallel to it.
+			glm::vec3 tangent = cp[1] - cp[0];
+			if (glm::dot(tangent, tangent) < 1e-12f)
+				tangent = cp[3] - cp[0];
+			tangent = glm::dot(tangent, tangent) > 1e-24f ? glm::normalize(tangent) : glm::vec3(0.0f, 1.0f, 0.0f);
+			glm::vec3 reference = std::abs(tangent.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			glm::vec3 normal = glm::normalize(glm::cross(reference, tangent));
+			startNormal[0][lane] = normal.x;
+			startNormal[1][lane] = normal.y;
+			startNormal[2][lane] = normal.z;
+		}
+
+		Lanes3 cp[4];
+		for (int k = 0; k < 4; ++k)
+		{
+			cp[k].x = Load(gather[k][0]);
+			cp[k].y = Load(gather[k][1]);
+			cp[k].z = Load(gather[k][2]);
+		}
+		Lanes3 slope[3] = { Sub3(cp[1], cp[0]), Sub3(cp[2], cp[1]), Sub3(cp[3], cp[2]) };
+		Lanes root = Load(rootRadius);
+		Lanes radiusChange = Sub(Load(tipRadius), root);
+
+		Lanes3 normal = { Load(startNormal[0]), Load(startNormal[1]), Load(startNormal[2]) };
+		Lanes3 binormal = normal;
+
+		for (int i = 0; i <= segments; ++i)
+		{
+			float t = (float)i / segments;
+			float t_sqr = t * t;
+			float t_inv = 1.0f - t;
+			float t_inv_sqr = t_inv * t_inv;
+
+			// The same cubic Bernstein factors as a patch row, and the quadratic ones on the
+			// differences between control points for the slope
+			Lanes3 position = Blend4(cp, t_inv * t_inv_sqr, 3.0f * t * t_inv_sqr, 3.0f * t_sqr * t_inv, t * t_sqr);
+			Lanes3 tangent = Normalize3(Blend3(slope, t_inv_sqr, 2.0f * t * t_inv, t_sqr));
+			Lanes radius = Add(root, Mul(radiusChange, Splat(t)));
+
+			if (tube)
+			{
+				// Carry the frame along: the new normal is the old binormal crossed with the new
+				// tangent, which is the old normal with any twist around the tangent removed
+				if (i > 0)
+					normal = Normalize3(Cross3(binormal, tangent));
+				binormal = Cross3(tangent, normal);
+
+				for (int s = 0; s < sides; ++s)
+				{
+					Lanes3 offset = Add3(Scale3(normal, Splat(ring[s * 2])), Scale3(binormal, Splat(ring[s * 2 + 1])));
+					ScatterVertex(verts, vertsPerCurve, firstCurve, numLanes, i * sides + s, Add3(position, Scale3(offset, radius)), offset);
+				}
+			}
+			else
+			{
+				// Spread the ribbon sideways, across both the curve and the view direction
+				Lanes3 view = Sub3(camera, position);
+				Lanes3 side = Normalize3(Cross3(tangent, view));
+				Lanes3 facing = Cross3(side, tangent);
+				Lanes3 offset = Scale3(side, radius);
+
+				ScatterVertex(verts, vertsPerCurve, firstCurve, numLanes, i * 2, Sub3(position, offset), facing);
+				ScatterVertex(verts, vertsPerCurve, firstCurve, numLanes, i * 2 + 1, Add3(position, offset), facing);
+			}
+		}
+	}
+}
+
+int CurveTessellator::NumVerts(const CurveTessellationOptions& options)
+{
+	int across = options.style == CurveStyle::Tube ? std::max(options.sides, 3) : 2;
+	return (std::max(options.segments, 1) + 1) * across;
+}
+
+int CurveTessellator::NumElements(const CurveTessellationOptions& options)
+{
+	int quadsAcross = options.style == CurveStyle::Tube ? std::max(options.sides, 3) : 1;
+	return std::max(options.segments, 1) * quadsAcross * 6;
+}
+
+void CurveTessellator::Tessellate(const glm::vec3* controlPoints, const float* radii, int numCurves, const CurveTessellationOptions& options, float* verts)
+{
+	TessellateBatches(controlPoints, radii, numCurves, options, verts, 0, (numCurves + 3) / 4);
+}
+
+void CurveTessellator::Tessellate(WorkerPool& pool, const glm::vec3* controlPoints, const float* radii, int numCurves, const CurveTessellationOptions& options, float* verts)
+{
+	pool.ParallelFor((numCurves + 3) / 4, [&](int begin, int end, int)
+	{
+		TessellateBatches(controlPoints, radii, numCurves, options, verts, begin, end);
+	});
+}
+
+void CurveTessellator::GenerateElements(int numCurves, const CurveTessellationOptions& options, unsigned int* elements)
+{
+	int segments = std::max(options.segments, 1);
+	int vertsPerCurve = NumVerts(options);
+	bool tube = options.style == CurveStyle::Tube;
+	int sides = std::max(options.sides, 3);
+
+	for (int curve = 0; curve < numCurves; ++curve)
+	{
+		unsigned int base = curve * vertsPerCurve;
+		for (int i = 0; i < segments; ++i)
+		{
+			if (tube)
+			{
+				// Quads between this ring and the next, wrapping around to close the tube
+				for (int s = 0; s < sides; ++s)
+				{
+					unsigned int a = base + i * sides + s;
+					unsigned int b = base + i * sides + (s + 1) % sides;
+					*elements++ = a;
+					*elements++ = b;
+					*elements++ = a + sides;
+					*elements++ = b;
+					*elements++ = b + sides;
+					*elements++ = a + sides;
+				}
+			}
+			else
+			{
+				unsigned int a = base + i * 2;
+				*elements++ = a;
+				*elements++ = a + 1;
+				*elements++ = a + 2;
+				*elements++ = a + 1;
+				*elements++ = a + 3;
+				*elements++ = a + 2;
+			}
+		}
+	}
+}
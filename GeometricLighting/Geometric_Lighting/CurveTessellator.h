@@ -0,0 +1,46 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+class WorkerPool;
+
+enum class CurveStyle
+{
+	Ribbon,		// a flat strip turned to face the camera, two vertices across
+	Tube		// a closed tube, sides vertices around
+};
+
+struct CurveTessellationOptions
+{
+	CurveStyle style = CurveStyle::Ribbon;
+
+	// Spans along each curve, and vertices around each ring of a tube
+	int segments = 8;
+	int sides = 6;
+
+	// Ribbons are turned towards this point, given in the same space as the control points
+	glm::vec3 cameraPos = glm::vec3();
+};
+
+// Turns cubic Bezier curves (4 control points each) into ribbons or tubes, using the same
+// Bernstein evaluation as Patch in one dimension. Curves are processed four at a time, one per
+// SIMD lane, so the basis weights are computed once per ring and every add and multiply works
+// on four curves. Vertices use the position/normal layout of PatchEvaluator.
+//
+// Tube rings follow a frame carried along the curve by projecting the previous ring's frame,
+// which keeps the tube from twisting where a fixed up vector would flip.
+class CurveTessellator
+{
+public:
+	static int NumVerts(const CurveTessellationOptions& options);
+	static int NumElements(const CurveTessellationOptions& options);
+
+	// radii holds a root and a tip radius for every curve, the radius is blended between them.
+	// Writes NumVerts(options) vertices per curve.
+	static void Tessellate(const glm::vec3* controlPoints, const float* radii, int numCurves, const CurveTessellationOptions& options, float* verts);
+
+	// Same, spread over the pool's threads a few batches at a time
+	static void Tessellate(WorkerPool& pool, const glm::vec3* controlPoints, const float* radii, int numCurves, const CurveTessellationOptions& options, float* verts);
+
+	// Triangle lists for numCurves curves laid out one after the other
+	static void GenerateElements(int numCurves, const CurveTessellationOptions& options, unsigned int* elements);
+};
@@ -0,0 +1,651 @@
+#include "DynamicBVH.h"
+#include "SimdLanes.h"
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+
+static float SurfaceArea(const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+	glm::vec3 size = maxPos - minPos;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static float UnionArea(const BVHNode& a, const BVHNode& b)
+{
+	return SurfaceArea(glm::min(a.minPos, b.minPos), glm::max(a.maxPos, b.maxPos));
+}
+
+static bool Overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+{
+	return minA.x <= maxB.x && minA.y <= maxB.y && minA.z <= maxB.z && minB.x <= maxA.x && minB.y <= maxA.y && minB.z <= maxA.z;
+}
+
+static bool Contains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& innerMin, const glm::vec3& innerMax)
+{
+	return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z
+		&& innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+}
+
+// Distance along the ray to where it enters the box, or -1 if it misses within maxDistance
+static float RayEnter(const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+	glm::vec3 t0 = (minPos - origin) * invDirection;
+	glm::vec3 t1 = (maxPos - origin) * invDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit ? enter : -1.0f;
+}
+
+// The planes of four frusta, one per lane, for testing a box against all of them at once
+struct FrustumLanes
+{
+	Lanes x[6], y[6], z[6], w[6];
+};
+
+static void LoadFrustumLanes(const Frustum* frusta, int count, FrustumLanes& lanes)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		// Lanes without a frustum get zero planes, which nothing is outside of
+		float x[4] = {}, y[4] = {}, z[4] = {}, w[4] = {};
+		for (int f = 0; f < count; ++f)
+		{
+			x[f] = frusta[f].planes[i].x;
+			y[f] = frusta[f].planes[i].y;
+			z[f] = frusta[f].planes[i].z;
+			w[f] = frusta[f].planes[i].w;
+		}
+		lanes.x[i] = Load(x);
+		lanes.y[i] = Load(y);
+		lanes.z[i] = Load(z);
+		lanes.w[i] = Load(w);
+	}
+}
+
+// The same tests as Frustum::IntersectsBox and ContainsBox, giving a bit for each lane whose
+// frustum the box is entirely outside of, and one for each it is entirely inside. The corner
+// furthest along a plane's normal is the one with the larger product on every axis.
+static void TestBoxLanes(const FrustumLanes& lanes, const glm::vec3& boxMin, const glm::vec3& boxMax, unsigned int& outside, unsigned int& inside)
+{
+	Lanes minX = Splat(boxMin.x), minY = Splat(boxMin.y), minZ = Splat(boxMin.z);
+	Lanes maxX = Splat(boxMax.x), maxY = Splat(boxMax.y), maxZ = Splat(boxMax.z);
+	int far = 0, near = 0;
+	for (int i = 0; i < 6; ++i)
+	{
+		Lanes loX = Mul(lanes.x[i], minX), hiX = Mul(lanes.x[i], maxX);
+		Lanes loY = Mul(lanes.y[i], minY), hiY = Mul(lanes.y[i], maxY);
+		Lanes loZ = Mul(lanes.z[i], minZ), hiZ = Mul(lanes.z[i], maxZ);
+		far |= NegativeLanes(Add(Add(Add(Max(loX, hiX), Max(loY, hiY)), Max(loZ, hiZ)), lanes.w[i]));
+		near |= NegativeLanes(Add(Add(Add(Min(loX, hiX), Min(loY, hiY)), Min(loZ, hiZ)), lanes.w[i]));
+	}
+	outside = (unsigned int)far;
+	inside = (unsigned int)~near & 0xfu;
+}
+
+DynamicBVH::DynamicBVH(float margin, bool rotate)
+{
+	_root = -1;
+	_freeList = -1;
+	_numProxies = 0;
+	_margin = margin;
+	_rotate = rotate;
+	_refits = 0;
+	_reinsertions = 0;
+	_rotations = 0;
+}
+
+int DynamicBVH::AllocateNode()
+{
+	if (_freeList < 0)
+	{
+		BVHNode node = {};
+		node.height = -1;
+		node.child1 = -1;
+		node.parent = -1;
+		_nodes.push_back(node);
+		_freeList = (int)_nodes.size() - 1;
+	}
+
+	// Free nodes are chained through their parent index
+	int index = _freeList;
+	_freeList = _nodes[index].parent;
+
+	BVHNode& node = _nodes[index];
+	node.parent = -1;
+	node.child1 = -1;
+	node.child2 = -1;
+	node.height = 0;
+	node.userData = nullptr;
+	return index;
+}
+
+void DynamicBVH::FreeNode(int index)
+{
+	_nodes[index].height = -1;
+	_nodes[index].parent = _freeList;
+	_freeList = index;
+}
+
+int DynamicBVH::Insert(const glm::vec3& minPos, const glm::vec3& maxPos, void* userData)
+{
+	int proxy = AllocateNode();
+	BVHNode& leaf = _nodes[proxy];
+	leaf.minPos = minPos - glm::vec3(_margin);
+	leaf.maxPos = maxPos + glm::vec3(_margin);
+	leaf.userData = userData;
+
+	InsertLeaf(proxy);
+	_numProxies++;
+	return proxy;
+}
+
+void DynamicBVH::Remove(int proxy)
+{
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	_numProxies--;
+}
+
+bool DynamicBVH::Move(int proxy, const glm::vec3& minPos, const glm::vec3& maxPos, const glm::vec3& displacement)
+{
+	if (Contains(_nodes[proxy].minPos, _nodes[proxy].maxPos, minPos, maxPos))
+		return false;
+
+	// Stretch the box ahead of a moving object so it stays inside for the next few moves
+	glm::vec3 ahead = displacement * (float)DISPLACEMENT_FRAMES;
+	glm::vec3 fatMin = minPos - glm::vec3(_margin) + glm::min(ahead, glm::vec3(0.0f));
+	glm::vec3 fatMax = maxPos + glm::vec3(_margin) + glm::max(ahead, glm::vec3(0.0f));
+
+	// Still inside its parent, the leaf is where it belongs and only the boxes above it change.
+	// Once it leaves the parent, it's cheaper in the long run to find it a better place.
+	int parent = _nodes[proxy].parent;
+	if (parent >= 0 && Contains(_nodes[parent].minPos, _nodes[parent].maxPos, fatMin, fatMax))
+	{
+		_nodes[proxy].minPos = fatMin;
+		_nodes[proxy].maxPos = fatMax;
+		RefitFrom(parent);
+		_refits++;
+	}
+	else
+	{
+		RemoveLeaf(proxy);
+		_nodes[proxy].minPos = fatMin;
+		_nodes[proxy].maxPos = fatMax;
+		InsertLeaf(proxy);
+		_reinsertions++;
+	}
+	return true;
+}
+
+void DynamicBVH::InsertLeaf(int leaf)
+{
+	if (_root < 0)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = -1;
+		return;
+	}
+
+	int sibling = FindBestSibling(_nodes[leaf].minPos, _nodes[leaf].maxPos);
+
+	// A new internal node takes the sibling's place and gets the sibling and the leaf as children
+	int oldParent = _nodes[sibling].parent;
+	int newParent = AllocateNode();
+	BVHNode& node = _nodes[newParent];
+	node.parent = oldParent;
+	node.child1 = sibling;
+	node.child2 = leaf;
+	node.height = _nodes[sibling].height + 1;
+
+	if (oldParent < 0)
+		_root = newParent;
+	else if (_nodes[oldParent].child1 == sibling)
+		_nodes[oldParent].child1 = newParent;
+	else
+		_nodes[oldParent].child2 = newParent;
+
+	_nodes[sibling].parent = newParent;
+	_nodes[leaf].parent = newParent;
+
+	RefitFrom(newParent);
+}
+
+void DynamicBVH::RemoveLeaf(int leaf)
+{
+	if (leaf == _root)
+	{
+		_root = -1;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int parent = _nodes[leaf].parent;
+	int grandParent = _nodes[parent].parent;
+	int sibling = _nodes[parent].child1 == leaf ? _nodes[parent].child2 : _nodes[parent].child1;
+	FreeNode(parent);
+
+	_nodes[sibling].parent = grandParent;
+	if (grandParent < 0)
+	{
+		_root = sibling;
+		return;
+	}
+
+	if (_nodes[grandParent].child1 == parent)
+		_nodes[grandParent].child1 = sibling;
+	else
+		_nodes[grandParent].child2 = sibling;
+	RefitFrom(grandParent);
+}
+
+// Branch and bound over the tree. Putting the leaf next to a node costs the area of their union
+// plus what every ancestor of the node grows by; the growth so far only adds up going down, so
+// a subtree can be skipped once even its smallest possible cost is no better than the best.
+int DynamicBVH::FindBestSibling(const glm::vec3& minPos, const glm::vec3& maxPos) const
+{
+	float leafArea = SurfaceArea(minPos, maxPos);
+
+	int best = _root;
+	float bestCost = SurfaceArea(glm::min(_nodes[_root].minPos, minPos), glm::max(_nodes[_root].maxPos, maxPos));
+
+	// Min heap on the growth inherited from the ancestors
+	std::greater<std::pair<float, int> > compare;
+	_candidates.clear();
+	_candidates.push_back(std::make_pair(0.0f, _root));
+
+	while (!_candidates.empty())
+	{
+		std::pop_heap(_candidates.begin(), _candidates.end(), compare);
+		float inherited = _candidates.back().first;
+		int index = _candidates.back().second;
+		_candidates.pop_back();
+
+		if (inherited + leafArea >= bestCost)
+			break;
+
+		const BVHNode& node = _nodes[index];
+		float direct = SurfaceArea(glm::min(node.minPos, minPos), glm::max(node.maxPos, maxPos));
+		float cost = direct + inherited;
+		if (cost < bestCost)
+		{
+			best = index;
+			bestCost = cost;
+		}
+
+		float childInherited = inherited + direct - SurfaceArea(node.minPos, node.maxPos);
+		if (!node.IsLeaf() && childInherited + leafArea < bestCost)
+		{
+			_candidates.push_back(std::make_pair(childInherited, node.child1));
+			std::push_heap(_candidates.begin(), _candidates.end(), compare);
+			_candidates.push_back(std::make_pair(childInherited, node.child2));
+			std::push_heap(_candidates.begin(), _candidates.end(), compare);
+		}
+	}
+	return best;
+}
+
+void DynamicBVH::RefitFrom(int index)
+{
+	while (index >= 0)
+	{
+		BVHNode& node = _nodes[index];
+		const BVHNode& child1 = _nodes[node.child1];
+		const BVHNode& child2 = _nodes[node.child2];
+		node.minPos = glm::min(child1.minPos, child2.minPos);
+		node.maxPos = glm::max(child1.maxPos, child2.maxPos);
+		node.height = 1 + std::max(child1.height, child2.height);
+
+		if (_rotate)
+			Rotate(index);
+		index = node.parent;
+	}
+}
+
+// Node A has children B and C. Swapping B with one of C's children (or C with one of B's)
+// leaves A's box alone and changes only the box of the child that gains the swapped node.
+// Of the four possible swaps, the one that shrinks that box the most is made.
+void DynamicBVH::Rotate(int index)
+{
+	BVHNode& a = _nodes[index];
+	if (a.height < 2)
+		return;
+
+	int b = a.child1;
+	int c = a.child2;
+
+	enum { NONE, B_F, B_G, C_D, C_E } rotation = NONE;
+	float bestDiff = 0.0f;
+
+	if (!_nodes[c].IsLeaf())
+	{
+		// Swapping B and F makes C the union of B and G
+		float area = SurfaceArea(_nodes[c].minPos, _nodes[c].maxPos);
+		float diff = UnionArea(_nodes[b], _nodes[_nodes[c].child2]) - area;
+		if (diff < bestDiff)
+		{
+			rotation = B_F;
+			bestDiff = diff;
+		}
+		diff = UnionArea(_nodes[b], _nodes[_nodes[c].child1]) - area;
+		if (diff < bestDiff)
+		{
+			rotation = B_G;
+			bestDiff = diff;
+		}
+	}
+	if (!_nodes[b].IsLeaf())
+	{
+		float area = SurfaceArea(_nodes[b].minPos, _nodes[b].maxPos);
+		float diff = UnionArea(_nodes[c], _nodes[_nodes[b].child2]) - area;
+		if (diff < bestDiff)
+		{
+			rotation = C_D;
+			bestDiff = diff;
+		}
+		diff = UnionArea(_nodes[c], _nodes[_nodes[b].child1]) - area;
+		if (diff < bestDiff)
+		{
+			rotation = C_E;
+			bestDiff = diff;
+		}
+	}
+	if (rotation == NONE)
+		return;
+
+	// Work out which child of A moves down into which grandchild's place
+	int moved = (rotation == B_F || rotation == B_G) ? b : c;
+	int other = moved == b ? c : b;
+	int& slot = (rotation == B_F || rotation == C_D) ? _nodes[other].child1 : _nodes[other].child2;
+	int grandChild = slot;
+
+	slot = moved;
+	_nodes[moved].parent = other;
+	if (moved == b)
+		a.child1 = grandChild;
+	else
+		a.child2 = grandChild;
+	_nodes[grandChild].parent = index;
+
+	BVHNode& otherNode = _nodes[other];
+	const BVHNode& child1 = _nodes[otherNode.child1];
+	const BVHNode& child2 = _nodes[otherNode.child2];
+	otherNode.minPos = glm::min(child1.minPos, child2.minPos);
+	otherNode.maxPos = glm::max(child1.maxPos, child2.maxPos);
+	otherNode.height = 1 + std::max(child1.height, child2.height);
+	a.height = 1 + std::max(_nodes[a.child1].height, _nodes[a.child2].height);
+	_rotations++;
+}
+
+void* DynamicBVH::userData(int proxy) const
+{
+	return _nodes[proxy].userData;
+}
+
+const BVHNode& DynamicBVH::node(int proxy) const
+{
+	return _nodes[proxy];
+}
+
+void DynamicBVH::QueryBox(const glm::vec3& minPos, const glm::vec3& maxPos, std::vector<int>& proxies) const
+{
+	if (_root < 0)
+		return;
+
+	std::vector<int> stack;
+	stack.push_back(_root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = _nodes[index];
+		if (!Overlaps(node.minPos, node.maxPos, minPos, maxPos))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			proxies.push_back(index);
+			continue;
+		}
+		stack.push_back(node.child1);
+		stack.push_back(node.child2);
+	}
+}
+
+void DynamicBVH::QueryFrustum(const Frustum& frustum, std::vector<int>& proxies) const
+{
+	if (_root < 0)
+		return;
+
+	std::vector<int> stack;
+	stack.push_back(_root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = _nodes[index];
+		if (!frustum.IntersectsBox(node.minPos, node.maxPos))
+			continue;
+
+		// Everything under a node that is entirely inside is visible without further tests
+		if (node.IsLeaf() || frustum.ContainsBox(node.minPos, node.maxPos))
+		{
+			CollectLeaves(index, proxies);
+			continue;
+		}
+		stack.push_back(node.child1);
+		stack.push_back(node.child2);
+	}
+}
+
+void DynamicBVH::QueryFrusta(const Frustum* frusta, int numFrusta, std::vector<int>& proxies, std::vector<unsigned int>& masks) const
+{
+	numFrusta = std::min(numFrusta, 32);
+	if (_root < 0 || numFrusta <= 0)
+		return;
+
+	// Four frusta to a group, so each box is tested against four at once
+	FrustumLanes groups[8];
+	int numGroups = (numFrusta + 3) / 4;
+	for (int g = 0; g < numGroups; ++g)
+	{
+		LoadFrustumLanes(frusta + g * 4, std::min(numFrusta - g * 4, 4), groups[g]);
+	}
+
+	// Each entry is a node, the frusta still to test it against and those known to contain it
+	struct Entry
+	{
+		int index;
+		unsigned int testing;
+		unsigned int containing;
+	};
+	std::vector<Entry> stack;
+	Entry root = { _root, numFrusta == 32 ? ~0u : (1u << numFrusta) - 1u, 0u };
+	stack.push_back(root);
+	while (!stack.empty())
+	{
+		Entry entry = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = _nodes[entry.index];
+		for (int g = 0; g < numGroups; ++g)
+		{
+			unsigned int testing = (entry.testing >> (g * 4)) & 0xfu;
+			if (!testing)
+				continue;
+
+			unsigned int outside, inside;
+			TestBoxLanes(groups[g], node.minPos, node.maxPos, outside, inside);
+			entry.testing &= ~((outside | inside) << (g * 4));
+			entry.containing |= (inside & ~outside & testing) << (g * 4);
+		}
+
+		unsigned int visible = entry.testing | entry.containing;
+		if (!visible)
+			continue;
+
+		if (node.IsLeaf() || !entry.testing)
+		{
+			CollectLeaves(entry.index, proxies);
+			masks.resize(proxies.size(), visible);
+			continue;
+		}
+		Entry child = { node.child1, entry.testing, entry.containing };
+		stack.push_back(child);
+		child.index = node.child2;
+		stack.push_back(child);
+	}
+}
+
+void DynamicBVH::CollectLeaves(int index, std::vector<int>& proxies) const
+{
+	if (_nodes[index].IsLeaf())
+	{
+		proxies.push_back(index);
+		return;
+	}
+	CollectLeaves(_nodes[index].child1, proxies);
+	CollectLeaves(_nodes[index].child2, proxies);
+}
+
+int DynamicBVH::RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const
+{
+	int hit = -1;
+	distance = maxDistance;
+	if (_root < 0)
+		return hit;
+
+	glm::vec3 invDirection = 1.0f / direction;
+	float rootEnter = RayEnter(origin, invDirection, distance, _nodes[_root].minPos, _nodes[_root].maxPos);
+	if (rootEnter < 0.0f)
+		return hit;
+
+	std::vector<std::pair<float, int> > stack;
+	stack.push_back(std::make_pair(rootEnter, _root));
+	while (!stack.empty())
+	{
+		float enter = stack.back().first;
+		int index = stack.back().second;
+		stack.pop_back();
+		if (enter > distance)
+			continue;
+
+		const BVHNode& node = _nodes[index];
+		if (node.IsLeaf())
+		{
+			hit = index;
+			distance = enter;
+			continue;
+		}
+
+		// Push the nearer child last so it is visited first
+		float enter1 = RayEnter(origin, invDirection, distance, _nodes[node.child1].minPos, _nodes[node.child1].maxPos);
+		float enter2 = RayEnter(origin, invDirection, distance, _nodes[node.child2].minPos, _nodes[node.child2].maxPos);
+		int first = node.child1, second = node.child2;
+		if (enter2 >= 0.0f && (enter1 < 0.0f || enter2 < enter1))
+		{
+			std::swap(first, second);
+			std::swap(enter1, enter2);
+		}
+		if (enter2 >= 0.0f)
+			stack.push_back(std::make_pair(enter2, second));
+		if (enter1 >= 0.0f)
+			stack.push_back(std::make_pair(enter1, first));
+	}
+	return hit;
+}
+
+void DynamicBVH::QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<int>& proxies) const
+{
+	if (_root < 0)
+		return;
+
+	glm::vec3 invDirection = 1.0f / direction;
+	std::vector<int> stack;
+	stack.push_back(_root);
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+
+		const BVHNode& node = _nodes[index];
+		if (RayEnter(origin, invDirection, maxDistance, node.minPos, node.maxPos) < 0.0f)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			proxies.push_back(index);
+			continue;
+		}
+		stack.push_back(node.child1);
+		stack.push_back(node.child2);
+	}
+}
+
+void DynamicBVH::QueryPairs(std::vector<std::pair<int, int> >& pairs) const
+{
+	// Every leaf looks for the leaves overlapping it and keeps those with a higher index
+	std::vector<int> stack;
+	int size = (int)_nodes.size();
+	for (int leaf = 0; leaf < size; ++leaf)
+	{
+		const BVHNode& leafNode = _nodes[leaf];
+		if (leafNode.height != 0)
+			continue;
+
+		stack.push_back(_root);
+		while (!stack.empty())
+		{
+			int index = stack.back();
+			stack.pop_back();
+
+			const BVHNode& node = _nodes[index];
+			if (!Overlaps(node.minPos, node.maxPos, leafNode.minPos, leafNode.maxPos))
+				continue;
+
+			if (node.IsLeaf())
+			{
+				if (index > leaf)
+					pairs.push_back(std::make_pair(leaf, index));
+				continue;
+			}
+			stack.push_back(node.child1);
+			stack.push_back(node.child2);
+		}
+	}
+}
+
+DynamicBVHStats DynamicBVH::Stats() const
+{
+	DynamicBVHStats stats;
+	stats.proxies = _numProxies;
+	stats.refits = _refits;
+	stats.reinsertions = _reinsertions;
+	stats.rotations = _rotations;
+	if (_root < 0)
+		return stats;
+
+	float internalArea = 0.0f;
+	unsigned int size = _nodes.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		if (_nodes[i].height < 0)
+			continue;
+		stats.nodes++;
+		if (!_nodes[i].IsLeaf())
+			internalArea += SurfaceArea(_nodes[i].minPos, _nodes[i].maxPos);
+	}
+	stats.height = _nodes[_root].height;
+	stats.sahCost = internalArea / std::max(SurfaceArea(_nodes[_root].minPos, _nodes[_root].maxPos), 1e-12f);
+	return stats;
+}
+
+void DynamicBVH::PrintStats(const DynamicBVHStats& stats)
+{
+	std::cout << "BVH: " << stats.proxies << " objects, " << stats.nodes << " nodes, height " << stats.height << ", SAH cost " << stats.sahCost << std::endl;
+	std::cout << "  " << stats.refits << " refits, " << stats.reinsertions << " reinsertions, " << stats.rotations << " rotations" << std::endl;
+}
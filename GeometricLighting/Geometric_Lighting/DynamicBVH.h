@@ -0,0 +1,120 @@
+#pragma once
+#include "Frustum.h"
+
+#include <GLM/glm.hpp>
+#include <vector>
+
+struct DynamicBVHStats
+{
+	int proxies = 0;
+	int nodes = 0;
+	int height = 0;
+
+	// Total surface area of the internal nodes relative to the root, what a query into the
+	// tree expects to pay. Lower is better.
+	float sahCost = 0.0f;
+
+	unsigned long long refits = 0;
+	unsigned long long reinsertions = 0;
+	unsigned long long rotations = 0;
+};
+
+struct BVHNode
+{
+	// Leaves hold the fattened box of their object, internal nodes the union of their children
+	glm::vec3 minPos;
+	glm::vec3 maxPos;
+
+	int parent;
+	int child1;
+	int child2;
+
+	// 0 for leaves, -1 for nodes on the free list
+	int height;
+
+	void* userData;
+
+	bool IsLeaf() const { return child1 < 0; }
+};
+
+// A bounding volume hierarchy that is changed a little at a time instead of rebuilt, for scenes
+// where objects come, go and move every frame. Every object is a leaf identified by a proxy id.
+//
+// Leaves are placed with the surface area heuristic: a branch and bound search finds the
+// sibling that adds the least surface area to the tree. Leaf boxes are fattened by a margin and
+// stretched ahead of moving objects so most movements don't touch the tree at all. An object
+// that leaves its box but stays inside its parent's only refits the path to the root; one that
+// leaves the parent too is taken out and inserted again. Every node on a path
+// that changed is offered a tree rotation (swapping a child with a grandchild) when that
+// shrinks it, which keeps the tree good without ever rebuilding it.
+class DynamicBVH
+{
+public:
+	DynamicBVH(float margin = 0.1f, bool rotate = true);
+
+	int Insert(const glm::vec3& minPos, const glm::vec3& maxPos, void* userData);
+	void Remove(int proxy);
+
+	// Call when an object's box changes, with how far it moved since the last call if known.
+	// Returns true if the tree had to change.
+	bool Move(int proxy, const glm::vec3& minPos, const glm::vec3& maxPos, const glm::vec3& displacement = glm::vec3());
+
+	void* userData(int proxy) const;
+	const BVHNode& node(int proxy) const;
+
+	// Queries append the proxies they find
+	void QueryBox(const glm::vec3& minPos, const glm::vec3& maxPos, std::vector<int>& proxies) const;
+	void QueryFrustum(const Frustum& frustum, std::vector<int>& proxies) const;
+
+	// Every proxy in any of numFrusta frusta (up to 32), each with a mask of the frusta it is in.
+	// The tree is walked once for all of them: a node is visited while any frustum still touches
+	// it, and below it only the frusta that touch it but don't contain it are tested again.
+	void QueryFrusta(const Frustum* frusta, int numFrusta, std::vector<int>& proxies, std::vector<unsigned int>& masks) const;
+
+	// The proxy whose box the ray enters first within maxDistance, or -1. Boxes are visited
+	// nearest first and everything further than the best hit so far is skipped.
+	int RayCast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float& distance) const;
+
+	// Every proxy whose box the ray passes through within maxDistance, for callers that test what
+	// is inside the boxes themselves and so can't stop at the first box
+	void QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<int>& proxies) const;
+
+	// Every pair of proxies whose boxes overlap, each pair once with the lower proxy first
+	void QueryPairs(std::vector<std::pair<int, int> >& pairs) const;
+
+	DynamicBVHStats Stats() const;
+	static void PrintStats(const DynamicBVHStats& stats);
+
+	// How many moves ahead a moving object's leaf box reaches
+	static const int DISPLACEMENT_FRAMES = 4;
+
+private:
+	int AllocateNode();
+	void FreeNode(int index);
+
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int FindBestSibling(const glm::vec3& minPos, const glm::vec3& maxPos) const;
+
+	// Recomputes the boxes and heights from index up to the root, rotating along the way
+	void RefitFrom(int index);
+	void Rotate(int index);
+
+	void CollectLeaves(int index, std::vector<int>& proxies) const;
+
+private:
+	std::vector<BVHNode> _nodes;
+	int _root;
+	int _freeList;
+	int _numProxies;
+
+	float _margin;
+	bool _rotate;
+
+	unsigned long long _refits;
+	unsigned long long _reinsertions;
+	unsigned long long _rotations;
+
+	// Scratch for FindBestSibling
+	mutable std::vector<std::pair<float, int> > _candidates;
+};
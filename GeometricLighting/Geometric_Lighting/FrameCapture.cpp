@@ -0,0 +1,309 @@
+#include "FrameCapture.h"
+#include "GLState.h"
+
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+FrameCapture::PboSlot FrameCapture::_slots[FrameCapture::NUM_PBOS];
+int FrameCapture::_nextSlot = 0;
+int FrameCapture::_width = 0;
+int FrameCapture::_height = 0;
+unsigned int FrameCapture::_frameIndex = 0;
+bool FrameCapture::_capturing = false;
+std::string FrameCapture::_pendingScreenshot;
+
+std::mutex FrameCapture::_sinkMutex;
+std::vector<CaptureSink*> FrameCapture::_sinks;
+std::vector<CapturedFrame*> FrameCapture::_freeFrames;
+int FrameCapture::_allocatedFrames = 0;
+std::deque<CapturedFrame*> FrameCapture::_queue;
+std::mutex FrameCapture::_mutex;
+std::condition_variable FrameCapture::_queueSignal;
+std::thread FrameCapture::_encoder;
+bool FrameCapture::_running = false;
+
+CaptureStats FrameCapture::_stats;
+std::atomic<unsigned int> FrameCapture::_dropped(0);
+
+void FrameCapture::Init(int width, int height)
+{
+	_width = width;
+	_height = height;
+	_nextSlot = 0;
+	_frameIndex = 0;
+
+	// GL_STREAM_READ tells the driver we will read this buffer back once per fill, so it
+	// places the storage somewhere the CPU can map cheaply
+	for (int i = 0; i < NUM_PBOS; ++i)
+	{
+		glGenBuffers(1, &_slots[i].pbo);
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, _slots[i].pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, _width * _height * 4, NULL, GL_STREAM_READ);
+		_slots[i].pending = false;
+		_slots[i].fence = 0;
+	}
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	_running = true;
+	_encoder = std::thread(EncoderLoop);
+}
+
+void FrameCapture::Update(double time)
+{
+	// Hand off anything the GPU has already finished copying
+	RetireSlots(false);
+
+	if (_capturing || !_pendingScreenshot.empty())
+	{
+		std::string screenshotFile = _pendingScreenshot;
+
+		PboSlot& slot = _slots[_nextSlot];
+		if (slot.pending)
+		{
+			// The oldest read back still hasn't finished. Waiting on it here would stall the
+			// frame, so skip capturing this one. A pending screenshot is retried next frame.
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stats.requested++;
+			_stats.dropped++;
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		slot.index = _frameIndex++;
+		slot.time = time;
+		slot.screenshotFile = screenshotFile;
+		_pendingScreenshot.clear();
+
+		Readback();
+	}
+}
+
+void FrameCapture::Readback()
+{
+	PboSlot& slot = _slots[_nextSlot];
+
+	// With a pack buffer bound, glReadPixels only queues a copy into the buffer and
+	// returns immediately instead of waiting for the frame to finish rendering
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.pending = true;
+
+	_nextSlot = (_nextSlot + 1) % NUM_PBOS;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stats.requested++;
+}
+
+void FrameCapture::RetireSlots(bool wait)
+{
+	// Slots are retired oldest first so frames reach the encoder in order. The oldest
+	// slot in the ring is the one we are about to write into next.
+	for (int k = 0; k < NUM_PBOS; ++k)
+	{
+		PboSlot& slot = _slots[(_nextSlot + k) % NUM_PBOS];
+		if (!slot.pending)
+			continue;
+
+		GLenum status = glClientWaitSync(slot.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000 : 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+			break;
+
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		slot.pending = false;
+
+		CapturedFrame* frame = AcquireFrame();
+		if (!frame)
+		{
+			// The encoder thread has fallen behind and every pooled frame is in use
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stats.dropped++;
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		frame->width = _width;
+		frame->height = _height;
+		frame->index = slot.index;
+		frame->time = slot.time;
+		frame->screenshotFile = slot.screenshotFile;
+		frame->pixels.resize(_width * _height * 4);
+
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, _width * _height * 4, GL_MAP_READ_BIT);
+		if (data)
+		{
+			memcpy(&frame->pixels[0], data, frame->pixels.size());
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		if (!data)
+		{
+			ReleaseFrame(frame);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.readBack++;
+		_queue.push_back(frame);
+		_queueSignal.notify_one();
+	}
+}
+
+CapturedFrame* FrameCapture::AcquireFrame()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (!_freeFrames.empty())
+	{
+		CapturedFrame* frame = _freeFrames.back();
+		_freeFrames.pop_back();
+		return frame;
+	}
+	if (_allocatedFrames < MAX_POOLED_FRAMES)
+	{
+		_allocatedFrames++;
+		return new CapturedFrame();
+	}
+	return nullptr;
+}
+
+void FrameCapture::ReleaseFrame(CapturedFrame* frame)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_freeFrames.push_back(frame);
+}
+
+void FrameCapture::EncoderLoop()
+{
+	while (true)
+	{
+		CapturedFrame* frame;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_queueSignal.wait(lock, [] { return !_queue.empty() || !_running; });
+			if (_queue.empty())
+				break;
+
+			frame = _queue.front();
+			_queue.pop_front();
+		}
+
+		if (!frame->screenshotFile.empty())
+			WriteTGA(frame->screenshotFile.c_str(), *frame);
+
+		{
+			std::lock_guard<std::mutex> sinkLock(_sinkMutex);
+			unsigned int numSinks = _sinks.size();
+			for (unsigned int i = 0; i < numSinks; ++i)
+			{
+				_sinks[i]->Consume(*frame);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.encoded++;
+		_freeFrames.push_back(frame);
+	}
+}
+
+void FrameCapture::Screenshot(const char* fileName)
+{
+	_pendingScreenshot = fileName;
+}
+
+void FrameCapture::StartCapture() { _capturing = true; }
+void FrameCapture::StopCapture() { _capturing = false; }
+bool FrameCapture::capturing() { return _capturing; }
+
+void FrameCapture::AddSink(CaptureSink* sink)
+{
+	std::lock_guard<std::mutex> lock(_sinkMutex);
+	_sinks.push_back(sink);
+}
+
+void FrameCapture::RemoveSink(CaptureSink* sink)
+{
+	std::lock_guard<std::mutex> lock(_sinkMutex);
+	_sinks.erase(std::remove(_sinks.begin(), _sinks.end(), sink), _sinks.end());
+}
+
+CaptureStats FrameCapture::Stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+unsigned int FrameCapture::droppedFrames()
+{
+	return _dropped.load(std::memory_order_relaxed);
+}
+
+void FrameCapture::DumpData()
+{
+	// Flush whatever is still in flight so the last frames of a capture aren't lost
+	RetireSlots(true);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+		_queueSignal.notify_one();
+	}
+	if (_encoder.joinable())
+		_encoder.join();
+
+	for (int i = 0; i < NUM_PBOS; ++i)
+	{
+		if (_slots[i].fence)
+			glDeleteSync(_slots[i].fence);
+		GLState::DeleteBuffers(1, &_slots[i].pbo);
+		_slots[i] = PboSlot();
+	}
+
+	while (!_freeFrames.empty())
+	{
+		delete _freeFrames.back();
+		_freeFrames.pop_back();
+	}
+	_allocatedFrames = 0;
+	_sinks.clear();
+}
+
+// Writes an uncompressed 32 bit TGA. TGA stores rows bottom-up like GL does, so only the
+// channel order needs to change.
+bool FrameCapture::WriteTGA(const char* fileName, const CapturedFrame& frame)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	unsigned char header[18] = { 0 };
+	header[2] = 2;
+	header[12] = frame.width & 0xFF;
+	header[13] = (frame.width >> 8) & 0xFF;
+	header[14] = frame.height & 0xFF;
+	header[15] = (frame.height >> 8) & 0xFF;
+	header[16] = 32;
+	header[17] = 8;
+	file.write((const char*)header, sizeof(header));
+
+	std::vector<unsigned char> row(frame.width * 4);
+	for (int y = 0; y < frame.height; ++y)
+	{
+		const unsigned char* src = &frame.pixels[y * frame.width * 4];
+		for (int x = 0; x < frame.width; ++x)
+		{
+			row[x * 4] = src[x * 4 + 2];
+			row[x * 4 + 1] = src[x * 4 + 1];
+			row[x * 4 + 2] = src[x * 4];
+			row[x * 4 + 3] = src[x * 4 + 3];
+		}
+		file.write((const char*)&row[0], row.size());
+	}
+	return file.good();
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <GLEW/GL/glew.h>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// A single frame that has been read back from the GPU. Pixels are tightly packed RGBA,
+// bottom row first, exactly as glReadPixels hands them back.
+struct CapturedFrame
+{
+	int width = 0;
+	int height = 0;
+	unsigned int index = 0;
+	double time = 0.0;
+	std::vector<unsigned char> pixels;
+
+	// If non-empty, the encoder thread writes this frame to disk as a screenshot
+	std::string screenshotFile;
+};
+
+// Anything that wants to receive captured frames (video writers, image pipelines, ...)
+// Consume is always called from the capture encoder thread, never from the render thread.
+class CaptureSink
+{
+public:
+	virtual ~CaptureSink() {}
+	virtual void Consume(const CapturedFrame& frame) = 0;
+};
+
+struct CaptureStats
+{
+	unsigned int requested = 0;
+	unsigned int readBack = 0;
+	unsigned int dropped = 0;
+	unsigned int encoded = 0;
+};
+
+class FrameCapture
+{
+public:
+	static void Init(int width, int height);
+
+	// Call once per frame after drawing and before swapping buffers. Retires any read backs
+	// whose fences have signaled and, if a capture is wanted this frame, starts a new one.
+	static void Update(double time);
+
+	static void Screenshot(const char* fileName);
+
+	static void StartCapture();
+	static void StopCapture();
+	static bool capturing();
+
+	static void AddSink(CaptureSink* sink);
+	static void RemoveSink(CaptureSink* sink);
+
+	static CaptureStats Stats();
+
+	// Stats().dropped, read without taking the lock, for telemetry to sample every frame
+	static unsigned int droppedFrames();
+
+	static void DumpData();
+
+	static bool WriteTGA(const char* fileName, const CapturedFrame& frame);
+
+private:
+	static void Readback();
+	static void RetireSlots(bool wait);
+	static CapturedFrame* AcquireFrame();
+	static void ReleaseFrame(CapturedFrame* frame);
+	static void EncoderLoop();
+
+private:
+	// Number of pixel buffer objects in the ring. A read back started on frame N is mapped
+	// on frame N + NUM_PBOS - 1 at the earliest, which gives the GPU time to finish the copy.
+	static const int NUM_PBOS = 3;
+
+	// Frames kept around for the encoder thread, so steady state capture never allocates
+	static const int MAX_POOLED_FRAMES = NUM_PBOS * 2;
+
+	struct PboSlot
+	{
+		GLuint pbo = 0;
+		GLsync fence = 0;
+		bool pending = false;
+		unsigned int index = 0;
+		double time = 0.0;
+		std::string screenshotFile;
+	};
+
+	static PboSlot _slots[NUM_PBOS];
+	static int _nextSlot;
+	static int _width;
+	static int _height;
+	static unsigned int _frameIndex;
+	static bool _capturing;
+	static std::string _pendingScreenshot;
+
+	// Held by the encoder thread while it feeds sinks, so a sink is never called after RemoveSink returns
+	static std::mutex _sinkMutex;
+	static std::vector<CaptureSink*> _sinks;
+	static std::vector<CapturedFrame*> _freeFrames;
+	static int _allocatedFrames;
+	static std::deque<CapturedFrame*> _queue;
+	static std::mutex _mutex;
+	static std::condition_variable _queueSignal;
+	static std::thread _encoder;
+	static bool _running;
+
+	static CaptureStats _stats;
+	static std::atomic<unsigned int> _dropped;
+};
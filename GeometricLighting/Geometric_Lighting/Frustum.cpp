@@ -0,0 +1,40 @@
+#include "Frustum.h"
+
+void Frustum::FromMatrix(const glm::mat4& viewProjMat)
+{
+	// Each plane is the last row of the matrix plus or minus one of the others
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(viewProjMat[0][i], viewProjMat[1][i], viewProjMat[2][i], viewProjMat[3][i]);
+	for (int i = 0; i < 3; ++i)
+	{
+		planes[i * 2] = rows[3] + rows[i];
+		planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+}
+
+bool Frustum::IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	// Checking the box corner furthest along each plane's normal is enough
+	for (int i = 0; i < 6; ++i)
+	{
+		const glm::vec4& plane = planes[i];
+		glm::vec3 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x, plane.y >= 0.0f ? boxMax.y : boxMin.y, plane.z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::ContainsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+{
+	// The opposite corner, the one furthest against each plane's normal, has to be inside
+	for (int i = 0; i < 6; ++i)
+	{
+		const glm::vec4& plane = planes[i];
+		glm::vec3 corner(plane.x >= 0.0f ? boxMin.x : boxMax.x, plane.y >= 0.0f ? boxMin.y : boxMax.y, plane.z >= 0.0f ? boxMin.z : boxMax.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+// The six planes of a view frustum, pulled out of a view projection matrix, for culling
+// bounding boxes on the CPU
+struct Frustum
+{
+	// Plane normals point inwards, a point p is inside a plane when dot(xyz, p) + w >= 0
+	glm::vec4 planes[6];
+
+	void FromMatrix(const glm::mat4& viewProjMat);
+
+	// False only when the box is entirely outside one of the planes
+	bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+	// True when the box is entirely inside all six planes
+	bool ContainsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+};
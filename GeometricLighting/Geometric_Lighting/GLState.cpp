@@ -0,0 +1,330 @@
+#include "GLState.h"
+
+#include <cstring>
+#include <iostream>
+
+// Stands in for a binding nothing has been set through the cache yet
+static const GLuint UNKNOWN = 0xffffffffu;
+
+bool GLState::_filtering = true;
+GLuint GLState::_program = UNKNOWN;
+GLuint GLState::_vao = UNKNOWN;
+GLuint GLState::_buffers[GLState::NUM_BUFFER_TARGETS] = { UNKNOWN, UNKNOWN, UNKNOWN };
+GLenum GLState::_activeTexture = UNKNOWN;
+GLuint GLState::_textures[GLState::NUM_TEXTURE_UNITS][GLState::NUM_TEXTURE_TARGETS];
+std::unordered_map<GLuint, std::vector<GLState::UniformValue> > GLState::_uniforms;
+std::vector<GLState::UniformValue>* GLState::_programUniforms = nullptr;
+GLStateStats GLState::_stats;
+
+// Fills in the texture bindings too, which are too many to write out, before anything can call in
+static bool startUnknown = (GLState::Invalidate(), true);
+
+int GLState::BufferTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_ELEMENT_ARRAY_BUFFER: return 1;
+	case GL_PIXEL_PACK_BUFFER: return 2;
+	default: return -1;
+	}
+}
+
+int GLState::TextureTargetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_3D: return 1;
+	default: return -1;
+	}
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	if (_filtering && program == _program)
+	{
+		++_stats.programs.filtered;
+		return;
+	}
+
+	glUseProgram(program);
+	_program = program;
+	_programUniforms = &_uniforms[program];
+	++_stats.programs.issued;
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	if (_filtering && vao == _vao)
+	{
+		++_stats.vertexArrays.filtered;
+		return;
+	}
+
+	glBindVertexArray(vao);
+	_vao = vao;
+	_buffers[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	++_stats.vertexArrays.issued;
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	int index = BufferTargetIndex(target);
+	if (_filtering && index >= 0 && _buffers[index] == buffer)
+	{
+		++_stats.buffers.filtered;
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	if (index >= 0)
+		_buffers[index] = buffer;
+	++_stats.buffers.issued;
+}
+
+void GLState::ActiveTexture(GLenum unit)
+{
+	if (_filtering && unit == _activeTexture)
+	{
+		++_stats.textures.filtered;
+		return;
+	}
+
+	glActiveTexture(unit);
+	_activeTexture = unit;
+	++_stats.textures.issued;
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+	int unit = _activeTexture == UNKNOWN ? -1 : (int)(_activeTexture - GL_TEXTURE0);
+	int index = TextureTargetIndex(target);
+	bool tracked = unit >= 0 && unit < NUM_TEXTURE_UNITS && index >= 0;
+	if (_filtering && tracked && _textures[unit][index] == texture)
+	{
+		++_stats.textures.filtered;
+		return;
+	}
+
+	glBindTexture(target, texture);
+	if (tracked)
+		_textures[unit][index] = texture;
+	++_stats.textures.issued;
+}
+
+bool GLState::UniformSet(GLint location, const void* value, GLsizei bytes, GLsizei count)
+{
+	// GL ignores location -1, which is what uniforms the program doesn't have come back as
+	if (_filtering && location < 0)
+	{
+		++_stats.uniforms.filtered;
+		return true;
+	}
+
+	if (!_filtering || !_programUniforms || location < 0)
+	{
+		++_stats.uniforms.issued;
+		return false;
+	}
+
+	std::vector<UniformValue>& values = *_programUniforms;
+	if ((size_t)location >= values.size())
+		values.resize(location + 1);
+
+	UniformValue& current = values[location];
+	if (bytes <= MAX_UNIFORM_BYTES && current.bytes == bytes && !memcmp(current.data, value, bytes))
+	{
+		++_stats.uniforms.filtered;
+		return true;
+	}
+
+	if (bytes <= MAX_UNIFORM_BYTES)
+	{
+		current.bytes = bytes;
+		memcpy(current.data, value, bytes);
+	}
+	else
+		current.bytes = 0;
+
+	// The elements after the first of an array have locations of their own, set along with it
+	for (GLsizei i = 1; i < count && (size_t)(location + i) < values.size(); ++i)
+		values[location + i].bytes = 0;
+
+	++_stats.uniforms.issued;
+	return false;
+}
+
+void GLState::Uniform1i(GLint location, GLint value)
+{
+	if (!UniformSet(location, &value, sizeof(value), 1))
+		glUniform1i(location, value);
+}
+
+void GLState::Uniform1ui(GLint location, GLuint value)
+{
+	if (!UniformSet(location, &value, sizeof(value), 1))
+		glUniform1ui(location, value);
+}
+
+void GLState::Uniform1f(GLint location, GLfloat value)
+{
+	if (!UniformSet(location, &value, sizeof(value), 1))
+		glUniform1f(location, value);
+}
+
+void GLState::Uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w)
+{
+	GLfloat value[4] = { x, y, z, w };
+	if (!UniformSet(location, value, sizeof(value), 1))
+		glUniform4f(location, x, y, z, w);
+}
+
+void GLState::Uniform1iv(GLint location, GLsizei count, const GLint* value)
+{
+	if (!UniformSet(location, value, count * sizeof(GLint), count))
+		glUniform1iv(location, count, value);
+}
+
+void GLState::Uniform3fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	if (!UniformSet(location, value, count * 3 * sizeof(GLfloat), count))
+		glUniform3fv(location, count, value);
+}
+
+void GLState::Uniform4fv(GLint location, GLsizei count, const GLfloat* value)
+{
+	if (!UniformSet(location, value, count * 4 * sizeof(GLfloat), count))
+		glUniform4fv(location, count, value);
+}
+
+void GLState::UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value)
+{
+	// Transposed matrices are rare enough to always send, and forget
+	if (transpose)
+	{
+		UniformSet(location, value, MAX_UNIFORM_BYTES + 1, count);
+		glUniformMatrix4fv(location, count, transpose, value);
+		return;
+	}
+
+	if (!UniformSet(location, value, count * 16 * sizeof(GLfloat), count))
+		glUniformMatrix4fv(location, count, transpose, value);
+}
+
+void GLState::DeleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+
+	// A program deleted while in use stays bound until another one is, so only its values go
+	_uniforms.erase(program);
+	if (program == _program)
+	{
+		_program = UNKNOWN;
+		_programUniforms = nullptr;
+	}
+}
+
+void GLState::DeleteVertexArrays(GLsizei count, const GLuint* vaos)
+{
+	glDeleteVertexArrays(count, vaos);
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		if (vaos[i] == _vao)
+		{
+			_vao = UNKNOWN;
+			_buffers[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+		}
+	}
+}
+
+void GLState::DeleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	glDeleteBuffers(count, buffers);
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		for (int t = 0; t < NUM_BUFFER_TARGETS; ++t)
+		{
+			if (_buffers[t] == buffers[i])
+				_buffers[t] = UNKNOWN;
+		}
+	}
+}
+
+void GLState::DeleteTextures(GLsizei count, const GLuint* textures)
+{
+	glDeleteTextures(count, textures);
+	for (GLsizei i = 0; i < count; ++i)
+	{
+		for (int u = 0; u < NUM_TEXTURE_UNITS; ++u)
+		{
+			for (int t = 0; t < NUM_TEXTURE_TARGETS; ++t)
+			{
+				if (_textures[u][t] == textures[i])
+					_textures[u][t] = UNKNOWN;
+			}
+		}
+	}
+}
+
+void GLState::Invalidate()
+{
+	_program = UNKNOWN;
+	_vao = UNKNOWN;
+	for (int t = 0; t < NUM_BUFFER_TARGETS; ++t)
+		_buffers[t] = UNKNOWN;
+	_activeTexture = UNKNOWN;
+	for (int u = 0; u < NUM_TEXTURE_UNITS; ++u)
+		for (int t = 0; t < NUM_TEXTURE_TARGETS; ++t)
+			_textures[u][t] = UNKNOWN;
+	_uniforms.clear();
+	_programUniforms = nullptr;
+}
+
+void GLState::SetFiltering(bool filtering)
+{
+	// What went through unfiltered wasn't kept track of
+	if (filtering && !_filtering)
+		Invalidate();
+	_filtering = filtering;
+}
+
+bool GLState::filtering()
+{
+	return _filtering;
+}
+
+GLStateStats GLState::Stats()
+{
+	return _stats;
+}
+
+void GLState::ResetStats()
+{
+	_stats = GLStateStats();
+}
+
+static void PrintCounts(const char* name, const GLStateCounts& counts)
+{
+	std::cout << "  " << name << ": " << counts.issued << " issued, " << counts.filtered << " filtered" << std::endl;
+}
+
+void GLState::PrintStats()
+{
+	GLStateCounts total;
+	const GLStateCounts* kinds[] = { &_stats.programs, &_stats.vertexArrays, &_stats.buffers, &_stats.textures, &_stats.uniforms };
+	for (int i = 0; i < 5; ++i)
+	{
+		total.issued += kinds[i]->issued;
+		total.filtered += kinds[i]->filtered;
+	}
+
+	unsigned long long calls = total.issued + total.filtered;
+	std::cout << "GL state: " << total.filtered << " of " << calls << " calls filtered (" << (calls ? 100.0 * total.filtered / calls : 0.0) << "%)"
+		<< (_filtering ? "" : ", filtering off") << std::endl;
+	PrintCounts("programs", _stats.programs);
+	PrintCounts("vertex arrays", _stats.vertexArrays);
+	PrintCounts("buffers", _stats.buffers);
+	PrintCounts("textures", _stats.textures);
+	PrintCounts("uniforms", _stats.uniforms);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <GLEW/GL/glew.h>
+
+#include <vector>
+#include <unordered_map>
+
+// Calls passed on to GL, and calls dropped because they would have changed nothing
+struct GLStateCounts
+{
+	unsigned long long issued = 0;
+	unsigned long long filtered = 0;
+};
+
+struct GLStateStats
+{
+	GLStateCounts programs;
+	GLStateCounts vertexArrays;
+	GLStateCounts buffers;
+	GLStateCounts textures;
+	GLStateCounts uniforms;
+};
+
+// Shadows the GL state the viewer changes every frame (the current program, vertex array,
+// buffer and texture bindings, and the uniform values of each program) and drops calls that
+// would set what is already set before they reach the driver. Each call has the same arguments
+// as the GL function it stands in for.
+//
+// The cache only knows what went through it, so everything that binds, deletes or sets these
+// has to, or call Invalidate afterwards. Until something is set through the cache it is taken
+// to be unknown, and the first call always goes through. Render thread only.
+class GLState
+{
+public:
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vao);
+
+	// Array, element array and pixel pack buffers are tracked, other targets always go through.
+	// The element array binding belongs to the vertex array, so it is forgotten whenever
+	// another vertex array is bound.
+	static void BindBuffer(GLenum target, GLuint buffer);
+
+	// 2D and 3D textures are tracked on each unit, other targets always go through
+	static void ActiveTexture(GLenum unit);
+	static void BindTexture(GLenum target, GLuint texture);
+
+	// Uniforms of the current program. Arrays of more than 64 bytes always go through.
+	static void Uniform1i(GLint location, GLint value);
+	static void Uniform1ui(GLint location, GLuint value);
+	static void Uniform1f(GLint location, GLfloat value);
+	static void Uniform4f(GLint location, GLfloat x, GLfloat y, GLfloat z, GLfloat w);
+	static void Uniform1iv(GLint location, GLsizei count, const GLint* value);
+	static void Uniform3fv(GLint location, GLsizei count, const GLfloat* value);
+	static void Uniform4fv(GLint location, GLsizei count, const GLfloat* value);
+	static void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+
+	// Deletes the objects and forgets any binding of them, since GL hands their names out again
+	static void DeleteProgram(GLuint program);
+	static void DeleteVertexArrays(GLsizei count, const GLuint* vaos);
+	static void DeleteBuffers(GLsizei count, const GLuint* buffers);
+	static void DeleteTextures(GLsizei count, const GLuint* textures);
+
+	// Forgets everything, for a new context or after code that changed the state behind the
+	// cache's back. RenderContext::Init calls it once the context exists.
+	static void Invalidate();
+
+	// With filtering off every call goes through, for measuring what the cache saves
+	static void SetFiltering(bool filtering);
+	static bool filtering();
+
+	static GLStateStats Stats();
+	static void ResetStats();
+	static void PrintStats();
+
+private:
+	enum
+	{
+		NUM_BUFFER_TARGETS = 3,
+		NUM_TEXTURE_UNITS = 32,
+		NUM_TEXTURE_TARGETS = 2,
+		MAX_UNIFORM_BYTES = 64
+	};
+
+	// What a location was last set to; no bytes while unknown
+	struct UniformValue
+	{
+		GLsizei bytes = 0;
+		unsigned char data[MAX_UNIFORM_BYTES];
+	};
+
+	static int BufferTargetIndex(GLenum target);
+	static int TextureTargetIndex(GLenum target);
+
+	// Whether value is already at location, remembering it if not. Counts the call either way.
+	static bool UniformSet(GLint location, const void* value, GLsizei bytes, GLsizei count);
+
+private:
+	static bool _filtering;
+
+	static GLuint _program;
+	static GLuint _vao;
+	static GLuint _buffers[NUM_BUFFER_TARGETS];
+	static GLenum _activeTexture;
+	static GLuint _textures[NUM_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+
+	// Uniform values of every program by location, and those of the current one
+	static std::unordered_map<GLuint, std::vector<UniformValue> > _uniforms;
+	static std::vector<UniformValue>* _programUniforms;
+
+	static GLStateStats _stats;
+};
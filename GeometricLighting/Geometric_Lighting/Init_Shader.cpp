@@ -1,18 +1,19 @@
-#include "init_shader.h"
+#include "Init_Shader.h"
+#include "GLState.h"
 #include <fstream>
 #include <iostream>
+#include <cstdio>
 
 static char* textFileRead(char* fn)
 {
 	FILE* fp;
 	char* content = NULL;
-	errno_t err;
 
 	int count = 0;
 
 	if (fn != NULL)
 	{
-		err = fopen_s(&fp, fn, "rt");
+		fp = fopen(fn, "rt");
 
 		if (fp != NULL)
 		{
@@ -26,7 +27,7 @@ static char* textFileRead(char* fn)
 				count = fread(content, sizeof(char), count, fp);
 				content[count] = '\0';
 			}
-			err = fclose(fp);
+			fclose(fp);
 		}
 	}
 	return content;
@@ -50,7 +51,7 @@ GLuint initShaders(char** shaders, GLenum* types, int numShaders)
 
 	glLinkProgram(program);
 
-	glUseProgram(program);
+	GLState::UseProgram(program);
 
 	return program;
 }
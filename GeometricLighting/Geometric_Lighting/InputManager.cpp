@@ -30,6 +30,10 @@ bool InputManager::_prevCtrlKey = false;
 
 bool InputManager::_prevSpaceKey = false;
 bool InputManager::_spaceKey = false;
+bool InputManager::_prevPKey = false;
+bool InputManager::_pKey = false;
+bool InputManager::_prevCKey = false;
+bool InputManager::_cKey = false;
 
 GLFWwindow* InputManager::_window;
 float InputManager::_aspectRatio = 0.0f;
@@ -44,6 +48,10 @@ void InputManager::Init(GLFWwindow* window)
 
 void InputManager::Update()
 {
+	// Headless contexts have no window to read, so every key and button stays up
+	if (!_window)
+		return;
+
 	_prevLeftMouseButton = _leftMouseButton;
 	_leftMouseButton = glfwGetMouseButton(_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
 	glfwGetCursorPos(_window, &_mousePos[0], &_mousePos[1]);
@@ -89,6 +97,10 @@ void InputManager::Update()
 
 	_prevSpaceKey = _spaceKey;
 	_spaceKey = glfwGetKey(_window, GLFW_KEY_SPACE) == GLFW_PRESS;
+	_prevPKey = _pKey;
+	_pKey = glfwGetKey(_window, GLFW_KEY_P) == GLFW_PRESS;
+	_prevCKey = _cKey;
+	_cKey = glfwGetKey(_window, GLFW_KEY_C) == GLFW_PRESS;
 }
 
 glm::vec2 InputManager::GetMouseCoords()
@@ -113,4 +125,6 @@ bool InputManager::dKey(bool prev) { if (prev) return _prevDKey; else return _dK
 bool InputManager::shiftKey(bool prev) { if (prev) return _prevShiftKey; else return _shiftKey; }
 bool InputManager::ctrlKey(bool prev) { if (prev) return _prevCtrlKey; else return _ctrlKey; }
 bool InputManager::spaceKey(bool prev) { if (prev) return _prevSpaceKey; else return _spaceKey; }
+bool InputManager::pKey(bool prev) { if (prev) return _prevPKey; else return _pKey; }
+bool InputManager::cKey(bool prev) { if (prev) return _prevCKey; else return _cKey; }
 
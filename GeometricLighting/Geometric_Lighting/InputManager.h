@@ -1,7 +1,7 @@
 #pragma once
-#include <GLEW\GL\glew.h>
-#include <GLFW\glfw3.h>
-#include <GLM\glm.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <GLM/glm.hpp>
 
 class InputManager
 {
@@ -26,6 +26,8 @@ public:
 	static bool shiftKey(bool prev = false);
 	static bool ctrlKey(bool prev = false);
 	static bool spaceKey(bool prev = false);
+	static bool pKey(bool prev = false);
+	static bool cKey(bool prev = false);
 private:
 
 	static double _mousePos[2];
@@ -57,6 +59,10 @@ private:
 
 	static bool _prevSpaceKey;
 	static bool _spaceKey;
+	static bool _prevPKey;
+	static bool _pKey;
+	static bool _prevCKey;
+	static bool _cKey;
 
 	static GLFWwindow* _window;
 	static float _aspectRatio;
@@ -0,0 +1,467 @@
+#include "LTCFitter.h"
+#include "WorkerPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const float PI = 3.14159265f;
+
+// Smoothest roughness fitted; a perfect mirror has no lobe to fit
+static const float MIN_ALPHA = 0.00001f;
+
+static const char CACHE_MAGIC[8] = "LTCGGX1";
+static const unsigned int CACHE_VERSION = 1;
+
+struct LTCCacheHeader
+{
+	char magic[8];
+	unsigned int version;
+	int size;
+	int samples;
+};
+
+// GGX with Smith's height correlated masking-shadowing, for a view direction in the xz plane
+// and the normal along z. Returns the BRDF times the cosine of the light direction.
+static float SmithLambda(float alpha, float cosTheta)
+{
+	if (cosTheta >= 1.0f)
+		return 0.0f;
+	float a = 1.0f / (alpha * tan(acos(cosTheta)));
+	return 0.5f * (-1.0f + sqrt(1.0f + 1.0f / (a * a)));
+}
+
+static float EvalGGX(const glm::vec3& V, const glm::vec3& L, float alpha, float& pdf)
+{
+	pdf = 0.0f;
+	if (V.z <= 0.0f || L.z <= 0.0f)
+		return 0.0f;
+
+	float G2 = 1.0f / (1.0f + SmithLambda(alpha, V.z) + SmithLambda(alpha, L.z));
+
+	glm::vec3 H = glm::normalize(V + L);
+	float slopeX = H.x / H.z;
+	float slopeY = H.y / H.z;
+	float D = 1.0f / (1.0f + (slopeX * slopeX + slopeY * slopeY) / (alpha * alpha));
+	D = D * D / (PI * alpha * alpha * H.z * H.z * H.z * H.z);
+
+	pdf = fabs(D * H.z / (4.0f * glm::dot(V, H)));
+	return D * G2 / (4.0f * V.z);
+}
+
+// Reflects V about a normal drawn from the distribution of visible and invisible normals
+static glm::vec3 SampleGGX(const glm::vec3& V, float alpha, float u1, float u2)
+{
+	float phi = 2.0f * PI * u1;
+	float r = alpha * sqrt(u2 / (1.0f - u2));
+	glm::vec3 N = glm::normalize(glm::vec3(r * cos(phi), r * sin(phi), 1.0f));
+	return -V + 2.0f * N * glm::dot(N, V);
+}
+
+// A clamped cosine distribution transformed by M, scaled to magnitude
+struct LTC
+{
+	float magnitude;
+	float fresnel;
+
+	// The matrix is a frame (X, Y, Z) times a scale and shear in that frame
+	float m11;
+	float m22;
+	float m13;
+	glm::vec3 X;
+	glm::vec3 Y;
+	glm::vec3 Z;
+
+	glm::mat3 M;
+	glm::mat3 invM;
+	float detM;
+
+	LTC()
+	{
+		magnitude = 1.0f;
+		fresnel = 1.0f;
+		m11 = 1.0f;
+		m22 = 1.0f;
+		m13 = 0.0f;
+		X = glm::vec3(1.0f, 0.0f, 0.0f);
+		Y = glm::vec3(0.0f, 1.0f, 0.0f);
+		Z = glm::vec3(0.0f, 0.0f, 1.0f);
+		Update();
+	}
+
+	void Update()
+	{
+		M = glm::mat3(X, Y, Z) * glm::mat3(glm::vec3(m11, 0.0f, 0.0f), glm::vec3(0.0f, m22, 0.0f), glm::vec3(m13, 0.0f, 1.0f));
+		invM = glm::inverse(M);
+		detM = fabs(glm::determinant(M));
+	}
+
+	float Eval(const glm::vec3& L) const
+	{
+		glm::vec3 original = glm::normalize(invM * L);
+		glm::vec3 transformed = M * original;
+		float length = glm::length(transformed);
+		float jacobian = detM / (length * length * length);
+		float D = std::max(0.0f, original.z) / PI;
+		return magnitude * D / jacobian;
+	}
+
+	glm::vec3 Sample(float u1, float u2) const
+	{
+		float theta = acos(sqrt(u1));
+		float phi = 2.0f * PI * u2;
+		return glm::normalize(M * glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta)));
+	}
+};
+
+// Magnitude, Fresnel weighted magnitude and average direction of the lobe, the last of which
+// the fitted distribution is centered on
+static void AverageTerms(const glm::vec3& V, float alpha, int samples, float& norm, float& fresnel, glm::vec3& averageDir)
+{
+	norm = 0.0f;
+	fresnel = 0.0f;
+	averageDir = glm::vec3();
+
+	for (int j = 0; j < samples; ++j)
+	{
+		for (int i = 0; i < samples; ++i)
+		{
+			glm::vec3 L = SampleGGX(V, alpha, (j + 0.5f) / samples, (i + 0.5f) / samples);
+
+			float pdf;
+			float eval = EvalGGX(V, L, alpha, pdf);
+			if (pdf <= 0.0f)
+				continue;
+
+			float weight = eval / pdf;
+			glm::vec3 H = glm::normalize(V + L);
+			norm += weight;
+			fresnel += weight * pow(1.0f - std::max(glm::dot(V, H), 0.0f), 5.0f);
+			averageDir += weight * L;
+		}
+	}
+	norm /= (float)(samples * samples);
+	fresnel /= (float)(samples * samples);
+
+	// The lobe is symmetric about the plane of incidence
+	averageDir.y = 0.0f;
+	averageDir = glm::normalize(averageDir);
+}
+
+// Difference between the distributions, sampled from both and weighted by multiple importance
+// sampling. Cubing the difference makes the fit care most about where they differ most.
+static double FitError(const LTC& ltc, const glm::vec3& V, float alpha, int samples)
+{
+	double error = 0.0;
+	for (int j = 0; j < samples; ++j)
+	{
+		for (int i = 0; i < samples; ++i)
+		{
+			float u1 = (j + 0.5f) / samples;
+			float u2 = (i + 0.5f) / samples;
+			for (int fromBrdf = 0; fromBrdf < 2; ++fromBrdf)
+			{
+				glm::vec3 L = fromBrdf ? SampleGGX(V, alpha, u1, u2) : ltc.Sample(u1, u2);
+
+				float pdfBrdf;
+				float evalBrdf = EvalGGX(V, L, alpha, pdfBrdf);
+				float evalLtc = ltc.Eval(L);
+				float pdfLtc = evalLtc / ltc.magnitude;
+
+				double difference = fabs(evalBrdf - evalLtc);
+				if (pdfBrdf + pdfLtc > 0.0f)
+					error += difference * difference * difference / (pdfBrdf + pdfLtc);
+			}
+		}
+	}
+	return error / (samples * samples);
+}
+
+// Parameters are m11, m22 and m13; at normal incidence the lobe is round and only m11 counts
+static double FitErrorFor(LTC& ltc, const float* params, bool isotropic, const glm::vec3& V, float alpha, int samples)
+{
+	ltc.m11 = std::max(params[0], 1e-7f);
+	ltc.m22 = isotropic ? ltc.m11 : std::max(params[1], 1e-7f);
+	ltc.m13 = isotropic ? 0.0f : params[2];
+	ltc.Update();
+	return FitError(ltc, V, alpha, samples);
+}
+
+// Downhill simplex search over the three parameters, starting from start. Returns the error
+// of the best parameters found, which are left in ltc.
+static double NelderMead(LTC& ltc, const float* start, bool isotropic, const glm::vec3& V, float alpha, const LTCFitSettings& settings,
+	unsigned long long& evaluations)
+{
+	const int DIM = 3;
+	const float DELTA = 0.05f;
+	const double TOLERANCE = 1e-5;
+
+	float simplex[DIM + 1][DIM];
+	double errors[DIM + 1];
+	for (int p = 0; p <= DIM; ++p)
+	{
+		for (int d = 0; d < DIM; ++d)
+			simplex[p][d] = start[d] + (p == d + 1 ? DELTA : 0.0f);
+		errors[p] = FitErrorFor(ltc, simplex[p], isotropic, V, alpha, settings.samples);
+		++evaluations;
+	}
+
+	int lowest = 0;
+	for (int iteration = 0; iteration < settings.maxIterations; ++iteration)
+	{
+		// Best, worst and second worst points
+		lowest = 0;
+		int highest = 0;
+		for (int p = 1; p <= DIM; ++p)
+		{
+			if (errors[p] < errors[lowest])
+				lowest = p;
+			if (errors[p] > errors[highest])
+				highest = p;
+		}
+		int nextHighest = lowest;
+		for (int p = 0; p <= DIM; ++p)
+		{
+			if (p != highest && errors[p] > errors[nextHighest])
+				nextHighest = p;
+		}
+
+		double a = fabs(errors[lowest]);
+		double b = fabs(errors[highest]);
+		if (2.0 * fabs(a - b) <= (a + b) * TOLERANCE)
+			break;
+
+		// Centroid of every point but the worst
+		float centroid[DIM] = { 0.0f, 0.0f, 0.0f };
+		for (int p = 0; p <= DIM; ++p)
+		{
+			if (p == highest)
+				continue;
+			for (int d = 0; d < DIM; ++d)
+				centroid[d] += simplex[p][d] / DIM;
+		}
+
+		// Reflect the worst point through the centroid, going further if that is the new best
+		float reflected[DIM];
+		for (int d = 0; d < DIM; ++d)
+			reflected[d] = 2.0f * centroid[d] - simplex[highest][d];
+		double reflectedError = FitErrorFor(ltc, reflected, isotropic, V, alpha, settings.samples);
+		++evaluations;
+		if (reflectedError < errors[nextHighest])
+		{
+			if (reflectedError < errors[lowest])
+			{
+				float expanded[DIM];
+				for (int d = 0; d < DIM; ++d)
+					expanded[d] = 3.0f * centroid[d] - 2.0f * simplex[highest][d];
+				double expandedError = FitErrorFor(ltc, expanded, isotropic, V, alpha, settings.samples);
+				++evaluations;
+				if (expandedError < reflectedError)
+				{
+					memcpy(simplex[highest], expanded, sizeof(expanded));
+					errors[highest] = expandedError;
+					continue;
+				}
+			}
+			memcpy(simplex[highest], reflected, sizeof(reflected));
+			errors[highest] = reflectedError;
+			continue;
+		}
+
+		// Pull the worst point towards the centroid
+		float contracted[DIM];
+		for (int d = 0; d < DIM; ++d)
+			contracted[d] = 0.5f * (centroid[d] + simplex[highest][d]);
+		double contractedError = FitErrorFor(ltc, contracted, isotropic, V, alpha, settings.samples);
+		++evaluations;
+		if (contractedError < errors[highest])
+		{
+			memcpy(simplex[highest], contracted, sizeof(contracted));
+			errors[highest] = contractedError;
+			continue;
+		}
+
+		// Otherwise shrink everything towards the best point
+		for (int p = 0; p <= DIM; ++p)
+		{
+			if (p == lowest)
+				continue;
+			for (int d = 0; d < DIM; ++d)
+				simplex[p][d] = 0.5f * (simplex[lowest][d] + simplex[p][d]);
+			errors[p] = FitErrorFor(ltc, simplex[p], isotropic, V, alpha, settings.samples);
+			++evaluations;
+		}
+	}
+
+	lowest = 0;
+	for (int p = 1; p <= DIM; ++p)
+	{
+		if (errors[p] < errors[lowest])
+			lowest = p;
+	}
+	FitErrorFor(ltc, simplex[lowest], isotropic, V, alpha, settings.samples);
+	return errors[lowest];
+}
+
+// Fits one entry, starting from the parameters in params and leaving the result there
+static void FitEntry(int roughnessIndex, int viewIndex, const LTCFitSettings& settings, glm::vec3& params, LTCTable& table,
+	unsigned long long& evaluations)
+{
+	int size = settings.size;
+	float x = (float)viewIndex / (size - 1);
+	float theta = std::min(1.57f, (float)acos(1.0f - x * x));
+	glm::vec3 V = glm::vec3(sin(theta), 0.0f, cos(theta));
+
+	float roughness = (float)roughnessIndex / (size - 1);
+	float alpha = std::max(roughness * roughness, MIN_ALPHA);
+
+	LTC ltc;
+	glm::vec3 averageDir;
+	AverageTerms(V, alpha, settings.samples, ltc.magnitude, ltc.fresnel, averageDir);
+
+	// Away from normal incidence the distribution is centered on the lobe's average direction
+	bool isotropic = viewIndex == 0;
+	if (!isotropic)
+	{
+		ltc.X = glm::vec3(averageDir.z, 0.0f, -averageDir.x);
+		ltc.Y = glm::vec3(0.0f, 1.0f, 0.0f);
+		ltc.Z = averageDir;
+	}
+
+	float start[3] = { params.x, params.y, params.z };
+	NelderMead(ltc, start, isotropic, V, alpha, settings, evaluations);
+	params = glm::vec3(ltc.m11, ltc.m22, ltc.m13);
+
+	glm::mat3 invM = glm::inverse(ltc.M);
+	invM /= invM[1][1];
+
+	int entry = roughnessIndex + viewIndex * size;
+	float* matrix = &table.matrices[entry * 4];
+	matrix[0] = invM[0][0];
+	matrix[1] = invM[0][2];
+	matrix[2] = invM[2][0];
+	matrix[3] = invM[2][2];
+
+	float* magnitude = &table.magnitudes[entry * 4];
+	magnitude[0] = ltc.magnitude;
+	magnitude[1] = ltc.fresnel;
+	magnitude[2] = 0.0f;
+	magnitude[3] = 0.0f;
+}
+
+bool LTCFitter::Fit(const LTCFitSettings& settings, LTCTable& table, LTCFitStats* stats)
+{
+	int size = settings.size;
+	if (size < 2 || settings.samples < 1)
+		return false;
+
+	Clock::time_point start = Clock::now();
+	table.size = size;
+	table.matrices.assign((size_t)size * size * 4, 0.0f);
+	table.magnitudes.assign((size_t)size * size * 4, 0.0f);
+
+	WorkerPool pool(settings.numThreads);
+	std::vector<unsigned long long> evaluations(pool.numThreads(), 0);
+
+	// Normal incidence, from rough to smooth, each starting from the rougher one
+	std::vector<glm::vec3> columnParams(size);
+	glm::vec3 params = glm::vec3(1.0f, 1.0f, 0.0f);
+	for (int r = size - 1; r >= 0; --r)
+	{
+		FitEntry(r, 0, settings, params, table, evaluations[0]);
+		columnParams[r] = params;
+	}
+
+	// Then every roughness across the view angles, each starting from the previous angle
+	pool.ParallelFor(size, [&](int begin, int end, int thread)
+	{
+		for (int r = begin; r < end; ++r)
+		{
+			glm::vec3 rowParams = columnParams[r];
+			for (int v = 1; v < size; ++v)
+				FitEntry(r, v, settings, rowParams, table, evaluations[thread]);
+		}
+	}, 1);
+
+	if (stats)
+	{
+		*stats = LTCFitStats();
+		stats->entries = size * size;
+		for (unsigned int i = 0; i < evaluations.size(); ++i)
+			stats->errorEvaluations += evaluations[i];
+		stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	return true;
+}
+
+bool LTCFitter::Save(const char* fileName, const LTCFitSettings& settings, const LTCTable& table)
+{
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	LTCCacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.size = table.size;
+	header.samples = settings.samples;
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&table.matrices[0], table.matrices.size() * sizeof(float));
+	file.write((const char*)&table.magnitudes[0], table.magnitudes.size() * sizeof(float));
+	return !file.fail();
+}
+
+bool LTCFitter::Load(const char* fileName, const LTCFitSettings& settings, LTCTable& table)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	LTCCacheHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) || header.version != CACHE_VERSION
+		|| header.size != settings.size || header.samples != settings.samples)
+		return false;
+
+	table.size = header.size;
+	table.matrices.resize((size_t)header.size * header.size * 4);
+	table.magnitudes.resize((size_t)header.size * header.size * 4);
+	file.read((char*)&table.matrices[0], table.matrices.size() * sizeof(float));
+	file.read((char*)&table.magnitudes[0], table.magnitudes.size() * sizeof(float));
+	return !file.fail();
+}
+
+bool LTCFitter::LoadOrFit(const char* fileName, const LTCFitSettings& settings, LTCTable& table, LTCFitStats* stats)
+{
+	if (Load(fileName, settings, table))
+	{
+		if (stats)
+		{
+			*stats = LTCFitStats();
+			stats->entries = table.size * table.size;
+			stats->loaded = true;
+		}
+		return true;
+	}
+
+	if (!Fit(settings, table, stats))
+		return false;
+	if (!Save(fileName, settings, table))
+		std::cout << "Couldn't cache the LTC tables in " << fileName << std::endl;
+	return true;
+}
+
+void LTCFitter::PrintStats(const LTCFitStats& stats)
+{
+	if (stats.loaded)
+	{
+		std::cout << "LTC tables: " << stats.entries << " entries loaded from the cache" << std::endl;
+		return;
+	}
+	std::cout << "LTC tables: fitted " << stats.entries << " entries in " << stats.seconds << " s, " << stats.errorEvaluations << " error evaluations" << std::endl;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+struct LTCFitSettings
+{
+	// Entries along each side of the tables: roughness across, view angle down. Bilinear
+	// filtering makes up for most of the difference to the usual 64; 32 fits four times faster.
+	int size = 32;
+
+	// Each error evaluation takes samples^2 directions from both the BRDF and the fitted
+	// distribution
+	int samples = 32;
+
+	int maxIterations = 100;
+
+	// 0 uses one thread per core
+	int numThreads = 0;
+};
+
+struct LTCFitStats
+{
+	int entries = 0;
+	unsigned long long errorEvaluations = 0;
+	double seconds = 0.0;
+	bool loaded = false;
+};
+
+// Lookup tables for shading with linearly transformed cosines: for every roughness and view
+// angle, the inverse of the 3x3 matrix that turns a clamped cosine distribution into the GGX
+// specular lobe, plus the lobe's magnitude. Entry (roughness r, view v) is at r + v * size, and
+// the view angle is indexed by sqrt(1 - cos theta), which spends more entries near grazing.
+struct LTCTable
+{
+	int size = 0;
+
+	// The inverse matrix divided by its middle element, which leaves four values that matter:
+	// m00, m02, m20 and m22 in column major order, as a shader rebuilds it
+	std::vector<float> matrices;
+
+	// Directional albedo of the lobe and the part of it weighted by Schlick's (1 - VdotH)^5,
+	// then two unused values so both tables are RGBA
+	std::vector<float> magnitudes;
+};
+
+// Fits the tables the way Heitz et al. do in "Real-Time Polygonal-Light Shading with Linearly
+// Transformed Cosines": each entry is found with a Nelder-Mead search over the matrix, starting
+// from its neighbor's solution, that minimizes the difference between the two distributions
+// where either one puts its samples. Entries at normal incidence depend on the next rougher
+// one, so that column is fitted first; each roughness is then fitted across the view angles
+// on its own thread.
+//
+// Fitting takes a while, so the tables are cached in a file and only fitted again when the
+// file is missing or was made with different settings.
+class LTCFitter
+{
+public:
+	static bool Fit(const LTCFitSettings& settings, LTCTable& table, LTCFitStats* stats = nullptr);
+
+	static bool Save(const char* fileName, const LTCFitSettings& settings, const LTCTable& table);
+
+	// Fails if the file is missing, damaged, or holds tables of another size or sample count
+	static bool Load(const char* fileName, const LTCFitSettings& settings, LTCTable& table);
+
+	// Loads the cached tables, or fits and caches them
+	static bool LoadOrFit(const char* fileName, const LTCFitSettings& settings, LTCTable& table, LTCFitStats* stats = nullptr);
+
+	static void PrintStats(const LTCFitStats& stats);
+};
@@ -0,0 +1,148 @@
+#include "LightManager.h"
+#include "GLState.h"
+
+#include <GLM/gtc/matrix_transform.hpp>
+#include <GLM/gtc/type_ptr.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+bool LightManager::_active = false;
+AreaLightSettings LightManager::_settings;
+LTCFitStats LightManager::_fitStats;
+int LightManager::_tableSize = 0;
+GLuint LightManager::_matrixTexture = 0;
+GLuint LightManager::_magnitudeTexture = 0;
+std::vector<AreaLight> LightManager::_areaLights;
+std::vector<glm::vec3> LightManager::_polygonVerts;
+
+static GLuint CreateTableTexture(int size, const std::vector<float>& data)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	GLState::BindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size, size, 0, GL_RGBA, GL_FLOAT, &data[0]);
+	GLState::BindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+bool LightManager::Init(const AreaLightSettings& settings)
+{
+	if (_active)
+		DumpData();
+
+	_settings = settings;
+
+	LTCTable table;
+	if (!LTCFitter::LoadOrFit(settings.cacheFile, settings.fit, table, &_fitStats))
+		return false;
+
+	_tableSize = table.size;
+	_matrixTexture = CreateTableTexture(table.size, table.matrices);
+	_magnitudeTexture = CreateTableTexture(table.size, table.magnitudes);
+	_polygonVerts.resize(MAX_AREA_LIGHTS * MAX_POLYGON_VERTS);
+	_active = true;
+	return true;
+}
+
+std::vector<AreaLight>& LightManager::areaLights()
+{
+	return _areaLights;
+}
+
+void LightManager::Bind(GLuint shaderProgram, const glm::mat4& projMat, const glm::mat4& viewMat)
+{
+	// The shader only gets clip space positions and projected normals, which these turn back
+	// into world space. Normals it bends in world space go back through the projection.
+	glm::mat4 invViewProj = glm::inverse(projMat * viewMat);
+	glm::mat4 invProj = glm::inverse(projMat);
+	glm::vec3 cameraPos = glm::vec3(glm::inverse(viewMat)[3]);
+
+	GLState::UseProgram(shaderProgram);
+	GLState::UniformMatrix4fv(glGetUniformLocation(shaderProgram, "invViewProj"), 1, GL_FALSE, glm::value_ptr(invViewProj));
+	GLState::UniformMatrix4fv(glGetUniformLocation(shaderProgram, "invProj"), 1, GL_FALSE, glm::value_ptr(invProj));
+	GLState::UniformMatrix4fv(glGetUniformLocation(shaderProgram, "projMat"), 1, GL_FALSE, glm::value_ptr(projMat));
+	GLState::Uniform3fv(glGetUniformLocation(shaderProgram, "cameraPos"), 1, glm::value_ptr(cameraPos));
+
+	// Set with or without lights, like the light probes' samplers
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "ltcMatrix"), LTC_TEXTURE_UNIT);
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "ltcMagnitude"), LTC_TEXTURE_UNIT + 1);
+
+	int count = _active ? std::min((int)_areaLights.size(), (int)MAX_AREA_LIGHTS) : 0;
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "areaLightCount"), count);
+	if (count == 0)
+		return;
+
+	// Every light becomes a polygon, wound clockwise seen from the side it shines on, which is
+	// the side the shader's integral comes out positive for. Disks become octagons of equal area.
+	GLint vertCounts[MAX_AREA_LIGHTS];
+	GLint twoSided[MAX_AREA_LIGHTS];
+	glm::vec3 colors[MAX_AREA_LIGHTS];
+	float diskScale = std::sqrt(2.0f * 3.14159265f / (MAX_POLYGON_VERTS * std::sin(2.0f * 3.14159265f / MAX_POLYGON_VERTS)));
+	for (int i = 0; i < count; ++i)
+	{
+		const AreaLight& light = _areaLights[i];
+		glm::vec3* verts = &_polygonVerts[i * MAX_POLYGON_VERTS];
+		if (light.shape == AreaLightShape::Rectangle)
+		{
+			verts[0] = light.center - light.right - light.up;
+			verts[1] = light.center - light.right + light.up;
+			verts[2] = light.center + light.right + light.up;
+			verts[3] = light.center + light.right - light.up;
+			vertCounts[i] = 4;
+		}
+		else
+		{
+			for (int v = 0; v < MAX_POLYGON_VERTS; ++v)
+			{
+				float angle = 2.0f * 3.14159265f * v / MAX_POLYGON_VERTS;
+				verts[v] = light.center + (light.right * std::cos(angle) - light.up * std::sin(angle)) * diskScale;
+			}
+			vertCounts[i] = MAX_POLYGON_VERTS;
+		}
+		twoSided[i] = light.twoSided ? 1 : 0;
+		colors[i] = light.color * light.intensity;
+	}
+
+	GLState::Uniform3fv(glGetUniformLocation(shaderProgram, "areaLightVerts"), count * MAX_POLYGON_VERTS, glm::value_ptr(_polygonVerts[0]));
+	GLState::Uniform1iv(glGetUniformLocation(shaderProgram, "areaLightVertCount"), count, vertCounts);
+	GLState::Uniform1iv(glGetUniformLocation(shaderProgram, "areaLightTwoSided"), count, twoSided);
+	GLState::Uniform3fv(glGetUniformLocation(shaderProgram, "areaLightColor"), count, glm::value_ptr(colors[0]));
+	GLState::Uniform1f(glGetUniformLocation(shaderProgram, "areaRoughness"), _settings.roughness);
+	GLState::Uniform1f(glGetUniformLocation(shaderProgram, "areaSpecular"), _settings.specular);
+	GLState::Uniform1f(glGetUniformLocation(shaderProgram, "ltcSize"), (float)_tableSize);
+
+	GLState::ActiveTexture(GL_TEXTURE0 + LTC_TEXTURE_UNIT);
+	GLState::BindTexture(GL_TEXTURE_2D, _matrixTexture);
+	GLState::ActiveTexture(GL_TEXTURE0 + LTC_TEXTURE_UNIT + 1);
+	GLState::BindTexture(GL_TEXTURE_2D, _magnitudeTexture);
+	GLState::ActiveTexture(GL_TEXTURE0);
+}
+
+void LightManager::DumpData()
+{
+	if (_active)
+	{
+		GLState::DeleteTextures(1, &_matrixTexture);
+		GLState::DeleteTextures(1, &_magnitudeTexture);
+	}
+	_areaLights.clear();
+	_polygonVerts.clear();
+	_active = false;
+}
+
+bool LightManager::active()
+{
+	return _active;
+}
+
+void LightManager::PrintStats()
+{
+	LTCFitter::PrintStats(_fitStats);
+	std::cout << "Area lights: " << _areaLights.size() << " (" << std::min((int)_areaLights.size(), (int)MAX_AREA_LIGHTS) << " drawn), roughness "
+		<< _settings.roughness << std::endl;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "LTCFitter.h"
+
+#include <GLEW/GL/glew.h>
+#include <GLM/glm.hpp>
+#include <vector>
+
+enum class AreaLightShape
+{
+	Rectangle,
+	Disk
+};
+
+// A flat light of uniform radiance. Rectangles span center +- right +- up; disks (or ellipses)
+// have right and up as radii. The light shines towards cross(right, up), or both ways if
+// twoSided is set.
+struct AreaLight
+{
+	AreaLightShape shape = AreaLightShape::Rectangle;
+	glm::vec3 center = glm::vec3();
+	glm::vec3 right = glm::vec3(0.5f, 0.0f, 0.0f);
+	glm::vec3 up = glm::vec3(0.0f, 0.5f, 0.0f);
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+	float intensity = 1.0f;
+	bool twoSided = false;
+};
+
+struct AreaLightSettings
+{
+	// Surface the area lights shade: GGX roughness, and reflectance at normal incidence
+	float roughness = 0.4f;
+	float specular = 0.04f;
+
+	// Where the LTC tables are cached between runs
+	const char* cacheFile = "ltc_ggx.bin";
+	LTCFitSettings fit;
+};
+
+// The lights of the scene beyond fShader.glsl's built in point light, and the per frame
+// uniforms the lit shader needs to shade in world space.
+//
+// Area lights are shaded with linearly transformed cosines: the GGX lobe for the surface's
+// roughness and view angle is a clamped cosine under a 3x3 matrix from a lookup table, so
+// transforming a light's polygon by the inverse matrix turns the specular integral over it into
+// a cosine weighted solid angle, which has a closed form per edge. The diffuse term is the same
+// integral without the matrix. Each light costs two polygon integrals in the fragment shader,
+// whatever its size. That is far more than a point light: on llvmpipe at 1280x720 every area
+// light on a close up teapot added about 47 ms to a 50 ms frame, where the built in point light
+// costs about 0.5 ms. Disks are drawn as octagons of the same area.
+class LightManager
+{
+public:
+	// Loads the LTC tables, fitting and caching them the first time, and creates their textures
+	static bool Init(const AreaLightSettings& settings);
+
+	// The area lights, which can be changed freely between frames. Only the first
+	// MAX_AREA_LIGHTS are drawn.
+	static std::vector<AreaLight>& areaLights();
+
+	// Call every frame before drawing with the lit shader, whether or not there are area lights:
+	// it also sets the matrices the shader moves positions and normals to world space and back with
+	static void Bind(GLuint shaderProgram, const glm::mat4& projMat, const glm::mat4& viewMat);
+
+	static void DumpData();
+
+	static bool active();
+	static void PrintStats();
+
+	static const int MAX_AREA_LIGHTS = 8;
+	static const int MAX_POLYGON_VERTS = 8;
+
+	// Follows the light probe textures
+	static const int LTC_TEXTURE_UNIT = 7;
+
+private:
+	static bool _active;
+	static AreaLightSettings _settings;
+	static LTCFitStats _fitStats;
+	static int _tableSize;
+	static GLuint _matrixTexture;
+	static GLuint _magnitudeTexture;
+	static std::vector<AreaLight> _areaLights;
+
+	// Uniform data for the lights, rebuilt every Bind
+	static std::vector<glm::vec3> _polygonVerts;
+};
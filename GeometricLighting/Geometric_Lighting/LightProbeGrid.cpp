@@ -0,0 +1,583 @@
+#include "LightProbeGrid.h"
+#include "GLState.h"
+#include "SplineManager.h"
+#include "B-Spline.h"
+#include "Patch.h"
+#include "PatchEvaluator.h"
+
+#include <GLM/gtc/matrix_transform.hpp>
+#include <GLM/gtc/type_ptr.hpp>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+bool LightProbeGrid::_active = false;
+LightProbeSettings LightProbeGrid::_settings;
+std::vector<ProbeLight> LightProbeGrid::_lights;
+WorkerPool* LightProbeGrid::_pool = nullptr;
+GLuint LightProbeGrid::_textures[LightProbeGrid::NUM_TEXTURES];
+std::vector<float> LightProbeGrid::_texels;
+std::vector<glm::vec3> LightProbeGrid::_directions;
+std::unordered_map<B_Spline*, LightProbeGrid::TraceMesh> LightProbeGrid::_meshes;
+unsigned int LightProbeGrid::_updates = 0;
+std::vector<int> LightProbeGrid::_dirtyQueue;
+std::vector<char> LightProbeGrid::_dirty;
+std::vector<int> LightProbeGrid::_baking;
+std::vector<std::vector<int> > LightProbeGrid::_proxies;
+LightProbeStats LightProbeGrid::_stats;
+
+static const float PI = 3.14159265f;
+
+// Offset of secondary rays off the surface they start on, so they don't hit it again
+static const float RAY_EPSILON = 1e-3f;
+
+static bool Overlaps(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+{
+	return minA.x <= maxB.x && minB.x <= maxA.x && minA.y <= maxB.y && minB.y <= maxA.y && minA.z <= maxB.z && minB.z <= maxA.z;
+}
+
+// Same slab test as DynamicBVH's, for the patch boxes inside a spline
+static bool RayHitsBox(const glm::vec3& origin, const glm::vec3& invDirection, float maxDistance, const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+	glm::vec3 t0 = (minPos - origin) * invDirection;
+	glm::vec3 t1 = (maxPos - origin) * invDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, maxDistance));
+	return enter <= exit;
+}
+
+// Moller-Trumbore, hitting both sides. Returns the distance along the ray or -1.
+static float RayTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+{
+	glm::vec3 edge1 = b - a;
+	glm::vec3 edge2 = c - a;
+	glm::vec3 p = glm::cross(direction, edge2);
+	float det = glm::dot(edge1, p);
+	if (fabs(det) < 1e-12f)
+		return -1.0f;
+
+	float invDet = 1.0f / det;
+	glm::vec3 s = origin - a;
+	float u = glm::dot(s, p) * invDet;
+	if (u < 0.0f || u > 1.0f)
+		return -1.0f;
+
+	glm::vec3 q = glm::cross(s, edge1);
+	float v = glm::dot(direction, q) * invDet;
+	if (v < 0.0f || u + v > 1.0f)
+		return -1.0f;
+
+	return glm::dot(edge2, q) * invDet;
+}
+
+// The nine second order real spherical harmonics at a unit direction
+static void SHBasis(const glm::vec3& n, float* basis)
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * n.y;
+	basis[2] = 0.488603f * n.z;
+	basis[3] = 0.488603f * n.x;
+	basis[4] = 1.092548f * n.x * n.y;
+	basis[5] = 1.092548f * n.y * n.z;
+	basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+	basis[7] = 1.092548f * n.x * n.z;
+	basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+}
+
+void LightProbeGrid::Init(const LightProbeSettings& settings, const std::vector<ProbeLight>& lights)
+{
+	if (_active)
+		DumpData();
+
+	_settings = settings;
+	_settings.resolution = glm::max(_settings.resolution, glm::ivec3(2, 2, 2));
+	_lights = lights;
+	_pool = new WorkerPool(settings.numThreads);
+	_proxies.resize(_pool->numThreads());
+	_stats = LightProbeStats();
+
+	int numProbes = _settings.resolution.x * _settings.resolution.y * _settings.resolution.z;
+	_stats.probes = numProbes;
+	_texels.assign((size_t)NUM_TEXTURES * numProbes * 4, 0.0f);
+	_dirty.assign(numProbes, 0);
+
+	// A spherical Fibonacci spiral spreads any number of directions evenly
+	int numRays = std::max(settings.raysPerProbe, 1);
+	_directions.resize(numRays);
+	float goldenAngle = PI * (3.0f - sqrt(5.0f));
+	for (int i = 0; i < numRays; ++i)
+	{
+		float z = 1.0f - (2.0f * i + 1.0f) / numRays;
+		float r = sqrt(std::max(0.0f, 1.0f - z * z));
+		_directions[i] = glm::vec3(r * cos(goldenAngle * i), r * sin(goldenAngle * i), z);
+	}
+
+	glGenTextures(NUM_TEXTURES, _textures);
+	for (int t = 0; t < NUM_TEXTURES; ++t)
+	{
+		GLState::BindTexture(GL_TEXTURE_3D, _textures[t]);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, _settings.resolution.x, _settings.resolution.y, _settings.resolution.z, 0, GL_RGBA, GL_FLOAT,
+			&_texels[(size_t)t * numProbes * 4]);
+	}
+	GLState::BindTexture(GL_TEXTURE_3D, 0);
+	_stats.gpuBytes = (size_t)NUM_TEXTURES * numProbes * 4 * 2;
+
+	_active = true;
+
+	for (int i = 0; i < numProbes; ++i)
+		MarkDirtyProbe(i);
+
+	Clock::time_point start = Clock::now();
+	++_updates;
+	FindChanges();
+	BakeAll();
+	_stats.fullBakeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void LightProbeGrid::Update()
+{
+	if (!_active)
+		return;
+
+	++_updates;
+	FindChanges();
+	Bake(_settings.probesPerFrame);
+}
+
+void LightProbeGrid::FindChanges()
+{
+	glm::vec3 reachMin = _settings.minPos - glm::vec3(_settings.rayDistance);
+	glm::vec3 reachMax = _settings.maxPos + glm::vec3(_settings.rayDistance);
+	glm::vec3 margin = glm::vec3(_settings.dirtyMargin);
+
+	glm::vec3 minPos, maxPos;
+	int numSplines = SplineManager::numSplines();
+	for (int i = 0; i < numSplines; ++i)
+	{
+		B_Spline* spline = SplineManager::spline(i);
+		spline->Bounds(minPos, maxPos);
+
+		std::unordered_map<B_Spline*, TraceMesh>::iterator found = _meshes.find(spline);
+		bool inReach = Overlaps(minPos, maxPos, reachMin, reachMax);
+		if (found != _meshes.end())
+		{
+			TraceMesh& mesh = found->second;
+			if (inReach && mesh.modelMat == spline->transform().modelMat && mesh.minPos == minPos && mesh.maxPos == maxPos)
+			{
+				mesh.seen = _updates;
+				continue;
+			}
+
+			// Wherever it was is lit differently now
+			MarkDirty(mesh.minPos - margin, mesh.maxPos + margin);
+		}
+		if (!inReach)
+		{
+			if (found != _meshes.end())
+				_meshes.erase(found);
+			continue;
+		}
+
+		MarkDirty(minPos - margin, maxPos + margin);
+		TraceMesh& mesh = _meshes[spline];
+		BuildTraceMesh(spline, mesh);
+		mesh.seen = _updates;
+		++_stats.splineChanges;
+	}
+
+	// Splines no longer in the scene
+	for (std::unordered_map<B_Spline*, TraceMesh>::iterator it = _meshes.begin(); it != _meshes.end();)
+	{
+		if (it->second.seen != _updates)
+		{
+			MarkDirty(it->second.minPos - margin, it->second.maxPos + margin);
+			it = _meshes.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+void LightProbeGrid::BuildTraceMesh(B_Spline* spline, TraceMesh& mesh)
+{
+	int resolution = std::max(_settings.traceResolution, 2);
+	int pointsPerPatch = resolution * resolution;
+	int numPatches = spline->numPatches();
+
+	mesh.modelMat = spline->transform().modelMat;
+	spline->Bounds(mesh.minPos, mesh.maxPos);
+	mesh.points.resize((size_t)numPatches * pointsPerPatch);
+	mesh.patchMin.resize(numPatches);
+	mesh.patchMax.resize(numPatches);
+
+	std::vector<float> verts((size_t)pointsPerPatch * PatchEvaluator::FLOATS_PER_VERT);
+	for (int p = 0; p < numPatches; ++p)
+	{
+		Patch* patch = spline->patch(p);
+		PatchEvaluator::Tessellate(patch->controlPoints(), resolution, &verts[0]);
+
+		const glm::mat4& modelMat = patch->transform().modelMat;
+		glm::vec3 patchMin = glm::vec3(FLT_MAX);
+		glm::vec3 patchMax = glm::vec3(-FLT_MAX);
+		for (int v = 0; v < pointsPerPatch; ++v)
+		{
+			const float* vert = &verts[(size_t)v * PatchEvaluator::FLOATS_PER_VERT];
+			glm::vec3 point = glm::vec3(modelMat * glm::vec4(vert[0], vert[1], vert[2], 1.0f));
+			mesh.points[(size_t)p * pointsPerPatch + v] = point;
+			patchMin = glm::min(patchMin, point);
+			patchMax = glm::max(patchMax, point);
+		}
+		mesh.patchMin[p] = patchMin;
+		mesh.patchMax[p] = patchMax;
+	}
+}
+
+bool LightProbeGrid::Trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<int>& proxies, Hit* hit)
+{
+	const DynamicBVH& tree = SplineManager::tree();
+	proxies.clear();
+	tree.QueryRay(origin, direction, maxDistance, proxies);
+
+	int resolution = std::max(_settings.traceResolution, 2);
+	int pointsPerPatch = resolution * resolution;
+	glm::vec3 invDirection = 1.0f / direction;
+
+	float nearest = maxDistance;
+	bool found = false;
+	for (unsigned int i = 0; i < proxies.size(); ++i)
+	{
+		std::unordered_map<B_Spline*, TraceMesh>::const_iterator mesh = _meshes.find((B_Spline*)tree.userData(proxies[i]));
+		if (mesh == _meshes.end())
+			continue;
+
+		int numPatches = (int)mesh->second.patchMin.size();
+		for (int p = 0; p < numPatches; ++p)
+		{
+			if (!RayHitsBox(origin, invDirection, nearest, mesh->second.patchMin[p], mesh->second.patchMax[p]))
+				continue;
+
+			const glm::vec3* points = &mesh->second.points[(size_t)p * pointsPerPatch];
+			for (int row = 0; row + 1 < resolution; ++row)
+			{
+				for (int col = 0; col + 1 < resolution; ++col)
+				{
+					const glm::vec3& p00 = points[row * resolution + col];
+					const glm::vec3& p01 = points[row * resolution + col + 1];
+					const glm::vec3& p10 = points[(row + 1) * resolution + col];
+					const glm::vec3& p11 = points[(row + 1) * resolution + col + 1];
+
+					float t = RayTriangle(origin, direction, p00, p10, p11);
+					if (t > 0.0f && t < nearest)
+					{
+						nearest = t;
+						found = true;
+						if (!hit)
+							return true;
+						hit->normal = glm::cross(p10 - p00, p11 - p00);
+					}
+					t = RayTriangle(origin, direction, p00, p11, p01);
+					if (t > 0.0f && t < nearest)
+					{
+						nearest = t;
+						found = true;
+						if (!hit)
+							return true;
+						hit->normal = glm::cross(p11 - p00, p01 - p00);
+					}
+				}
+			}
+		}
+	}
+
+	if (found)
+	{
+		hit->distance = nearest;
+
+		// Face the normal back along the ray, whichever way the patch was wound
+		float length = glm::length(hit->normal);
+		hit->normal = length > 0.0f ? hit->normal / length : -direction;
+		if (glm::dot(hit->normal, direction) > 0.0f)
+			hit->normal = -hit->normal;
+	}
+	return found;
+}
+
+// What a ray sees: the sky if it escapes, otherwise the surface it hits lit the way fShader.glsl
+// lights it, by the lights it can see plus the flat ambient
+glm::vec3 LightProbeGrid::Radiance(const glm::vec3& origin, const glm::vec3& direction, std::vector<int>& proxies)
+{
+	Hit hit;
+	if (!Trace(origin, direction, _settings.rayDistance, proxies, &hit))
+		return _settings.skyColor;
+
+	glm::vec3 position = origin + direction * hit.distance + hit.normal * RAY_EPSILON;
+	glm::vec3 irradiance = _settings.skyColor;
+	for (unsigned int i = 0; i < _lights.size(); ++i)
+	{
+		const ProbeLight& light = _lights[i];
+		glm::vec3 toLight = light.position - position;
+		float distance = glm::length(toLight);
+		if (distance <= 0.0f || distance > light.radius)
+			continue;
+
+		glm::vec3 lightDir = toLight / distance;
+		float NdotL = glm::dot(hit.normal, lightDir);
+		if (NdotL <= 0.0f || Trace(position, lightDir, distance, proxies, nullptr))
+			continue;
+
+		irradiance += light.color * (light.power * NdotL / (distance * distance));
+	}
+	return _settings.albedo * irradiance;
+}
+
+void LightProbeGrid::BakeProbe(int probe, std::vector<int>& proxies)
+{
+	glm::vec3 origin = ProbePosition(probe);
+	glm::vec3 coefficients[SH_COEFFICIENTS];
+	float basis[SH_COEFFICIENTS];
+
+	int numRays = (int)_directions.size();
+	for (int r = 0; r < numRays; ++r)
+	{
+		glm::vec3 radiance = Radiance(origin, _directions[r], proxies);
+		SHBasis(_directions[r], basis);
+		for (int c = 0; c < SH_COEFFICIENTS; ++c)
+			coefficients[c] += radiance * basis[c];
+	}
+
+	// Monte Carlo weight of each ray, times the cosine lobe convolution (pi, 2pi/3, pi/4 per
+	// band) over pi, so the shader's dot product gives irradiance / pi, the ambient to use
+	float weight = 4.0f * PI / numRays;
+	float bands[SH_COEFFICIENTS] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (int c = 0; c < SH_COEFFICIENTS; ++c)
+		coefficients[c] *= weight * bands[c];
+
+	size_t numProbes = _dirty.size();
+	for (int channel = 0; channel < 3; ++channel)
+	{
+		float* low = &_texels[((2 * channel) * numProbes + probe) * 4];
+		float* high = &_texels[((2 * channel + 1) * numProbes + probe) * 4];
+		for (int c = 0; c < 4; ++c)
+		{
+			low[c] = coefficients[c][channel];
+			high[c] = coefficients[c + 4][channel];
+		}
+	}
+	float* last = &_texels[(6 * numProbes + probe) * 4];
+	last[0] = coefficients[8].x;
+	last[1] = coefficients[8].y;
+	last[2] = coefficients[8].z;
+	last[3] = 0.0f;
+}
+
+void LightProbeGrid::Bake(int maxProbes)
+{
+	if (_dirtyQueue.empty())
+		return;
+
+	int count = (int)_dirtyQueue.size();
+	if (maxProbes > 0)
+		count = std::min(count, maxProbes);
+	_baking.assign(_dirtyQueue.begin(), _dirtyQueue.begin() + count);
+	_dirtyQueue.erase(_dirtyQueue.begin(), _dirtyQueue.begin() + count);
+
+	int minZ = _settings.resolution.z;
+	int maxZ = -1;
+	int slice = _settings.resolution.x * _settings.resolution.y;
+	for (int i = 0; i < count; ++i)
+	{
+		_dirty[_baking[i]] = 0;
+		minZ = std::min(minZ, _baking[i] / slice);
+		maxZ = std::max(maxZ, _baking[i] / slice);
+	}
+
+	Clock::time_point start = Clock::now();
+	_pool->ParallelFor(count, [](int begin, int end, int thread)
+	{
+		for (int i = begin; i < end; ++i)
+			BakeProbe(_baking[i], _proxies[thread]);
+	}, 4);
+	_stats.bakeSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+	_stats.probesBaked += count;
+	_stats.raysTraced += (unsigned long long)count * _directions.size();
+
+	Upload(minZ, maxZ);
+}
+
+void LightProbeGrid::BakeAll()
+{
+	if (_active)
+		Bake(0);
+}
+
+void LightProbeGrid::Upload(int minZ, int maxZ)
+{
+	size_t numProbes = _dirty.size();
+	size_t slice = (size_t)_settings.resolution.x * _settings.resolution.y;
+	for (int t = 0; t < NUM_TEXTURES; ++t)
+	{
+		GLState::BindTexture(GL_TEXTURE_3D, _textures[t]);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, minZ, _settings.resolution.x, _settings.resolution.y, maxZ - minZ + 1, GL_RGBA, GL_FLOAT,
+			&_texels[(t * numProbes + minZ * slice) * 4]);
+	}
+	GLState::BindTexture(GL_TEXTURE_3D, 0);
+	++_stats.uploads;
+}
+
+void LightProbeGrid::Bind(GLuint shaderProgram)
+{
+	// The samplers get their units even without a grid, since samplers of different types left
+	// on the same unit make every draw fail
+	GLint units[NUM_TEXTURES];
+	for (int t = 0; t < NUM_TEXTURES; ++t)
+		units[t] = t;
+
+	GLState::UseProgram(shaderProgram);
+	GLState::Uniform1iv(glGetUniformLocation(shaderProgram, "probeSH"), NUM_TEXTURES, units);
+
+	if (!_active)
+		return;
+
+	// Probe texture coordinates put each probe on the middle of its texel
+	glm::vec3 resolution = glm::vec3(_settings.resolution);
+	glm::vec3 scale = (resolution - 1.0f) / (resolution * (_settings.maxPos - _settings.minPos));
+	glm::vec3 offset = 0.5f / resolution - _settings.minPos * scale;
+
+	GLState::Uniform3fv(glGetUniformLocation(shaderProgram, "probeScale"), 1, glm::value_ptr(scale));
+	GLState::Uniform3fv(glGetUniformLocation(shaderProgram, "probeOffset"), 1, glm::value_ptr(offset));
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "probesEnabled"), 1);
+
+	for (int t = 0; t < NUM_TEXTURES; ++t)
+	{
+		GLState::ActiveTexture(GL_TEXTURE0 + t);
+		GLState::BindTexture(GL_TEXTURE_3D, _textures[t]);
+	}
+	GLState::ActiveTexture(GL_TEXTURE0);
+}
+
+void LightProbeGrid::SetLights(const std::vector<ProbeLight>& lights)
+{
+	if (!_active)
+	{
+		_lights = lights;
+		return;
+	}
+
+	// A light's reach is dirtied where it was and where it is now
+	unsigned int count = std::max(lights.size(), _lights.size());
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		const ProbeLight* before = i < _lights.size() ? &_lights[i] : nullptr;
+		const ProbeLight* after = i < lights.size() ? &lights[i] : nullptr;
+		if (before && after && before->position == after->position && before->color == after->color
+			&& before->power == after->power && before->radius == after->radius)
+			continue;
+
+		if (before)
+			MarkDirty(before->position - glm::vec3(before->radius), before->position + glm::vec3(before->radius));
+		if (after)
+			MarkDirty(after->position - glm::vec3(after->radius), after->position + glm::vec3(after->radius));
+	}
+	_lights = lights;
+}
+
+void LightProbeGrid::MarkDirty(const glm::vec3& minPos, const glm::vec3& maxPos)
+{
+	if (!_active)
+		return;
+
+	// Grid points inside the box
+	glm::vec3 spacing = (_settings.maxPos - _settings.minPos) / glm::vec3(_settings.resolution - 1);
+	glm::ivec3 first, last;
+	for (int i = 0; i < 3; ++i)
+	{
+		first[i] = std::max(0, (int)ceil((minPos[i] - _settings.minPos[i]) / spacing[i]));
+		last[i] = std::min(_settings.resolution[i] - 1, (int)floor((maxPos[i] - _settings.minPos[i]) / spacing[i]));
+	}
+
+	for (int z = first.z; z <= last.z; ++z)
+	{
+		for (int y = first.y; y <= last.y; ++y)
+		{
+			for (int x = first.x; x <= last.x; ++x)
+				MarkDirtyProbe(x + _settings.resolution.x * (y + _settings.resolution.y * z));
+		}
+	}
+}
+
+void LightProbeGrid::MarkDirtyProbe(int probe)
+{
+	if (_dirty[probe])
+		return;
+	_dirty[probe] = 1;
+	_dirtyQueue.push_back(probe);
+}
+
+glm::vec3 LightProbeGrid::ProbePosition(int probe)
+{
+	int x = probe % _settings.resolution.x;
+	int y = (probe / _settings.resolution.x) % _settings.resolution.y;
+	int z = probe / (_settings.resolution.x * _settings.resolution.y);
+	glm::vec3 t = glm::vec3((float)x, (float)y, (float)z) / glm::vec3(_settings.resolution - 1);
+	return _settings.minPos + (_settings.maxPos - _settings.minPos) * t;
+}
+
+void LightProbeGrid::DumpData()
+{
+	if (!_active)
+		return;
+
+	GLState::DeleteTextures(NUM_TEXTURES, _textures);
+	delete _pool;
+	_pool = nullptr;
+
+	_texels.clear();
+	_directions.clear();
+	_meshes.clear();
+	_dirtyQueue.clear();
+	_dirty.clear();
+	_baking.clear();
+	_proxies.clear();
+	_active = false;
+}
+
+bool LightProbeGrid::active()
+{
+	return _active;
+}
+
+LightProbeStats LightProbeGrid::Stats()
+{
+	LightProbeStats stats = _stats;
+	stats.dirtyProbes = (int)_dirtyQueue.size();
+	stats.traceSplines = (int)_meshes.size();
+	stats.tracePatches = 0;
+	for (std::unordered_map<B_Spline*, TraceMesh>::const_iterator it = _meshes.begin(); it != _meshes.end(); ++it)
+		stats.tracePatches += (int)it->second.patchMin.size();
+	return stats;
+}
+
+void LightProbeGrid::PrintStats()
+{
+	LightProbeStats stats = Stats();
+	std::cout << "Light probes: " << stats.probes << " (" << _settings.resolution.x << " x " << _settings.resolution.y << " x " << _settings.resolution.z
+		<< "), " << stats.dirtyProbes << " waiting for a rebake, " << stats.gpuBytes / 1024 << " KB of textures" << std::endl;
+	std::cout << "  Traced against " << stats.traceSplines << " splines (" << stats.tracePatches << " patches), "
+		<< stats.splineChanges << " spline changes seen" << std::endl;
+	std::cout << "  Initial bake " << stats.fullBakeSeconds * 1000.0 << " ms; " << stats.probesBaked << " probes baked in all, "
+		<< stats.raysTraced << " rays, " << stats.uploads << " uploads" << std::endl;
+	if (stats.bakeSeconds > 0.0)
+		std::cout << "  " << stats.raysTraced / stats.bakeSeconds / 1e6 << " million rays per second, "
+			<< stats.bakeSeconds * 1e6 / stats.probesBaked << " us per probe" << std::endl;
+}
@@ -0,0 +1,169 @@
+#pragma once
+#include "WorkerPool.h"
+
+#include <GLEW/GL/glew.h>
+#include <GLM/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+class B_Spline;
+
+// A point light as fShader.glsl lights things: diffuse power falling off with the square of
+// the distance. Beyond radius it is taken to light nothing, which bounds what moving it dirties.
+struct ProbeLight
+{
+	glm::vec3 position = glm::vec3(8.0f, 0.0f, 0.0f);
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+	float power = 5.0f;
+	float radius = 20.0f;
+};
+
+struct LightProbeSettings
+{
+	// Box the probes fill, with a probe on every grid point including the corners
+	glm::vec3 minPos = glm::vec3(-6.0f, -1.0f, -6.0f);
+	glm::vec3 maxPos = glm::vec3(6.0f, 5.0f, 6.0f);
+	glm::ivec3 resolution = glm::ivec3(16, 8, 16);
+
+	int raysPerProbe = 128;
+
+	// How far rays look for geometry; splines further than this from the box are ignored
+	float rayDistance = 20.0f;
+
+	// Color light bounces off the splines with, and the light arriving from wherever a ray
+	// escapes to. The sky matches fShader.glsl's flat ambient, so open areas look as before.
+	glm::vec3 albedo = glm::vec3(0.6f, 0.6f, 0.6f);
+	glm::vec3 skyColor = glm::vec3(0.3f, 0.3f, 0.3f);
+
+	// Grid points used to trace each patch
+	int traceResolution = 8;
+
+	// A change to the scene dirties the probes within this distance of it
+	float dirtyMargin = 1.5f;
+
+	// Spreads rebaking over frames, so moving things never causes a hitch
+	int probesPerFrame = 256;
+
+	// 0 uses one thread per core
+	int numThreads = 0;
+};
+
+struct LightProbeStats
+{
+	int probes = 0;
+	int dirtyProbes = 0;
+	int traceSplines = 0;
+	int tracePatches = 0;
+	unsigned long long probesBaked = 0;
+	unsigned long long raysTraced = 0;
+	unsigned long long splineChanges = 0;
+	unsigned long long uploads = 0;
+	double bakeSeconds = 0.0;
+	double fullBakeSeconds = 0.0;
+	size_t gpuBytes = 0;
+};
+
+// A grid of irradiance probes that gives the splines the light bouncing between them. Each probe
+// shoots rays from its grid point against the splines in SplineManager's tree, takes the light
+// a hit surface reflects (or the sky, for rays that escape) and projects it onto second order
+// spherical harmonics, pre-convolved with the cosine lobe. The nine RGB coefficients go into
+// seven RGBA 3D textures that fShader.glsl samples with trilinear filtering in place of its flat
+// ambient term.
+//
+// The splines' placement and bounds are compared with what the probes were baked against every
+// Update. Probes near a spline that moved, changed, appeared or went away, or near a light that
+// changed, are queued for rebaking, a few hundred per frame across the worker threads, and only
+// the slices of the textures they are in are uploaded again.
+class LightProbeGrid
+{
+public:
+	// Creates the textures and bakes every probe before returning
+	static void Init(const LightProbeSettings& settings, const std::vector<ProbeLight>& lights);
+
+	// Finds what changed since the last call and rebakes up to probesPerFrame probes
+	static void Update();
+
+	// Sets the uniforms of the lit shader and binds the textures for the coming draws. The
+	// shader finds world space positions with what LightManager::Bind sets.
+	static void Bind(GLuint shaderProgram);
+
+	// Replaces the lights, rebaking around the ones that are new, gone or different
+	static void SetLights(const std::vector<ProbeLight>& lights);
+
+	// Queues the probes in a box for rebaking, for changes Update can't see, such as control
+	// points moving inside the spline's bounds
+	static void MarkDirty(const glm::vec3& minPos, const glm::vec3& maxPos);
+
+	// Bakes every queued probe now
+	static void BakeAll();
+
+	static void DumpData();
+
+	static bool active();
+	static LightProbeStats Stats();
+	static void PrintStats();
+
+	// Four coefficients per texture, RGB interleaved by channel: textures 0 and 1 hold red
+	// coefficients 0-3 and 4-7, 2 and 3 green, 4 and 5 blue, and 6 coefficient 8 of all three
+	static const int NUM_TEXTURES = 7;
+	static const int SH_COEFFICIENTS = 9;
+
+private:
+	// A spline as the probes were last baked against it: each patch as a grid of world space
+	// points with a box around it
+	struct TraceMesh
+	{
+		glm::mat4 modelMat;
+		glm::vec3 minPos;
+		glm::vec3 maxPos;
+		std::vector<glm::vec3> points;
+		std::vector<glm::vec3> patchMin;
+		std::vector<glm::vec3> patchMax;
+		unsigned int seen;
+	};
+
+	struct Hit
+	{
+		float distance;
+		glm::vec3 normal;
+	};
+
+	// Rebuilds the trace meshes of splines that changed and dirties the probes around them
+	static void FindChanges();
+	static void BuildTraceMesh(B_Spline* spline, TraceMesh& mesh);
+	static bool Trace(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<int>& proxies, Hit* hit);
+	static glm::vec3 Radiance(const glm::vec3& origin, const glm::vec3& direction, std::vector<int>& proxies);
+	static void BakeProbe(int probe, std::vector<int>& proxies);
+	static void Bake(int maxProbes);
+	static void Upload(int minZ, int maxZ);
+
+	static glm::vec3 ProbePosition(int probe);
+	static void MarkDirtyProbe(int probe);
+
+private:
+	static bool _active;
+	static LightProbeSettings _settings;
+	static std::vector<ProbeLight> _lights;
+	static WorkerPool* _pool;
+
+	static GLuint _textures[NUM_TEXTURES];
+
+	// CPU copy of the textures, NUM_TEXTURES blocks of RGBA texels
+	static std::vector<float> _texels;
+
+	// Unit directions the rays of every probe go in, spread evenly over the sphere
+	static std::vector<glm::vec3> _directions;
+
+	static std::unordered_map<B_Spline*, TraceMesh> _meshes;
+	static unsigned int _updates;
+
+	// Probes waiting for a rebake, in the order they were dirtied
+	static std::vector<int> _dirtyQueue;
+	static std::vector<char> _dirty;
+	static std::vector<int> _baking;
+
+	// Per thread ray query scratch
+	static std::vector<std::vector<int> > _proxies;
+
+	static LightProbeStats _stats;
+};
@@ -0,0 +1,106 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	_data = nullptr;
+	_size = 0;
+#ifdef _WIN32
+	_file = INVALID_HANDLE_VALUE;
+	_mapping = nullptr;
+#else
+	_file = -1;
+#endif
+}
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+
+#ifdef _WIN32
+	_file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	_size = (size_t)fileSize.QuadPart;
+
+	_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!_mapping)
+	{
+		Close();
+		return false;
+	}
+
+	_data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	_file = open(fileName, O_RDONLY);
+	if (_file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(_file, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	_size = (size_t)info.st_size;
+
+	void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+	_data = data == MAP_FAILED ? nullptr : (const char*)data;
+	if (_data)
+		madvise(data, _size, MADV_SEQUENTIAL);
+#endif
+
+	if (!_data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+#else
+	if (_data)
+		munmap((void*)_data, _size);
+	if (_file >= 0)
+		close(_file);
+	_file = -1;
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+const char* MappedFile::data() { return _data; }
+size_t MappedFile::size() { return _size; }
+bool MappedFile::isOpen() { return _data != nullptr; }
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+// Read only memory mapping of a whole file. The OS pages the file in as it is touched, which
+// avoids copying large assets through a read buffer before parsing them.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* fileName);
+	void Close();
+
+	const char* data();
+	size_t size();
+	bool isOpen();
+
+private:
+	// Not copyable, the mapping has a single owner
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+private:
+	const char* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#else
+	int _file;
+#endif
+};
@@ -0,0 +1,489 @@
+#include "MeshExporter.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+// Space reserved at the front of a .glb for its JSON chunk. The JSON is written last, once the
+// vertex and triangle counts are known, and padded with spaces to exactly this size.
+static const int GLB_JSON_RESERVED = 2048;
+
+// Quantized position used to find vertices shared along patch seams
+struct WeldKey
+{
+	long long x, y, z;
+	bool operator==(const WeldKey& other) const { return x == other.x && y == other.y && z == other.z; }
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey& key) const
+	{
+		return (size_t)(key.x * 73856093LL ^ key.y * 19349663LL ^ key.z * 83492791LL);
+	}
+};
+
+// Formatted output for a contiguous run of patches within a batch
+struct ExportChunk
+{
+	std::string vertexData;
+	std::string faceData;
+	unsigned long long triangles;
+	glm::vec3 minPos;
+	glm::vec3 maxPos;
+};
+
+static void AppendBytes(std::string& out, const void* data, size_t size)
+{
+	out.append((const char*)data, size);
+}
+
+static void AppendUInt(std::string& out, unsigned long long value)
+{
+	char digits[24];
+	int len = 0;
+	do
+	{
+		digits[len++] = '0' + (char)(value % 10);
+		value /= 10;
+	} while (value);
+
+	while (len)
+		out += digits[--len];
+}
+
+// Fixed six decimal places with trailing zeros trimmed. Much quicker than printf and
+// plenty for positions and unit normals.
+static void AppendFloat(std::string& out, float value)
+{
+	if (value != value)
+		value = 0.0f;
+
+	if (fabs(value) >= 1e9f)
+	{
+		char buffer[32];
+		int len = sprintf(buffer, "%g", value);
+		out.append(buffer, len);
+		return;
+	}
+
+	if (value < 0.0f)
+	{
+		out += '-';
+		value = -value;
+	}
+
+	long long scaled = (long long)((double)value * 1000000.0 + 0.5);
+	AppendUInt(out, scaled / 1000000);
+
+	int fraction = (int)(scaled % 1000000);
+	if (fraction)
+	{
+		char digits[6];
+		for (int i = 5; i >= 0; --i)
+		{
+			digits[i] = '0' + (char)(fraction % 10);
+			fraction /= 10;
+		}
+
+		int len = 6;
+		while (digits[len - 1] == '0')
+			--len;
+
+		out += '.';
+		out.append(digits, len);
+	}
+}
+
+static bool IsBorderVertex(int vert, int resolution)
+{
+	int row = vert / resolution;
+	int column = vert % resolution;
+	return row == 0 || column == 0 || row == resolution - 1 || column == resolution - 1;
+}
+
+static std::string PlyHeader(unsigned long long numVertices, unsigned long long numTriangles)
+{
+	// Counts are zero padded to a fixed width so the header can be rewritten in place at the end
+	char counts[2][32];
+	sprintf(counts[0], "%010llu", numVertices);
+	sprintf(counts[1], "%010llu", numTriangles);
+
+	std::string header = "ply\nformat binary_little_endian 1.0\ncomment Geometric_Lighting bezier patch export\n";
+	header += "element vertex ";
+	header += counts[0];
+	header += "\nproperty float x\nproperty float y\nproperty float z\n";
+	header += "property float nx\nproperty float ny\nproperty float nz\n";
+	header += "element face ";
+	header += counts[1];
+	header += "\nproperty list uchar uint vertex_indices\nend_header\n";
+	return header;
+}
+
+static std::string GlbJson(unsigned long long numVertices, unsigned long long numTriangles, glm::vec3 minPos, glm::vec3 maxPos)
+{
+	unsigned long long vertexBytes = numVertices * 24;
+	unsigned long long indexBytes = numTriangles * 12;
+
+	char buffer[GLB_JSON_RESERVED];
+	sprintf(buffer,
+		"{\"asset\":{\"version\":\"2.0\",\"generator\":\"Geometric_Lighting\"},"
+		"\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+		"\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2}]}],"
+		"\"buffers\":[{\"byteLength\":%llu}],"
+		"\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%llu,\"byteStride\":24,\"target\":34962},"
+		"{\"buffer\":0,\"byteOffset\":%llu,\"byteLength\":%llu,\"target\":34963}],"
+		"\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\","
+		"\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+		"{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5126,\"count\":%llu,\"type\":\"VEC3\"},"
+		"{\"bufferView\":1,\"byteOffset\":0,\"componentType\":5125,\"count\":%llu,\"type\":\"SCALAR\"}]}",
+		vertexBytes + indexBytes, vertexBytes, vertexBytes, indexBytes, numVertices,
+		minPos.x, minPos.y, minPos.z, maxPos.x, maxPos.y, maxPos.z,
+		numVertices, numTriangles * 3);
+
+	std::string json = buffer;
+	json.resize(GLB_JSON_RESERVED, ' ');
+	return json;
+}
+
+static void WriteUInt32(std::ostream& out, unsigned int value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	out.write((const char*)bytes, 4);
+}
+
+bool MeshExporter::Export(int numPatches, const PatchSource& source, const char* fileName, const MeshExportOptions& options, MeshExportStats* stats)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	MeshFormat format = options.format;
+	int resolution = std::max(2, options.resolution);
+	int vertsPerPatch = PatchEvaluator::NumVerts(resolution);
+	int elementsPerPatch = PatchEvaluator::NumElements(resolution);
+	int batchSize = std::max(1, options.patchesPerBatch);
+
+	std::ofstream out(fileName, std::ios::binary);
+	if (!out)
+		return false;
+
+	// PLY and glTF want every vertex before any triangle, so triangles are spooled to a
+	// temporary file and appended once the vertices are done
+	std::string faceFileName = std::string(fileName) + ".faces.tmp";
+	std::ofstream faceOut;
+	if (format != MeshFormat::OBJ)
+	{
+		faceOut.open(faceFileName.c_str(), std::ios::binary);
+		if (!faceOut)
+			return false;
+	}
+
+	std::vector<unsigned int> gridElements(elementsPerPatch);
+	PatchEvaluator::GenerateElements(resolution, &gridElements[0]);
+
+	WorkerPool pool(options.numThreads);
+	int numChunks = pool.numThreads() * 4;
+
+	std::vector<glm::vec3> controlPoints(batchSize * 16);
+	std::vector<float> verts(batchSize * vertsPerPatch * PatchEvaluator::FLOATS_PER_VERT);
+	std::vector<unsigned int> vertexIndex(batchSize * vertsPerPatch);
+	std::vector<unsigned char> emitVertex(batchSize * vertsPerPatch);
+	std::vector<ExportChunk> chunks(numChunks);
+
+	// Each key's vertex index and the last batch that used it
+	typedef std::unordered_map<WeldKey, std::pair<unsigned int, int>, WeldKeyHash> WeldMap;
+	WeldMap weldMap;
+	int weldWindow = std::max(1, options.weldWindow);
+	size_t peakWeldBytes = 0;
+	double weldScale = 1.0 / std::max((double)options.weldTolerance, 1e-12);
+
+	unsigned long long numVertices = 0;
+	unsigned long long numTriangles = 0;
+	glm::vec3 minPos(FLT_MAX, FLT_MAX, FLT_MAX);
+	glm::vec3 maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	size_t peakBufferBytes = 0;
+
+	// Placeholder headers, rewritten with the real counts at the end
+	if (format == MeshFormat::PLY)
+	{
+		std::string header = PlyHeader(0, 0);
+		out.write(header.data(), header.size());
+	}
+	else if (format == MeshFormat::GLB)
+	{
+		std::vector<char> placeholder(12 + 8 + GLB_JSON_RESERVED + 8, 0);
+		out.write(&placeholder[0], placeholder.size());
+	}
+	else
+	{
+		out << "# Geometric_Lighting bezier patch export\n";
+	}
+
+	for (int batchStart = 0; batchStart < numPatches; batchStart += batchSize)
+	{
+		int batchCount = std::min(batchSize, numPatches - batchStart);
+		int batch = batchStart / batchSize;
+
+		// Control points are gathered on this thread since the source may not be thread safe
+		for (int p = 0; p < batchCount; ++p)
+		{
+			source(batchStart + p, &controlPoints[p * 16]);
+		}
+
+		pool.ParallelFor(batchCount, [&](int begin, int end, int)
+		{
+			PatchEvaluator::TessellateBatch(&controlPoints[begin * 16], end - begin, resolution, &verts[begin * vertsPerPatch * PatchEvaluator::FLOATS_PER_VERT]);
+		});
+
+		// Vertex indices have to follow file order, so they are handed out on one thread
+		for (int p = 0; p < batchCount; ++p)
+		{
+			for (int v = 0; v < vertsPerPatch; ++v)
+			{
+				int local = p * vertsPerPatch + v;
+				if (options.weld && IsBorderVertex(v, resolution))
+				{
+					const float* pos = &verts[local * PatchEvaluator::FLOATS_PER_VERT];
+					WeldKey key;
+					key.x = (long long)floor(pos[0] * weldScale + 0.5);
+					key.y = (long long)floor(pos[1] * weldScale + 0.5);
+					key.z = (long long)floor(pos[2] * weldScale + 0.5);
+
+					WeldMap::iterator found = weldMap.find(key);
+					if (found != weldMap.end())
+					{
+						vertexIndex[local] = found->second.first;
+						emitVertex[local] = 0;
+						found->second.second = batch;
+						continue;
+					}
+					weldMap[key] = std::make_pair((unsigned int)numVertices, batch);
+				}
+				vertexIndex[local] = (unsigned int)numVertices++;
+				emitVertex[local] = 1;
+			}
+		}
+
+		// Format each chunk of patches into its own buffer in parallel
+		int chunkCount = std::min(numChunks, batchCount);
+		pool.ParallelFor(chunkCount, [&](int begin, int end, int)
+		{
+			for (int c = begin; c < end; ++c)
+			{
+				ExportChunk& chunk = chunks[c];
+				chunk.vertexData.clear();
+				chunk.faceData.clear();
+				chunk.triangles = 0;
+				chunk.minPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+				chunk.maxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+				int firstPatch = batchCount * c / chunkCount;
+				int lastPatch = batchCount * (c + 1) / chunkCount;
+				for (int p = firstPatch; p < lastPatch; ++p)
+				{
+					for (int v = 0; v < vertsPerPatch; ++v)
+					{
+						int local = p * vertsPerPatch + v;
+						if (!emitVertex[local])
+							continue;
+
+						const float* vert = &verts[local * PatchEvaluator::FLOATS_PER_VERT];
+						glm::vec3 pos(vert[0], vert[1], vert[2]);
+						chunk.minPos = glm::min(chunk.minPos, pos);
+						chunk.maxPos = glm::max(chunk.maxPos, pos);
+
+						if (format == MeshFormat::OBJ)
+						{
+							chunk.vertexData += "v ";
+							AppendFloat(chunk.vertexData, vert[0]);
+							chunk.vertexData += ' ';
+							AppendFloat(chunk.vertexData, vert[1]);
+							chunk.vertexData += ' ';
+							AppendFloat(chunk.vertexData, vert[2]);
+							chunk.vertexData += "\nvn ";
+							AppendFloat(chunk.vertexData, vert[3]);
+							chunk.vertexData += ' ';
+							AppendFloat(chunk.vertexData, vert[4]);
+							chunk.vertexData += ' ';
+							AppendFloat(chunk.vertexData, vert[5]);
+							chunk.vertexData += '\n';
+						}
+						else
+						{
+							AppendBytes(chunk.vertexData, vert, sizeof(float) * 6);
+						}
+					}
+
+					const unsigned int* patchIndex = &vertexIndex[p * vertsPerPatch];
+					for (int e = 0; e < elementsPerPatch; e += 3)
+					{
+						unsigned int tri[3] = { patchIndex[gridElements[e]], patchIndex[gridElements[e + 1]], patchIndex[gridElements[e + 2]] };
+
+						// Welding collapses the triangles along degenerate patch edges (the teapot's lid and bottom)
+						if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+							continue;
+
+						if (format == MeshFormat::OBJ)
+						{
+							chunk.faceData += 'f';
+							for (int k = 0; k < 3; ++k)
+							{
+								chunk.faceData += ' ';
+								AppendUInt(chunk.faceData, tri[k] + 1);
+								chunk.faceData += "//";
+								AppendUInt(chunk.faceData, tri[k] + 1);
+							}
+							chunk.faceData += '\n';
+						}
+						else if (format == MeshFormat::PLY)
+						{
+							chunk.faceData += (char)3;
+							AppendBytes(chunk.faceData, tri, sizeof(tri));
+						}
+						else
+						{
+							AppendBytes(chunk.faceData, tri, sizeof(tri));
+						}
+						chunk.triangles++;
+					}
+				}
+			}
+		}, 1);
+
+		// Chunks go out in order so the file matches the indices handed out above
+		size_t bufferBytes = 0;
+		for (int c = 0; c < chunkCount; ++c)
+		{
+			ExportChunk& chunk = chunks[c];
+			out.write(chunk.vertexData.data(), chunk.vertexData.size());
+			if (format == MeshFormat::OBJ)
+				out.write(chunk.faceData.data(), chunk.faceData.size());
+			else
+				faceOut.write(chunk.faceData.data(), chunk.faceData.size());
+
+			numTriangles += chunk.triangles;
+			minPos = glm::min(minPos, chunk.minPos);
+			maxPos = glm::max(maxPos, chunk.maxPos);
+			bufferBytes += chunk.vertexData.capacity() + chunk.faceData.capacity();
+		}
+
+		bufferBytes += controlPoints.size() * sizeof(glm::vec3) + verts.size() * sizeof(float);
+		bufferBytes += vertexIndex.size() * sizeof(unsigned int) + emitVertex.size();
+		peakBufferBytes = std::max(peakBufferBytes, bufferBytes);
+
+		if (options.weld)
+		{
+			size_t weldBytes = weldMap.size() * (sizeof(WeldKey) + sizeof(std::pair<unsigned int, int>) + 2 * sizeof(void*)) + weldMap.bucket_count() * sizeof(void*);
+			peakWeldBytes = std::max(peakWeldBytes, weldBytes);
+
+			// Keys no patch of the window used are done with, unless a patch much further on shares them
+			for (WeldMap::iterator it = weldMap.begin(); it != weldMap.end();)
+			{
+				if (it->second.second <= batch - weldWindow)
+					it = weldMap.erase(it);
+				else
+					++it;
+			}
+		}
+	}
+
+	if (format != MeshFormat::OBJ)
+	{
+		faceOut.close();
+
+		std::ifstream faceIn(faceFileName.c_str(), std::ios::binary);
+		std::vector<char> block(1 << 20);
+		while (faceIn)
+		{
+			faceIn.read(&block[0], block.size());
+			out.write(&block[0], faceIn.gcount());
+		}
+		faceIn.close();
+		remove(faceFileName.c_str());
+
+		if (numVertices == 0)
+		{
+			minPos = glm::vec3();
+			maxPos = glm::vec3();
+		}
+
+		out.seekp(0);
+		if (format == MeshFormat::PLY)
+		{
+			std::string header = PlyHeader(numVertices, numTriangles);
+			out.write(header.data(), header.size());
+		}
+		else
+		{
+			unsigned long long binBytes = numVertices * 24 + numTriangles * 12;
+			std::string json = GlbJson(numVertices, numTriangles, minPos, maxPos);
+
+			out.write("glTF", 4);
+			WriteUInt32(out, 2);
+			WriteUInt32(out, (unsigned int)(12 + 8 + json.size() + 8 + binBytes));
+			WriteUInt32(out, (unsigned int)json.size());
+			out.write("JSON", 4);
+			out.write(json.data(), json.size());
+			WriteUInt32(out, (unsigned int)binBytes);
+			out.write("BIN\0", 4);
+		}
+	}
+
+	out.seekp(0, std::ios::end);
+	unsigned long long bytesWritten = (unsigned long long)out.tellp();
+	bool ok = out.good();
+	out.close();
+
+	if (stats)
+	{
+		stats->patches = numPatches;
+		stats->vertices = numVertices;
+		stats->triangles = numTriangles;
+		stats->bytesWritten = bytesWritten;
+		stats->peakBufferBytes = peakBufferBytes;
+		stats->peakWeldBytes = peakWeldBytes;
+		stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	return ok;
+}
+
+MeshFormat MeshExporter::FormatFromFileName(const char* fileName)
+{
+	const char* extension = strrchr(fileName, '.');
+	if (extension)
+	{
+		std::string ext = extension + 1;
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		if (ext == "obj")
+			return MeshFormat::OBJ;
+		if (ext == "glb")
+			return MeshFormat::GLB;
+	}
+	return MeshFormat::PLY;
+}
+
+void MeshExporter::PrintStats(const MeshExportStats& stats)
+{
+	std::cout << "Exported " << stats.patches << " patches: " << stats.vertices << " vertices, " << stats.triangles << " triangles" << std::endl;
+	std::cout << "  " << (stats.bytesWritten / (1024.0 * 1024.0)) << " MB in " << stats.seconds << " s";
+	if (stats.seconds > 0.0)
+	{
+		std::cout << " (" << (stats.patches / stats.seconds) << " patches/s, "
+			<< (stats.bytesWritten / (1024.0 * 1024.0) / stats.seconds) << " MB/s)";
+	}
+	std::cout << std::endl;
+	std::cout << "  peak buffer memory " << (stats.peakBufferBytes / (1024.0 * 1024.0)) << " MB";
+	if (stats.peakWeldBytes > 0)
+		std::cout << ", weld map " << (stats.peakWeldBytes / (1024.0 * 1024.0)) << " MB";
+	std::cout << std::endl;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <functional>
+#include <cstddef>
+
+enum class MeshFormat
+{
+	OBJ,
+	PLY,	// binary little endian
+	GLB		// binary glTF 2.0
+};
+
+struct MeshExportOptions
+{
+	MeshFormat format = MeshFormat::PLY;
+	int resolution = 20;
+
+	// Merge vertices shared along patch seams. Only patch border vertices can be shared, so only
+	// those are hashed; the welded vertex keeps the normal of the first patch that emitted it.
+	bool weld = false;
+	float weldTolerance = 1e-5f;
+
+	// A border vertex is forgotten once no patch of the last weldWindow batches has used it, which
+	// keeps the weld map bounded. Seams between patches further apart than that in the source's
+	// order are left unwelded, with a vertex on each side.
+	int weldWindow = 2;
+
+	int numThreads = 0;
+	int patchesPerBatch = 1024;
+};
+
+struct MeshExportStats
+{
+	unsigned long long patches = 0;
+	unsigned long long vertices = 0;
+	unsigned long long triangles = 0;
+	unsigned long long bytesWritten = 0;
+	size_t peakBufferBytes = 0;
+
+	// Of the weld map, counted apart from the batch buffers
+	size_t peakWeldBytes = 0;
+	double seconds = 0.0;
+};
+
+// Fills in the 16 control points of the given patch
+typedef std::function<void(int, glm::vec3*)> PatchSource;
+
+// Streams tessellated patches straight to disk. Patches are tessellated and formatted in
+// parallel one batch at a time and written in order, so memory use depends on the batch
+// size (and, welding, the weld window) and not on the size of the model.
+class MeshExporter
+{
+public:
+	static bool Export(int numPatches, const PatchSource& source, const char* fileName, const MeshExportOptions& options, MeshExportStats* stats = nullptr);
+
+	// Picks a format from the file extension, defaulting to PLY
+	static MeshFormat FormatFromFileName(const char* fileName);
+
+	static void PrintStats(const MeshExportStats& stats);
+};
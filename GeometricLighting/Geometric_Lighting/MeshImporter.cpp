@@ -0,0 +1,923 @@
+#include "MeshImporter.h"
+#include "MappedFile.h"
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+
+static const unsigned int NO_INDEX = 0xFFFFFFFF;
+
+// OBJ allows negative indices relative to the vertices read so far. A chunk doesn't know how
+// many vertices came before it until every chunk is parsed, so those are stored biased and
+// flagged, then fixed up once the chunk offsets are known.
+static const unsigned int RELATIVE_INDEX = 0x80000000;
+static const int RELATIVE_BIAS = 0x40000000;
+
+static const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline bool IsDigit(char c)
+{
+	return (unsigned char)(c - '0') < 10;
+}
+
+static inline const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p))
+		++p;
+	return p;
+}
+
+static inline const char* SkipToken(const char* p, const char* end)
+{
+	while (p < end && !IsSpace(*p) && *p != '\n')
+		++p;
+	return p;
+}
+
+static inline const char* SkipLine(const char* p, const char* end)
+{
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// Parses a decimal float straight out of the mapped file. strtod is locale aware and needs
+// a terminated string, both of which make it several times slower than this.
+static const char* ParseFloat(const char* p, const char* end, float& out)
+{
+	p = SkipSpaces(p, end);
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int digits = 0;
+	const char* start = p;
+	while (p < end && IsDigit(*p))
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+		{
+			++exponent;
+		}
+		++p;
+	}
+	if (p < end && *p == '.')
+	{
+		++p;
+		while (p < end && IsDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa != 0;
+				--exponent;
+			}
+			++p;
+		}
+	}
+	if (p == start)
+	{
+		// Not a number (nan, inf or garbage), skip it
+		out = 0.0f;
+		return SkipToken(p, end);
+	}
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negativeExponent = *p == '-';
+			++p;
+		}
+		int value = 0;
+		while (p < end && IsDigit(*p))
+		{
+			if (value < 10000)
+				value = value * 10 + (*p - '0');
+			++p;
+		}
+		exponent += negativeExponent ? -value : value;
+	}
+
+	double value = (double)mantissa;
+	while (exponent > 22)
+	{
+		value *= 1e22;
+		exponent -= 22;
+	}
+	while (exponent < -22)
+	{
+		value /= 1e22;
+		exponent += 22;
+	}
+	value = exponent >= 0 ? value * POW10[exponent] : value / POW10[-exponent];
+
+	out = (float)(negative ? -value : value);
+	return p;
+}
+
+static const char* ParseInt(const char* p, const char* end, long long& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = *p == '-';
+		++p;
+	}
+
+	long long value = 0;
+	while (p < end && IsDigit(*p))
+	{
+		value = value * 10 + (*p - '0');
+		++p;
+	}
+	out = negative ? -value : value;
+	return p;
+}
+
+static inline unsigned int ObjIndex(long long index, size_t localCount)
+{
+	if (index > 0)
+		return (unsigned int)(index - 1);
+	if (index < 0)
+		return RELATIVE_INDEX | (unsigned int)((long long)localCount + index + RELATIVE_BIAS);
+	return NO_INDEX;
+}
+
+static inline unsigned int ResolveObjIndex(unsigned int index, size_t offset)
+{
+	if (index == NO_INDEX || !(index & RELATIVE_INDEX))
+		return index;
+	return (unsigned int)((long long)offset + (long long)(index & ~RELATIVE_INDEX) - RELATIVE_BIAS);
+}
+
+// Everything one thread read from its slice of an OBJ file
+struct ObjChunk
+{
+	const char* begin;
+	const char* end;
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<unsigned int> corners;	// position and normal index pairs, three corners per triangle
+	size_t positionOffset;
+	size_t normalOffset;
+	bool hasNormals;
+};
+
+static void ParseObjChunk(ObjChunk& chunk)
+{
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	std::vector<unsigned int> polygon;
+
+	chunk.hasNormals = false;
+	while (p < end)
+	{
+		p = SkipSpaces(p, end);
+		if (p + 1 >= end)
+			break;
+
+		if (p[0] == 'v' && IsSpace(p[1]))
+		{
+			float x, y, z;
+			p = ParseFloat(p + 2, end, x);
+			p = ParseFloat(p, end, y);
+			p = ParseFloat(p, end, z);
+			chunk.positions.push_back(x);
+			chunk.positions.push_back(y);
+			chunk.positions.push_back(z);
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && p + 2 < end && IsSpace(p[2]))
+		{
+			float x, y, z;
+			p = ParseFloat(p + 3, end, x);
+			p = ParseFloat(p, end, y);
+			p = ParseFloat(p, end, z);
+			chunk.normals.push_back(x);
+			chunk.normals.push_back(y);
+			chunk.normals.push_back(z);
+		}
+		else if (p[0] == 'f' && IsSpace(p[1]))
+		{
+			// Each corner is v, v/vt, v//vn or v/vt/vn
+			polygon.clear();
+			p += 2;
+			while (true)
+			{
+				p = SkipSpaces(p, end);
+				if (p >= end || *p == '\n' || *p == '#')
+					break;
+
+				long long v = 0, vn = 0, vt = 0;
+				p = ParseInt(p, end, v);
+				if (p < end && *p == '/')
+				{
+					++p;
+					if (p < end && *p != '/')
+						p = ParseInt(p, end, vt);
+					if (p < end && *p == '/')
+						p = ParseInt(p + 1, end, vn);
+				}
+				p = SkipToken(p, end);
+
+				polygon.push_back(ObjIndex(v, chunk.positions.size() / 3));
+				polygon.push_back(ObjIndex(vn, chunk.normals.size() / 3));
+				chunk.hasNormals |= vn != 0;
+			}
+
+			// Triangulate as a fan, which is exact for the convex polygons scanners and modelers write
+			unsigned int numCorners = polygon.size() / 2;
+			for (unsigned int k = 1; k + 1 < numCorners; ++k)
+			{
+				chunk.corners.push_back(polygon[0]);
+				chunk.corners.push_back(polygon[1]);
+				chunk.corners.push_back(polygon[k * 2]);
+				chunk.corners.push_back(polygon[k * 2 + 1]);
+				chunk.corners.push_back(polygon[k * 2 + 2]);
+				chunk.corners.push_back(polygon[k * 2 + 3]);
+			}
+		}
+		p = SkipLine(p, end);
+	}
+}
+
+// Area weighted vertex normals: the cross product of two edges is twice the triangle's area
+// long, so summing them unnormalized weights big triangles more
+static void GenerateNormals(const float* positions, size_t numVerts, const unsigned int* elements, size_t numElements,
+	std::vector<float>& normals, const std::vector<unsigned char>* onlyThese)
+{
+	normals.assign(numVerts * 3, 0.0f);
+	for (size_t e = 0; e + 2 < numElements; e += 3)
+	{
+		unsigned int a = elements[e], b = elements[e + 1], c = elements[e + 2];
+		glm::vec3 pa(positions[a * 3], positions[a * 3 + 1], positions[a * 3 + 2]);
+		glm::vec3 pb(positions[b * 3], positions[b * 3 + 1], positions[b * 3 + 2]);
+		glm::vec3 pc(positions[c * 3], positions[c * 3 + 1], positions[c * 3 + 2]);
+		glm::vec3 n = glm::cross(pb - pa, pc - pa);
+
+		unsigned int tri[3] = { a, b, c };
+		for (int k = 0; k < 3; ++k)
+		{
+			if (onlyThese && !(*onlyThese)[tri[k]])
+				continue;
+			normals[tri[k] * 3] += n.x;
+			normals[tri[k] * 3 + 1] += n.y;
+			normals[tri[k] * 3 + 2] += n.z;
+		}
+	}
+}
+
+// Interleaves positions and normals into the vertex layout Patch uses and finds the bounds
+static void InterleaveVerts(WorkerPool& pool, const float* positions, const float* normals, size_t numVerts, ImportedMesh& mesh)
+{
+	mesh.verts.resize(numVerts * 6);
+
+	int numChunks = pool.numThreads() * 4;
+	std::vector<glm::vec3> chunkMin(numChunks, glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX));
+	std::vector<glm::vec3> chunkMax(numChunks, glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+
+	pool.ParallelFor(numChunks, [&](int begin, int end, int)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			size_t first = numVerts * c / numChunks;
+			size_t last = numVerts * (c + 1) / numChunks;
+			for (size_t v = first; v < last; ++v)
+			{
+				glm::vec3 pos(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+				glm::vec3 normal(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]);
+				float length = glm::length(normal);
+				normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+
+				float* vert = &mesh.verts[v * 6];
+				vert[0] = pos.x;
+				vert[1] = pos.y;
+				vert[2] = pos.z;
+				vert[3] = normal.x;
+				vert[4] = normal.y;
+				vert[5] = normal.z;
+
+				chunkMin[c] = glm::min(chunkMin[c], pos);
+				chunkMax[c] = glm::max(chunkMax[c], pos);
+			}
+		}
+	}, 1);
+
+	mesh.minPos = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	mesh.maxPos = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int c = 0; c < numChunks; ++c)
+	{
+		mesh.minPos = glm::min(mesh.minPos, chunkMin[c]);
+		mesh.maxPos = glm::max(mesh.maxPos, chunkMax[c]);
+	}
+	if (numVerts == 0)
+	{
+		mesh.minPos = glm::vec3();
+		mesh.maxPos = glm::vec3();
+	}
+}
+
+// Builds the mesh when each position has at most one normal (PLY, or OBJ without vn)
+static void BuildFromPositions(WorkerPool& pool, std::vector<float>& positions, std::vector<float>& normals,
+	std::vector<unsigned int>& triangles, ImportedMesh& mesh, MeshImportStats& stats)
+{
+	size_t numVerts = positions.size() / 3;
+
+	// Drop triangles that point past the end of the vertex list
+	size_t kept = 0;
+	for (size_t t = 0; t + 2 < triangles.size(); t += 3)
+	{
+		if (triangles[t] < numVerts && triangles[t + 1] < numVerts && triangles[t + 2] < numVerts)
+		{
+			triangles[kept++] = triangles[t];
+			triangles[kept++] = triangles[t + 1];
+			triangles[kept++] = triangles[t + 2];
+		}
+	}
+	triangles.resize(kept);
+
+	if (normals.size() != positions.size())
+	{
+		GenerateNormals(&positions[0], numVerts, triangles.empty() ? nullptr : &triangles[0], triangles.size(), normals, nullptr);
+		stats.generatedNormals = true;
+	}
+
+	InterleaveVerts(pool, &positions[0], &normals[0], numVerts, mesh);
+	mesh.elements.swap(triangles);
+}
+
+// Builds the mesh from OBJ corners, making one vertex per unique position/normal pair.
+// Each position keeps a short chain of the vertices made from it, which is nearly always
+// one or two long, so this is much cheaper than hashing every corner.
+static void BuildFromCorners(WorkerPool& pool, std::vector<float>& positions, std::vector<float>& normals,
+	std::vector<unsigned int>& corners, ImportedMesh& mesh, MeshImportStats& stats)
+{
+	size_t numPositions = positions.size() / 3;
+	size_t numNormals = normals.size() / 3;
+
+	std::vector<unsigned int> head(numPositions, NO_INDEX);
+	std::vector<unsigned int> vertPosition;
+	std::vector<unsigned int> vertNormal;
+	std::vector<unsigned int> next;
+	vertPosition.reserve(numPositions);
+	vertNormal.reserve(numPositions);
+	next.reserve(numPositions);
+
+	std::vector<unsigned int>& elements = mesh.elements;
+	elements.clear();
+	elements.reserve(corners.size() / 2);
+
+	for (size_t c = 0; c + 5 < corners.size(); c += 6)
+	{
+		unsigned int tri[3];
+		bool valid = true;
+		for (int k = 0; k < 3; ++k)
+		{
+			unsigned int pos = corners[c + k * 2];
+			unsigned int normal = corners[c + k * 2 + 1];
+			if (pos >= numPositions)
+			{
+				valid = false;
+				break;
+			}
+			if (normal >= numNormals)
+				normal = NO_INDEX;
+
+			unsigned int vert = head[pos];
+			while (vert != NO_INDEX && vertNormal[vert] != normal)
+				vert = next[vert];
+
+			if (vert == NO_INDEX)
+			{
+				vert = vertPosition.size();
+				vertPosition.push_back(pos);
+				vertNormal.push_back(normal);
+				next.push_back(head[pos]);
+				head[pos] = vert;
+			}
+			tri[k] = vert;
+		}
+
+		if (valid)
+			elements.insert(elements.end(), tri, tri + 3);
+	}
+
+	size_t numVerts = vertPosition.size();
+	std::vector<float> vertPositions(numVerts * 3);
+	std::vector<float> vertNormals(numVerts * 3);
+	std::vector<unsigned char> missingNormal(numVerts, 0);
+	bool anyMissing = false;
+
+	for (size_t v = 0; v < numVerts; ++v)
+	{
+		memcpy(&vertPositions[v * 3], &positions[vertPosition[v] * 3], sizeof(float) * 3);
+		if (vertNormal[v] != NO_INDEX)
+		{
+			memcpy(&vertNormals[v * 3], &normals[vertNormal[v] * 3], sizeof(float) * 3);
+		}
+		else
+		{
+			missingNormal[v] = 1;
+			anyMissing = true;
+		}
+	}
+
+	if (anyMissing && numVerts > 0)
+	{
+		std::vector<float> generated;
+		GenerateNormals(&vertPositions[0], numVerts, elements.empty() ? nullptr : &elements[0], elements.size(), generated, &missingNormal);
+		for (size_t v = 0; v < numVerts; ++v)
+		{
+			if (missingNormal[v])
+				memcpy(&vertNormals[v * 3], &generated[v * 3], sizeof(float) * 3);
+		}
+		stats.generatedNormals = true;
+	}
+
+	if (numVerts > 0)
+		InterleaveVerts(pool, &vertPositions[0], &vertNormals[0], numVerts, mesh);
+	else
+		mesh.verts.clear();
+}
+
+static bool LoadObj(WorkerPool& pool, const char* data, size_t size, ImportedMesh& mesh, MeshImportStats& stats)
+{
+	Clock::time_point parseStart = Clock::now();
+
+	// Split the file into slices that start and end on line boundaries
+	int numChunks = pool.numThreads() * 8;
+	std::vector<ObjChunk> chunks(numChunks);
+	const char* end = data + size;
+	const char* p = data;
+	for (int c = 0; c < numChunks; ++c)
+	{
+		chunks[c].begin = p;
+		if (c == numChunks - 1)
+		{
+			p = end;
+		}
+		else
+		{
+			const char* target = data + size * (c + 1) / numChunks;
+			if (target > p)
+				p = SkipLine(target, end);
+		}
+		chunks[c].end = p;
+	}
+
+	pool.ParallelFor(numChunks, [&](int begin, int end, int)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			ParseObjChunk(chunks[c]);
+		}
+	}, 1);
+
+	// Now the chunk sizes are known, merge them into single arrays and resolve relative indices
+	size_t numPositions = 0, numNormals = 0, numCorners = 0;
+	bool hasNormals = false;
+	for (int c = 0; c < numChunks; ++c)
+	{
+		chunks[c].positionOffset = numPositions;
+		chunks[c].normalOffset = numNormals;
+		numPositions += chunks[c].positions.size() / 3;
+		numNormals += chunks[c].normals.size() / 3;
+		numCorners += chunks[c].corners.size();
+		hasNormals |= chunks[c].hasNormals;
+	}
+
+	std::vector<float> positions(numPositions * 3);
+	std::vector<float> normals(numNormals * 3);
+	std::vector<unsigned int> corners(numCorners);
+	std::vector<size_t> cornerOffsets(numChunks, 0);
+	for (int c = 1; c < numChunks; ++c)
+	{
+		cornerOffsets[c] = cornerOffsets[c - 1] + chunks[c - 1].corners.size();
+	}
+
+	pool.ParallelFor(numChunks, [&](int begin, int end, int)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			ObjChunk& chunk = chunks[c];
+			if (!chunk.positions.empty())
+				memcpy(&positions[chunk.positionOffset * 3], &chunk.positions[0], chunk.positions.size() * sizeof(float));
+			if (!chunk.normals.empty())
+				memcpy(&normals[chunk.normalOffset * 3], &chunk.normals[0], chunk.normals.size() * sizeof(float));
+
+			unsigned int* out = numCorners ? &corners[cornerOffsets[c]] : nullptr;
+			size_t count = chunk.corners.size();
+			for (size_t i = 0; i < count; i += 2)
+			{
+				out[i] = ResolveObjIndex(chunk.corners[i], chunk.positionOffset);
+				out[i + 1] = ResolveObjIndex(chunk.corners[i + 1], chunk.normalOffset);
+			}
+
+			std::vector<float>().swap(chunk.positions);
+			std::vector<float>().swap(chunk.normals);
+			std::vector<unsigned int>().swap(chunk.corners);
+		}
+	}, 1);
+
+	Clock::time_point buildStart = Clock::now();
+	stats.parseSeconds = std::chrono::duration<double>(buildStart - parseStart).count();
+	stats.positions = numPositions;
+
+	if (numPositions == 0)
+		return false;
+
+	if (hasNormals && numNormals > 0)
+	{
+		BuildFromCorners(pool, positions, normals, corners, mesh, stats);
+	}
+	else
+	{
+		std::vector<unsigned int> triangles(numCorners / 2);
+		for (size_t i = 0; i < triangles.size(); ++i)
+		{
+			triangles[i] = corners[i * 2];
+		}
+		std::vector<float> noNormals;
+		BuildFromPositions(pool, positions, noNormals, triangles, mesh, stats);
+	}
+
+	stats.buildSeconds = std::chrono::duration<double>(Clock::now() - buildStart).count();
+	return true;
+}
+
+// A scalar PLY property and where it lives in a binary record
+struct PlyProperty
+{
+	std::string name;
+	int type;			// size in bytes, negative for signed integers, 0 for float/double handled by isFloat
+	bool isFloat;
+	bool isList;
+	int countType;
+	bool countIsFloat;
+	size_t offset;
+};
+
+struct PlyElement
+{
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+	size_t stride;		// record size in bytes, only meaningful when no property is a list
+};
+
+static bool PlyType(const std::string& name, int& size, bool& isFloat)
+{
+	isFloat = false;
+	if (name == "char" || name == "int8") size = -1;
+	else if (name == "uchar" || name == "uint8") size = 1;
+	else if (name == "short" || name == "int16") size = -2;
+	else if (name == "ushort" || name == "uint16") size = 2;
+	else if (name == "int" || name == "int32") size = -4;
+	else if (name == "uint" || name == "uint32") size = 4;
+	else if (name == "float" || name == "float32") { size = 4; isFloat = true; }
+	else if (name == "double" || name == "float64") { size = 8; isFloat = true; }
+	else return false;
+	return true;
+}
+
+// Reads one little endian scalar of the given PLY type
+static inline double ReadPlyScalar(const char* p, int type, bool isFloat)
+{
+	if (isFloat)
+	{
+		if (type == 4)
+		{
+			float value;
+			memcpy(&value, p, 4);
+			return value;
+		}
+		double value;
+		memcpy(&value, p, 8);
+		return value;
+	}
+	switch (type)
+	{
+	case -1: return (double)*(const signed char*)p;
+	case 1: return (double)*(const unsigned char*)p;
+	case -2: { short value; memcpy(&value, p, 2); return value; }
+	case 2: { unsigned short value; memcpy(&value, p, 2); return value; }
+	case -4: { int value; memcpy(&value, p, 4); return value; }
+	default: { unsigned int value; memcpy(&value, p, 4); return value; }
+	}
+}
+
+static bool LoadPly(WorkerPool& pool, const char* data, size_t size, ImportedMesh& mesh, MeshImportStats& stats)
+{
+	Clock::time_point parseStart = Clock::now();
+	const char* end = data + size;
+
+	// Header
+	bool binary = false;
+	std::vector<PlyElement> elements;
+	const char* p = data;
+	while (p < end)
+	{
+		const char* lineEnd = SkipLine(p, end);
+		std::string line(p, lineEnd);
+		while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+			line.resize(line.size() - 1);
+		p = lineEnd;
+
+		char word[3][64] = { { 0 } };
+		int numWords = sscanf(line.c_str(), "%63s %63s %63s", word[0], word[1], word[2]);
+		std::string keyword = numWords > 0 ? word[0] : "";
+
+		if (keyword == "end_header")
+			break;
+		else if (keyword == "format")
+		{
+			std::string format = word[1];
+			if (format == "binary_little_endian")
+				binary = true;
+			else if (format != "ascii")
+				return false;
+		}
+		else if (keyword == "element" && numWords == 3)
+		{
+			PlyElement element;
+			element.name = word[1];
+			element.count = (size_t)strtoull(word[2], nullptr, 10);
+			element.stride = 0;
+			elements.push_back(element);
+		}
+		else if (keyword == "property" && !elements.empty())
+		{
+			PlyProperty property;
+			property.isList = std::string(word[1]) == "list";
+			property.countType = 0;
+			property.countIsFloat = false;
+			if (property.isList)
+			{
+				char listWords[5][64];
+				if (sscanf(line.c_str(), "%63s %63s %63s %63s %63s", listWords[0], listWords[1], listWords[2], listWords[3], listWords[4]) != 5)
+					return false;
+				if (!PlyType(listWords[2], property.countType, property.countIsFloat) || !PlyType(listWords[3], property.type, property.isFloat))
+					return false;
+				property.name = listWords[4];
+			}
+			else
+			{
+				if (!PlyType(word[1], property.type, property.isFloat))
+					return false;
+				property.name = word[2];
+			}
+
+			PlyElement& element = elements.back();
+			property.offset = element.stride;
+			element.stride += abs(property.type);
+			element.properties.push_back(property);
+		}
+	}
+
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<unsigned int> triangles;
+
+	for (unsigned int e = 0; e < elements.size(); ++e)
+	{
+		PlyElement& element = elements[e];
+		bool hasList = false;
+		int propertyIndex[6] = { -1, -1, -1, -1, -1, -1 };
+		const char* names[6] = { "x", "y", "z", "nx", "ny", "nz" };
+		for (unsigned int i = 0; i < element.properties.size(); ++i)
+		{
+			hasList |= element.properties[i].isList;
+			for (int k = 0; k < 6; ++k)
+			{
+				if (element.properties[i].name == names[k])
+					propertyIndex[k] = i;
+			}
+		}
+
+		if (element.name == "vertex" && !hasList && propertyIndex[0] >= 0 && propertyIndex[1] >= 0 && propertyIndex[2] >= 0)
+		{
+			bool hasNormals = propertyIndex[3] >= 0 && propertyIndex[4] >= 0 && propertyIndex[5] >= 0;
+			positions.resize(element.count * 3);
+			if (hasNormals)
+				normals.resize(element.count * 3);
+
+			if (binary)
+			{
+				if ((size_t)(end - p) < element.count * element.stride)
+					return false;
+
+				// Fixed size records, so every thread can jump straight to its range
+				const char* base = p;
+				pool.ParallelFor((int)std::min(element.count, (size_t)0x7FFFFFFF), [&](int begin, int last, int)
+				{
+					for (int v = begin; v < last; ++v)
+					{
+						const char* record = base + (size_t)v * element.stride;
+						for (int k = 0; k < (hasNormals ? 6 : 3); ++k)
+						{
+							const PlyProperty& property = element.properties[propertyIndex[k]];
+							float value = (float)ReadPlyScalar(record + property.offset, property.type, property.isFloat);
+							if (k < 3)
+								positions[v * 3 + k] = value;
+							else
+								normals[v * 3 + k - 3] = value;
+						}
+					}
+				});
+				p += element.count * element.stride;
+			}
+			else
+			{
+				// Find where each line starts, then parse the lines in parallel
+				std::vector<const char*> lines(element.count + 1);
+				for (size_t v = 0; v < element.count; ++v)
+				{
+					lines[v] = p;
+					p = SkipLine(p, end);
+				}
+				lines[element.count] = p;
+
+				unsigned int numProperties = element.properties.size();
+				pool.ParallelFor((int)std::min(element.count, (size_t)0x7FFFFFFF), [&](int begin, int last, int)
+				{
+					for (int v = begin; v < last; ++v)
+					{
+						const char* q = lines[v];
+						for (unsigned int i = 0; i < numProperties; ++i)
+						{
+							float value;
+							q = ParseFloat(q, lines[v + 1], value);
+							for (int k = 0; k < (hasNormals ? 6 : 3); ++k)
+							{
+								if (propertyIndex[k] != (int)i)
+									continue;
+								if (k < 3)
+									positions[v * 3 + k] = value;
+								else
+									normals[v * 3 + k - 3] = value;
+							}
+						}
+					}
+				});
+			}
+		}
+		else if (element.name == "face")
+		{
+			// Face records vary in size, so they're read in order
+			triangles.reserve(element.count * 3);
+			std::vector<unsigned int> polygon;
+			for (size_t f = 0; f < element.count; ++f)
+			{
+				const char* lineEnd = binary ? end : SkipLine(p, end);
+				for (unsigned int i = 0; i < element.properties.size(); ++i)
+				{
+					const PlyProperty& property = element.properties[i];
+					bool isIndexList = property.isList && (property.name == "vertex_indices" || property.name == "vertex_index");
+					if (binary)
+					{
+						size_t count = 1;
+						if (property.isList)
+						{
+							if (p + abs(property.countType) > end)
+								return false;
+							count = (size_t)ReadPlyScalar(p, property.countType, property.countIsFloat);
+							p += abs(property.countType);
+						}
+						if (p + count * abs(property.type) > end)
+							return false;
+
+						if (isIndexList)
+						{
+							polygon.resize(count);
+							for (size_t k = 0; k < count; ++k)
+							{
+								polygon[k] = (unsigned int)ReadPlyScalar(p + k * abs(property.type), property.type, property.isFloat);
+							}
+						}
+						p += count * abs(property.type);
+					}
+					else
+					{
+						long long count = 1;
+						if (property.isList)
+						{
+							p = SkipSpaces(p, lineEnd);
+							p = ParseInt(p, lineEnd, count);
+						}
+						if (isIndexList)
+							polygon.resize((size_t)std::max(count, 0LL));
+						for (long long k = 0; k < count; ++k)
+						{
+							p = SkipSpaces(p, lineEnd);
+							long long value = 0;
+							p = ParseInt(p, lineEnd, value);
+							p = SkipToken(p, lineEnd);
+							if (isIndexList)
+								polygon[(size_t)k] = (unsigned int)value;
+						}
+					}
+				}
+				if (!binary)
+					p = lineEnd;
+
+				for (unsigned int k = 1; k + 1 < polygon.size(); ++k)
+				{
+					triangles.push_back(polygon[0]);
+					triangles.push_back(polygon[k]);
+					triangles.push_back(polygon[k + 1]);
+				}
+				polygon.clear();
+			}
+		}
+		else
+		{
+			// Some other element (edges, materials, ...), skip over it
+			if (binary)
+			{
+				if (hasList)
+					return false;
+				p += element.count * element.stride;
+			}
+			else
+			{
+				for (size_t i = 0; i < element.count; ++i)
+					p = SkipLine(p, end);
+			}
+		}
+	}
+
+	Clock::time_point buildStart = Clock::now();
+	stats.parseSeconds = std::chrono::duration<double>(buildStart - parseStart).count();
+	stats.positions = positions.size() / 3;
+
+	if (positions.empty())
+		return false;
+
+	BuildFromPositions(pool, positions, normals, triangles, mesh, stats);
+	stats.buildSeconds = std::chrono::duration<double>(Clock::now() - buildStart).count();
+	return true;
+}
+
+bool MeshImporter::Load(const char* fileName, ImportedMesh& mesh, MeshImportStats* stats, int numThreads)
+{
+	MeshImportStats localStats;
+	MeshImportStats& s = stats ? *stats : localStats;
+	s = MeshImportStats();
+
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+	s.fileBytes = file.size();
+
+	WorkerPool pool(numThreads);
+
+	bool ok;
+	const char* extension = strrchr(fileName, '.');
+	std::string ext = extension ? extension + 1 : "";
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == "ply")
+		ok = LoadPly(pool, file.data(), file.size(), mesh, s);
+	else
+		ok = LoadObj(pool, file.data(), file.size(), mesh, s);
+
+	s.vertices = mesh.verts.size() / 6;
+	s.triangles = mesh.elements.size() / 3;
+	return ok && !mesh.elements.empty();
+}
+
+void MeshImporter::PrintStats(const MeshImportStats& stats)
+{
+	double megabytes = stats.fileBytes / (1024.0 * 1024.0);
+	std::cout << "Imported " << stats.positions << " positions -> " << stats.vertices << " vertices, " << stats.triangles << " triangles"
+		<< (stats.generatedNormals ? " (normals generated)" : "") << std::endl;
+	std::cout << "  parse " << stats.parseSeconds << " s";
+	if (stats.parseSeconds > 0.0)
+		std::cout << " (" << (megabytes / stats.parseSeconds) << " MB/s of " << megabytes << " MB)";
+	std::cout << ", build " << stats.buildSeconds << " s, upload " << stats.uploadSeconds << " s" << std::endl;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+// Indexed triangle mesh using the same interleaved position/normal layout as Patch
+struct ImportedMesh
+{
+	std::vector<float> verts;
+	std::vector<unsigned int> elements;
+	glm::vec3 minPos;
+	glm::vec3 maxPos;
+};
+
+struct MeshImportStats
+{
+	size_t fileBytes = 0;
+	size_t positions = 0;
+	size_t vertices = 0;
+	size_t triangles = 0;
+	bool generatedNormals = false;
+	double parseSeconds = 0.0;
+	double buildSeconds = 0.0;
+	double uploadSeconds = 0.0;
+};
+
+// Loads OBJ and PLY (ascii or binary little endian) meshes. Files are memory mapped and parsed
+// in parallel chunks, then turned into an indexed vertex buffer with one vertex per unique
+// position/normal pair. Missing normals are generated from the faces.
+class MeshImporter
+{
+public:
+	// Safe to call from any thread. MeshShape turns the result into something to draw.
+	static bool Load(const char* fileName, ImportedMesh& mesh, MeshImportStats* stats = nullptr, int numThreads = 0);
+
+	static void PrintStats(const MeshImportStats& stats);
+};
@@ -0,0 +1,64 @@
+#include "MeshShape.h"
+#include "GLState.h"
+#include "RenderManager.h"
+
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+MeshShape::MeshShape(GLuint vao, GLuint vbo, GLuint ebo, GLsizei count, Shader shader, glm::vec4 color)
+	: RenderShape(vao, count, GL_TRIANGLES, shader, color)
+{
+	_ownedVao = vao;
+	_vbo = vbo;
+	_ebo = ebo;
+}
+MeshShape::~MeshShape()
+{
+	GLState::DeleteBuffers(1, &_vbo);
+	GLState::DeleteBuffers(1, &_ebo);
+	GLState::DeleteVertexArrays(1, &_ownedVao);
+}
+
+MeshShape* MeshShape::Create(const ImportedMesh& mesh, Shader shader, glm::vec4 color)
+{
+	GLuint vao, vbo, ebo;
+	glGenVertexArrays(1, &vao);
+	GLState::BindVertexArray(vao);
+
+	glGenBuffers(1, &vbo);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * mesh.verts.size(), &mesh.verts[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &ebo);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mesh.elements.size(), &mesh.elements[0], GL_STATIC_DRAW);
+
+	// Same layout as Patch, so the same shaders light it
+	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
+	glEnableVertexAttribArray(posAttrib);
+	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+
+	GLint normAttrib = glGetAttribLocation(shader.shaderPointer, "normal");
+	glEnableVertexAttribArray(normAttrib);
+	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+	GLState::BindVertexArray(0);
+
+	MeshShape* shape = new MeshShape(vao, vbo, ebo, mesh.elements.size(), shader, color);
+	RenderManager::AddShape(shape);
+	return shape;
+}
+
+MeshShape* MeshShape::Import(const char* fileName, Shader shader, glm::vec4 color, MeshImportStats* stats)
+{
+	ImportedMesh mesh;
+	if (!MeshImporter::Load(fileName, mesh, stats))
+		return nullptr;
+
+	Clock::time_point uploadStart = Clock::now();
+	MeshShape* shape = Create(mesh, shader, color);
+	if (stats)
+		stats->uploadSeconds = std::chrono::duration<double>(Clock::now() - uploadStart).count();
+	return shape;
+}
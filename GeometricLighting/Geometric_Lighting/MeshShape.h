@@ -0,0 +1,21 @@
+#pragma once
+#include "RenderShape.h"
+#include "MeshImporter.h"
+
+// A RenderShape that owns the GL buffers behind it, made from a mesh MeshImporter loaded
+class MeshShape : public RenderShape
+{
+public:
+	MeshShape(GLuint vao, GLuint vbo, GLuint ebo, GLsizei count, Shader shader, glm::vec4 color);
+	~MeshShape();
+
+	// Uploads the mesh and adds it to the RenderManager's display list
+	static MeshShape* Create(const ImportedMesh& mesh, Shader shader, glm::vec4 color);
+
+	static MeshShape* Import(const char* fileName, Shader shader, glm::vec4 color, MeshImportStats* stats = nullptr);
+
+private:
+	GLuint _vbo;
+	GLuint _ebo;
+	GLuint _ownedVao;
+};
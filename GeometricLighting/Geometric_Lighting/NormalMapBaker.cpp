@@ -0,0 +1,233 @@
+#include "NormalMapBaker.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+#include "SimdLanes.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+glm::vec4 NormalMapAtlas::TileRect(int patch) const
+{
+	int stride = tileSize + 2;
+	int x = (patch % tilesPerRow) * stride + 1;
+	int y = (patch / tilesPerRow) * stride + 1;
+	return glm::vec4((float)x / width, (float)y / height, (float)tileSize / width, (float)tileSize / height);
+}
+
+// Each worker thread tessellates into its own buffers
+struct BakeScratch
+{
+	std::vector<float> high;
+	std::vector<float> low;
+	float maxDeviation = 0.0f;
+};
+
+// Loads a vec3 from each lane's own address
+static inline Lanes3 Gather3(const float* const* src)
+{
+	float x[4], y[4], z[4];
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		x[lane] = src[lane][0];
+		y[lane] = src[lane][1];
+		z[lane] = src[lane][2];
+	}
+	Lanes3 r = { Load(x), Load(y), Load(z) };
+	return r;
+}
+
+// Where t in [0, 1] falls on a grid of resolution vertices: the cell, and how far across it
+static inline int Cell(float t, int resolution, float& fraction)
+{
+	float position = t * (resolution - 1);
+	int cell = std::min(std::max((int)position, 0), resolution - 2);
+	fraction = position - cell;
+	return cell;
+}
+
+static unsigned char EncodeComponent(float c)
+{
+	return (unsigned char)std::min(std::max((c * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f), 255.0f);
+}
+
+static void BakeTile(const glm::vec3* controlPoints, const NormalMapBakeSettings& settings, NormalMapAtlas& atlas, int patch, BakeScratch& scratch)
+{
+	const int stride = PatchEvaluator::FLOATS_PER_VERT;
+	int high = settings.highResolution;
+	int low = settings.lowResolution;
+	int tileSize = settings.tileSize;
+
+	PatchEvaluator::Tessellate(controlPoints, high, &scratch.high[0]);
+	PatchEvaluator::Tessellate(controlPoints, low, &scratch.low[0]);
+
+	int originX = (patch % atlas.tilesPerRow) * (tileSize + 2) + 1;
+	int originY = (patch / atlas.tilesPerRow) * (tileSize + 2) + 1;
+
+	for (int y = 0; y < tileSize; ++y)
+	{
+		float v = (y + 0.5f) / tileSize;
+		float highFv, lowFv;
+		int highRow = Cell(v, high, highFv);
+		int lowRow = Cell(v, low, lowFv);
+
+		for (int x = 0; x < tileSize; x += 4)
+		{
+			int numLanes = std::min(4, tileSize - x);
+
+			// Everything that differs per texel is gathered into lanes; the rest is SIMD
+			const float* highCorners[4][4];
+			const float* lowNormals[3][4];
+			const float* edgeStart[4];
+			const float* edgeEnd[4];
+			float highWeights[4][4];
+			float lowWeights[3][4];
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				// Lanes past the end of the row repeat the last texel
+				float u = (std::min(x + lane, tileSize - 1) + 0.5f) / tileSize;
+
+				float fu;
+				int column = Cell(u, high, fu);
+				const float* corner = &scratch.high[(column + highRow * high) * stride + 3];
+				highCorners[0][lane] = corner;
+				highCorners[1][lane] = corner + stride;
+				highCorners[2][lane] = corner + high * stride;
+				highCorners[3][lane] = corner + (high + 1) * stride;
+				highWeights[0][lane] = (1.0f - fu) * (1.0f - highFv);
+				highWeights[1][lane] = fu * (1.0f - highFv);
+				highWeights[2][lane] = (1.0f - fu) * highFv;
+				highWeights[3][lane] = fu * highFv;
+
+				// The coarse quad splits into the triangles PatchEvaluator::GenerateElements makes:
+				// (a, b, c) below the diagonal and (b, d, c) above it
+				column = Cell(u, low, fu);
+				const float* a = &scratch.low[(column + lowRow * low) * stride];
+				const float* b = a + stride;
+				const float* c = a + low * stride;
+				const float* d = c + stride;
+				if (fu + lowFv <= 1.0f)
+				{
+					lowNormals[0][lane] = a + 3;
+					lowWeights[0][lane] = 1.0f - fu - lowFv;
+					edgeStart[lane] = a;
+					edgeEnd[lane] = b;
+				}
+				else
+				{
+					lowNormals[0][lane] = d + 3;
+					lowWeights[0][lane] = fu + lowFv - 1.0f;
+					edgeStart[lane] = c;
+					edgeEnd[lane] = d;
+				}
+				lowNormals[1][lane] = b + 3;
+				lowNormals[2][lane] = c + 3;
+				lowWeights[1][lane] = fu + lowFv <= 1.0f ? fu : 1.0f - lowFv;
+				lowWeights[2][lane] = fu + lowFv <= 1.0f ? lowFv : 1.0f - fu;
+			}
+
+			Lanes3 detail = Scale3(Gather3(highCorners[0]), Load(highWeights[0]));
+			for (int i = 1; i < 4; ++i)
+				detail = Add3(detail, Scale3(Gather3(highCorners[i]), Load(highWeights[i])));
+			detail = Normalize3(detail);
+
+			// The same frame the shader builds: interpolated normal, and u's direction along the
+			// triangle made perpendicular to it
+			Lanes3 normal = Scale3(Gather3(lowNormals[0]), Load(lowWeights[0]));
+			for (int i = 1; i < 3; ++i)
+				normal = Add3(normal, Scale3(Gather3(lowNormals[i]), Load(lowWeights[i])));
+			normal = Normalize3(normal);
+			Lanes3 tangent = Sub3(Gather3(edgeEnd), Gather3(edgeStart));
+			tangent = Normalize3(Sub3(tangent, Scale3(normal, Dot3(normal, tangent))));
+			Lanes3 bitangent = Cross3(normal, tangent);
+
+			float tx[4], ty[4], tz[4];
+			Store(tx, Dot3(detail, tangent));
+			Store(ty, Dot3(detail, bitangent));
+			Store(tz, Dot3(detail, normal));
+
+			for (int lane = 0; lane < numLanes; ++lane)
+			{
+				// Degenerate edges (the teapot's poles) give no frame or no normal; leave those flat
+				float lengthSqr = tx[lane] * tx[lane] + ty[lane] * ty[lane] + tz[lane] * tz[lane];
+				if (!(lengthSqr > 0.5f))
+				{
+					tx[lane] = 0.0f;
+					ty[lane] = 0.0f;
+					tz[lane] = 1.0f;
+				}
+				scratch.maxDeviation = std::max(scratch.maxDeviation, (float)acos(std::min(tz[lane], 1.0f)));
+
+				unsigned char* texel = &atlas.texels[((originY + y) * atlas.width + originX + x + lane) * 4];
+				texel[0] = EncodeComponent(tx[lane]);
+				texel[1] = EncodeComponent(ty[lane]);
+				texel[2] = EncodeComponent(tz[lane]);
+				texel[3] = 255;
+			}
+		}
+	}
+
+	// Border: each edge texel copied one further out, rows first, then the columns with corners
+	for (int y = 0; y < tileSize; ++y)
+	{
+		unsigned char* row = &atlas.texels[((originY + y) * atlas.width + originX) * 4];
+		std::copy(row, row + 4, row - 4);
+		std::copy(row + (tileSize - 1) * 4, row + tileSize * 4, row + tileSize * 4);
+	}
+	size_t rowBytes = (tileSize + 2) * 4;
+	unsigned char* bottom = &atlas.texels[(originY * atlas.width + originX - 1) * 4];
+	unsigned char* top = &atlas.texels[((originY + tileSize - 1) * atlas.width + originX - 1) * 4];
+	std::copy(bottom, bottom + rowBytes, bottom - atlas.width * 4);
+	std::copy(top, top + rowBytes, top + atlas.width * 4);
+}
+
+bool NormalMapBaker::Bake(const glm::vec3* controlPoints, int numPatches, const NormalMapBakeSettings& settings, NormalMapAtlas& atlas, NormalMapBakeStats* stats)
+{
+	if (numPatches <= 0 || settings.tileSize < 1 || settings.lowResolution < 2 || settings.highResolution < 2)
+		return false;
+
+	Clock::time_point start = Clock::now();
+
+	int stride = settings.tileSize + 2;
+	atlas.tileSize = settings.tileSize;
+	atlas.lowResolution = settings.lowResolution;
+	atlas.tilesPerRow = (int)ceil(sqrt((double)numPatches));
+	atlas.width = atlas.tilesPerRow * stride;
+	atlas.height = ((numPatches + atlas.tilesPerRow - 1) / atlas.tilesPerRow) * stride;
+	atlas.texels.assign((size_t)atlas.width * atlas.height * 4, 0);
+
+	WorkerPool pool(settings.numThreads);
+	std::vector<BakeScratch> scratch(pool.numThreads());
+	for (size_t i = 0; i < scratch.size(); ++i)
+	{
+		scratch[i].high.resize(PatchEvaluator::NumVerts(settings.highResolution) * PatchEvaluator::FLOATS_PER_VERT);
+		scratch[i].low.resize(PatchEvaluator::NumVerts(settings.lowResolution) * PatchEvaluator::FLOATS_PER_VERT);
+	}
+
+	pool.ParallelFor(numPatches, [&](int begin, int end, int thread)
+	{
+		for (int patch = begin; patch < end; ++patch)
+			BakeTile(&controlPoints[patch * 16], settings, atlas, patch, scratch[thread]);
+	}, 1);
+
+	if (stats)
+	{
+		stats->patches = numPatches;
+		stats->texels = (unsigned long long)numPatches * settings.tileSize * settings.tileSize;
+		stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		stats->maxDeviation = 0.0f;
+		for (size_t i = 0; i < scratch.size(); ++i)
+			stats->maxDeviation = std::max(stats->maxDeviation, scratch[i].maxDeviation * 57.2957795f);
+	}
+	return true;
+}
+
+void NormalMapBaker::PrintStats(const NormalMapBakeStats& stats)
+{
+	std::cout << "Normal maps: " << stats.patches << " patches, " << stats.texels << " texels in " << stats.seconds * 1000.0 << " ms ("
+		<< (stats.seconds > 0.0 ? stats.texels / stats.seconds / 1e6 : 0.0) << " Mtexels/s), up to " << stats.maxDeviation
+		<< " degrees of detail" << std::endl;
+}
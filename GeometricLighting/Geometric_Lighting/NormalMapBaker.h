@@ -0,0 +1,61 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+struct NormalMapBakeSettings
+{
+	// Grid the detailed normals are taken from, and the grid they are baked against, which
+	// should be the resolution the patches are drawn at
+	int highResolution = 128;
+	int lowResolution = 20;
+
+	// Texels along each side of a patch's map
+	int tileSize = 32;
+
+	// 0 uses one thread per core
+	int numThreads = 0;
+};
+
+struct NormalMapBakeStats
+{
+	int patches = 0;
+	unsigned long long texels = 0;
+	double seconds = 0.0;
+
+	// Largest angle between a detailed normal and the coarse surface's, in degrees: how much
+	// shading the low resolution loses without the maps
+	float maxDeviation = 0.0f;
+};
+
+// One normal map per patch, packed in a grid of tiles. Texels are RGBA8 with the tangent space
+// normal in rgb, bottom row first like a GL texture. Each tile has a one texel border copied
+// from its edges so bilinear filtering never reaches a neighbor.
+struct NormalMapAtlas
+{
+	int width = 0;
+	int height = 0;
+	int tileSize = 0;
+	int tilesPerRow = 0;
+	int lowResolution = 0;
+	std::vector<unsigned char> texels;
+
+	// Where patch's map is in texture coordinates: offset in xy and size in zw, so the patch's
+	// (u, v) maps to xy + (u, v) * zw
+	glm::vec4 TileRect(int patch) const;
+};
+
+// Bakes the difference between a finely and a coarsely tessellated patch into normal maps, so a
+// coarse tessellation shades like a fine one. Each texel stores the fine normal in the frame of
+// the coarse triangle under it: the interpolated vertex normal, and the direction u grows along
+// the triangle, which is also what a fragment shader gets from screen space derivatives, so the
+// runtime frame matches without storing tangents. Patches bake in parallel, four texels at a
+// time in SIMD lanes.
+class NormalMapBaker
+{
+public:
+	// controlPoints holds 16 per patch
+	static bool Bake(const glm::vec3* controlPoints, int numPatches, const NormalMapBakeSettings& settings, NormalMapAtlas& atlas, NormalMapBakeStats* stats = nullptr);
+
+	static void PrintStats(const NormalMapBakeStats& stats);
+};
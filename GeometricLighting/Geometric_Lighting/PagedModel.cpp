@@ -0,0 +1,191 @@
+#include "PagedModel.h"
+#include "GLState.h"
+#include "CameraManager.h"
+#include "PatchEvaluator.h"
+
+#include <algorithm>
+#include <iostream>
+
+PagedModel::PagedModel()
+{
+	_resolution = 0;
+	_pagePatches = 0;
+	_uploadsPerFrame = 0;
+	_frame = 0;
+	_vao = 0;
+	_vbo = 0;
+	_ebo = 0;
+	_numSlots = 0;
+	_uploads = 0;
+	_deferredUploads = 0;
+}
+PagedModel::~PagedModel()
+{
+	_pager.Close();
+	if (_vao)
+	{
+		GLState::DeleteBuffers(1, &_vbo);
+		GLState::DeleteBuffers(1, &_ebo);
+		GLState::DeleteVertexArrays(1, &_vao);
+	}
+}
+
+bool PagedModel::Open(const char* fileName, Shader shader, const PatchPagerSettings& settings, size_t gpuBudgetBytes, int uploadsPerFrame)
+{
+	PatchPagerSettings pagerSettings = settings;
+	pagerSettings.resolution = std::max(settings.resolution, 2);
+	if (!_pager.Open(fileName, pagerSettings))
+		return false;
+
+	_shader = shader;
+	_resolution = pagerSettings.resolution;
+	_pagePatches = _pager.database().pagePatches();
+	_uploadsPerFrame = uploadsPerFrame;
+
+	// Every page gets the same number of vertices, so one element buffer for a full page works
+	// for all of them
+	int patchVerts = PatchEvaluator::NumVerts(_resolution);
+	int patchElements = PatchEvaluator::NumElements(_resolution);
+	size_t slotBytes = (size_t)_pagePatches * patchVerts * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+	_numSlots = std::max(1, (int)(gpuBudgetBytes / slotBytes));
+	_freeSlots.clear();
+	for (int i = _numSlots - 1; i >= 0; --i)
+		_freeSlots.push_back(i);
+
+	std::vector<GLuint> elements((size_t)_pagePatches * patchElements);
+	PatchEvaluator::GenerateElements(_resolution, elements.data());
+	for (int patch = 1; patch < _pagePatches; ++patch)
+	{
+		for (int i = 0; i < patchElements; ++i)
+			elements[patch * patchElements + i] = elements[i] + patch * patchVerts;
+	}
+
+	glGenVertexArrays(1, &_vao);
+	GLState::BindVertexArray(_vao);
+
+	glGenBuffers(1, &_vbo);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, slotBytes * _numSlots, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &_ebo);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * elements.size(), elements.data(), GL_STATIC_DRAW);
+
+	// Bind buffer data to shader values
+	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
+	glEnableVertexAttribArray(posAttrib);
+	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+
+	GLint normAttrib = glGetAttribLocation(shader.shaderPointer, "normal");
+	glEnableVertexAttribArray(normAttrib);
+	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+	GLState::BindVertexArray(0);
+	return true;
+}
+
+void PagedModel::Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat)
+{
+	_frame++;
+	_pager.Update(cameraPos, viewProjMat, _visible);
+
+	int patchVerts = PatchEvaluator::NumVerts(_resolution);
+	int patchElements = PatchEvaluator::NumElements(_resolution);
+	size_t slotBytes = (size_t)_pagePatches * patchVerts * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+
+	_drawCounts.clear();
+	_drawBaseVertices.clear();
+	_drawOffsets.clear();
+
+	int uploads = 0;
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	for (unsigned int i = 0; i < _visible.size(); ++i)
+	{
+		const ResidentPage& page = *_visible[i];
+		std::unordered_map<int, Slot>::iterator found = _slots.find(page.index);
+		if (found == _slots.end())
+		{
+			// Visible pages come nearest first, so the ones left for later frames are far away
+			int slot = uploads < _uploadsPerFrame ? AcquireSlot() : -1;
+			if (slot < 0)
+			{
+				_deferredUploads++;
+				continue;
+			}
+
+			glBufferSubData(GL_ARRAY_BUFFER, slot * slotBytes, page.verts.size() * sizeof(GLfloat), page.verts.data());
+			Slot entry;
+			entry.slot = slot;
+			entry.lastUsed = _frame;
+			found = _slots.insert(std::make_pair(page.index, entry)).first;
+			uploads++;
+			_uploads++;
+		}
+		found->second.lastUsed = _frame;
+
+		_drawCounts.push_back(page.numPatches * patchElements);
+		_drawBaseVertices.push_back(found->second.slot * _pagePatches * patchVerts);
+		_drawOffsets.push_back((const GLvoid*)0);
+	}
+
+	// The pager's copies are only needed until they are uploaded
+	_visible.clear();
+}
+
+// Takes a free slot, or the slot of the page that has gone longest without being drawn
+int PagedModel::AcquireSlot()
+{
+	if (!_freeSlots.empty())
+	{
+		int slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		return slot;
+	}
+
+	std::unordered_map<int, Slot>::iterator oldest = _slots.end();
+	for (std::unordered_map<int, Slot>::iterator it = _slots.begin(); it != _slots.end(); ++it)
+	{
+		if (it->second.lastUsed != _frame && (oldest == _slots.end() || it->second.lastUsed < oldest->second.lastUsed))
+			oldest = it;
+	}
+	if (oldest == _slots.end())
+		return -1;
+
+	int slot = oldest->second.slot;
+	_slots.erase(oldest);
+	return slot;
+}
+
+void PagedModel::Draw()
+{
+	if (_drawCounts.empty())
+		return;
+
+	glm::mat4 mpMat = CameraManager::DrawProjMat();
+	glm::mat4 mpvMat = CameraManager::DrawProjMat() * CameraManager::DrawViewMat();
+	glm::vec4 color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
+
+	GLState::BindVertexArray(_vao);
+
+	GLState::UniformMatrix4fv(_shader.uMPMat, 1, GL_FALSE, glm::value_ptr(mpMat));
+	GLState::UniformMatrix4fv(_shader.uMPVMat, 1, GL_FALSE, glm::value_ptr(mpvMat));
+	GLState::Uniform4fv(_shader.uColor, 1, glm::value_ptr(color));
+	GLState::Uniform4f(_shader.uNormalMapRect, 0.0f, 0.0f, 0.0f, 0.0f);
+	GLState::Uniform1ui(_shader.uViewMask, ~0u);
+
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, _drawCounts.data(), GL_UNSIGNED_INT, _drawOffsets.data(), (GLsizei)_drawCounts.size(), _drawBaseVertices.data());
+
+	GLState::BindVertexArray(0);
+}
+
+PatchPager& PagedModel::pager()
+{
+	return _pager;
+}
+
+void PagedModel::PrintStats()
+{
+	_pager.PrintStats();
+	std::cout << "  GPU: " << _slots.size() << " / " << _numSlots << " page slots in use, " << _uploads << " uploads, "
+		<< _deferredUploads << " deferred to a later frame" << std::endl;
+}
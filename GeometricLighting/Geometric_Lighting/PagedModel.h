@@ -0,0 +1,58 @@
+#pragma once
+#include "RenderShape.h"
+#include "PatchPager.h"
+
+#include <GLEW/GL/glew.h>
+#include <vector>
+#include <unordered_map>
+
+// Draws a PatchDatabase through a PatchPager. Pages the pager hands back are uploaded into
+// slots of one vertex buffer (at most a few per frame, so a burst of new pages doesn't hitch)
+// and drawn with one multi draw call. The GPU copy has its own budget and LRU, the same way
+// the pager limits the CPU side.
+class PagedModel
+{
+public:
+	PagedModel();
+	~PagedModel();
+
+	bool Open(const char* fileName, Shader shader, const PatchPagerSettings& settings, size_t gpuBudgetBytes = 128 * 1024 * 1024, int uploadsPerFrame = 32);
+
+	void Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat);
+	void Draw();
+
+	PatchPager& pager();
+	void PrintStats();
+
+private:
+	struct Slot
+	{
+		int slot;
+		unsigned int lastUsed;
+	};
+
+	int AcquireSlot();
+
+private:
+	PatchPager _pager;
+	Shader _shader;
+	int _resolution;
+	int _pagePatches;
+	int _uploadsPerFrame;
+	unsigned int _frame;
+
+	GLuint _vao;
+	GLuint _vbo;
+	GLuint _ebo;
+	int _numSlots;
+	std::vector<int> _freeSlots;
+	std::unordered_map<int, Slot> _slots;
+
+	std::vector<std::shared_ptr<const ResidentPage> > _visible;
+	std::vector<GLsizei> _drawCounts;
+	std::vector<GLint> _drawBaseVertices;
+	std::vector<const GLvoid*> _drawOffsets;
+
+	unsigned long long _uploads;
+	unsigned long long _deferredUploads;
+};
@@ -1,11 +1,17 @@
 #include "Patch.h"
+#include "GLState.h"
 #include "RenderManager.h"
 #include "RenderShape.h"
 #include "Init_Shader.h"
 #include "InputManager.h"
+#include "PatchKernelSelector.h"
 
 #include <vector>
 
+GLuint Patch::_sharedEbo = 0;
+int Patch::_numPatches = 0;
+std::vector<GLfloat> Patch::_scratch;
+
 Patch::Patch(Shader shader)
 {
 	_transform = Transform();
@@ -19,19 +25,26 @@ Patch::Patch(Shader shader)
 	_transform.rotationOrigin = glm::vec3();
 	_transform.scaleOrigin = glm::vec3();
 
-	GLfloat data = 0.0f;
-	GLint elements = 0;
+	_cpuVerts = nullptr;
 
 	glGenVertexArrays(1, &_vao);
-	glBindVertexArray(_vao);
+	GLState::BindVertexArray(_vao);
 
 	glGenBuffers(1, &_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * NUM_VERTS_STORED, &data, GL_DYNAMIC_DRAW);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * NUM_VERTS_STORED, NULL, GL_DYNAMIC_DRAW);
 
-	glGenBuffers(1, &_ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLint) * NUM_ELEMENTS, &elements, GL_DYNAMIC_DRAW);
+	// The first patch builds the triangle list every patch draws with
+	if (_numPatches++ == 0)
+	{
+		std::vector<GLuint> elements(NUM_ELEMENTS);
+		PatchEvaluator::GenerateElements(NUM_VERTS, &elements[0]);
+		glGenBuffers(1, &_sharedEbo);
+		GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _sharedEbo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * NUM_ELEMENTS, &elements[0], GL_STATIC_DRAW);
+	}
+	else
+		GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _sharedEbo);
 
 	// Bind buffer data to shader values
 	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
@@ -52,9 +65,15 @@ Patch::Patch(Shader shader)
 }
 Patch::~Patch()
 {
-	glDeleteBuffers(1, &_vbo);
-	glDeleteVertexArrays(1, &_vao);
-	glDeleteBuffers(1, &_ebo);
+	GLState::DeleteBuffers(1, &_vbo);
+	GLState::DeleteVertexArrays(1, &_vao);
+	delete _cpuVerts;
+
+	if (--_numPatches == 0)
+	{
+		GLState::DeleteBuffers(1, &_sharedEbo);
+		_sharedEbo = 0;
+	}
 }
 
 void Patch::Update(float dt, bool updateSurface)
@@ -73,9 +92,9 @@ void Patch::Update(float dt, bool updateSurface)
 	glm::mat4 scaleOriginMat = glm::translate(glm::mat4(), _transform.scaleOrigin);
 	glm::mat4 scaleMat = scaleOriginMat * glm::scale(glm::mat4(), _transform.scale) * glm::inverse(scaleOriginMat);
 
-	glm::mat4 *parentModelMat = _transform.parent ? &_transform.parent->modelMat : &glm::mat4();
+	glm::mat4 parentModelMat = _transform.parent ? _transform.parent->modelMat : glm::mat4();
 
-	_transform.modelMat = (*parentModelMat) * (translateMat * scaleMat* rotateMat);
+	_transform.modelMat = parentModelMat * (translateMat * scaleMat* rotateMat);
 }
 
 void Patch::SetControlPoint(int controlPointIndex, glm::vec3 newPos)
@@ -84,96 +103,67 @@ void Patch::SetControlPoint(int controlPointIndex, glm::vec3 newPos)
 }
 
 Transform& Patch::transform() { return _transform; }
+const glm::vec3* Patch::controlPoints() { return _controlPoints; }
+RenderShape* Patch::shape() { return _curve; }
 
-void Patch::UpdateSurface()
+void Patch::Bounds(glm::vec3& minPos, glm::vec3& maxPos)
 {
-	GLfloat  inc = 1.0f / ((float)NUM_VERTS - 1.0f);
-	GLfloat t = 0.0f;
-
-	GLfloat factors[NUM_VERTS][7];
+	minPos = _localMin;
+	maxPos = _localMax;
+}
 
-	for (int i = 0; i < NUM_VERTS; ++i, t += inc)
+void Patch::KeepCpuCopy(bool keep)
+{
+	if (keep && !_cpuVerts)
 	{
-		GLfloat t_sqr = t * t;
-		GLfloat t_inv = (1 - t);
-		GLfloat t_inv_sqr = t_inv * t_inv;
-
-		// These are the factors used in a Bernstein polynomial
-		// Bernstein polynomials increase in order as the number of 
-		// control points increases. For four control points, we'll
-		// use a third order polynomial. 
-		factors[i][0] = t_inv * t_inv_sqr;
-		factors[i][1] = 3 * t * t_inv_sqr;
-		factors[i][2] = 3 * t_sqr * t_inv;
-		factors[i][3] = t * t_sqr;
-
-		// One of the great mathematical properties of Bernstein 
-		// polynomials is that each order lower you go, you go 
-		// down one derivation and each order higher you go, you
-		// go up one integration. Calculus!
-		// In this case, we're storing one order lower to get 
-		// the slope of the bezier curve for finding the normal
-		factors[i][4] = t_inv_sqr;
-		factors[i][5] = 2 * t * t_inv;
-		factors[i][6] = t_sqr;
+		_cpuVerts = new std::vector<GLfloat>(NUM_VERTS_STORED);
+		PatchKernelSelector::Tessellate(_controlPoints, NUM_VERTS, &(*_cpuVerts)[0]);
 	}
-
-	glm::vec3 newControlPoints[4];
-	glm::vec3 newSlopeControlPoints[4];
-	for (int i = 0; i < NUM_VERTS; ++i)
+	else if (!keep)
 	{
-		newControlPoints[0] = factors[i][0] * _controlPoints[0] + factors[i][1] * _controlPoints[1] + factors[i][2] * _controlPoints[2] + factors[i][3] * _controlPoints[3];
-		newControlPoints[1] = factors[i][0] * _controlPoints[4] + factors[i][1] * _controlPoints[5] + factors[i][2] * _controlPoints[6] + factors[i][3] * _controlPoints[7];
-		newControlPoints[2] = factors[i][0] * _controlPoints[8] + factors[i][1] * _controlPoints[9] + factors[i][2] * _controlPoints[10] + factors[i][3] * _controlPoints[11];
-		newControlPoints[3] = factors[i][0] * _controlPoints[12] + factors[i][1] * _controlPoints[13] + factors[i][2] * _controlPoints[14] + factors[i][3] * _controlPoints[15];
-
-		// These represent the columnar tangents for each row of verticies in the bezier surface
-		// Use the derivitave of the Bernstein polynomial to determine the normal of the curve at this point using the difference between control points as slope control points
-		// (1-t)^2 + 2t(1-t) + t^2
-		newSlopeControlPoints[0] = factors[i][4] * (_controlPoints[1] - _controlPoints[0]) + factors[i][5] * (_controlPoints[2] - _controlPoints[1]) + factors[i][6] * (_controlPoints[3] - _controlPoints[2]);
-		newSlopeControlPoints[1] = factors[i][4] * (_controlPoints[5] - _controlPoints[4]) + factors[i][5] * (_controlPoints[6] - _controlPoints[5]) + factors[i][6] * (_controlPoints[7] - _controlPoints[6]);
-		newSlopeControlPoints[2] = factors[i][4] * (_controlPoints[9] - _controlPoints[8]) + factors[i][5] * (_controlPoints[10] - _controlPoints[9]) + factors[i][6] * (_controlPoints[11] - _controlPoints[10]);
-		newSlopeControlPoints[3] = factors[i][4] * (_controlPoints[13] - _controlPoints[12]) + factors[i][5] * (_controlPoints[14] - _controlPoints[13]) + factors[i][6] * (_controlPoints[15] - _controlPoints[14]);
-
-		for (int j = 0; j < NUM_VERTS; ++j)
-		{
-			glm::vec3 newPoint = factors[j][0] * newControlPoints[0] + factors[j][1] * newControlPoints[1] + factors[j][2] * newControlPoints[2] + factors[j][3] * newControlPoints[3];
-			_verts[(j + (i * NUM_VERTS)) * 6] = newPoint.x;
-			_verts[(j + (i * NUM_VERTS)) * 6 + 1] = newPoint.y;
-			_verts[(j + (i * NUM_VERTS)) * 6 + 2] = newPoint.z;
-
-			// This tangent represents the row tangent, so the tangent of the surface relative to the surface's x direction
-			glm::vec3 tangentA = factors[j][4] * (newControlPoints[1] - newControlPoints[0]) + factors[j][5] * (newControlPoints[2] - newControlPoints[1]) + factors[j][6] * (newControlPoints[3] - newControlPoints[2]);
-
-			// This tangent is a second valid tangent necessary for finding a cross product, this one being relative to the surface's y direction
-			glm::vec3 tangentB = factors[j][0] * newSlopeControlPoints[0] + factors[j][1] * newSlopeControlPoints[1] + factors[j][2] * newSlopeControlPoints[2] + factors[j][3] * newSlopeControlPoints[3];
-
-			// By taking the normal of these two tangents, we can get the normal to the surface
-			glm::vec3 normal = glm::cross(glm::normalize(tangentB), glm::normalize(tangentA));
-
-			_verts[(j + (i * NUM_VERTS)) * 6 + 3] = normal.x;
-			_verts[(j + (i * NUM_VERTS)) * 6 + 4] = normal.y;
-			_verts[(j + (i * NUM_VERTS)) * 6 + 5] = normal.z;
-		}
+		delete _cpuVerts;
+		_cpuVerts = nullptr;
 	}
-	glBindBuffer(GL_VERTEX_ARRAY, _vao);
-	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(_verts), (void*)&_verts, GL_DYNAMIC_DRAW);
 }
 
-void Patch::GeneratePlane()
+const GLfloat* Patch::cpuVerts()
+{
+	return _cpuVerts ? &(*_cpuVerts)[0] : nullptr;
+}
+
+void Patch::UpdateSurface()
 {
-	// Allocate vertices for the plane
-	int vertNum = 0;
-	GLfloat numVertsf = (GLfloat)NUM_VERTS;
-	for (GLfloat i = 0.0f; i < numVertsf; i += 1.0f)
+	PatchEvaluator::Bounds(_controlPoints, _localMin, _localMax);
+
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	if (_cpuVerts)
 	{
-		for (GLfloat j = 0.0f; j < numVertsf; j += 1.0f)
-		{
-			AddVert(0.0f, 0.0f, 0.0f, i / (numVertsf - 1.0f), j / (numVertsf - 1.0f), vertNum++);
-		}
+		PatchKernelSelector::Tessellate(_controlPoints, NUM_VERTS, &(*_cpuVerts)[0]);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * NUM_VERTS_STORED, &(*_cpuVerts)[0]);
+		return;
 	}
 
+	// Tessellate straight into the vertex buffer. Invalidating it lets the driver hand back fresh
+	// memory rather than wait for draws still reading the old surface.
+	GLfloat* mapped = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * NUM_VERTS_STORED,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped)
+	{
+		PatchKernelSelector::Tessellate(_controlPoints, NUM_VERTS, mapped);
+
+		// Unmapping fails if the memory was lost meanwhile (a mode switch, say); upload it again then
+		if (glUnmapBuffer(GL_ARRAY_BUFFER))
+			return;
+	}
+
+	_scratch.resize(NUM_VERTS_STORED);
+	PatchKernelSelector::Tessellate(_controlPoints, NUM_VERTS, &_scratch[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * NUM_VERTS_STORED, &_scratch[0]);
+}
+
+void Patch::GeneratePlane()
+{
+	// Start out as a flat square one unit across
 	int cp = 0;
 	float zOffset = 1.0f / 3.0f;
 	float xOffset = 1.0f / 3.0f;
@@ -186,38 +176,5 @@ void Patch::GeneratePlane()
 		_controlPoints[cp++] = glm::vec3(baseVec.x + xOffset * 3, baseVec.y, baseVec.z + zOffset * row);
 	}
 
-	// Add elements for faces
-	int faceNum = 0;
-	int quadsPerRow = NUM_VERTS * (NUM_VERTS - 1);
-	for (int i = 0; i < quadsPerRow; i += NUM_VERTS)
-	{
-		for (int j = 0; j < NUM_VERTS - 1; ++j)
-		{
-			AddFace(i + j, i + j + 1, i + NUM_VERTS + j, faceNum++);
-			AddFace(i + j + 1, i + NUM_VERTS + j + 1, i + NUM_VERTS + j, faceNum++);
-		}
-	}
-	glBindBuffer(GL_VERTEX_ARRAY, _vao);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(_elements), (void*)&_elements, GL_DYNAMIC_DRAW);
-
 	UpdateSurface();
 }
-
-void Patch::AddVert(GLfloat x, GLfloat y, GLfloat z, GLfloat u, GLfloat v, int vertNum)
-{
-	int itr = vertNum * 6;
-	_verts[itr++] = x;
-	_verts[itr++] = y;
-	_verts[itr++] = z;
-	_verts[itr++] = 0.0f;
-	_verts[itr++] = 1.0f;
-	_verts[itr] = 0.0f;
-}
-
-void Patch::AddFace(GLint a, GLint b, GLint c, int faceNum)
-{
-	_elements[faceNum * 3] = a;
-	_elements[faceNum * 3 + 1] = b;
-	_elements[faceNum * 3 + 2] = c;
-}
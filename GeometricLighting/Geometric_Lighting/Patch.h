@@ -1,8 +1,8 @@
 #pragma once
 #include "RenderShape.h"
 
-#include <GLEW\GL\glew.h>
-#include <GLM\gtc\matrix_transform.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLM/gtc/matrix_transform.hpp>
 #include <vector>
 
 class RenderShape;
@@ -17,24 +17,43 @@ public:
 
 	void SetControlPoint(int controlPointIndex, glm::vec3 newPos);
 	Transform& transform();
+	const glm::vec3* controlPoints();
+	RenderShape* shape();
+
+	// Box around the control points in the patch's own space, as of the last surface update
+	void Bounds(glm::vec3& minPos, glm::vec3& maxPos);
+
+	// The tessellated vertices normally only live in the vertex buffer. Patches that need them on
+	// the CPU (picking against triangles, exporting what is on screen, ...) can ask to keep a copy,
+	// which is then kept up to date with every surface update.
+	void KeepCpuCopy(bool keep);
+	const GLfloat* cpuVerts();
+
+	static const int NUM_VERTS = 20;
+	static const int NUM_VERTS_STORED = NUM_VERTS * NUM_VERTS * 6;
+	static const int NUM_ELEMENTS = (NUM_VERTS - 1) * (NUM_VERTS - 1) * 6;
 private:
 	void UpdateSurface();
 	void GeneratePlane();
-	void AddVert(GLfloat x, GLfloat y, GLfloat z, GLfloat u, GLfloat v, int vertNum);
-	void AddFace(GLint a, GLint b, GLint c, int faceNum);
 private:
 	glm::vec3 _controlPoints[16];
+	glm::vec3 _localMin;
+	glm::vec3 _localMax;
 	RenderShape* _curve;
 	GLuint _vao;
 	GLuint _vbo;
-	GLuint _ebo;
 
 	Transform _transform;
 
-	static const int NUM_VERTS = 20;
-	static const int NUM_VERTS_STORED = NUM_VERTS * NUM_VERTS * 6;
-	static const int NUM_ELEMENTS = (NUM_VERTS - 1) * (NUM_VERTS - 1) * 6;
+	// Only allocated while a CPU copy is wanted
+	std::vector<GLfloat>* _cpuVerts;
+
+	// Every patch has the same triangle list, so they all share one element buffer, created with
+	// the first patch and deleted with the last
+	static GLuint _sharedEbo;
+	static int _numPatches;
 
-	GLfloat _verts[NUM_VERTS_STORED];
-	GLuint _elements[NUM_ELEMENTS];
+	// Where vertices are tessellated when the vertex buffer can't be mapped. Patches are only
+	// tessellated on the render thread, so one is enough.
+	static std::vector<GLfloat> _scratch;
 };
\ No newline at end of file
@@ -0,0 +1,239 @@
+#include "PatchDatabase.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cfloat>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+static const char DATABASE_MAGIC[8] = { 'B', 'P', 'T', 'P', 'A', 'G', 'E', '1' };
+
+struct DatabaseHeader
+{
+	char magic[8];
+	unsigned int numPatches;
+	unsigned int numPages;
+	unsigned int pagePatches;
+	float minPos[3];
+	float maxPos[3];
+};
+
+struct DatabasePageEntry
+{
+	float minPos[3];
+	float maxPos[3];
+	unsigned int firstPatch;
+	unsigned int numPatches;
+	unsigned long long offset;
+};
+
+// Spreads the low 21 bits of v out to every third bit
+static unsigned long long SpreadBits(unsigned long long v)
+{
+	v &= 0x1FFFFF;
+	v = (v | (v << 32)) & 0x1F00000000FFFFull;
+	v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+	v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+	v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+	v = (v | (v << 2)) & 0x1249249249249249ull;
+	return v;
+}
+
+static unsigned long long MortonCode(const glm::vec3& normalized)
+{
+	glm::vec3 scaled = glm::clamp(normalized, 0.0f, 1.0f) * 2097151.0f;
+	return SpreadBits((unsigned long long)scaled.x) | (SpreadBits((unsigned long long)scaled.y) << 1) | (SpreadBits((unsigned long long)scaled.z) << 2);
+}
+
+PatchDatabase::PatchDatabase()
+{
+	_numPatches = 0;
+	_pagePatches = 0;
+}
+
+bool PatchDatabase::Build(const char* fileName, int numPatches, const PatchSource& source, int pagePatches, int numThreads, PatchDatabaseBuildStats* statsOut)
+{
+	Clock::time_point start = Clock::now();
+	if (numPatches <= 0 || pagePatches <= 0)
+		return false;
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	WorkerPool pool(numThreads);
+
+	// First pass: the center of every patch, and the bounds of the whole model
+	std::vector<glm::vec3> centers(numPatches);
+	std::vector<glm::vec3> threadMin(pool.numThreads(), glm::vec3(FLT_MAX)), threadMax(pool.numThreads(), glm::vec3(-FLT_MAX));
+	pool.ParallelFor(numPatches, [&](int begin, int end, int thread)
+	{
+		glm::vec3 controlPoints[16];
+		for (int i = begin; i < end; ++i)
+		{
+			source(i, controlPoints);
+			glm::vec3 minPos, maxPos;
+			PatchEvaluator::Bounds(controlPoints, minPos, maxPos);
+			centers[i] = (minPos + maxPos) * 0.5f;
+			threadMin[thread] = glm::min(threadMin[thread], minPos);
+			threadMax[thread] = glm::max(threadMax[thread], maxPos);
+		}
+	});
+
+	glm::vec3 modelMin(FLT_MAX), modelMax(-FLT_MAX);
+	for (int i = 0; i < pool.numThreads(); ++i)
+	{
+		modelMin = glm::min(modelMin, threadMin[i]);
+		modelMax = glm::max(modelMax, threadMax[i]);
+	}
+
+	// Order the patches along the Morton curve
+	glm::vec3 extent = glm::max(modelMax - modelMin, glm::vec3(1e-6f));
+	std::vector<std::pair<unsigned long long, unsigned int> > order(numPatches);
+	pool.ParallelFor(numPatches, [&](int begin, int end, int)
+	{
+		for (int i = begin; i < end; ++i)
+			order[i] = std::make_pair(MortonCode((centers[i] - modelMin) / extent), (unsigned int)i);
+	});
+	std::vector<glm::vec3>().swap(centers);
+	std::sort(order.begin(), order.end());
+
+	int numPages = (numPatches + pagePatches - 1) / pagePatches;
+
+	DatabaseHeader header;
+	memcpy(header.magic, DATABASE_MAGIC, sizeof(header.magic));
+	header.numPatches = numPatches;
+	header.numPages = numPages;
+	header.pagePatches = pagePatches;
+	for (int k = 0; k < 3; ++k)
+	{
+		header.minPos[k] = modelMin[k];
+		header.maxPos[k] = modelMax[k];
+	}
+	file.write((const char*)&header, sizeof(header));
+
+	// The page table goes in once the pages are written and their bounds are known
+	std::streamoff tableOffset = sizeof(header);
+	unsigned long long offset = tableOffset + (unsigned long long)numPages * sizeof(DatabasePageEntry);
+	file.seekp((std::streamoff)offset);
+
+	// Second pass: fetch the patches in page order, a batch of pages at a time
+	std::vector<DatabasePageEntry> table(numPages);
+	int pagesPerBatch = std::max(1, pool.numThreads() * 4);
+	std::vector<glm::vec3> batch((size_t)pagesPerBatch * pagePatches * 16);
+	for (int firstPage = 0; firstPage < numPages; firstPage += pagesPerBatch)
+	{
+		int batchPages = std::min(pagesPerBatch, numPages - firstPage);
+		pool.ParallelFor(batchPages, [&](int begin, int end, int)
+		{
+			for (int p = begin; p < end; ++p)
+			{
+				int page = firstPage + p;
+				int firstPatch = page * pagePatches;
+				int count = std::min(pagePatches, numPatches - firstPatch);
+				glm::vec3* controlPoints = &batch[(size_t)p * pagePatches * 16];
+
+				glm::vec3 pageMin(FLT_MAX), pageMax(-FLT_MAX);
+				for (int i = 0; i < count; ++i)
+				{
+					source(order[firstPatch + i].second, controlPoints + i * 16);
+					glm::vec3 minPos, maxPos;
+					PatchEvaluator::Bounds(controlPoints + i * 16, minPos, maxPos);
+					pageMin = glm::min(pageMin, minPos);
+					pageMax = glm::max(pageMax, maxPos);
+				}
+
+				DatabasePageEntry& entry = table[page];
+				for (int k = 0; k < 3; ++k)
+				{
+					entry.minPos[k] = pageMin[k];
+					entry.maxPos[k] = pageMax[k];
+				}
+				entry.firstPatch = firstPatch;
+				entry.numPatches = count;
+			}
+		}, 1);
+
+		for (int p = 0; p < batchPages; ++p)
+		{
+			DatabasePageEntry& entry = table[firstPage + p];
+			entry.offset = offset;
+			size_t bytes = entry.numPatches * 16 * sizeof(glm::vec3);
+			file.write((const char*)&batch[(size_t)p * pagePatches * 16], bytes);
+			offset += bytes;
+		}
+	}
+
+	file.seekp(tableOffset);
+	file.write((const char*)table.data(), table.size() * sizeof(DatabasePageEntry));
+
+	if (statsOut)
+	{
+		statsOut->patches = numPatches;
+		statsOut->pages = numPages;
+		statsOut->bytesWritten = offset;
+		statsOut->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	return (bool)file;
+}
+
+bool PatchDatabase::Open(const char* fileName)
+{
+	_pages.clear();
+
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	DatabaseHeader header;
+	file.read((char*)&header, sizeof(header));
+	if (!file || memcmp(header.magic, DATABASE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		std::cout << fileName << " is not a patch database" << std::endl;
+		return false;
+	}
+
+	std::vector<DatabasePageEntry> table(header.numPages);
+	file.read((char*)table.data(), table.size() * sizeof(DatabasePageEntry));
+	if (!file)
+		return false;
+
+	_fileName = fileName;
+	_numPatches = header.numPatches;
+	_pagePatches = header.pagePatches;
+	_minPos = glm::vec3(header.minPos[0], header.minPos[1], header.minPos[2]);
+	_maxPos = glm::vec3(header.maxPos[0], header.maxPos[1], header.maxPos[2]);
+
+	_pages.resize(table.size());
+	for (unsigned int i = 0; i < table.size(); ++i)
+	{
+		PatchPageInfo& page = _pages[i];
+		page.minPos = glm::vec3(table[i].minPos[0], table[i].minPos[1], table[i].minPos[2]);
+		page.maxPos = glm::vec3(table[i].maxPos[0], table[i].maxPos[1], table[i].maxPos[2]);
+		page.firstPatch = table[i].firstPatch;
+		page.numPatches = table[i].numPatches;
+		page.offset = table[i].offset;
+	}
+	return true;
+}
+
+bool PatchDatabase::ReadPage(std::ifstream& file, int page, glm::vec3* controlPoints) const
+{
+	const PatchPageInfo& info = _pages[page];
+	file.clear();
+	file.seekg((std::streamoff)info.offset);
+	file.read((char*)controlPoints, info.numPatches * 16 * sizeof(glm::vec3));
+	return (bool)file;
+}
+
+const char* PatchDatabase::fileName() const { return _fileName.c_str(); }
+int PatchDatabase::numPatches() const { return _numPatches; }
+int PatchDatabase::numPages() const { return (int)_pages.size(); }
+int PatchDatabase::pagePatches() const { return _pagePatches; }
+const PatchPageInfo& PatchDatabase::page(int index) const { return _pages[index]; }
+glm::vec3 PatchDatabase::minPos() const { return _minPos; }
+glm::vec3 PatchDatabase::maxPos() const { return _maxPos; }
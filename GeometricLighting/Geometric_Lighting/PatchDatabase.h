@@ -0,0 +1,66 @@
+#pragma once
+#include "MeshExporter.h"
+
+#include <GLM/glm.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+
+// Where a page lives in the file and what it covers
+struct PatchPageInfo
+{
+	glm::vec3 minPos;
+	glm::vec3 maxPos;
+	unsigned int firstPatch;
+	unsigned int numPatches;
+	unsigned long long offset;
+};
+
+struct PatchDatabaseBuildStats
+{
+	unsigned long long patches = 0;
+	unsigned int pages = 0;
+	unsigned long long bytesWritten = 0;
+	double seconds = 0.0;
+};
+
+// A file of Bezier patches too large to keep in memory, split into pages of spatially close
+// patches. Patches are sorted along a Morton (Z order) curve through the centers of their
+// bounds before they are cut into pages, so each page covers a compact piece of the model and
+// loading the pages near the camera brings in little that is far away.
+//
+// The header and the page table with every page's bounds are small and read whole by Open;
+// page contents (16 control points per patch) are read separately with ReadPage.
+class PatchDatabase
+{
+public:
+	PatchDatabase();
+
+	// The source is called twice per patch, in any order, and from several threads at once
+	static bool Build(const char* fileName, int numPatches, const PatchSource& source, int pagePatches = DEFAULT_PAGE_PATCHES,
+		int numThreads = 0, PatchDatabaseBuildStats* stats = nullptr);
+
+	bool Open(const char* fileName);
+
+	// Reads one page's control points with the given stream. Streams aren't shared between
+	// threads, so every reader opens the file for itself.
+	bool ReadPage(std::ifstream& file, int page, glm::vec3* controlPoints) const;
+
+	const char* fileName() const;
+	int numPatches() const;
+	int numPages() const;
+	int pagePatches() const;
+	const PatchPageInfo& page(int index) const;
+	glm::vec3 minPos() const;
+	glm::vec3 maxPos() const;
+
+	static const int DEFAULT_PAGE_PATCHES = 256;
+
+private:
+	std::string _fileName;
+	int _numPatches;
+	int _pagePatches;
+	glm::vec3 _minPos;
+	glm::vec3 _maxPos;
+	std::vector<PatchPageInfo> _pages;
+};
@@ -0,0 +1,424 @@
+#include "PatchEvaluator.h"
+#include "SimdLanes.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// The Bernstein factors for every step along a resolution long edge, 7 per step
+class BernsteinFactors
+{
+public:
+	BernsteinFactors(int resolution)
+	{
+		// The factors only depend on the resolution, keep them on the stack for any sensible size
+		_factors = _stackFactors;
+		if (resolution > MAX_STACK_RESOLUTION)
+		{
+			_heapFactors.resize(resolution * 7);
+			_factors = &_heapFactors[0];
+		}
+
+		float inc = 1.0f / ((float)resolution - 1.0f);
+		float t = 0.0f;
+
+		for (int i = 0; i < resolution; ++i, t += inc)
+		{
+			float t_sqr = t * t;
+			float t_inv = (1 - t);
+			float t_inv_sqr = t_inv * t_inv;
+
+			// These are the factors used in a Bernstein polynomial
+			// Bernstein polynomials increase in order as the number of
+			// control points increases. For four control points, we'll
+			// use a third order polynomial.
+			float* f = &_factors[i * 7];
+			f[0] = t_inv * t_inv_sqr;
+			f[1] = 3 * t * t_inv_sqr;
+			f[2] = 3 * t_sqr * t_inv;
+			f[3] = t * t_sqr;
+
+			// One of the great mathematical properties of Bernstein
+			// polynomials is that each order lower you go, you go
+			// down one derivation and each order higher you go, you
+			// go up one integration. Calculus!
+			// In this case, we're storing one order lower to get
+			// the slope of the bezier curve for finding the normal
+			f[4] = t_inv_sqr;
+			f[5] = 2 * t * t_inv;
+			f[6] = t_sqr;
+		}
+	}
+
+	const float* operator[](int i) const { return &_factors[i * 7]; }
+
+private:
+	static const int MAX_STACK_RESOLUTION = 64;
+	float _stackFactors[MAX_STACK_RESOLUTION * 7];
+	std::vector<float> _heapFactors;
+	float* _factors;
+};
+
+// glm::normalize, except that a vector that vanishes, like a tangent along a patch edge collapsed
+// to a point, comes back as zero instead of NaN. Normalize3 does the same in SIMD lanes.
+static inline glm::vec3 Normalize(const glm::vec3& a)
+{
+	return a * (1.0f / std::max(std::sqrt(glm::dot(a, a)), 1e-20f));
+}
+
+void PatchEvaluator::Tessellate(const glm::vec3 controlPoints[16], int resolution, float* verts)
+{
+	BernsteinFactors factors(resolution);
+
+	const glm::vec3* cp = controlPoints;
+	glm::vec3 newControlPoints[4];
+	glm::vec3 newSlopeControlPoints[4];
+	for (int i = 0; i < resolution; ++i)
+	{
+		const float* fi = factors[i];
+		newControlPoints[0] = fi[0] * cp[0] + fi[1] * cp[1] + fi[2] * cp[2] + fi[3] * cp[3];
+		newControlPoints[1] = fi[0] * cp[4] + fi[1] * cp[5] + fi[2] * cp[6] + fi[3] * cp[7];
+		newControlPoints[2] = fi[0] * cp[8] + fi[1] * cp[9] + fi[2] * cp[10] + fi[3] * cp[11];
+		newControlPoints[3] = fi[0] * cp[12] + fi[1] * cp[13] + fi[2] * cp[14] + fi[3] * cp[15];
+
+		// These represent the columnar tangents for each row of verticies in the bezier surface
+		// Use the derivitave of the Bernstein polynomial to determine the normal of the curve at this point using the difference between control points as slope control points
+		// (1-t)^2 + 2t(1-t) + t^2
+		newSlopeControlPoints[0] = fi[4] * (cp[1] - cp[0]) + fi[5] * (cp[2] - cp[1]) + fi[6] * (cp[3] - cp[2]);
+		newSlopeControlPoints[1] = fi[4] * (cp[5] - cp[4]) + fi[5] * (cp[6] - cp[5]) + fi[6] * (cp[7] - cp[6]);
+		newSlopeControlPoints[2] = fi[4] * (cp[9] - cp[8]) + fi[5] * (cp[10] - cp[9]) + fi[6] * (cp[11] - cp[10]);
+		newSlopeControlPoints[3] = fi[4] * (cp[13] - cp[12]) + fi[5] * (cp[14] - cp[13]) + fi[6] * (cp[15] - cp[14]);
+
+		for (int j = 0; j < resolution; ++j)
+		{
+			const float* fj = factors[j];
+			float* vert = &verts[(j + (i * resolution)) * FLOATS_PER_VERT];
+
+			glm::vec3 newPoint = fj[0] * newControlPoints[0] + fj[1] * newControlPoints[1] + fj[2] * newControlPoints[2] + fj[3] * newControlPoints[3];
+			vert[0] = newPoint.x;
+			vert[1] = newPoint.y;
+			vert[2] = newPoint.z;
+
+			// This tangent represents the row tangent, so the tangent of the surface relative to the surface's x direction
+			glm::vec3 tangentA = fj[4] * (newControlPoints[1] - newControlPoints[0]) + fj[5] * (newControlPoints[2] - newControlPoints[1]) + fj[6] * (newControlPoints[3] - newControlPoints[2]);
+
+			// This tangent is a second valid tangent necessary for finding a cross product, this one being relative to the surface's y direction
+			glm::vec3 tangentB = fj[0] * newSlopeControlPoints[0] + fj[1] * newSlopeControlPoints[1] + fj[2] * newSlopeControlPoints[2] + fj[3] * newSlopeControlPoints[3];
+
+			// By taking the normal of these two tangents, we can get the normal to the surface
+			glm::vec3 normal = glm::cross(Normalize(tangentB), Normalize(tangentA));
+
+			vert[3] = normal.x;
+			vert[4] = normal.y;
+			vert[5] = normal.z;
+		}
+	}
+}
+
+// f[0] * a + f[1] * b + f[2] * c + f[3] * d in every lane
+static inline Lanes3 Blend(const Lanes f[4], const Lanes3& a, const Lanes3& b, const Lanes3& c, const Lanes3& d)
+{
+	return Add3(Add3(Scale3(a, f[0]), Scale3(b, f[1])), Add3(Scale3(c, f[2]), Scale3(d, f[3])));
+}
+
+// The derivative's f[0] * (b - a) + f[1] * (c - b) + f[2] * (d - c)
+static inline Lanes3 BlendSlope(const Lanes f[3], const Lanes3& a, const Lanes3& b, const Lanes3& c, const Lanes3& d)
+{
+	return Add3(Add3(Scale3(Sub3(b, a), f[0]), Scale3(Sub3(c, b), f[1])), Scale3(Sub3(d, c), f[2]));
+}
+
+void PatchEvaluator::TessellateBatch(const glm::vec3* controlPoints, int numPatches, int resolution, float* verts)
+{
+	BernsteinFactors factors(resolution);
+	size_t patchFloats = (size_t)NumVerts(resolution) * FLOATS_PER_VERT;
+
+	int p = 0;
+	for (; p + BATCH_PATCHES <= numPatches; p += BATCH_PATCHES)
+	{
+		// Lane l of every control point is patch p + l
+		Lanes3 cp[16];
+		for (int k = 0; k < 16; ++k)
+		{
+			float x[BATCH_PATCHES], y[BATCH_PATCHES], z[BATCH_PATCHES];
+			for (int l = 0; l < BATCH_PATCHES; ++l)
+			{
+				const glm::vec3& point = controlPoints[(p + l) * 16 + k];
+				x[l] = point.x;
+				y[l] = point.y;
+				z[l] = point.z;
+			}
+			cp[k].x = Load(x);
+			cp[k].y = Load(y);
+			cp[k].z = Load(z);
+		}
+
+		float* patchVerts = &verts[p * patchFloats];
+		for (int i = 0; i < resolution; ++i)
+		{
+			const float* fi = factors[i];
+			Lanes rowFactors[4] = { Splat(fi[0]), Splat(fi[1]), Splat(fi[2]), Splat(fi[3]) };
+			Lanes slopeFactors[3] = { Splat(fi[4]), Splat(fi[5]), Splat(fi[6]) };
+
+			// The same row curves and slopes as Tessellate, for four patches at once
+			Lanes3 rows[4], slopes[4];
+			for (int r = 0; r < 4; ++r)
+			{
+				const Lanes3* c = &cp[r * 4];
+				rows[r] = Blend(rowFactors, c[0], c[1], c[2], c[3]);
+				slopes[r] = BlendSlope(slopeFactors, c[0], c[1], c[2], c[3]);
+			}
+
+			for (int j = 0; j < resolution; ++j)
+			{
+				const float* fj = factors[j];
+				Lanes pointFactors[4] = { Splat(fj[0]), Splat(fj[1]), Splat(fj[2]), Splat(fj[3]) };
+				Lanes tangentFactors[3] = { Splat(fj[4]), Splat(fj[5]), Splat(fj[6]) };
+
+				Lanes3 point = Blend(pointFactors, rows[0], rows[1], rows[2], rows[3]);
+				Lanes3 tangentA = BlendSlope(tangentFactors, rows[0], rows[1], rows[2], rows[3]);
+				Lanes3 tangentB = Blend(pointFactors, slopes[0], slopes[1], slopes[2], slopes[3]);
+				Lanes3 normal = Cross3(Normalize3(tangentB), Normalize3(tangentA));
+
+				// Scatter each lane back to its own patch
+				float out[6][BATCH_PATCHES];
+				Store(out[0], point.x);
+				Store(out[1], point.y);
+				Store(out[2], point.z);
+				Store(out[3], normal.x);
+				Store(out[4], normal.y);
+				Store(out[5], normal.z);
+
+				float* vert = &patchVerts[(j + i * resolution) * FLOATS_PER_VERT];
+				for (int l = 0; l < BATCH_PATCHES; ++l, vert += patchFloats)
+				{
+					for (int f = 0; f < FLOATS_PER_VERT; ++f)
+						vert[f] = out[f][l];
+				}
+			}
+		}
+	}
+
+	// Whatever doesn't fill a batch
+	for (; p < numPatches; ++p)
+		Tessellate(&controlPoints[p * 16], resolution, &verts[p * patchFloats]);
+}
+
+// The cubic Bezier basis in powers of t: row a holds the t^a coefficients of the four
+// Bernstein polynomials
+static const float BEZIER_TO_POWER[4][4] =
+{
+	{ 1.0f, 0.0f, 0.0f, 0.0f },
+	{ -3.0f, 3.0f, 0.0f, 0.0f },
+	{ 3.0f, -6.0f, 3.0f, 0.0f },
+	{ -1.0f, 3.0f, -3.0f, 1.0f }
+};
+
+void PatchEvaluator::ToPowerBasis(const glm::vec3 controlPoints[16], glm::vec3 coefficients[16])
+{
+	// M * G * M^T, with the control point rows as G's rows, one matrix product at a time
+	glm::vec3 rows[16];
+	for (int k = 0; k < 4; ++k)
+	{
+		for (int a = 0; a < 4; ++a)
+		{
+			glm::vec3 sum;
+			for (int c = 0; c < 4; ++c)
+				sum += BEZIER_TO_POWER[a][c] * controlPoints[k * 4 + c];
+			rows[k * 4 + a] = sum;
+		}
+	}
+	for (int b = 0; b < 4; ++b)
+	{
+		for (int a = 0; a < 4; ++a)
+		{
+			glm::vec3 sum;
+			for (int k = 0; k < 4; ++k)
+				sum += BEZIER_TO_POWER[b][k] * rows[k * 4 + a];
+			coefficients[b * 4 + a] = sum;
+		}
+	}
+}
+
+// The cubic in u (and its derivative in v) along the grid row at v: four coefficients each
+static inline void RowPolynomials(const glm::vec3 coefficients[16], float v, glm::vec3 row[4], glm::vec3 rowDv[4])
+{
+	for (int b = 0; b < 4; ++b)
+	{
+		const glm::vec3* c = &coefficients[b * 4];
+		row[b] = ((c[3] * v + c[2]) * v + c[1]) * v + c[0];
+		rowDv[b] = (c[3] * (3.0f * v) + c[2] * 2.0f) * v + c[1];
+	}
+}
+
+static inline void WriteVert(float* vert, const glm::vec3& position, const glm::vec3& dv, const glm::vec3& du)
+{
+	// The same normal, of the same length, as the Bernstein kernel's
+	glm::vec3 normal = glm::cross(Normalize(dv), Normalize(du));
+	vert[0] = position.x;
+	vert[1] = position.y;
+	vert[2] = position.z;
+	vert[3] = normal.x;
+	vert[4] = normal.y;
+	vert[5] = normal.z;
+}
+
+void PatchEvaluator::TessellatePowerBasis(const glm::vec3 coefficients[16], int resolution, float* verts)
+{
+	float inc = 1.0f / ((float)resolution - 1.0f);
+	glm::vec3 row[4], rowDv[4];
+	for (int i = 0; i < resolution; ++i)
+	{
+		RowPolynomials(coefficients, i * inc, row, rowDv);
+		for (int j = 0; j < resolution; ++j)
+		{
+			float u = j * inc;
+			glm::vec3 position = ((row[3] * u + row[2]) * u + row[1]) * u + row[0];
+			glm::vec3 du = (row[3] * (3.0f * u) + row[2] * 2.0f) * u + row[1];
+			glm::vec3 dv = ((rowDv[3] * u + rowDv[2]) * u + rowDv[1]) * u + rowDv[0];
+			WriteVert(&verts[(j + i * resolution) * FLOATS_PER_VERT], position, dv, du);
+		}
+	}
+}
+
+void PatchEvaluator::TessellateForwardDifference(const glm::vec3 coefficients[16], int resolution, float* verts)
+{
+	float h = 1.0f / ((float)resolution - 1.0f);
+	float h2 = h * h;
+	float h3 = h2 * h;
+	glm::vec3 row[4], rowDv[4];
+	for (int i = 0; i < resolution; ++i)
+	{
+		// Starting each row from Horner's rule keeps the drift to one row's worth of steps
+		RowPolynomials(coefficients, i * h, row, rowDv);
+
+		// A cubic a + bu + cu^2 + du^3 steps by position1, which steps by position2, which steps by
+		// the constant position3
+		glm::vec3 position = row[0];
+		glm::vec3 position1 = row[1] * h + row[2] * h2 + row[3] * h3;
+		glm::vec3 position2 = row[2] * (2.0f * h2) + row[3] * (6.0f * h3);
+		glm::vec3 position3 = row[3] * (6.0f * h3);
+
+		glm::vec3 dv = rowDv[0];
+		glm::vec3 dv1 = rowDv[1] * h + rowDv[2] * h2 + rowDv[3] * h3;
+		glm::vec3 dv2 = rowDv[2] * (2.0f * h2) + rowDv[3] * (6.0f * h3);
+		glm::vec3 dv3 = rowDv[3] * (6.0f * h3);
+
+		// The u tangent b + 2cu + 3du^2 is a quadratic
+		glm::vec3 du = row[1];
+		glm::vec3 du1 = row[2] * (2.0f * h) + row[3] * (3.0f * h2);
+		glm::vec3 du2 = row[3] * (6.0f * h2);
+
+		float* vert = &verts[i * resolution * FLOATS_PER_VERT];
+		for (int j = 0; j < resolution; ++j, vert += FLOATS_PER_VERT)
+		{
+			WriteVert(vert, position, dv, du);
+
+			position += position1;
+			position1 += position2;
+			position2 += position3;
+
+			dv += dv1;
+			dv1 += dv2;
+			dv2 += dv3;
+
+			du += du1;
+			du1 += du2;
+		}
+	}
+}
+
+void PatchEvaluator::GenerateElements(int resolution, unsigned int* elements)
+{
+	// Two triangles for every quad of the grid
+	int faceNum = 0;
+	int quadsPerRow = resolution * (resolution - 1);
+	for (int i = 0; i < quadsPerRow; i += resolution)
+	{
+		for (int j = 0; j < resolution - 1; ++j)
+		{
+			unsigned int* face = &elements[faceNum * 6];
+			face[0] = i + j;
+			face[1] = i + j + 1;
+			face[2] = i + resolution + j;
+
+			face[3] = i + j + 1;
+			face[4] = i + resolution + j + 1;
+			face[5] = i + resolution + j;
+			++faceNum;
+		}
+	}
+}
+
+// The bound on |Suu| + 2 |Suv| + |Svv| over the patch. A cubic's second derivative is 6 times
+// a blend of its control polygon's second differences, and the twist 9 times a blend of the
+// mixed differences, so the largest of those bound them.
+static float SecondDerivativeBound(const glm::vec3 controlPoints[16])
+{
+	const glm::vec3* cp = controlPoints;
+	float uu = 0.0f, uv = 0.0f, vv = 0.0f;
+	for (int a = 0; a < 4; ++a)
+	{
+		for (int b = 0; b < 2; ++b)
+		{
+			// Along a row, and across the rows
+			vv = std::max(vv, glm::length(cp[a * 4 + b + 2] - 2.0f * cp[a * 4 + b + 1] + cp[a * 4 + b]));
+			uu = std::max(uu, glm::length(cp[(b + 2) * 4 + a] - 2.0f * cp[(b + 1) * 4 + a] + cp[b * 4 + a]));
+		}
+	}
+	for (int a = 0; a < 3; ++a)
+	{
+		for (int b = 0; b < 3; ++b)
+			uv = std::max(uv, glm::length(cp[(a + 1) * 4 + b + 1] - cp[(a + 1) * 4 + b] - cp[a * 4 + b + 1] + cp[a * 4 + b]));
+	}
+	return 6.0f * uu + 2.0f * 9.0f * uv + 6.0f * vv;
+}
+
+float PatchEvaluator::ErrorBound(const glm::vec3 controlPoints[16], int resolution)
+{
+	float h = 1.0f / ((float)resolution - 1.0f);
+	return h * h / 8.0f * SecondDerivativeBound(controlPoints);
+}
+
+int PatchEvaluator::MinResolution(const glm::vec3 controlPoints[16], float tolerance, int maxResolution)
+{
+	float derivatives = SecondDerivativeBound(controlPoints);
+	if (derivatives <= 0.0f)
+		return 2;
+	if (tolerance <= 0.0f)
+		return std::max(maxResolution, 2);
+
+	// Solve h^2 / 8 * derivatives = tolerance for the step, then make sure of it against the
+	// bound itself, which rounding could put either side of the answer
+	double steps = ceil(sqrt(derivatives / (8.0 * tolerance)));
+	int resolution = (int)std::min(steps + 1.0, (double)std::max(maxResolution, 2));
+	resolution = std::max(resolution, 2);
+	while (resolution > 2 && ErrorBound(controlPoints, resolution - 1) <= tolerance)
+		--resolution;
+	while (resolution < maxResolution && ErrorBound(controlPoints, resolution) > tolerance)
+		++resolution;
+	return resolution;
+}
+
+void PatchEvaluator::Bounds(const glm::vec3 controlPoints[16], glm::vec3& minPos, glm::vec3& maxPos)
+{
+	minPos = controlPoints[0];
+	maxPos = controlPoints[0];
+	for (int i = 1; i < 16; ++i)
+	{
+		minPos = glm::min(minPos, controlPoints[i]);
+		maxPos = glm::max(maxPos, controlPoints[i]);
+	}
+}
+
+void PatchEvaluator::TransformBounds(const glm::mat4& mat, const glm::vec3& minPos, const glm::vec3& maxPos, glm::vec3& outMin, glm::vec3& outMax)
+{
+	glm::vec3 center = glm::vec3(mat * glm::vec4((minPos + maxPos) * 0.5f, 1.0f));
+	glm::vec3 halfSize = (maxPos - minPos) * 0.5f;
+	glm::vec3 extent;
+	for (int i = 0; i < 3; ++i)
+	{
+		extent[i] = std::fabs(mat[0][i]) * halfSize.x + std::fabs(mat[1][i]) * halfSize.y + std::fabs(mat[2][i]) * halfSize.z;
+	}
+	outMin = center - extent;
+	outMax = center + extent;
+}
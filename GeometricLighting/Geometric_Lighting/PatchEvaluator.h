@@ -0,0 +1,69 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+// Ways of evaluating the same surface. All of them write the same vertices, up to rounding.
+enum class PatchKernel
+{
+	// Sums of Bernstein polynomials times the control points, from scratch for every vertex
+	Bernstein,
+
+	// Horner's rule on the power basis form of the patch
+	PowerBasis,
+
+	// Horner's rule once per row, then forward differences along it: three vector adds for a
+	// position, two for each tangent. Rounding builds up along a row, so long rows drift.
+	ForwardDifference
+};
+
+// The Bernstein polynomial evaluation behind Patch, without any GL calls, so the same surface
+// can be generated for rendering, exporting or any other CPU side consumer.
+class PatchEvaluator
+{
+public:
+	// Each vertex is a position followed by a normal
+	static const int FLOATS_PER_VERT = 6;
+
+	// Evaluates a bicubic Bezier patch on a resolution x resolution grid, writing
+	// interleaved position/normal vertices with u varying fastest. Vertices where a tangent
+	// vanishes, as on an edge collapsed to a point, get a zero normal, here and in every
+	// other kernel.
+	static void Tessellate(const glm::vec3 controlPoints[16], int resolution, float* verts);
+
+	// Tessellate for numPatches patches, 16 control points each, one after the other in both
+	// controlPoints and verts. Patches are evaluated BATCH_PATCHES at a time, one per SIMD lane,
+	// so small grids keep every lane busy where spreading one patch's vertices over the lanes
+	// would leave most of them idle.
+	static void TessellateBatch(const glm::vec3* controlPoints, int numPatches, int resolution, float* verts);
+	static const int BATCH_PATCHES = 4;
+
+	// The power basis form of a patch: coefficients[b * 4 + a] multiplies v^a u^b, where v blends
+	// along each control point row and u across the rows. Only changes with the control points.
+	static void ToPowerBasis(const glm::vec3 controlPoints[16], glm::vec3 coefficients[16]);
+
+	// Tessellate's grid and vertices, from the power basis form
+	static void TessellatePowerBasis(const glm::vec3 coefficients[16], int resolution, float* verts);
+	static void TessellateForwardDifference(const glm::vec3 coefficients[16], int resolution, float* verts);
+
+	// Writes the triangle list for a resolution x resolution grid of vertices
+	static void GenerateElements(int resolution, unsigned int* elements);
+
+	// Box around a patch. A Bezier patch lies inside the convex hull of its control points, so
+	// the box around those holds the whole surface.
+	static void Bounds(const glm::vec3 controlPoints[16], glm::vec3& minPos, glm::vec3& maxPos);
+
+	// Box around a box after a transform: the center is transformed and the half size projected
+	// onto the new axes
+	static void TransformBounds(const glm::mat4& mat, const glm::vec3& minPos, const glm::vec3& maxPos, glm::vec3& outMin, glm::vec3& outMax);
+
+	// Upper bound on how far the triangles of a resolution x resolution grid can be from the
+	// surface they stand in for, at the same (u, v). It follows from the largest second
+	// differences of the control net, which bound the surface's second derivatives: for grid
+	// steps h the triangles are within h^2 / 8 * (|Suu| + 2 |Suv| + |Svv|) of the surface.
+	static float ErrorBound(const glm::vec3 controlPoints[16], int resolution);
+
+	// The smallest resolution whose ErrorBound is within tolerance, up to maxResolution
+	static int MinResolution(const glm::vec3 controlPoints[16], float tolerance, int maxResolution);
+
+	static int NumVerts(int resolution) { return resolution * resolution; }
+	static int NumElements(int resolution) { return (resolution - 1) * (resolution - 1) * 6; }
+};
@@ -0,0 +1,525 @@
+#include "PatchFitter.h"
+#include "MeshImporter.h"
+#include "WorkerPool.h"
+
+#include <GLM/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cfloat>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// A connected piece of the mesh inside one grid cell of one orientation class.
+// Positions are split into (u, v) along the plane and a height h along the class axis.
+struct FitRegion
+{
+	int orientation;	// axis * 2 + (1 if facing down the axis)
+	int cellU, cellV;
+	bool fullCell;		// covers its whole cell, so its borders line up with its neighbors
+
+	// Parameter domain, in world units along the u and v axes
+	float uMin, uMax, vMin, vMax;
+
+	std::vector<unsigned int> verts;
+
+	double heights[16];
+	bool fitted;
+
+	double squaredError;
+	double maxError;
+};
+
+// World axes for an orientation class. u and v are picked so that cross(u, v) points out of
+// the surface, which keeps the winding of the fitted patches the same as the mesh.
+static void OrientationAxes(int orientation, int& uAxis, int& vAxis, int& hAxis)
+{
+	hAxis = orientation / 2;
+	if (orientation % 2 == 0)
+	{
+		uAxis = (hAxis + 1) % 3;
+		vAxis = (hAxis + 2) % 3;
+	}
+	else
+	{
+		uAxis = (hAxis + 2) % 3;
+		vAxis = (hAxis + 1) % 3;
+	}
+}
+
+static void Bernstein(double t, double b[4])
+{
+	double s = 1.0 - t;
+	b[0] = s * s * s;
+	b[1] = 3.0 * t * s * s;
+	b[2] = 3.0 * t * t * s;
+	b[3] = t * t * t;
+}
+
+static double EvaluateHeight(const double heights[16], double u, double v)
+{
+	double bu[4], bv[4];
+	Bernstein(u, bu);
+	Bernstein(v, bv);
+
+	double h = 0.0;
+	for (int row = 0; row < 4; row++)
+		for (int col = 0; col < 4; col++)
+			h += heights[row * 4 + col] * bu[col] * bv[row];
+	return h;
+}
+
+// Solves the 16x16 system a * x = b in place with partial pivoting
+static bool Solve16(double a[16][16], double b[16], double x[16])
+{
+	for (int col = 0; col < 16; col++)
+	{
+		int pivot = col;
+		for (int row = col + 1; row < 16; row++)
+			if (std::abs(a[row][col]) > std::abs(a[pivot][col]))
+				pivot = row;
+		if (std::abs(a[pivot][col]) < 1e-14)
+			return false;
+
+		if (pivot != col)
+		{
+			for (int k = 0; k < 16; k++)
+				std::swap(a[col][k], a[pivot][k]);
+			std::swap(b[col], b[pivot]);
+		}
+
+		for (int row = col + 1; row < 16; row++)
+		{
+			double factor = a[row][col] / a[col][col];
+			if (factor == 0.0)
+				continue;
+			for (int k = col; k < 16; k++)
+				a[row][k] -= factor * a[col][k];
+			b[row] -= factor * b[col];
+		}
+	}
+
+	for (int row = 15; row >= 0; row--)
+	{
+		double sum = b[row];
+		for (int k = row + 1; k < 16; k++)
+			sum -= a[row][k] * x[k];
+		x[row] = sum / a[row][row];
+	}
+	return true;
+}
+
+// Adds weight * (x[i] - 2 x[j] + x[k])^2 to the normal equations
+static void AddSecondDifference(double a[16][16], int i, int j, int k, double weight)
+{
+	int index[3] = { i, j, k };
+	double coefficient[3] = { 1.0, -2.0, 1.0 };
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 3; c++)
+			a[index[r]][index[c]] += weight * coefficient[r] * coefficient[c];
+}
+
+// Least squares fit of the 16 control point heights to the region's vertices
+static void FitRegionHeights(FitRegion& region, const float* verts, int uAxis, int vAxis, int hAxis, double smoothing)
+{
+	double a[16][16] = {};
+	double b[16] = {};
+	double heightSum = 0.0;
+
+	double uScale = 1.0 / (region.uMax - region.uMin);
+	double vScale = 1.0 / (region.vMax - region.vMin);
+
+	for (size_t i = 0; i < region.verts.size(); i++)
+	{
+		const float* p = verts + region.verts[i] * 6;
+		double u = std::min(std::max((p[uAxis] - region.uMin) * uScale, 0.0), 1.0);
+		double v = std::min(std::max((p[vAxis] - region.vMin) * vScale, 0.0), 1.0);
+		double h = p[hAxis];
+		heightSum += h;
+
+		double bu[4], bv[4];
+		Bernstein(u, bu);
+		Bernstein(v, bv);
+
+		double basis[16];
+		for (int row = 0; row < 4; row++)
+			for (int col = 0; col < 4; col++)
+				basis[row * 4 + col] = bu[col] * bv[row];
+
+		for (int r = 0; r < 16; r++)
+		{
+			if (basis[r] == 0.0)
+				continue;
+			for (int c = 0; c < 16; c++)
+				a[r][c] += basis[r] * basis[c];
+			b[r] += basis[r] * h;
+		}
+	}
+
+	// The smoothing term penalizes bending of the control net along its rows and columns.
+	// It fills in the parts of the domain the mesh doesn't reach with something flat instead
+	// of letting the fit wander off there.
+	double weight = smoothing * region.verts.size();
+	for (int line = 0; line < 4; line++)
+	{
+		for (int k = 0; k < 2; k++)
+		{
+			AddSecondDifference(a, line * 4 + k, line * 4 + k + 1, line * 4 + k + 2, weight);
+			AddSecondDifference(a, k * 4 + line, (k + 1) * 4 + line, (k + 2) * 4 + line, weight);
+		}
+	}
+
+	// A very small pull towards the mean height keeps the system solvable when the vertices
+	// don't pin down every control point (all of them on a line, for example)
+	double mean = heightSum / region.verts.size();
+	double ridge = 1e-8 * region.verts.size();
+	for (int k = 0; k < 16; k++)
+	{
+		a[k][k] += ridge;
+		b[k] += ridge * mean;
+	}
+
+	region.fitted = Solve16(a, b, region.heights);
+}
+
+// Makes the patches on either side of a seam meet (C0), then moves the control points next to
+// the seam so that they stay collinear with the shared point across it (C1, which is G1 as
+// well). Neighbors share the same cell size and the parameter runs the same way on both sides,
+// so the tangent lengths match and only the heights need to change.
+static void JoinSeam(double* left, double* right, int leftEdge, int leftInner, int rightEdge, int rightInner, int stride, bool tangents)
+{
+	for (int k = 0; k < 4; k++)
+	{
+		double& l = left[leftInner + k * stride];
+		double& le = left[leftEdge + k * stride];
+		double& re = right[rightEdge + k * stride];
+		double& r = right[rightInner + k * stride];
+
+		double edge = 0.5 * (le + re);
+		le = edge;
+		re = edge;
+
+		if (tangents)
+		{
+			double shift = edge - 0.5 * (l + r);
+			l += shift;
+			r += shift;
+		}
+	}
+}
+
+static long long CellKey(int orientation, int cellU, int cellV)
+{
+	return ((long long)orientation << 48) | ((long long)(cellU & 0xFFFFFF) << 24) | (long long)(cellV & 0xFFFFFF);
+}
+
+static int FindRoot(std::vector<int>& parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+bool PatchFitter::Fit(const ImportedMesh& mesh, std::vector<glm::vec3>& controlPoints, const PatchFitOptions& options, PatchFitStats* statsOut)
+{
+	Clock::time_point start = Clock::now();
+
+	PatchFitStats stats;
+	const float* verts = mesh.verts.data();
+	const unsigned int* elements = mesh.elements.data();
+	size_t numTriangles = mesh.elements.size() / 3;
+
+	stats.meshVertices = mesh.verts.size() / 6;
+	stats.meshTriangles = numTriangles;
+	stats.meshBytes = mesh.verts.size() * sizeof(float) + mesh.elements.size() * sizeof(unsigned int);
+
+	glm::vec3 extent = mesh.maxPos - mesh.minPos;
+	stats.boundsDiagonal = glm::length(extent);
+	float longest = std::max(extent.x, std::max(extent.y, extent.z));
+	if (numTriangles == 0 || longest <= 0.0f)
+	{
+		std::cout << "Nothing to fit" << std::endl;
+		return false;
+	}
+
+	int cellsAcross = std::max(options.cellsAcross, 1);
+	float cellSize = longest / cellsAcross;
+
+	// Bucket the faces by orientation class and grid cell. Sorting the (cell, face) pairs keeps
+	// each bucket contiguous.
+	std::vector<std::pair<long long, unsigned int> > faceCells(numTriangles);
+	for (size_t f = 0; f < numTriangles; f++)
+	{
+		glm::vec3 p0 = glm::make_vec3(verts + elements[f * 3 + 0] * 6);
+		glm::vec3 p1 = glm::make_vec3(verts + elements[f * 3 + 1] * 6);
+		glm::vec3 p2 = glm::make_vec3(verts + elements[f * 3 + 2] * 6);
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		glm::vec3 magnitude = glm::abs(normal);
+
+		int axis = 0;
+		if (magnitude.y > magnitude[axis])
+			axis = 1;
+		if (magnitude.z > magnitude[axis])
+			axis = 2;
+		int orientation = axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+
+		int uAxis, vAxis, hAxis;
+		OrientationAxes(orientation, uAxis, vAxis, hAxis);
+		glm::vec3 center = (p0 + p1 + p2) / 3.0f - mesh.minPos;
+		int cellU = std::min((int)(center[uAxis] / cellSize), cellsAcross - 1);
+		int cellV = std::min((int)(center[vAxis] / cellSize), cellsAcross - 1);
+
+		faceCells[f] = std::make_pair(CellKey(orientation, cellU, cellV), (unsigned int)f);
+	}
+	std::sort(faceCells.begin(), faceCells.end());
+
+	// Split each bucket into connected pieces. Faces that only share a cell (the spout and the
+	// body behind it, say) are different surfaces and need their own patches.
+	std::vector<FitRegion> regions;
+	std::unordered_map<unsigned int, int> vertexFace;
+	std::vector<int> parent;
+	std::vector<int> componentRegion;
+	for (size_t first = 0; first < faceCells.size();)
+	{
+		size_t last = first;
+		while (last < faceCells.size() && faceCells[last].first == faceCells[first].first)
+			last++;
+		int count = (int)(last - first);
+
+		vertexFace.clear();
+		parent.resize(count);
+		for (int i = 0; i < count; i++)
+			parent[i] = i;
+		for (int i = 0; i < count; i++)
+		{
+			unsigned int f = faceCells[first + i].second;
+			for (int k = 0; k < 3; k++)
+			{
+				std::pair<std::unordered_map<unsigned int, int>::iterator, bool> inserted = vertexFace.insert(std::make_pair(elements[f * 3 + k], i));
+				if (!inserted.second)
+				{
+					int a = FindRoot(parent, i);
+					int b = FindRoot(parent, inserted.first->second);
+					if (a != b)
+						parent[a] = b;
+				}
+			}
+		}
+
+		long long key = faceCells[first].first;
+		int orientation = (int)(key >> 48);
+		int cellU = (int)((key >> 24) & 0xFFFFFF);
+		int cellV = (int)(key & 0xFFFFFF);
+
+		componentRegion.assign(count, -1);
+		for (std::unordered_map<unsigned int, int>::iterator it = vertexFace.begin(); it != vertexFace.end(); ++it)
+		{
+			int root = FindRoot(parent, it->second);
+			if (componentRegion[root] < 0)
+			{
+				componentRegion[root] = (int)regions.size();
+				regions.push_back(FitRegion());
+				FitRegion& region = regions.back();
+				region.orientation = orientation;
+				region.cellU = cellU;
+				region.cellV = cellV;
+				region.fitted = false;
+				region.squaredError = 0.0;
+				region.maxError = 0.0;
+			}
+			regions[componentRegion[root]].verts.push_back(it->first);
+		}
+
+		first = last;
+	}
+
+	// Domains: the cell, shrunk to the part the region covers so partial regions don't spend
+	// their control points on empty space
+	for (size_t r = 0; r < regions.size(); r++)
+	{
+		FitRegion& region = regions[r];
+		int uAxis, vAxis, hAxis;
+		OrientationAxes(region.orientation, uAxis, vAxis, hAxis);
+
+		float cellUMin = mesh.minPos[uAxis] + region.cellU * cellSize;
+		float cellVMin = mesh.minPos[vAxis] + region.cellV * cellSize;
+
+		float uMin = FLT_MAX, uMax = -FLT_MAX, vMin = FLT_MAX, vMax = -FLT_MAX;
+		for (size_t i = 0; i < region.verts.size(); i++)
+		{
+			const float* p = verts + region.verts[i] * 6;
+			uMin = std::min(uMin, p[uAxis]);
+			uMax = std::max(uMax, p[uAxis]);
+			vMin = std::min(vMin, p[vAxis]);
+			vMax = std::max(vMax, p[vAxis]);
+		}
+
+		region.uMin = std::max(uMin, cellUMin);
+		region.uMax = std::min(uMax, cellUMin + cellSize);
+		region.vMin = std::max(vMin, cellVMin);
+		region.vMax = std::min(vMax, cellVMin + cellSize);
+
+		// Faces are bucketed by their centers, so a region that fills its cell pokes slightly out
+		// of it on every side
+		region.fullCell = region.uMin <= cellUMin && region.uMax >= cellUMin + cellSize
+			&& region.vMin <= cellVMin && region.vMax >= cellVMin + cellSize;
+		if (region.fullCell)
+		{
+			region.uMin = cellUMin;
+			region.uMax = cellUMin + cellSize;
+			region.vMin = cellVMin;
+			region.vMax = cellVMin + cellSize;
+		}
+	}
+
+	WorkerPool pool(options.numThreads);
+	pool.ParallelFor((int)regions.size(), [&](int begin, int end, int)
+	{
+		for (int r = begin; r < end; r++)
+		{
+			FitRegion& region = regions[r];
+			float minExtent = 1e-4f * cellSize;
+			if ((int)region.verts.size() < options.minVerticesPerRegion || region.uMax - region.uMin < minExtent || region.vMax - region.vMin < minExtent)
+				continue;
+
+			int uAxis, vAxis, hAxis;
+			OrientationAxes(region.orientation, uAxis, vAxis, hAxis);
+			FitRegionHeights(region, verts, uAxis, vAxis, hAxis, options.smoothing);
+		}
+	}, 1);
+
+	// Seams between fully covered neighbors of the same class. A cell can hold more than one
+	// region, and then it is unclear which one continues into the neighbor, so those are left
+	// alone.
+	if (options.enforceG1)
+	{
+		std::unordered_map<long long, int> cellRegion;
+		for (size_t r = 0; r < regions.size(); r++)
+		{
+			FitRegion& region = regions[r];
+			long long key = CellKey(region.orientation, region.cellU, region.cellV);
+			std::pair<std::unordered_map<long long, int>::iterator, bool> inserted = cellRegion.insert(std::make_pair(key, (int)r));
+			if (!inserted.second)
+				inserted.first->second = -1;
+		}
+
+		std::vector<std::pair<int, int> > uSeams, vSeams;
+		for (size_t r = 0; r < regions.size(); r++)
+		{
+			FitRegion& region = regions[r];
+			std::unordered_map<long long, int>::iterator self = cellRegion.find(CellKey(region.orientation, region.cellU, region.cellV));
+			if (self->second != (int)r || !region.fullCell || !region.fitted)
+				continue;
+
+			std::unordered_map<long long, int>::iterator right = cellRegion.find(CellKey(region.orientation, region.cellU + 1, region.cellV));
+			if (right != cellRegion.end() && right->second >= 0 && regions[right->second].fullCell && regions[right->second].fitted)
+				uSeams.push_back(std::make_pair((int)r, right->second));
+
+			std::unordered_map<long long, int>::iterator up = cellRegion.find(CellKey(region.orientation, region.cellU, region.cellV + 1));
+			if (up != cellRegion.end() && up->second >= 0 && regions[up->second].fullCell && regions[up->second].fitted)
+				vSeams.push_back(std::make_pair((int)r, up->second));
+		}
+		stats.seams = uSeams.size() + vSeams.size();
+
+		// Seams share corner control points, so fixing one can disturb another. A few passes
+		// settle them.
+		for (int pass = 0; pass < std::max(options.seamIterations, 1); pass++)
+		{
+			for (size_t s = 0; s < uSeams.size(); s++)
+				JoinSeam(regions[uSeams[s].first].heights, regions[uSeams[s].second].heights, 3, 2, 0, 1, 4, true);
+			for (size_t s = 0; s < vSeams.size(); s++)
+				JoinSeam(regions[vSeams[s].first].heights, regions[vSeams[s].second].heights, 12, 8, 0, 4, 1, true);
+		}
+
+		// The last word goes to C0 so the surface is watertight along the seams even if the
+		// tangents haven't fully settled
+		for (size_t s = 0; s < uSeams.size(); s++)
+			JoinSeam(regions[uSeams[s].first].heights, regions[uSeams[s].second].heights, 3, 2, 0, 1, 4, false);
+		for (size_t s = 0; s < vSeams.size(); s++)
+			JoinSeam(regions[vSeams[s].first].heights, regions[vSeams[s].second].heights, 12, 8, 0, 4, 1, false);
+	}
+
+	// Measure how far the vertices are from the final surfaces, along the class axis
+	pool.ParallelFor((int)regions.size(), [&](int begin, int end, int)
+	{
+		for (int r = begin; r < end; r++)
+		{
+			FitRegion& region = regions[r];
+			if (!region.fitted)
+				continue;
+
+			int uAxis, vAxis, hAxis;
+			OrientationAxes(region.orientation, uAxis, vAxis, hAxis);
+			double uScale = 1.0 / (region.uMax - region.uMin);
+			double vScale = 1.0 / (region.vMax - region.vMin);
+			for (size_t i = 0; i < region.verts.size(); i++)
+			{
+				const float* p = verts + region.verts[i] * 6;
+				double u = std::min(std::max((p[uAxis] - region.uMin) * uScale, 0.0), 1.0);
+				double v = std::min(std::max((p[vAxis] - region.vMin) * vScale, 0.0), 1.0);
+				double error = std::abs(EvaluateHeight(region.heights, u, v) - p[hAxis]);
+				region.squaredError += error * error;
+				region.maxError = std::max(region.maxError, error);
+			}
+		}
+	}, 1);
+
+	size_t measured = 0;
+	double squaredError = 0.0;
+	for (size_t r = 0; r < regions.size(); r++)
+	{
+		const FitRegion& region = regions[r];
+		if (!region.fitted)
+		{
+			stats.skippedRegions++;
+			continue;
+		}
+
+		int uAxis, vAxis, hAxis;
+		OrientationAxes(region.orientation, uAxis, vAxis, hAxis);
+		for (int row = 0; row < 4; row++)
+		{
+			for (int col = 0; col < 4; col++)
+			{
+				glm::vec3 point;
+				point[uAxis] = region.uMin + (region.uMax - region.uMin) * (col / 3.0f);
+				point[vAxis] = region.vMin + (region.vMax - region.vMin) * (row / 3.0f);
+				point[hAxis] = (float)region.heights[row * 4 + col];
+				controlPoints.push_back(point);
+			}
+		}
+
+		stats.regions++;
+		measured += region.verts.size();
+		squaredError += region.squaredError;
+		stats.maxError = std::max(stats.maxError, region.maxError);
+	}
+
+	stats.patchBytes = stats.regions * 16 * sizeof(glm::vec3);
+	stats.rmsError = measured > 0 ? std::sqrt(squaredError / measured) : 0.0;
+	stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	if (statsOut)
+		*statsOut = stats;
+	return stats.regions > 0;
+}
+
+void PatchFitter::PrintStats(const PatchFitStats& stats)
+{
+	std::cout << "Fitted " << stats.regions << " patches to " << stats.meshVertices << " vertices, " << stats.meshTriangles << " triangles"
+		<< " (" << stats.skippedRegions << " regions too small, " << stats.seams << " seams joined) in " << stats.seconds << " s" << std::endl;
+	std::cout << "  " << stats.meshBytes << " bytes of mesh -> " << stats.patchBytes << " bytes of control points";
+	if (stats.patchBytes > 0)
+		std::cout << " (" << (double)stats.meshBytes / stats.patchBytes << "x smaller)";
+	std::cout << std::endl;
+
+	double scale = stats.boundsDiagonal > 0.0 ? 100.0 / stats.boundsDiagonal : 0.0;
+	std::cout << "  error: rms " << stats.rmsError << " (" << stats.rmsError * scale << "% of the bounds diagonal), max "
+		<< stats.maxError << " (" << stats.maxError * scale << "%)" << std::endl;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+struct ImportedMesh;
+
+struct PatchFitOptions
+{
+	// Size of the segmentation grid, in cells across the longest side of the mesh
+	int cellsAcross = 8;
+
+	// Weight of the second difference penalty on the control net, relative to the data term.
+	// Keeps regions the mesh only partly covers from overshooting.
+	float smoothing = 1e-3f;
+
+	// Make neighboring patches share their border and match tangents across it
+	bool enforceG1 = true;
+	int seamIterations = 4;
+
+	// Regions with fewer vertices than this are left out
+	int minVerticesPerRegion = 8;
+
+	int numThreads = 0;
+};
+
+struct PatchFitStats
+{
+	size_t meshVertices = 0;
+	size_t meshTriangles = 0;
+	size_t regions = 0;
+	size_t skippedRegions = 0;
+	size_t seams = 0;
+	size_t meshBytes = 0;
+	size_t patchBytes = 0;
+	double rmsError = 0.0;
+	double maxError = 0.0;
+	double boundsDiagonal = 0.0;
+	double seconds = 0.0;
+};
+
+// Fits bicubic Bezier patches to a dense triangle mesh so it can be stored and rendered as a
+// B_Spline.
+//
+// The mesh is segmented by face orientation into six classes (the major axis of the normal and
+// its sign), then by a square grid over the plane facing that axis, then into connected pieces.
+// Every region is a height field over its grid cell, so it is parameterized by projecting onto
+// the plane and only the heights of the 16 control points need a least squares fit. Within a
+// class, neighboring cells that are fully covered share an edge of the same parameterization,
+// which makes G1 continuity a matter of averaging the seam row and keeping the rows either side
+// of it collinear. Seams between different classes are only as close as the fit makes them.
+class PatchFitter
+{
+public:
+	// Appends 16 control points per fitted patch
+	static bool Fit(const ImportedMesh& mesh, std::vector<glm::vec3>& controlPoints, const PatchFitOptions& options, PatchFitStats* stats = nullptr);
+
+	static void PrintStats(const PatchFitStats& stats);
+};
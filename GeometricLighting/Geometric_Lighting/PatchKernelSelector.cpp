@@ -0,0 +1,211 @@
+#include "PatchKernelSelector.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cctype>
+#include <string>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+std::map<int, PatchKernel> PatchKernelSelector::_selected;
+std::vector<PatchKernelResult> PatchKernelSelector::_results;
+bool PatchKernelSelector::_forced = false;
+PatchKernel PatchKernelSelector::_forcedKernel = PatchKernel::Bernstein;
+
+static const PatchKernel KERNELS[] = { PatchKernel::Bernstein, PatchKernel::PowerBasis, PatchKernel::ForwardDifference };
+
+static void TessellateCoefficients(PatchKernel kernel, const glm::vec3 controlPoints[16], const glm::vec3 coefficients[16], int resolution, float* verts)
+{
+	if (kernel == PatchKernel::PowerBasis)
+		PatchEvaluator::TessellatePowerBasis(coefficients, resolution, verts);
+	else if (kernel == PatchKernel::ForwardDifference)
+		PatchEvaluator::TessellateForwardDifference(coefficients, resolution, verts);
+	else
+		PatchEvaluator::Tessellate(controlPoints, resolution, verts);
+}
+
+// Worst position and normal of verts against reference, numPatches patches of numVerts each
+static void Compare(const std::vector<glm::vec3>& controlPoints, int numVerts, const std::vector<float>& reference, const std::vector<float>& verts, PatchKernelResult& result)
+{
+	const int stride = PatchEvaluator::FLOATS_PER_VERT;
+	int numPatches = (int)controlPoints.size() / 16;
+	double maxPosition = 0.0;
+	double maxAngle = 0.0;
+	for (int p = 0; p < numPatches; ++p)
+	{
+		glm::vec3 minPos, maxPos;
+		PatchEvaluator::Bounds(&controlPoints[p * 16], minPos, maxPos);
+		double extent = std::max((double)glm::length(maxPos - minPos), 1e-12);
+
+		const float* ref = &reference[(size_t)p * numVerts * stride];
+		const float* vert = &verts[(size_t)p * numVerts * stride];
+		for (int v = 0; v < numVerts; ++v, ref += stride, vert += stride)
+		{
+			glm::dvec3 refPos(ref[0], ref[1], ref[2]);
+			glm::dvec3 pos(vert[0], vert[1], vert[2]);
+			maxPosition = std::max(maxPosition, glm::length(pos - refPos) / extent);
+
+			// Degenerate corners (the teapot's lid and bottom have them) have no normal to compare
+			glm::dvec3 refNormal(ref[3], ref[4], ref[5]);
+			glm::dvec3 normal(vert[3], vert[4], vert[5]);
+			double refLength = glm::length(refNormal);
+			if (!(refLength > 1e-6))
+				continue;
+
+			double length = glm::length(normal);
+			double angle = 180.0;
+			if (length > 1e-6)
+				angle = atan2(glm::length(glm::cross(refNormal, normal)), glm::dot(refNormal, normal)) * 180.0 / 3.14159265358979;
+			maxAngle = std::max(maxAngle, angle);
+		}
+	}
+	result.maxPositionError = (float)maxPosition;
+	result.maxNormalDegrees = (float)maxAngle;
+}
+
+PatchKernel PatchKernelSelector::Select(const std::vector<glm::vec3>& controlPoints, int resolution, const PatchKernelSettings& settings)
+{
+	int numPatches = (int)controlPoints.size() / 16;
+	if (numPatches == 0 || resolution < 2)
+		return Kernel(resolution);
+
+	int numVerts = PatchEvaluator::NumVerts(resolution);
+	size_t patchFloats = (size_t)numVerts * PatchEvaluator::FLOATS_PER_VERT;
+	std::vector<float> reference(patchFloats * numPatches);
+	std::vector<float> verts(reference.size());
+	std::vector<glm::vec3> coefficients(controlPoints.size());
+
+	for (int p = 0; p < numPatches; ++p)
+		PatchEvaluator::Tessellate(&controlPoints[p * 16], resolution, &reference[p * patchFloats]);
+
+	// Converting is timed on its own, since callers that keep the coefficients skip it
+	int passes = 0;
+	Clock::time_point start = Clock::now();
+	double seconds;
+	do
+	{
+		for (int p = 0; p < numPatches; ++p)
+			PatchEvaluator::ToPowerBasis(&controlPoints[p * 16], &coefficients[p * 16]);
+		++passes;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	} while (seconds < settings.minSeconds);
+	double conversionNs = seconds * 1e9 / ((double)passes * numPatches);
+
+	_results.erase(std::remove_if(_results.begin(), _results.end(), [resolution](const PatchKernelResult& r) { return r.resolution == resolution; }), _results.end());
+
+	PatchKernel best = PatchKernel::Bernstein;
+	double bestNs = 0.0;
+	for (int k = 0; k < 3; ++k)
+	{
+		PatchKernelResult result;
+		result.kernel = KERNELS[k];
+		result.resolution = resolution;
+
+		passes = 0;
+		start = Clock::now();
+		do
+		{
+			for (int p = 0; p < numPatches; ++p)
+				TessellateCoefficients(result.kernel, &controlPoints[p * 16], &coefficients[p * 16], resolution, &verts[p * patchFloats]);
+			++passes;
+			seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		} while (seconds < settings.minSeconds);
+		result.nsPerVertex = seconds * 1e9 / ((double)passes * numPatches * numVerts);
+
+		if (result.kernel != PatchKernel::Bernstein)
+		{
+			result.conversionNsPerPatch = conversionNs;
+			Compare(controlPoints, numVerts, reference, verts, result);
+			result.safe = result.maxPositionError <= settings.maxPositionError && result.maxNormalDegrees <= settings.maxNormalDegrees;
+		}
+		_results.push_back(result);
+
+		// Patch converts on every surface update, so that counts against the kernel too
+		double ns = result.nsPerVertex * numVerts + result.conversionNsPerPatch;
+		if (result.safe && (k == 0 || ns < bestNs))
+		{
+			best = result.kernel;
+			bestNs = ns;
+		}
+	}
+
+	_selected[resolution] = best;
+	return best;
+}
+
+void PatchKernelSelector::Force(PatchKernel kernel)
+{
+	_forced = true;
+	_forcedKernel = kernel;
+}
+
+PatchKernel PatchKernelSelector::Kernel(int resolution)
+{
+	if (_forced)
+		return _forcedKernel;
+
+	std::map<int, PatchKernel>::const_iterator it = _selected.find(resolution);
+	return it == _selected.end() ? PatchKernel::Bernstein : it->second;
+}
+
+void PatchKernelSelector::Tessellate(const glm::vec3 controlPoints[16], int resolution, float* verts)
+{
+	Tessellate(Kernel(resolution), controlPoints, resolution, verts);
+}
+
+void PatchKernelSelector::Tessellate(PatchKernel kernel, const glm::vec3 controlPoints[16], int resolution, float* verts)
+{
+	glm::vec3 coefficients[16];
+	if (kernel != PatchKernel::Bernstein)
+		PatchEvaluator::ToPowerBasis(controlPoints, coefficients);
+	TessellateCoefficients(kernel, controlPoints, coefficients, resolution, verts);
+}
+
+const std::vector<PatchKernelResult>& PatchKernelSelector::results()
+{
+	return _results;
+}
+
+void PatchKernelSelector::PrintResults()
+{
+	for (size_t i = 0; i < _results.size(); ++i)
+	{
+		const PatchKernelResult& r = _results[i];
+		std::cout << r.resolution << "x" << r.resolution << " " << Name(r.kernel) << ": " << r.nsPerVertex << " ns/vertex";
+		if (r.kernel != PatchKernel::Bernstein)
+		{
+			std::cout << " + " << r.conversionNsPerPatch << " ns/patch converting, off by up to " << r.maxPositionError << " of the patch size and "
+				<< r.maxNormalDegrees << " degrees" << (r.safe ? "" : ", out of tolerance");
+		}
+		if (Kernel(r.resolution) == r.kernel)
+			std::cout << " (used)";
+		std::cout << std::endl;
+	}
+}
+
+const char* PatchKernelSelector::Name(PatchKernel kernel)
+{
+	switch (kernel)
+	{
+	case PatchKernel::PowerBasis: return "PowerBasis";
+	case PatchKernel::ForwardDifference: return "ForwardDifference";
+	default: return "Bernstein";
+	}
+}
+
+bool PatchKernelSelector::FromName(const char* name, PatchKernel& kernel)
+{
+	std::string lower = name;
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	if (lower == "bernstein")
+		kernel = PatchKernel::Bernstein;
+	else if (lower == "powerbasis" || lower == "power")
+		kernel = PatchKernel::PowerBasis;
+	else if (lower == "forwarddifference" || lower == "forward")
+		kernel = PatchKernel::ForwardDifference;
+	else
+		return false;
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "PatchEvaluator.h"
+
+#include <vector>
+#include <map>
+
+struct PatchKernelSettings
+{
+	// Largest distance a vertex may be from the Bernstein one, as a fraction of the size of the
+	// patch's bounding box
+	float maxPositionError = 1e-5f;
+
+	// Largest angle a normal may be from the Bernstein one, in degrees
+	float maxNormalDegrees = 0.05f;
+
+	// Each kernel is run over the sample patches until at least this long has passed, so the
+	// timings aren't down to clock resolution at low resolutions
+	double minSeconds = 0.02;
+};
+
+// How one kernel did at one resolution against the Bernstein kernel
+struct PatchKernelResult
+{
+	PatchKernel kernel = PatchKernel::Bernstein;
+	int resolution = 0;
+
+	// Tessellating, and turning the control points into power basis coefficients first, which is
+	// needed every time the control points change
+	double nsPerVertex = 0.0;
+	double conversionNsPerPatch = 0.0;
+
+	float maxPositionError = 0.0f;
+	float maxNormalDegrees = 0.0f;
+	bool safe = true;
+};
+
+// Chooses how Patch evaluates its surface. Every kernel is timed and checked against the
+// Bernstein one on sample patches at a resolution, and the fastest whose vertices stay within
+// the tolerances is used for that resolution from then on. Resolutions nothing was selected for
+// use the Bernstein kernel.
+class PatchKernelSelector
+{
+public:
+	// controlPoints holds 16 per patch. Returns the kernel picked.
+	static PatchKernel Select(const std::vector<glm::vec3>& controlPoints, int resolution, const PatchKernelSettings& settings = PatchKernelSettings());
+
+	// Uses kernel at every resolution, whatever was selected
+	static void Force(PatchKernel kernel);
+
+	static PatchKernel Kernel(int resolution);
+
+	// Tessellates like PatchEvaluator::Tessellate, with the kernel for the resolution
+	static void Tessellate(const glm::vec3 controlPoints[16], int resolution, float* verts);
+	static void Tessellate(PatchKernel kernel, const glm::vec3 controlPoints[16], int resolution, float* verts);
+
+	// Every kernel at every resolution selected so far
+	static const std::vector<PatchKernelResult>& results();
+	static void PrintResults();
+
+	static const char* Name(PatchKernel kernel);
+
+	// Accepts the names Name gives, in any case, and the short forms "power" and "forward"
+	static bool FromName(const char* name, PatchKernel& kernel);
+
+private:
+	static std::map<int, PatchKernel> _selected;
+	static std::vector<PatchKernelResult> _results;
+	static bool _forced;
+	static PatchKernel _forcedKernel;
+};
@@ -0,0 +1,309 @@
+#include "PatchPager.h"
+#include "PatchEvaluator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+PatchPager::PatchPager()
+{
+	_frame = 0;
+	_running = false;
+	_residentBytes = 0;
+	_publishedResidentBytes.store(0, std::memory_order_relaxed);
+}
+PatchPager::~PatchPager()
+{
+	Close();
+}
+
+bool PatchPager::Open(const char* fileName, const PatchPagerSettings& settings)
+{
+	Close();
+
+	if (!_database.Open(fileName))
+		return false;
+
+	_stallFile.open(fileName, std::ios::binary);
+	if (!_stallFile)
+		return false;
+
+	_settings = settings;
+	_frame = 0;
+	_stats = PatchPagerStats();
+
+	_running = true;
+	for (int i = 0; i < std::max(settings.ioThreads, 1); ++i)
+	{
+		_loaders.push_back(std::thread(&PatchPager::LoaderLoop, this));
+	}
+	return true;
+}
+
+void PatchPager::Close()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+		_requests.clear();
+	}
+	_requestSignal.notify_all();
+
+	unsigned int size = _loaders.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		_loaders[i].join();
+	}
+	_loaders.clear();
+
+	if (_stallFile.is_open())
+		_stallFile.close();
+	_stallFile.clear();
+
+	_inFlight.clear();
+	_lru.clear();
+	_resident.clear();
+	_prefetched.clear();
+	_residentBytes = 0;
+	_publishedResidentBytes.store(0, std::memory_order_relaxed);
+}
+
+void PatchPager::Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat, std::vector<std::shared_ptr<const ResidentPage> >& visible)
+{
+	visible.clear();
+	_visible.clear();
+	_nearby.clear();
+	_missing.clear();
+
+	Frustum frustum;
+	frustum.FromMatrix(viewProjMat);
+
+	// The page table is small enough to test every page against the frustum each frame
+	int numPages = _database.numPages();
+	for (int i = 0; i < numPages; ++i)
+	{
+		const PatchPageInfo& info = _database.page(i);
+		glm::vec3 closest = glm::clamp(cameraPos, info.minPos, info.maxPos);
+		float distance = glm::length(cameraPos - closest);
+
+		if (frustum.IntersectsBox(info.minPos, info.maxPos))
+			_visible.push_back(std::make_pair(distance, i));
+		else if (distance < _settings.prefetchDistance)
+			_nearby.push_back(std::make_pair(distance, i));
+	}
+	std::sort(_visible.begin(), _visible.end());
+	std::sort(_nearby.begin(), _nearby.end());
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_frame++;
+
+		for (unsigned int i = 0; i < _visible.size(); ++i)
+		{
+			int index = _visible[i].second;
+			std::unordered_map<int, PageList::iterator>::iterator found = _resident.find(index);
+			if (found == _resident.end())
+			{
+				_missing.push_back(index);
+				continue;
+			}
+
+			std::shared_ptr<ResidentPage>& page = *found->second;
+			page->lastUsed = _frame;
+			_lru.splice(_lru.begin(), _lru, found->second);
+			visible.push_back(page);
+
+			if (_prefetched.erase(index))
+				_stats.prefetchHits++;
+		}
+
+		// Rebuild the loaders' queue: nearest visible pages at the back where they are taken
+		// first, then the ones only nearby. Prefetching stops short of the budget, or it would
+		// only evict pages to make room for others nobody has asked for yet.
+		_requests.clear();
+		size_t prefetchBytes = _residentBytes;
+		for (unsigned int i = 0; i < _nearby.size() && prefetchBytes < _settings.budgetBytes; ++i)
+		{
+			int index = _nearby[i].second;
+			if (_resident.count(index) == 0 && _inFlight.count(index) == 0)
+			{
+				_requests.push_back(index);
+				prefetchBytes += PageBytes(index);
+			}
+		}
+		std::reverse(_requests.begin(), _requests.end());
+		for (int i = (int)_missing.size() - 1; i >= 0; --i)
+		{
+			if (_inFlight.count(_missing[i]) == 0)
+				_requests.push_back(_missing[i]);
+		}
+		_stats.queuedPages = (int)_requests.size();
+	}
+	_requestSignal.notify_all();
+
+	_stats.skippedPages = 0;
+	for (unsigned int i = 0; i < _missing.size(); ++i)
+	{
+		if (!_settings.stallOnMiss)
+		{
+			_stats.skippedPages++;
+			continue;
+		}
+
+		// A fault: the frame can't go on without this page
+		Clock::time_point start = Clock::now();
+		std::shared_ptr<ResidentPage> page = LoadPage(_stallFile, _missing[i]);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		page->lastUsed = _frame;
+		Insert(page, false);
+		visible.push_back(page);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stats.faults++;
+		_stats.stallSeconds += seconds;
+		_stats.maxStallSeconds = std::max(_stats.maxStallSeconds, seconds);
+	}
+
+	_stats.visiblePages = (int)_visible.size();
+}
+
+std::shared_ptr<ResidentPage> PatchPager::LoadPage(std::ifstream& file, int index)
+{
+	Clock::time_point start = Clock::now();
+
+	const PatchPageInfo& info = _database.page(index);
+	std::shared_ptr<ResidentPage> page = std::make_shared<ResidentPage>();
+	page->index = index;
+	page->numPatches = info.numPatches;
+	page->lastUsed = 0;
+	page->controlPoints.resize(info.numPatches * 16);
+	if (!_database.ReadPage(file, index, page->controlPoints.data()))
+		std::fill(page->controlPoints.begin(), page->controlPoints.end(), glm::vec3());
+
+	int resolution = _settings.resolution;
+	if (resolution > 1)
+	{
+		int patchFloats = PatchEvaluator::NumVerts(resolution) * PatchEvaluator::FLOATS_PER_VERT;
+		page->verts.resize((size_t)info.numPatches * patchFloats);
+		PatchEvaluator::TessellateBatch(page->controlPoints.data(), info.numPatches, resolution, page->verts.data());
+	}
+	page->bytes = PageBytes(index);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stats.loads++;
+	_stats.bytesRead += info.numPatches * 16 * sizeof(glm::vec3);
+	_stats.loadSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+	return page;
+}
+
+// Memory a page takes once loaded
+size_t PatchPager::PageBytes(int index) const
+{
+	size_t numPatches = _database.page(index).numPatches;
+	size_t bytes = numPatches * 16 * sizeof(glm::vec3);
+	if (_settings.resolution > 1)
+		bytes += numPatches * PatchEvaluator::NumVerts(_settings.resolution) * PatchEvaluator::FLOATS_PER_VERT * sizeof(float);
+	return bytes;
+}
+
+bool PatchPager::Insert(const std::shared_ptr<ResidentPage>& page, bool prefetched)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// A stall and a loader can both bring in the same page, the first one wins
+	if (_resident.count(page->index))
+		return false;
+
+	_lru.push_front(page);
+	_resident[page->index] = _lru.begin();
+	_residentBytes += page->bytes;
+	if (prefetched)
+		_prefetched.insert(page->index);
+	Trim();
+	_publishedResidentBytes.store(_residentBytes, std::memory_order_relaxed);
+	return true;
+}
+
+// Drops least recently used pages until the budget is met, passing over pages the current frame
+// has used. Called with the lock held.
+void PatchPager::Trim()
+{
+	PageList::iterator it = _lru.end();
+	while (_residentBytes > _settings.budgetBytes && it != _lru.begin())
+	{
+		--it;
+		if ((*it)->lastUsed >= _frame)
+			continue;
+
+		_residentBytes -= (*it)->bytes;
+		_resident.erase((*it)->index);
+		_prefetched.erase((*it)->index);
+		it = _lru.erase(it);
+		_stats.evictions++;
+	}
+}
+
+void PatchPager::LoaderLoop()
+{
+	std::ifstream file(_database.fileName(), std::ios::binary);
+
+	while (true)
+	{
+		int index;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_running && _requests.empty())
+				_requestSignal.wait(lock);
+			if (!_running)
+				return;
+
+			index = _requests.back();
+			_requests.pop_back();
+			_inFlight.insert(index);
+		}
+
+		std::shared_ptr<ResidentPage> page = LoadPage(file, index);
+		Insert(page, true);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_inFlight.erase(index);
+	}
+}
+
+const PatchDatabase& PatchPager::database()
+{
+	return _database;
+}
+
+PatchPagerStats PatchPager::Stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	PatchPagerStats stats = _stats;
+	stats.residentPages = (int)_lru.size();
+	stats.residentBytes = _residentBytes;
+	return stats;
+}
+
+size_t PatchPager::residentBytes() const
+{
+	return _publishedResidentBytes.load(std::memory_order_relaxed);
+}
+
+void PatchPager::PrintStats()
+{
+	PatchPagerStats stats = Stats();
+	double megabyte = 1024.0 * 1024.0;
+	std::cout << "Paging: " << stats.visiblePages << " of " << _database.numPages() << " pages visible, " << stats.skippedPages << " skipped, "
+		<< stats.queuedPages << " queued" << std::endl;
+	std::cout << "  resident " << stats.residentPages << " pages, " << stats.residentBytes / megabyte << " MB of " << _settings.budgetBytes / megabyte
+		<< " MB budget, " << stats.evictions << " evicted" << std::endl;
+	std::cout << "  " << stats.loads << " loads (" << stats.bytesRead / megabyte << " MB read";
+	if (stats.loads > 0)
+		std::cout << ", " << stats.loadSeconds * 1000.0 / stats.loads << " ms each";
+	std::cout << "), " << stats.prefetchHits << " visible pages were already prefetched" << std::endl;
+	std::cout << "  " << stats.faults << " page faults stalled for " << stats.stallSeconds * 1000.0 << " ms in total, worst "
+		<< stats.maxStallSeconds * 1000.0 << " ms" << std::endl;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "PatchDatabase.h"
+#include "Frustum.h"
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+struct PatchPagerSettings
+{
+	// Memory for resident pages, counting their control points and tessellated vertices
+	size_t budgetBytes = 256 * 1024 * 1024;
+
+	// Pages within this distance of the camera are loaded ahead of time even when not visible
+	float prefetchDistance = 20.0f;
+
+	int ioThreads = 2;
+
+	// Vertices along each side of a patch when the loader tessellates it, 0 to skip tessellation
+	int resolution = 8;
+
+	// Load visible pages that aren't resident on the spot (a stall) rather than skip them
+	bool stallOnMiss = true;
+};
+
+struct PatchPagerStats
+{
+	int visiblePages = 0;
+	int skippedPages = 0;
+	int queuedPages = 0;
+	int residentPages = 0;
+	size_t residentBytes = 0;
+	unsigned long long loads = 0;
+	unsigned long long prefetchHits = 0;
+	unsigned long long faults = 0;
+	unsigned long long evictions = 0;
+	unsigned long long bytesRead = 0;
+	double stallSeconds = 0.0;
+	double maxStallSeconds = 0.0;
+	double loadSeconds = 0.0;
+};
+
+// One page in memory. Stays valid for as long as it is held, even after being evicted.
+struct ResidentPage
+{
+	int index;
+	int numPatches;
+	std::vector<glm::vec3> controlPoints;
+	std::vector<float> verts;
+	size_t bytes;
+	unsigned int lastUsed;
+};
+
+// Keeps the working set of a PatchDatabase in memory. Every Update finds the pages in the view
+// frustum and hands back the resident ones; the rest of the frustum and everything within the
+// prefetch distance is queued, nearest first, for I/O threads that read and tessellate pages in
+// the background. Resident pages are kept in LRU order and the least recently used are dropped
+// once the memory budget is exceeded, never ones used by the current frame.
+//
+// A visible page that hasn't arrived is a page fault. It is either loaded right away on the
+// calling thread, which stalls the frame, or skipped until the loader gets to it.
+class PatchPager
+{
+public:
+	PatchPager();
+	~PatchPager();
+
+	bool Open(const char* fileName, const PatchPagerSettings& settings);
+	void Close();
+
+	void Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat, std::vector<std::shared_ptr<const ResidentPage> >& visible);
+
+	const PatchDatabase& database();
+	PatchPagerStats Stats();
+	void PrintStats();
+
+	// For telemetry, which samples it every frame; read without taking the lock
+	size_t residentBytes() const;
+
+private:
+	std::shared_ptr<ResidentPage> LoadPage(std::ifstream& file, int index);
+	size_t PageBytes(int index) const;
+	bool Insert(const std::shared_ptr<ResidentPage>& page, bool prefetched);
+	void Trim();
+	void LoaderLoop();
+
+private:
+	PatchDatabase _database;
+	PatchPagerSettings _settings;
+	std::ifstream _stallFile;
+	unsigned int _frame;
+
+	std::vector<std::thread> _loaders;
+	std::mutex _mutex;
+	std::condition_variable _requestSignal;
+	bool _running;
+
+	// Popped from the back
+	std::vector<int> _requests;
+	std::unordered_set<int> _inFlight;
+
+	// Most recently used at the front
+	typedef std::list<std::shared_ptr<ResidentPage> > PageList;
+	PageList _lru;
+	std::unordered_map<int, PageList::iterator> _resident;
+	std::unordered_set<int> _prefetched;
+	size_t _residentBytes;
+
+	// _residentBytes as of the last change, for residentBytes
+	std::atomic<size_t> _publishedResidentBytes;
+
+	// Scratch for Update
+	std::vector<std::pair<float, int> > _visible;
+	std::vector<std::pair<float, int> > _nearby;
+	std::vector<int> _missing;
+
+	PatchPagerStats _stats;
+};
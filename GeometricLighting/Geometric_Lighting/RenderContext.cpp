@@ -0,0 +1,332 @@
+#include "RenderContext.h"
+#include "GLState.h"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef GEOMETRIC_LIGHTING_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef GEOMETRIC_LIGHTING_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+RenderContextSettings RenderContext::_settings;
+RenderContextStats RenderContext::_stats;
+GLFWwindow* RenderContext::_window = nullptr;
+std::string RenderContext::_renderer;
+Clock::time_point RenderContext::_startTime;
+Clock::time_point RenderContext::_lastReset;
+void* RenderContext::_display = nullptr;
+void* RenderContext::_context = nullptr;
+std::vector<unsigned char> RenderContext::_osmesaBuffer;
+GLuint RenderContext::_framebuffer = 0;
+GLuint RenderContext::_colorBuffer = 0;
+GLuint RenderContext::_depthBuffer = 0;
+
+bool RenderContext::Init(const RenderContextSettings& settings)
+{
+	_settings = settings;
+	_stats = RenderContextStats();
+
+	if (settings.backend == ContextBackend::Window)
+	{
+		if (!glfwInit())
+			return false;
+
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+
+		glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+		_window = glfwCreateWindow(settings.width, settings.height, settings.title, NULL, NULL); // Windowed
+		if (!_window)
+		{
+			glfwTerminate();
+			return false;
+		}
+
+		glfwMakeContextCurrent(_window);
+	}
+	else if (!(settings.backend == ContextBackend::EGL ? CreateEGL() : CreateOSMesa()))
+		return false;
+
+	// GLEW finds entry points through GLX (or WGL) unless it was built for EGL or OSMesa. Under
+	// libglvnd GLX hands back dispatch stubs that work for EGL contexts too; OSMesa needs a GLEW
+	// built with GLEW_OSMESA. GLEW also reports a missing X display here, after it has already
+	// loaded everything a headless context needs, so only missing functions count as failure.
+	glewExperimental = true;
+	glewInit();
+	if (!glGenFramebuffers)
+	{
+		std::cout << "Couldn't load the GL entry points" << std::endl;
+		DumpData();
+		return false;
+	}
+
+	if (headless() && !CreateFramebuffer())
+	{
+		DumpData();
+		return false;
+	}
+	GLState::Invalidate();
+
+	const GLubyte* name = glGetString(GL_RENDERER);
+	_renderer = name ? (const char*)name : "unknown renderer";
+
+	_lastReset = Clock::now();
+	return true;
+}
+
+bool RenderContext::CreateEGL()
+{
+#ifdef GEOMETRIC_LIGHTING_EGL
+	// Mesa's surfaceless platform needs neither a display server nor a GPU
+	EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+	{
+		std::cout << "Couldn't open an EGL display" << std::endl;
+		return false;
+	}
+	_display = display;
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+	{
+		std::cout << "EGL has no desktop GL" << std::endl;
+		return false;
+	}
+
+	// Nothing is ever drawn to an EGL surface, so any config that renders desktop GL will do,
+	// or none at all where that is allowed
+	const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = (EGLConfig)0;
+	EGLint numConfigs = 0;
+	eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+	if (numConfigs < 1)
+		config = (EGLConfig)0;
+
+	const EGLint contextAttribs[] =
+	{
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 4,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if (context == EGL_NO_CONTEXT)
+	{
+		std::cout << "Couldn't create a GL 4.4 context with EGL" << std::endl;
+		return false;
+	}
+	_context = context;
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+	{
+		std::cout << "EGL can't make a context current without a surface" << std::endl;
+		return false;
+	}
+	return true;
+#else
+	std::cout << "Built without EGL (define GEOMETRIC_LIGHTING_EGL)" << std::endl;
+	return false;
+#endif
+}
+
+bool RenderContext::CreateOSMesa()
+{
+#ifdef GEOMETRIC_LIGHTING_OSMESA
+	const int attribs[] =
+	{
+		OSMESA_FORMAT, OSMESA_RGBA,
+		OSMESA_DEPTH_BITS, 24,
+		OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+		OSMESA_CONTEXT_MAJOR_VERSION, 4,
+		OSMESA_CONTEXT_MINOR_VERSION, 4,
+		0
+	};
+	OSMesaContext context = OSMesaCreateContextAttribs(attribs, NULL);
+	if (!context)
+	{
+		std::cout << "Couldn't create a GL 4.4 context with OSMesa" << std::endl;
+		return false;
+	}
+	_context = context;
+
+	_osmesaBuffer.resize((size_t)_settings.width * _settings.height * 4);
+	if (!OSMesaMakeCurrent(context, &_osmesaBuffer[0], GL_UNSIGNED_BYTE, _settings.width, _settings.height))
+	{
+		std::cout << "Couldn't make the OSMesa context current" << std::endl;
+		return false;
+	}
+	return true;
+#else
+	std::cout << "Built without OSMesa (define GEOMETRIC_LIGHTING_OSMESA)" << std::endl;
+	return false;
+#endif
+}
+
+bool RenderContext::CreateFramebuffer()
+{
+	glGenRenderbuffers(1, &_colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, _colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _settings.width, _settings.height);
+
+	glGenRenderbuffers(1, &_depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _settings.width, _settings.height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	// Bound for both drawing and reading, and left bound, so it stands in for a window's
+	// framebuffer everywhere
+	glGenFramebuffers(1, &_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "The headless framebuffer is incomplete" << std::endl;
+		return false;
+	}
+
+	glViewport(0, 0, _settings.width, _settings.height);
+	return true;
+}
+
+void RenderContext::DumpData()
+{
+	if (_framebuffer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteFramebuffers(1, &_framebuffer);
+		glDeleteRenderbuffers(1, &_colorBuffer);
+		glDeleteRenderbuffers(1, &_depthBuffer);
+		_framebuffer = 0;
+		_colorBuffer = 0;
+		_depthBuffer = 0;
+	}
+
+	if (_settings.backend == ContextBackend::Window)
+	{
+		glfwTerminate();
+		_window = nullptr;
+	}
+
+#ifdef GEOMETRIC_LIGHTING_EGL
+	if (_settings.backend == ContextBackend::EGL && _display)
+	{
+		eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (_context)
+			eglDestroyContext((EGLDisplay)_display, (EGLContext)_context);
+		eglTerminate((EGLDisplay)_display);
+	}
+#endif
+
+#ifdef GEOMETRIC_LIGHTING_OSMESA
+	if (_settings.backend == ContextBackend::OSMesa && _context)
+		OSMesaDestroyContext((OSMesaContext)_context);
+#endif
+
+	_display = nullptr;
+	_context = nullptr;
+	_osmesaBuffer.clear();
+}
+
+void RenderContext::Present()
+{
+	if (_window)
+		glfwSwapBuffers(_window);
+	else
+		glFinish();
+
+	// The first frame pays for one time work in the driver, like compiling shaders for real,
+	// so the frame rate is timed from the end of it
+	Clock::time_point now = Clock::now();
+	if (_stats.frames++ == 0)
+		_startTime = now;
+	_stats.seconds = std::chrono::duration<double>(now - _startTime).count();
+}
+
+void RenderContext::PollEvents()
+{
+	if (_window)
+		glfwPollEvents();
+}
+
+bool RenderContext::ShouldClose()
+{
+	if (_window)
+		return glfwWindowShouldClose(_window) != 0;
+	return _stats.frames >= (unsigned long long)_settings.frames;
+}
+
+double RenderContext::Time()
+{
+	return std::chrono::duration<double>(Clock::now() - _lastReset).count();
+}
+
+void RenderContext::ResetTime()
+{
+	_lastReset = Clock::now();
+}
+
+GLFWwindow* RenderContext::window()
+{
+	return _window;
+}
+
+bool RenderContext::headless()
+{
+	return _settings.backend != ContextBackend::Window;
+}
+
+int RenderContext::width()
+{
+	return _settings.width;
+}
+
+int RenderContext::height()
+{
+	return _settings.height;
+}
+
+bool RenderContext::ParseBackend(const char* name, ContextBackend& backend)
+{
+	if (!strcmp(name, "window"))
+		backend = ContextBackend::Window;
+	else if (!strcmp(name, "egl"))
+		backend = ContextBackend::EGL;
+	else if (!strcmp(name, "osmesa"))
+		backend = ContextBackend::OSMesa;
+	else
+		return false;
+	return true;
+}
+
+RenderContextStats RenderContext::Stats()
+{
+	return _stats;
+}
+
+void RenderContext::PrintStats()
+{
+	const char* backends[] = { "Window", "EGL", "OSMesa" };
+	unsigned long long timedFrames = _stats.frames > 0 ? _stats.frames - 1 : 0;
+	std::cout << backends[(int)_settings.backend] << " context on " << _renderer << ": " << _stats.frames << " frames at " << _settings.width << "x"
+		<< _settings.height << ", " << (_stats.seconds > 0.0 ? timedFrames / _stats.seconds : 0.0) << " fps" << std::endl;
+}
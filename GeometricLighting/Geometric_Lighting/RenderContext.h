@@ -0,0 +1,93 @@
+#pragma once
+#include <GLEW/GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <chrono>
+#include <vector>
+#include <string>
+
+// Where the GL context comes from. The headless backends need to be compiled in with
+// GEOMETRIC_LIGHTING_EGL or GEOMETRIC_LIGHTING_OSMESA (and linked against libEGL or libOSMesa).
+enum class ContextBackend
+{
+	Window,
+	EGL,
+	OSMesa
+};
+
+struct RenderContextSettings
+{
+	ContextBackend backend = ContextBackend::Window;
+	int width = 800;
+	int height = 600;
+	const char* title = "Geometric_Lighting-GLFW";
+
+	// Headless contexts have no close button, so they stop after this many frames
+	int frames = 300;
+};
+
+struct RenderContextStats
+{
+	unsigned long long frames = 0;
+	double seconds = 0.0;
+};
+
+// The GL context everything draws into: a GLFW window, or a headless context for machines with
+// no display. Headless contexts are a surfaceless EGL context or an OSMesa one, either of which
+// runs on software GL, with a framebuffer object bound in place of a window's default
+// framebuffer, so drawing and reading pixels back work the same as with a window. There is no
+// input without a window; the camera stays where it starts.
+class RenderContext
+{
+public:
+	// Creates the context, makes it current and loads the GL entry points
+	static bool Init(const RenderContextSettings& settings);
+	static void DumpData();
+
+	// Swaps the window's buffers. Headless contexts wait for the frame to finish instead, so the
+	// frame rate is what the renderer can actually sustain.
+	static void Present();
+	static void PollEvents();
+	static bool ShouldClose();
+
+	// Seconds since the last ResetTime
+	static double Time();
+	static void ResetTime();
+
+	// Null for headless contexts
+	static GLFWwindow* window();
+	static bool headless();
+	static int width();
+	static int height();
+
+	// Reads "window", "egl" or "osmesa"
+	static bool ParseBackend(const char* name, ContextBackend& backend);
+
+	static RenderContextStats Stats();
+	static void PrintStats();
+
+private:
+	static bool CreateEGL();
+	static bool CreateOSMesa();
+	static bool CreateFramebuffer();
+
+private:
+	static RenderContextSettings _settings;
+	static RenderContextStats _stats;
+	static GLFWwindow* _window;
+	static std::string _renderer;
+
+	static std::chrono::high_resolution_clock::time_point _startTime;
+	static std::chrono::high_resolution_clock::time_point _lastReset;
+
+	// The headless context's handles, untyped so this header doesn't need the backends' headers
+	static void* _display;
+	static void* _context;
+
+	// OSMesa renders into memory it is given, even though drawing goes to the framebuffer object
+	static std::vector<unsigned char> _osmesaBuffer;
+
+	static GLuint _framebuffer;
+	static GLuint _colorBuffer;
+	static GLuint _depthBuffer;
+};
@@ -0,0 +1,530 @@
+#include "RenderFarm.h"
+#include "TileRenderer.h"
+#include "BptFile.h"
+#include "FrameCapture.h"
+
+#include <GLM/gtc/matrix_transform.hpp>
+#include <GLM/gtc/quaternion.hpp>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <unordered_map>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// File system and process helpers, the only parts that differ between platforms
+
+// Creates the directory and any missing parents
+static void MakeDirectory(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); ++i)
+	{
+		if (i < path.size() && path[i] != '/' && path[i] != '\\')
+			continue;
+		std::string prefix = path.substr(0, i);
+#ifdef _WIN32
+		_mkdir(prefix.c_str());
+#else
+		mkdir(prefix.c_str(), 0755);
+#endif
+	}
+}
+
+// Names of the files in a directory, sorted
+static std::vector<std::string> ListFiles(const std::string& dir)
+{
+	std::vector<std::string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				names.push_back(data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	DIR* handle = opendir(dir.c_str());
+	if (handle)
+	{
+		while (dirent* entry = readdir(handle))
+		{
+			if (entry->d_name[0] != '.')
+				names.push_back(entry->d_name);
+		}
+		closedir(handle);
+	}
+#endif
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+static bool FileExists(const std::string& path)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	return file.good();
+}
+
+static void TouchFile(const std::string& path)
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+}
+
+static void ClearDirectory(const std::string& dir)
+{
+	std::vector<std::string> names = ListFiles(dir);
+	for (unsigned int i = 0; i < names.size(); ++i)
+		remove((dir + "/" + names[i]).c_str());
+}
+
+struct WorkerProcess
+{
+	int index;
+	bool running;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pid_t pid;
+#endif
+};
+
+static bool StartWorker(const char* exe, const char* dir, int index, float failRate, WorkerProcess& worker)
+{
+	char indexText[16], failText[32];
+	sprintf(indexText, "%d", index);
+	sprintf(failText, "%g", failRate);
+
+	worker.index = index;
+	worker.running = false;
+#ifdef _WIN32
+	std::string commandLine = std::string("\"") + exe + "\" --farm-worker \"" + dir + "\" " + indexText + " --farm-fail " + failText;
+	STARTUPINFOA startup;
+	PROCESS_INFORMATION process;
+	ZeroMemory(&startup, sizeof(startup));
+	startup.cb = sizeof(startup);
+	if (!CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup, &process))
+		return false;
+	CloseHandle(process.hThread);
+	worker.handle = process.hProcess;
+#else
+	pid_t pid = fork();
+	if (pid < 0)
+		return false;
+	if (pid == 0)
+	{
+		execl(exe, exe, "--farm-worker", dir, indexText, "--farm-fail", failText, (char*)NULL);
+		_exit(127);
+	}
+	worker.pid = pid;
+#endif
+	worker.running = true;
+	return true;
+}
+
+// True once the worker has exited, with its exit code
+static bool PollWorker(WorkerProcess& worker, int& exitCode, bool wait)
+{
+#ifdef _WIN32
+	if (WaitForSingleObject(worker.handle, wait ? INFINITE : 0) != WAIT_OBJECT_0)
+		return false;
+	DWORD code = 0;
+	GetExitCodeProcess(worker.handle, &code);
+	CloseHandle(worker.handle);
+	exitCode = (int)code;
+#else
+	int status = 0;
+	if (waitpid(worker.pid, &status, wait ? 0 : WNOHANG) != worker.pid)
+		return false;
+	exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#endif
+	worker.running = false;
+	return true;
+}
+
+static std::string TaskName(int frame, int tile)
+{
+	char name[32];
+	sprintf(name, "f%04d_t%04d", frame, tile);
+	return name;
+}
+
+static int TilesAcross(const RenderJob& job) { return (job.width + job.tileSize - 1) / job.tileSize; }
+static int TilesDown(const RenderJob& job) { return (job.height + job.tileSize - 1) / job.tileSize; }
+
+static void TileRect(const RenderJob& job, int tile, int& x, int& y, int& width, int& height)
+{
+	x = (tile % TilesAcross(job)) * job.tileSize;
+	y = (tile / TilesAcross(job)) * job.tileSize;
+	width = std::min(job.tileSize, job.width - x);
+	height = std::min(job.tileSize, job.height - y);
+}
+
+bool RenderFarm::Submit(const char* dir, const RenderJob& job, const std::vector<glm::vec3>& controlPoints, int numQueues)
+{
+	std::string root = dir;
+	numQueues = std::max(numQueues, 1);
+
+	MakeDirectory(root);
+	const char* subdirs[] = { "queue", "claimed", "tiles", "stolen" };
+	for (int i = 0; i < 4; ++i)
+	{
+		MakeDirectory(root + "/" + subdirs[i]);
+		ClearDirectory(root + "/" + subdirs[i]);
+	}
+	remove((root + "/finished").c_str());
+
+	std::ofstream jobFile((root + "/job.txt").c_str());
+	jobFile << "frames " << job.frames << "\ndegrees " << job.degreesPerFrame << "\nwidth " << job.width << "\nheight " << job.height
+		<< "\ntile " << job.tileSize << "\nresolution " << job.resolution << "\nqueues " << numQueues << "\n";
+	if (!jobFile || !BptFile::Save((root + "/scene.bpt").c_str(), controlPoints))
+		return false;
+
+	// Contiguous runs of tasks, so a worker mostly renders tiles of the same few frames
+	int tilesPerFrame = TilesAcross(job) * TilesDown(job);
+	int numTasks = job.frames * tilesPerFrame;
+	for (int q = 0; q < numQueues; ++q)
+	{
+		std::string queue = root + "/queue/" + std::to_string(q);
+		MakeDirectory(queue);
+		ClearDirectory(queue);
+
+		int begin = (int)((long long)numTasks * q / numQueues);
+		int end = (int)((long long)numTasks * (q + 1) / numQueues);
+		for (int task = begin; task < end; ++task)
+			TouchFile(queue + "/" + TaskName(task / tilesPerFrame, task % tilesPerFrame));
+	}
+	return true;
+}
+
+bool RenderFarm::LoadJob(const char* dir, RenderJob& job, int& numQueues)
+{
+	std::ifstream file((std::string(dir) + "/job.txt").c_str());
+	std::string key;
+	numQueues = 1;
+	while (file >> key)
+	{
+		if (key == "frames") file >> job.frames;
+		else if (key == "degrees") file >> job.degreesPerFrame;
+		else if (key == "width") file >> job.width;
+		else if (key == "height") file >> job.height;
+		else if (key == "tile") file >> job.tileSize;
+		else if (key == "resolution") file >> job.resolution;
+		else if (key == "queues") file >> numQueues;
+	}
+	return job.frames > 0 && job.width > 0 && job.height > 0 && job.tileSize > 0;
+}
+
+bool RenderFarm::ClaimTask(const std::string& dir, int workerIndex, int numQueues, std::string& task, bool& stolen)
+{
+	stolen = false;
+
+	// Our own queue from the front. Workers beyond the number of queues (on other hosts, say)
+	// have none and only ever steal.
+	if (workerIndex < numQueues)
+	{
+		std::string queue = dir + "/queue/" + std::to_string(workerIndex);
+		std::vector<std::string> names = ListFiles(queue);
+		for (unsigned int i = 0; i < names.size(); ++i)
+		{
+			if (rename((queue + "/" + names[i]).c_str(), (dir + "/claimed/" + names[i]).c_str()) == 0)
+			{
+				task = names[i];
+				return true;
+			}
+		}
+	}
+
+	// Steal from the back of the longest queue. Another worker may get there first, so look again.
+	for (int attempt = 0; attempt < 4; ++attempt)
+	{
+		std::string longest;
+		std::vector<std::string> longestNames;
+		for (int q = 0; q < numQueues; ++q)
+		{
+			if (q == workerIndex)
+				continue;
+			std::string queue = dir + "/queue/" + std::to_string(q);
+			std::vector<std::string> names = ListFiles(queue);
+			if (names.size() > longestNames.size())
+			{
+				longest = queue;
+				longestNames.swap(names);
+			}
+		}
+		if (longestNames.empty())
+			return false;
+
+		for (int i = (int)longestNames.size() - 1; i >= 0; --i)
+		{
+			if (rename((longest + "/" + longestNames[i]).c_str(), (dir + "/claimed/" + longestNames[i]).c_str()) == 0)
+			{
+				task = longestNames[i];
+				stolen = true;
+				TouchFile(dir + "/stolen/" + task);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+int RenderFarm::Work(const char* dir, int workerIndex, float failRate)
+{
+	std::string root = dir;
+	RenderJob job;
+	int numQueues;
+	std::vector<glm::vec3> controlPoints;
+	if (!LoadJob(dir, job, numQueues) || !BptFile::Load((root + "/scene.bpt").c_str(), controlPoints))
+	{
+		std::cout << "Worker " << workerIndex << " couldn't load the job in " << dir << std::endl;
+		return 1;
+	}
+
+	TileRenderer renderer;
+	renderer.SetPatches(controlPoints, job.resolution);
+	srand((unsigned int)(workerIndex * 7919 + std::chrono::system_clock::now().time_since_epoch().count()));
+
+	// The same view the interactive window opens with
+	glm::mat4 viewMat = glm::lookAt(glm::vec3(0.0f, 0.0f, -5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 projMat = glm::perspective(60.0f, job.width / (float)job.height, 0.1f, 100.0f);
+	glm::vec4 color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
+	std::vector<unsigned char> pixels((size_t)job.tileSize * job.tileSize * 4);
+
+	while (true)
+	{
+		std::string task;
+		bool stolen;
+		if (!ClaimTask(root, workerIndex, numQueues, task, stolen))
+		{
+			// Expired leases can still come back into the queues until the coordinator says it's over
+			if (FileExists(root + "/finished"))
+				return 0;
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			continue;
+		}
+
+		std::string claim = root + "/claimed/" + task;
+		std::string tileFile = root + "/tiles/" + task + ".rgba";
+		if (FileExists(tileFile))
+		{
+			remove(claim.c_str());
+			continue;
+		}
+
+		// Dies holding the claim, which is what a crash looks like to the coordinator
+		if (failRate > 0.0f && rand() < failRate * RAND_MAX)
+			std::_Exit(3);
+
+		int frame = 0, tile = 0;
+		sscanf(task.c_str(), "f%d_t%d", &frame, &tile);
+		int x, y, width, height;
+		TileRect(job, tile, x, y, width, height);
+
+		glm::mat4 modelMat = glm::translate(glm::mat4(), glm::vec3(0.0f, -1.5f, 0.0f))
+			* glm::mat4_cast(glm::angleAxis(frame * job.degreesPerFrame, glm::vec3(0.0f, 1.0f, 0.0f)));
+		renderer.Render(modelMat, viewMat, projMat, color, job.width, job.height, x, y, width, height, pixels.data());
+
+		// Written under a temporary name and renamed, so a tile is never seen half written
+		std::string tempFile = tileFile + "." + std::to_string(workerIndex) + ".tmp";
+		{
+			std::ofstream file(tempFile.c_str(), std::ios::binary);
+			file.write((const char*)pixels.data(), (size_t)width * height * 4);
+		}
+		if (rename(tempFile.c_str(), tileFile.c_str()) != 0)
+			remove(tempFile.c_str());
+		remove(claim.c_str());
+	}
+}
+
+bool RenderFarm::Run(const char* exe, const char* dir, const RenderJob& job, const std::vector<glm::vec3>& controlPoints,
+	const RenderFarmSettings& settings, RenderFarmStats* statsOut)
+{
+	RenderFarmStats stats;
+	std::string root = dir;
+	if (!Submit(dir, job, controlPoints, settings.workers))
+	{
+		std::cout << "Failed to write the job to " << dir << std::endl;
+		return false;
+	}
+
+	int tilesPerFrame = TilesAcross(job) * TilesDown(job);
+	stats.tasks = job.frames * tilesPerFrame;
+	stats.workers = settings.workers;
+	int numQueues = std::max(settings.workers, 1);
+
+	Clock::time_point start = Clock::now();
+	std::vector<WorkerProcess> workers(settings.workers);
+	for (int i = 0; i < settings.workers; ++i)
+	{
+		if (!StartWorker(exe, dir, i, settings.failRate, workers[i]))
+			std::cout << "Failed to start worker " << i << std::endl;
+	}
+
+	// When each claim was first seen, by our own clock so remote hosts' clocks don't matter
+	std::unordered_map<std::string, Clock::time_point> leases;
+	bool complete = false;
+	while (!complete)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		Clock::time_point now = Clock::now();
+
+		std::vector<std::string> tiles = ListFiles(root + "/tiles");
+		int finished = 0;
+		for (unsigned int i = 0; i < tiles.size(); ++i)
+		{
+			if (tiles[i].size() > 5 && tiles[i].compare(tiles[i].size() - 5, 5, ".rgba") == 0)
+				finished++;
+		}
+		if (finished >= stats.tasks)
+		{
+			complete = true;
+			break;
+		}
+
+		// Hand expired leases back to the shortest queue
+		std::vector<std::string> claims = ListFiles(root + "/claimed");
+		std::unordered_map<std::string, Clock::time_point> current;
+		for (unsigned int i = 0; i < claims.size(); ++i)
+		{
+			std::unordered_map<std::string, Clock::time_point>::iterator found = leases.find(claims[i]);
+			Clock::time_point seen = found == leases.end() ? now : found->second;
+			if (std::chrono::duration<double>(now - seen).count() < settings.leaseSeconds)
+			{
+				current[claims[i]] = seen;
+				continue;
+			}
+
+			std::string claim = root + "/claimed/" + claims[i];
+			if (FileExists(root + "/tiles/" + claims[i] + ".rgba"))
+			{
+				remove(claim.c_str());
+				continue;
+			}
+
+			int shortest = 0;
+			size_t shortestSize = (size_t)-1;
+			for (int q = 0; q < numQueues; ++q)
+			{
+				size_t size = ListFiles(root + "/queue/" + std::to_string(q)).size();
+				if (size < shortestSize)
+				{
+					shortest = q;
+					shortestSize = size;
+				}
+			}
+			if (rename(claim.c_str(), (root + "/queue/" + std::to_string(shortest) + "/" + claims[i]).c_str()) == 0)
+				stats.expiredLeases++;
+		}
+		leases.swap(current);
+
+		// Bring back workers that died
+		int running = 0;
+		for (unsigned int i = 0; i < workers.size(); ++i)
+		{
+			int exitCode;
+			if (workers[i].running && PollWorker(workers[i], exitCode, false) && stats.restarts < settings.maxRestarts)
+			{
+				std::cout << "Worker " << i << " exited with code " << exitCode << ", restarting it" << std::endl;
+				if (StartWorker(exe, dir, i, settings.failRate, workers[i]))
+					stats.restarts++;
+			}
+			running += workers[i].running ? 1 : 0;
+		}
+
+		// With no local workers left, only workers on other hosts could still finish the job
+		if (running == 0 && settings.workers > 0)
+		{
+			std::cout << "Every worker has stopped with " << stats.tasks - finished << " tiles left" << std::endl;
+			break;
+		}
+	}
+
+	TouchFile(root + "/finished");
+	for (unsigned int i = 0; i < workers.size(); ++i)
+	{
+		int exitCode;
+		if (workers[i].running)
+			PollWorker(workers[i], exitCode, true);
+	}
+	stats.renderSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	stats.stolen = (int)ListFiles(root + "/stolen").size();
+
+	bool assembled = complete && Assemble(dir, job, &stats);
+	if (statsOut)
+		*statsOut = stats;
+	return assembled;
+}
+
+bool RenderFarm::Assemble(const char* dir, const RenderJob& job, RenderFarmStats* stats)
+{
+	Clock::time_point start = Clock::now();
+	std::string root = dir;
+	int tilesPerFrame = TilesAcross(job) * TilesDown(job);
+
+	CapturedFrame frame;
+	frame.width = job.width;
+	frame.height = job.height;
+	frame.pixels.resize((size_t)job.width * job.height * 4);
+	std::vector<unsigned char> pixels((size_t)job.tileSize * job.tileSize * 4);
+
+	for (int f = 0; f < job.frames; ++f)
+	{
+		for (int tile = 0; tile < tilesPerFrame; ++tile)
+		{
+			int x, y, width, height;
+			TileRect(job, tile, x, y, width, height);
+
+			std::ifstream file((root + "/tiles/" + TaskName(f, tile) + ".rgba").c_str(), std::ios::binary);
+			file.read((char*)pixels.data(), (size_t)width * height * 4);
+			if (!file)
+			{
+				std::cout << "Tile " << TaskName(f, tile) << " is missing or short" << std::endl;
+				return false;
+			}
+
+			for (int row = 0; row < height; ++row)
+			{
+				std::copy(&pixels[(size_t)row * width * 4], &pixels[(size_t)(row + 1) * width * 4],
+					&frame.pixels[((size_t)(y + row) * job.width + x) * 4]);
+			}
+		}
+
+		char fileName[32];
+		sprintf(fileName, "/frame_%04d.tga", f);
+		frame.index = f;
+		if (!FrameCapture::WriteTGA((root + fileName).c_str(), frame))
+			return false;
+		stats->framesWritten++;
+	}
+	stats->assembleSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return true;
+}
+
+void RenderFarm::PrintStats(const RenderFarmStats& stats)
+{
+	std::cout << "Render farm: " << stats.framesWritten << " frames from " << stats.tasks << " tiles with " << stats.workers << " workers in "
+		<< stats.renderSeconds << " s (" << stats.framesWritten / std::max(stats.renderSeconds, 1e-9) << " frames/s), assembled in "
+		<< stats.assembleSeconds * 1000.0 << " ms" << std::endl;
+	std::cout << "  " << stats.stolen << " tiles stolen, " << stats.expiredLeases << " expired leases requeued, " << stats.restarts
+		<< " workers restarted" << std::endl;
+}
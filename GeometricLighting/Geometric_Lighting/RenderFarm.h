@@ -0,0 +1,88 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+#include <string>
+
+// A turntable of a patch model: the model turns a little every frame in front of the same
+// camera the interactive view starts with
+struct RenderJob
+{
+	int frames = 36;
+	float degreesPerFrame = 10.0f;
+	int width = 800;
+	int height = 600;
+
+	// Frames are split into square tiles of this size, each one a task
+	int tileSize = 200;
+
+	// Vertices along each side of a patch
+	int resolution = 20;
+};
+
+struct RenderFarmSettings
+{
+	// Worker processes started on this machine. Workers on other hosts can join by running
+	// --farm-worker against the same (shared) job directory.
+	int workers = 4;
+
+	// A claimed task whose worker hasn't finished it in this time goes back in the queue
+	double leaseSeconds = 10.0;
+
+	// Local workers that die are started again this many times in total
+	int maxRestarts = 16;
+
+	// Workers exit abruptly on this fraction of tasks, to exercise recovery
+	float failRate = 0.0f;
+};
+
+struct RenderFarmStats
+{
+	int tasks = 0;
+	int workers = 0;
+	int framesWritten = 0;
+	int expiredLeases = 0;
+	int restarts = 0;
+	int stolen = 0;
+	double renderSeconds = 0.0;
+	double assembleSeconds = 0.0;
+};
+
+// Renders a RenderJob with several worker processes that share nothing but a job directory:
+//
+//	job.txt			the job settings
+//	scene.bpt		the patches to render
+//	queue/<n>/		tasks waiting for worker n, one empty file per tile
+//	claimed/		tasks being worked on
+//	tiles/			finished tiles, raw RGBA
+//	stolen/			one file per task a worker took from another's queue
+//
+// Every step is a rename within the directory, which is atomic, so no two workers ever get
+// the same task and a tile is either complete or absent. Each worker starts with a contiguous
+// run of tasks in its own queue (tiles of the same frames) and works from the front; once its
+// queue is empty it steals from the back of the longest queue left.
+//
+// The coordinator starts the workers, hands claims held past the lease time back to the queue
+// so tasks of crashed or hung workers are redone, restarts workers that die, and assembles the
+// frames out of the tiles once every tile is in. Lease times are measured on the coordinator's
+// clock from when it first sees a claim, so workers on other hosts need no synchronized clocks.
+class RenderFarm
+{
+public:
+	// Writes the job and its task queues into dir, which is created if needed
+	static bool Submit(const char* dir, const RenderJob& job, const std::vector<glm::vec3>& controlPoints, int numQueues);
+
+	// Submits the job, runs it with workers started from exe, and writes frame_NNNN.tga files
+	static bool Run(const char* exe, const char* dir, const RenderJob& job, const std::vector<glm::vec3>& controlPoints,
+		const RenderFarmSettings& settings, RenderFarmStats* stats = nullptr);
+
+	// The worker's main loop, run in its own process. Returns once there is nothing left to do.
+	static int Work(const char* dir, int workerIndex, float failRate);
+
+	static void PrintStats(const RenderFarmStats& stats);
+
+private:
+	static bool LoadJob(const char* dir, RenderJob& job, int& numQueues);
+	static bool Assemble(const char* dir, const RenderJob& job, RenderFarmStats* stats);
+	static bool ClaimTask(const std::string& dir, int workerIndex, int numQueues, std::string& task, bool& stolen);
+};
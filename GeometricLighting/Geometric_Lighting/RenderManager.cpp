@@ -2,7 +2,7 @@
 #include "RenderShape.h"
 #include "Init_Shader.h"
 #include "InputManager.h"
-#include <GLM\gtc\random.hpp>
+#include <GLM/gtc/random.hpp>
 
 std::vector<RenderShape*> RenderManager::_shapes = std::vector<RenderShape*>();
 
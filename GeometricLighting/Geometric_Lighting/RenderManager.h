@@ -1,6 +1,6 @@
 #pragma once
-#include <GLEW\GL\glew.h>
-#include <GLM\gtc\matrix_transform.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLM/gtc/matrix_transform.hpp>
 #include <vector>
 
 struct Transform;
@@ -1,4 +1,5 @@
 #include "RenderShape.h"
+#include "GLState.h"
 #include "CameraManager.h"
 
 RenderShape::RenderShape(GLint vao, GLsizei count, GLenum mode, Shader shader, glm::vec4 color)
@@ -9,6 +10,9 @@ RenderShape::RenderShape(GLint vao, GLsizei count, GLenum mode, Shader shader, g
 	_shader = shader;
 	_color = color;
 	_currentColor = color;
+	_normalMapRect = glm::vec4();
+	_viewMask = ~0u;
+	_active = true;
 
 	_transform = Transform();
 }
@@ -38,19 +42,20 @@ void RenderShape::Draw()
 		glm::mat4 scaleOriginMat = glm::translate(glm::mat4(), _transform.scaleOrigin);
 		glm::mat4 scaleMat = scaleOriginMat * glm::scale(glm::mat4(), _transform.scale) * glm::inverse(scaleOriginMat);
 
-		glm::mat4 *parentModelMat = _transform.parent ? &_transform.parent->modelMat : &glm::mat4();
+		glm::mat4 parentModelMat = _transform.parent ? _transform.parent->modelMat : glm::mat4();
 
-		_transform.modelMat = (*parentModelMat) * (translateMat * scaleMat* rotateMat);
+		_transform.modelMat = parentModelMat * (translateMat * scaleMat* rotateMat);
 
-		glm::mat4 mpMat = CameraManager::ProjMat() * _transform.modelMat;
-		glm::mat4 mpvMat = CameraManager::ProjMat() * CameraManager::ViewMat() * _transform.modelMat;
-		glm::vec4 camPos = CameraManager::CamPos();
+		glm::mat4 mpMat = CameraManager::DrawProjMat() * _transform.modelMat;
+		glm::mat4 mpvMat = CameraManager::DrawProjMat() * CameraManager::DrawViewMat() * _transform.modelMat;
 
-		glBindVertexArray(_vao);
+		GLState::BindVertexArray(_vao);
 
-		glUniformMatrix4fv(_shader.uMPMat, 1, GL_FALSE, glm::value_ptr(mpMat));
-		glUniformMatrix4fv(_shader.uMPVMat, 1, GL_FALSE, glm::value_ptr(mpvMat));
-		glUniform4fv(_shader.uColor, 1, glm::value_ptr(_currentColor));
+		GLState::UniformMatrix4fv(_shader.uMPMat, 1, GL_FALSE, glm::value_ptr(mpMat));
+		GLState::UniformMatrix4fv(_shader.uMPVMat, 1, GL_FALSE, glm::value_ptr(mpvMat));
+		GLState::Uniform4fv(_shader.uColor, 1, glm::value_ptr(_currentColor));
+		GLState::Uniform4fv(_shader.uNormalMapRect, 1, glm::value_ptr(_normalMapRect));
+		GLState::Uniform1ui(_shader.uViewMask, _viewMask);
 
 		//Make draw call
 		glDrawElements(_mode, _count, GL_UNSIGNED_INT, 0);
@@ -61,6 +66,11 @@ const glm::vec4& RenderShape::color()
 {
 	return _color;
 }
+void RenderShape::color(glm::vec4 newColor)
+{
+	_color = newColor;
+	_currentColor = newColor;
+}
 glm::vec4& RenderShape::currentColor()
 {
 	return _currentColor;
@@ -95,3 +105,12 @@ bool& RenderShape::active()
 	return _active;
 }
 
+glm::vec4& RenderShape::normalMapRect()
+{
+	return _normalMapRect;
+}
+
+unsigned int& RenderShape::viewMask()
+{
+	return _viewMask;
+}
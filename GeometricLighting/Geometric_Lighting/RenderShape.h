@@ -1,9 +1,9 @@
 #pragma once
 
-#include <GLEW\GL\glew.h>
-#include <GLM\gtc\matrix_transform.hpp>
-#include <GLM\gtc\quaternion.hpp>
-#include <GLM\gtc\type_ptr.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLM/gtc/matrix_transform.hpp>
+#include <GLM/gtc/quaternion.hpp>
+#include <GLM/gtc/type_ptr.hpp>
 
 struct Transform
 {
@@ -43,18 +43,23 @@ struct Shader
 	GLint uMPMat = 0;
 	GLint uMPVMat = 0;
 	GLint uColor = 0;
+	GLint uNormalMapRect = -1;
+
+	// Only in programs linked with gShader.glsl, for drawing several views at once
+	GLint uViewMask = -1;
 };
 
 class RenderShape
 {
 public:
 	RenderShape(GLint vao = 0, GLsizei count = 0, GLenum mode = 0, Shader shader = Shader(), glm::vec4 color = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
-	~RenderShape();
+	virtual ~RenderShape();
 
 	void Update(float dt);
 	void Draw();
 
 	const glm::vec4& color();
+	void color(glm::vec4 newColor);
 	glm::vec4& currentColor();
 	Transform& transform();
 	GLint vao();
@@ -65,6 +70,14 @@ public:
 	bool& active();
 	bool useDepthTest();
 
+	// Where the shape's normal map is in the normal map atlas, as offset and size in texture
+	// coordinates. Zero size (the default) draws without one.
+	glm::vec4& normalMapRect();
+
+	// The views the shape is drawn into, a bit for each of CameraManager's views. All of them by
+	// default; only matters with more than one view.
+	unsigned int& viewMask();
+
 private:
 
 	GLint _vao;
@@ -76,5 +89,7 @@ protected:
 	glm::vec4 _color;
 	glm::vec4 _currentColor;
 	Transform _transform;
+	glm::vec4 _normalMapRect;
+	unsigned int _viewMask;
 	bool _active;
 };
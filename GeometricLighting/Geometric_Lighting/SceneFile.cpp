@@ -0,0 +1,389 @@
+#include "SceneFile.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <cctype>
+
+bool SceneModel::IsMesh() const
+{
+	if (builtin)
+		return false;
+
+	size_t dot = file.rfind('.');
+	std::string ext = dot == std::string::npos ? "" : file.substr(dot + 1);
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext == "obj" || ext == "ply";
+}
+
+// The tokens of one line, read front to back
+struct SceneLine
+{
+	std::vector<std::string> tokens;
+	size_t next = 0;
+
+	bool done() const { return next >= tokens.size(); }
+	const std::string& Take() { return tokens[next++]; }
+
+	bool TakeFloat(float& value)
+	{
+		if (done())
+			return false;
+		const char* text = tokens[next].c_str();
+		char* end;
+		value = (float)strtod(text, &end);
+		if (end == text || *end)
+			return false;
+		++next;
+		return true;
+	}
+
+	bool TakeVec3(glm::vec3& value)
+	{
+		return TakeFloat(value.x) && TakeFloat(value.y) && TakeFloat(value.z);
+	}
+};
+
+static int FindByName(const std::vector<SceneModel>& models, const std::string& name)
+{
+	for (size_t i = 0; i < models.size(); ++i)
+		if (models[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+static int FindByName(const std::vector<SceneMaterial>& materials, const std::string& name)
+{
+	for (size_t i = 0; i < materials.size(); ++i)
+		if (materials[i].name == name)
+			return (int)i;
+	return -1;
+}
+
+static bool IsAbsolute(const std::string& path)
+{
+	return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+}
+
+static bool ParseModel(SceneLine& line, const std::string& directory, Scene& scene, std::string& error)
+{
+	if (line.tokens.size() != 3)
+	{
+		error = "model needs a name and a file";
+		return false;
+	}
+
+	SceneModel model;
+	model.name = line.Take();
+	model.file = line.Take();
+	if (FindByName(scene.models, model.name) >= 0)
+	{
+		error = "model " + model.name + " is already defined";
+		return false;
+	}
+
+	if (model.file[0] == '@')
+	{
+		model.builtin = true;
+		model.file = model.file.substr(1);
+	}
+	else if (!IsAbsolute(model.file))
+		model.file = directory + model.file;
+
+	scene.models.push_back(model);
+	return true;
+}
+
+static bool ParseMaterial(SceneLine& line, Scene& scene, std::string& error)
+{
+	if (line.done())
+	{
+		error = "material needs a name";
+		return false;
+	}
+
+	SceneMaterial material;
+	material.name = line.Take();
+	while (!line.done())
+	{
+		std::string field = line.Take();
+		glm::vec3 color;
+		if (field == "color" && line.TakeVec3(color))
+		{
+			material.color = glm::vec4(color, 1.0f);
+			line.TakeFloat(material.color.a);
+		}
+		else
+		{
+			error = "bad material field " + field;
+			return false;
+		}
+	}
+
+	scene.materials.push_back(material);
+	return true;
+}
+
+static bool ParseInstance(SceneLine& line, Scene& scene, std::string& error)
+{
+	if (line.done())
+	{
+		error = "instance needs a model";
+		return false;
+	}
+
+	SceneInstance instance;
+	std::string model = line.Take();
+	instance.model = FindByName(scene.models, model);
+	if (instance.model < 0)
+	{
+		error = "unknown model " + model;
+		return false;
+	}
+
+	while (!line.done())
+	{
+		std::string field = line.Take();
+		bool ok;
+		if (field == "material" && !line.done())
+		{
+			std::string material = line.Take();
+			instance.material = FindByName(scene.materials, material);
+			if (instance.material < 0)
+			{
+				error = "unknown material " + material;
+				return false;
+			}
+			ok = true;
+		}
+		else if (field == "position")
+			ok = line.TakeVec3(instance.position);
+		else if (field == "rotation")
+			ok = line.TakeVec3(instance.rotation);
+		else if (field == "scale")
+		{
+			ok = line.TakeFloat(instance.scale.x);
+			if (ok && line.TakeFloat(instance.scale.y))
+				ok = line.TakeFloat(instance.scale.z);
+			else
+				instance.scale = glm::vec3(instance.scale.x);
+		}
+		else if (field == "spin")
+			ok = line.TakeFloat(instance.spin);
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			error = "bad instance field " + field;
+			return false;
+		}
+	}
+
+	scene.instances.push_back(instance);
+	return true;
+}
+
+static bool ParseLight(SceneLine& line, Scene& scene, std::string& error)
+{
+	SceneLight light;
+	std::string shape = line.done() ? "" : line.Take();
+	if (shape == "rect")
+		light.shape = SceneLightShape::Rectangle;
+	else if (shape == "disk")
+		light.shape = SceneLightShape::Disk;
+	else
+	{
+		error = "light needs to be a rect or a disk";
+		return false;
+	}
+
+	while (!line.done())
+	{
+		std::string field = line.Take();
+		bool ok;
+		if (field == "center")
+			ok = line.TakeVec3(light.center);
+		else if (field == "right")
+			ok = line.TakeVec3(light.right);
+		else if (field == "up")
+			ok = line.TakeVec3(light.up);
+		else if (field == "color")
+			ok = line.TakeVec3(light.color);
+		else if (field == "intensity")
+			ok = line.TakeFloat(light.intensity);
+		else if (field == "two-sided")
+		{
+			light.twoSided = true;
+			ok = true;
+		}
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			error = "bad light field " + field;
+			return false;
+		}
+	}
+
+	scene.lights.push_back(light);
+	return true;
+}
+
+static bool ParseCamera(SceneLine& line, Scene& scene, std::string& error)
+{
+	SceneCamera camera;
+	while (!line.done())
+	{
+		std::string field = line.Take();
+		bool ok;
+		if (field == "position")
+			ok = line.TakeVec3(camera.position);
+		else if (field == "target")
+			ok = line.TakeVec3(camera.target);
+		else if (field == "fov")
+			ok = line.TakeFloat(camera.fov);
+		else if (field == "far")
+			ok = line.TakeFloat(camera.farPlane);
+		else
+			ok = false;
+
+		if (!ok)
+		{
+			error = "bad camera field " + field;
+			return false;
+		}
+	}
+
+	scene.cameras.push_back(camera);
+	return true;
+}
+
+bool SceneFile::Load(const char* fileName, Scene& scene, std::string* errorOut)
+{
+	std::ifstream file(fileName);
+	if (!file)
+	{
+		if (errorOut)
+			*errorOut = std::string("can't open ") + fileName;
+		return false;
+	}
+
+	std::string path = fileName;
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+	scene = Scene();
+	std::string text;
+	int lineNumber = 0;
+	while (std::getline(file, text))
+	{
+		++lineNumber;
+		size_t comment = text.find('#');
+		if (comment != std::string::npos)
+			text.erase(comment);
+
+		SceneLine line;
+		std::istringstream tokens(text);
+		std::string token;
+		while (tokens >> token)
+			line.tokens.push_back(token);
+		if (line.done())
+			continue;
+
+		std::string keyword = line.Take();
+		std::string error;
+		bool ok;
+		if (keyword == "model")
+			ok = ParseModel(line, directory, scene, error);
+		else if (keyword == "material")
+			ok = ParseMaterial(line, scene, error);
+		else if (keyword == "instance")
+			ok = ParseInstance(line, scene, error);
+		else if (keyword == "light")
+			ok = ParseLight(line, scene, error);
+		else if (keyword == "camera")
+			ok = ParseCamera(line, scene, error);
+		else
+		{
+			error = "unknown keyword " + keyword;
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			if (errorOut)
+			{
+				std::ostringstream message;
+				message << fileName << ":" << lineNumber << ": " << error;
+				*errorOut = message.str();
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+static void WriteVec3(std::ostream& out, const char* field, const glm::vec3& value)
+{
+	out << " " << field << " " << value.x << " " << value.y << " " << value.z;
+}
+
+bool SceneFile::Save(const char* fileName, const Scene& scene)
+{
+	std::ofstream file(fileName);
+	if (!file)
+		return false;
+
+	file << std::setprecision(9);
+	for (size_t i = 0; i < scene.models.size(); ++i)
+	{
+		const SceneModel& model = scene.models[i];
+		file << "model " << model.name << " " << (model.builtin ? "@" : "") << model.file << "\n";
+	}
+
+	for (size_t i = 0; i < scene.materials.size(); ++i)
+	{
+		const SceneMaterial& material = scene.materials[i];
+		file << "material " << material.name << " color " << material.color.r << " " << material.color.g << " " << material.color.b << " "
+			<< material.color.a << "\n";
+	}
+
+	for (size_t i = 0; i < scene.instances.size(); ++i)
+	{
+		const SceneInstance& instance = scene.instances[i];
+		file << "instance " << scene.models[instance.model].name;
+		if (instance.material >= 0)
+			file << " material " << scene.materials[instance.material].name;
+		WriteVec3(file, "position", instance.position);
+		WriteVec3(file, "rotation", instance.rotation);
+		WriteVec3(file, "scale", instance.scale);
+		if (instance.spin != 0.0f)
+			file << " spin " << instance.spin;
+		file << "\n";
+	}
+
+	for (size_t i = 0; i < scene.lights.size(); ++i)
+	{
+		const SceneLight& light = scene.lights[i];
+		file << "light " << (light.shape == SceneLightShape::Rectangle ? "rect" : "disk");
+		WriteVec3(file, "center", light.center);
+		WriteVec3(file, "right", light.right);
+		WriteVec3(file, "up", light.up);
+		WriteVec3(file, "color", light.color);
+		file << " intensity " << light.intensity << (light.twoSided ? " two-sided" : "") << "\n";
+	}
+
+	for (size_t i = 0; i < scene.cameras.size(); ++i)
+	{
+		const SceneCamera& camera = scene.cameras[i];
+		file << "camera";
+		WriteVec3(file, "position", camera.position);
+		WriteVec3(file, "target", camera.target);
+		file << " fov " << camera.fov << " far " << camera.farPlane << "\n";
+	}
+	return file.good();
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+#include <string>
+
+// A model every instance of it is drawn from: a .bpt patch file, an .obj or .ply mesh, or one
+// built into the program
+struct SceneModel
+{
+	std::string name;
+
+	// Relative paths are resolved against the scene file's directory when it is loaded
+	std::string file;
+
+	// Set for "@name" files, which name a model the program makes up itself
+	bool builtin = false;
+
+	bool IsMesh() const;
+};
+
+struct SceneMaterial
+{
+	std::string name;
+	glm::vec4 color = glm::vec4(0.6f, 0.6f, 0.6f, 1.0f);
+};
+
+struct SceneInstance
+{
+	int model = 0;
+
+	// -1 for the default material
+	int material = -1;
+
+	glm::vec3 position;
+
+	// Degrees about y, then x, then z
+	glm::vec3 rotation;
+	glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
+
+	// Degrees per second about y
+	float spin = 0.0f;
+};
+
+enum class SceneLightShape
+{
+	Rectangle,
+	Disk
+};
+
+// An area light, with the same meaning of every field as AreaLight
+struct SceneLight
+{
+	SceneLightShape shape = SceneLightShape::Rectangle;
+	glm::vec3 center;
+	glm::vec3 right = glm::vec3(1.0f, 0.0f, 0.0f);
+	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+	float intensity = 1.0f;
+	bool twoSided = false;
+};
+
+struct SceneCamera
+{
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, -5.0f);
+	glm::vec3 target;
+	float fov = 60.0f;
+	float farPlane = 100.0f;
+};
+
+struct Scene
+{
+	std::vector<SceneModel> models;
+	std::vector<SceneMaterial> materials;
+	std::vector<SceneInstance> instances;
+	std::vector<SceneLight> lights;
+	std::vector<SceneCamera> cameras;
+};
+
+// Reads and writes scene descriptions: a text file with one item per line, each a keyword
+// followed by its name or fields and then any number of optional "field values..." pairs.
+// Models and materials are referred to by name and have to come before the instances using
+// them. Everything after a # is a comment.
+//
+//	model teapot @teapot
+//	model bunny meshes/bunny.ply
+//	material copper color 0.9 0.5 0.3
+//	instance teapot material copper position 0 -1.5 0 rotation 0 45 0 scale 1 spin 30
+//	instance bunny position 3.5 -1.5 0 scale 10
+//	light rect center -4 1 0 right 0 1 0 up 0 0 1.5 color 1 0.8 0.6 intensity 4 two-sided
+//	light disk center 0 5 0 right 1 0 0 up 0 0 1 intensity 4
+//	camera position 0 2 -8 target 0 0 0 fov 60 far 100
+//
+// Scale takes one value or three.
+class SceneFile
+{
+public:
+	// On failure error, if given, says which line was wrong and why
+	static bool Load(const char* fileName, Scene& scene, std::string* error = nullptr);
+	static bool Save(const char* fileName, const Scene& scene);
+};
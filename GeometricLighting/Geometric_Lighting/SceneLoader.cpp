@@ -0,0 +1,239 @@
+#include "SceneLoader.h"
+#include "BptFile.h"
+
+#include <algorithm>
+#include <iostream>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+SceneLoader::SceneLoader()
+{
+	_running = false;
+	_hasView = false;
+	_finishedInstances = 0;
+}
+SceneLoader::~SceneLoader()
+{
+	Stop();
+}
+
+bool SceneLoader::Start(const Scene& scene, const SceneLoaderSettings& settings, const BuiltinSource& builtin)
+{
+	Stop();
+
+	_scene = scene;
+	_settings = settings;
+	_builtin = builtin;
+	_stats = SceneLoadStats();
+	_stats.models = (int)scene.models.size();
+	_stats.instances = (int)scene.instances.size();
+	_ready.clear();
+	_finishedInstances = 0;
+
+	// Models nothing uses are never loaded
+	_modelInstances.assign(scene.models.size(), std::vector<int>());
+	for (size_t i = 0; i < scene.instances.size(); ++i)
+		_modelInstances[scene.instances[i].model].push_back((int)i);
+	_pending.clear();
+	for (size_t m = 0; m < scene.models.size(); ++m)
+		if (!_modelInstances[m].empty())
+			_pending.push_back((int)m);
+
+	_start = Clock::now();
+	_running = true;
+	for (int i = 0; i < std::max(settings.loaderThreads, 1); ++i)
+	{
+		_loaders.push_back(std::thread(&SceneLoader::LoaderLoop, this));
+	}
+	return true;
+}
+
+void SceneLoader::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+		_pending.clear();
+	}
+	_signal.notify_all();
+
+	unsigned int size = _loaders.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		_loaders[i].join();
+	}
+	_loaders.clear();
+}
+
+void SceneLoader::SetView(const glm::vec3& cameraPos, const glm::mat4& viewProjMat)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_cameraPos = cameraPos;
+	_frustum.FromMatrix(viewProjMat);
+	_hasView = true;
+}
+
+std::pair<int, float> SceneLoader::Priority(int instance) const
+{
+	// Without a view everything loads in the order the file lists it
+	if (!_hasView)
+		return std::make_pair(0, (float)instance);
+
+	const SceneInstance& inst = _scene.instances[instance];
+	glm::vec3 scale = glm::abs(inst.scale);
+	glm::vec3 reach = glm::vec3(_settings.instanceRadius * std::max(scale.x, std::max(scale.y, scale.z)));
+	int hidden = _frustum.IntersectsBox(inst.position - reach, inst.position + reach) ? 0 : 1;
+	return std::make_pair(hidden, glm::length(inst.position - _cameraPos));
+}
+
+void SceneLoader::Poll(std::vector<LoadedInstance>& ready, int maxInstances)
+{
+	ready.clear();
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_ready.empty() || maxInstances <= 0)
+		return;
+
+	// The camera may have moved since the instances were queued, so they are ranked now
+	std::vector<std::pair<std::pair<int, float>, int> > ranked(_ready.size());
+	for (size_t i = 0; i < _ready.size(); ++i)
+		ranked[i] = std::make_pair(Priority(_ready[i].instance), (int)i);
+	size_t count = std::min(_ready.size(), (size_t)maxInstances);
+	std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+
+	std::vector<bool> taken(_ready.size(), false);
+	for (size_t i = 0; i < count; ++i)
+	{
+		ready.push_back(_ready[ranked[i].second]);
+		taken[ranked[i].second] = true;
+	}
+
+	size_t kept = 0;
+	for (size_t i = 0; i < _ready.size(); ++i)
+	{
+		if (!taken[i])
+			_ready[kept++] = _ready[i];
+	}
+	_ready.resize(kept);
+
+	if (_stats.firstInstanceSeconds < 0.0)
+		_stats.firstInstanceSeconds = std::chrono::duration<double>(Clock::now() - _start).count();
+	_stats.deliveredInstances += (int)count;
+	_finishedInstances += (int)count;
+}
+
+void SceneLoader::EndFrame()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_stats.completeSeconds >= 0.0)
+		return;
+
+	double seconds = std::chrono::duration<double>(Clock::now() - _start).count();
+	if (_stats.firstFrameSeconds < 0.0)
+		_stats.firstFrameSeconds = seconds;
+	++_stats.framesToComplete;
+	if (_finishedInstances == _stats.instances)
+		_stats.completeSeconds = seconds;
+}
+
+bool SceneLoader::done()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _finishedInstances == _stats.instances;
+}
+
+const Scene& SceneLoader::scene() const
+{
+	return _scene;
+}
+
+bool SceneLoader::LoadModel(int model, SceneAsset& asset)
+{
+	const SceneModel& source = _scene.models[model];
+	asset.model = model;
+	if (source.builtin)
+		return _builtin && _builtin(source.file, asset);
+	if (source.IsMesh())
+		return MeshImporter::Load(source.file.c_str(), asset.mesh, nullptr, _settings.importThreads);
+	return BptFile::Load(source.file.c_str(), asset.controlPoints) && !asset.controlPoints.empty();
+}
+
+void SceneLoader::LoaderLoop()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_signal.wait(lock, [this] { return !_running || !_pending.empty(); });
+		if (!_running)
+			return;
+
+		// The model whose best instance is best placed
+		size_t best = 0;
+		std::pair<int, float> bestPriority;
+		for (size_t i = 0; i < _pending.size(); ++i)
+		{
+			const std::vector<int>& instances = _modelInstances[_pending[i]];
+			std::pair<int, float> priority = Priority(instances[0]);
+			for (size_t j = 1; j < instances.size(); ++j)
+				priority = std::min(priority, Priority(instances[j]));
+			if (i == 0 || priority < bestPriority)
+			{
+				best = i;
+				bestPriority = priority;
+			}
+		}
+		int model = _pending[best];
+		_pending.erase(_pending.begin() + best);
+
+		lock.unlock();
+		Clock::time_point loadStart = Clock::now();
+		std::shared_ptr<SceneAsset> asset = std::make_shared<SceneAsset>();
+		bool loaded = LoadModel(model, *asset);
+		double seconds = std::chrono::duration<double>(Clock::now() - loadStart).count();
+		if (!loaded)
+			std::cout << "Failed to load " << _scene.models[model].file << " for scene model " << _scene.models[model].name << std::endl;
+		lock.lock();
+
+		_stats.loadSeconds += seconds;
+		const std::vector<int>& instances = _modelInstances[model];
+		if (loaded)
+		{
+			++_stats.loadedModels;
+			_stats.loadedPatches += asset->controlPoints.size() / 16;
+			_stats.loadedTriangles += asset->mesh.elements.size() / 3;
+			for (size_t i = 0; i < instances.size(); ++i)
+			{
+				LoadedInstance ready;
+				ready.instance = instances[i];
+				ready.asset = asset;
+				_ready.push_back(ready);
+			}
+		}
+		else
+		{
+			++_stats.failedModels;
+			_finishedInstances += (int)instances.size();
+		}
+	}
+}
+
+SceneLoadStats SceneLoader::Stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+void SceneLoader::PrintStats()
+{
+	SceneLoadStats stats = Stats();
+	std::cout << "Scene: " << stats.loadedModels << " of " << stats.models << " models (" << stats.loadedPatches << " patches, " << stats.loadedTriangles
+		<< " triangles) in " << stats.loadSeconds * 1000.0 << " ms of loading, " << stats.deliveredInstances << " of " << stats.instances << " instances";
+	if (stats.failedModels > 0)
+		std::cout << ", " << stats.failedModels << " models failed";
+	std::cout << std::endl;
+	std::cout << "  first frame " << stats.firstFrameSeconds * 1000.0 << " ms, first instance " << stats.firstInstanceSeconds * 1000.0 << " ms";
+	if (stats.completeSeconds >= 0.0)
+		std::cout << ", complete " << stats.completeSeconds * 1000.0 << " ms after " << stats.framesToComplete << " frames";
+	else
+		std::cout << ", not complete";
+	std::cout << std::endl;
+}
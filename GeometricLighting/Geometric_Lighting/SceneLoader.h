@@ -0,0 +1,123 @@
+#pragma once
+#include "SceneFile.h"
+#include "MeshImporter.h"
+#include "Frustum.h"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+
+struct SceneLoaderSettings
+{
+	int loaderThreads = 2;
+
+	// Threads each mesh import parses with, 0 for one per core
+	int importThreads = 0;
+
+	// How far around its position an instance is taken to reach before its model is loaded,
+	// when deciding whether it is in view
+	float instanceRadius = 2.0f;
+};
+
+struct SceneLoadStats
+{
+	int models = 0;
+	int instances = 0;
+	int loadedModels = 0;
+	int failedModels = 0;
+	int deliveredInstances = 0;
+	unsigned long long loadedPatches = 0;
+	unsigned long long loadedTriangles = 0;
+
+	// Time the loader threads spent reading and parsing, added up
+	double loadSeconds = 0.0;
+
+	// From Start to the end of the first frame, to the first instance handed over, and to the
+	// end of the frame that drew the last one; negative until they happen
+	double firstFrameSeconds = -1.0;
+	double firstInstanceSeconds = -1.0;
+	double completeSeconds = -1.0;
+	unsigned long long framesToComplete = 0;
+};
+
+// A model in memory: control points, 16 per patch, or a mesh. Shared by every instance of it.
+struct SceneAsset
+{
+	int model = 0;
+	std::vector<glm::vec3> controlPoints;
+	ImportedMesh mesh;
+};
+
+struct LoadedInstance
+{
+	int instance;
+	std::shared_ptr<const SceneAsset> asset;
+};
+
+// Streams the models of a scene in the background so the first frame doesn't wait for any of
+// them. Loader threads always take the model with the best placed instance next: one in the view
+// frustum before one outside it, then the nearest to the camera, as of the last SetView. Once a
+// model is in memory its instances queue up for the render thread, which takes a few each frame,
+// again best first, and turns them into something to draw. The loader never touches GL.
+class SceneLoader
+{
+public:
+	// Fills in a model named with @ in the scene file
+	typedef std::function<bool(const std::string& name, SceneAsset& asset)> BuiltinSource;
+
+	SceneLoader();
+	~SceneLoader();
+
+	// The scene is copied. Set the view first so the first models loaded are the right ones.
+	bool Start(const Scene& scene, const SceneLoaderSettings& settings, const BuiltinSource& builtin);
+	void Stop();
+
+	void SetView(const glm::vec3& cameraPos, const glm::mat4& viewProjMat);
+
+	// Hands over up to maxInstances of the loaded instances, best first
+	void Poll(std::vector<LoadedInstance>& ready, int maxInstances);
+
+	// Call at the end of every frame, for the timings
+	void EndFrame();
+
+	// Every instance has been handed over, or its model failed to load
+	bool done();
+
+	const Scene& scene() const;
+	SceneLoadStats Stats();
+	void PrintStats();
+
+private:
+	// Lower is better
+	std::pair<int, float> Priority(int instance) const;
+	bool LoadModel(int model, SceneAsset& asset);
+	void LoaderLoop();
+
+private:
+	Scene _scene;
+	SceneLoaderSettings _settings;
+	BuiltinSource _builtin;
+
+	std::vector<std::thread> _loaders;
+	std::mutex _mutex;
+	std::condition_variable _signal;
+	bool _running;
+
+	glm::vec3 _cameraPos;
+	Frustum _frustum;
+	bool _hasView;
+
+	// Models nobody has started on yet, and every model's instances
+	std::vector<int> _pending;
+	std::vector<std::vector<int> > _modelInstances;
+
+	std::vector<LoadedInstance> _ready;
+	int _finishedInstances;
+
+	std::chrono::high_resolution_clock::time_point _start;
+	SceneLoadStats _stats;
+};
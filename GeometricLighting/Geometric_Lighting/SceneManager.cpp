@@ -0,0 +1,235 @@
+#include "SceneManager.h"
+#include "SceneFile.h"
+#include "B-Spline.h"
+#include "MeshShape.h"
+#include "RenderManager.h"
+#include "SplineManager.h"
+#include "LightManager.h"
+#include "CameraManager.h"
+
+#include <GLM/gtc/random.hpp>
+#include <algorithm>
+#include <cmath>
+
+bool SceneManager::_active = false;
+Scene SceneManager::_scene;
+SceneSettings SceneManager::_settings;
+Shader SceneManager::_shader;
+SceneLoader* SceneManager::_loader = nullptr;
+bool SceneManager::_reported = false;
+std::vector<std::pair<B_Spline*, int> > SceneManager::_splines;
+std::vector<MeshShape*> SceneManager::_meshes;
+
+bool SceneManager::Load(const char* fileName, const SceneSettings& settings, std::string* error)
+{
+	_settings = settings;
+	_active = SceneFile::Load(fileName, _scene, error);
+	return _active;
+}
+
+bool SceneManager::GenerateTeapots(const char* fileName, int count)
+{
+	Scene generated;
+	SceneModel model;
+	model.name = "teapot";
+	model.file = "teapot";
+	model.builtin = true;
+	generated.models.push_back(model);
+
+	const char* names[] = { "gray", "copper", "jade", "ivory" };
+	glm::vec4 colors[] = { glm::vec4(0.6f, 0.6f, 0.6f, 1.0f), glm::vec4(0.9f, 0.5f, 0.3f, 1.0f), glm::vec4(0.4f, 0.8f, 0.5f, 1.0f), glm::vec4(0.9f, 0.9f, 0.8f, 1.0f) };
+	for (int i = 0; i < 4; ++i)
+	{
+		SceneMaterial material;
+		material.name = names[i];
+		material.color = colors[i];
+		generated.materials.push_back(material);
+	}
+
+	float farthest = 0.0f;
+	for (int n = 0; n < count; ++n)
+	{
+		SceneInstance instance;
+		instance.material = n % 4;
+		instance.position = glm::vec3(0.0f, -1.5f, 0.0f);
+		if (n > 0)
+		{
+			float radius = 7.0f + 7.0f * sqrt((float)(n - 1));
+			float angle = (n - 1) * 137.5f;
+			instance.position = glm::vec3(radius * cos(glm::radians(angle)), -1.5f, radius * sin(glm::radians(angle)));
+			instance.rotation = glm::vec3(0.0f, angle, 0.0f);
+			instance.spin = glm::linearRand(-90.0f, 90.0f);
+			farthest = radius;
+		}
+		generated.instances.push_back(instance);
+	}
+
+	SceneCamera camera;
+	camera.position = glm::vec3(0.0f, 3.0f, -12.0f);
+	camera.farPlane = std::max(100.0f, farthest * 2.0f + 20.0f);
+	generated.cameras.push_back(camera);
+
+	return SceneFile::Save(fileName, generated);
+}
+
+const SceneCamera* SceneManager::camera()
+{
+	if (_scene.cameras.empty())
+		return nullptr;
+	return &_scene.cameras[std::min(std::max(_settings.camera, 0), (int)_scene.cameras.size() - 1)];
+}
+
+void SceneManager::AddLights()
+{
+	for (size_t i = 0; i < _scene.lights.size(); ++i)
+	{
+		const SceneLight& source = _scene.lights[i];
+		AreaLight light;
+		light.shape = source.shape == SceneLightShape::Rectangle ? AreaLightShape::Rectangle : AreaLightShape::Disk;
+		light.center = source.center;
+		light.right = source.right;
+		light.up = source.up;
+		light.color = source.color;
+		light.intensity = source.intensity;
+		light.twoSided = source.twoSided;
+		LightManager::areaLights().push_back(light);
+	}
+}
+
+void SceneManager::Start(const Shader& shader, const SceneLoader::BuiltinSource& builtin)
+{
+	_shader = shader;
+
+	const SceneCamera* start = camera();
+	if (start)
+		CameraManager::LookAt(start->position, start->target);
+	CameraManager::Update(0.0f);
+
+	_meshes.assign(_scene.models.size(), nullptr);
+	_loader = new SceneLoader();
+	_loader->SetView(glm::vec3(CameraManager::CamPos()), CameraManager::ProjMat() * CameraManager::ViewMat());
+	_loader->Start(_scene, _settings.loader, builtin);
+}
+
+void SceneManager::Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat)
+{
+	if (!_loader)
+		return;
+
+	_loader->SetView(cameraPos, viewProjMat);
+
+	std::vector<LoadedInstance> ready;
+	_loader->Poll(ready, _settings.instancesPerFrame);
+	for (size_t i = 0; i < ready.size(); ++i)
+		CreateInstance(ready[i]);
+}
+
+void SceneManager::PlaceInstance(Transform& transform, const SceneInstance& instance)
+{
+	transform.position = instance.position;
+	transform.rotation = glm::angleAxis(instance.rotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::angleAxis(instance.rotation.x, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::angleAxis(instance.rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+	transform.scale = instance.scale;
+	transform.angularVelocity = glm::angleAxis(instance.spin, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+void SceneManager::CreateInstance(const LoadedInstance& loaded)
+{
+	const SceneInstance& instance = _scene.instances[loaded.instance];
+	glm::vec4 color = instance.material >= 0 ? _scene.materials[instance.material].color : SceneMaterial().color;
+
+	if (_scene.models[instance.model].IsMesh())
+	{
+		// Every instance of a mesh draws from the buffers uploaded for the first
+		RenderShape* shape;
+		MeshShape*& owner = _meshes[instance.model];
+		if (!owner)
+		{
+			owner = MeshShape::Create(loaded.asset->mesh, _shader, color);
+			shape = owner;
+		}
+		else
+		{
+			shape = new RenderShape(owner->vao(), owner->count(), GL_TRIANGLES, _shader, color);
+			RenderManager::AddShape(shape);
+		}
+		PlaceInstance(shape->transform(), instance);
+		return;
+	}
+
+	const std::vector<glm::vec3>& controlPoints = loaded.asset->controlPoints;
+	int numPatches = (int)controlPoints.size() / 16;
+	B_Spline* spline = new B_Spline(_shader, numPatches);
+	for (int i = 0; i < numPatches; ++i)
+		spline->SetControlPoints(i, &controlPoints[i * 16]);
+	spline->SetColor(color);
+	PlaceInstance(spline->transform(), instance);
+
+	// Only once placed, so its first box in the tree is right
+	SplineManager::Add(spline);
+	_splines.push_back(std::make_pair(spline, loaded.instance));
+}
+
+bool SceneManager::EndFrame()
+{
+	if (!_loader || _reported)
+		return false;
+
+	_loader->EndFrame();
+	if (_loader->Stats().completeSeconds < 0.0)
+		return false;
+
+	_loader->PrintStats();
+	_reported = true;
+	return true;
+}
+
+int SceneManager::InstanceOf(const B_Spline* spline)
+{
+	for (size_t i = 0; i < _splines.size(); ++i)
+	{
+		if (_splines[i].first == spline)
+			return _splines[i].second;
+	}
+	return -1;
+}
+
+void SceneManager::Stop()
+{
+	if (!_loader)
+		return;
+
+	_loader->Stop();
+	if (!_reported)
+		_loader->PrintStats();
+	delete _loader;
+	_loader = nullptr;
+}
+
+void SceneManager::DumpData()
+{
+	Stop();
+
+	// The shapes belong to the RenderManager
+	for (size_t i = 0; i < _splines.size(); ++i)
+		delete _splines[i].first;
+	_splines.clear();
+	_meshes.clear();
+	_active = false;
+}
+
+bool SceneManager::active()
+{
+	return _active;
+}
+
+const Scene& SceneManager::scene()
+{
+	return _scene;
+}
+
+void SceneManager::PrintStats()
+{
+	if (_loader)
+		_loader->PrintStats();
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "SceneLoader.h"
+#include "RenderShape.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+class B_Spline;
+class MeshShape;
+
+struct SceneSettings
+{
+	SceneLoaderSettings loader;
+
+	// Which of the scene's cameras to start from, clamped to the ones there are
+	int camera = 0;
+
+	// Instances turned into something to draw per frame at most, so a frame never waits long on uploads
+	int instancesPerFrame = 8;
+};
+
+// Draws a scene file in place of the teapot. Load reads only the description; Start hands the
+// models to a SceneLoader, and every Update turns the few instances it has finished into a
+// B_Spline for patch models or a RenderShape for meshes, placed where the file puts them. Every
+// instance of a mesh draws from the buffers uploaded for the first. Splines go to the
+// SplineManager and shapes to the RenderManager, which draw them like any other.
+class SceneManager
+{
+public:
+	// Reads the description only; the models it names stream in once Start is called
+	static bool Load(const char* fileName, const SceneSettings& settings, std::string* error);
+
+	// Writes a scene with the built-in teapot in the middle and count - 1 more around it, laid
+	// out like --teapots does, to try streaming on
+	static bool GenerateTeapots(const char* fileName, int count);
+
+	// The scene camera to start from, or nullptr if the file has none
+	static const SceneCamera* camera();
+
+	// Adds the file's area lights to the LightManager, which has to be initialized
+	static void AddLights();
+
+	// Points the camera where the scene's looks and starts loading from there
+	static void Start(const Shader& shader, const SceneLoader::BuiltinSource& builtin);
+
+	// Creates the next few finished instances and tells the loader where the camera went
+	static void Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat);
+
+	// Call at the end of every frame. Returns true on the frame that completes the scene.
+	static bool EndFrame();
+
+	// The scene instance a spline was created for, or -1
+	static int InstanceOf(const B_Spline* spline);
+
+	// Stops the loader threads, before anything they could still be reading goes away
+	static void Stop();
+	static void DumpData();
+
+	static bool active();
+	static const Scene& scene();
+	static void PrintStats();
+
+private:
+	static void CreateInstance(const LoadedInstance& loaded);
+	static void PlaceInstance(Transform& transform, const SceneInstance& instance);
+
+private:
+	static bool _active;
+	static Scene _scene;
+	static SceneSettings _settings;
+	static Shader _shader;
+	static SceneLoader* _loader;
+	static bool _reported;
+
+	// What the scene's instances became: a spline each for patch models, and per mesh model the
+	// first instance's shape, which owns the buffers the others draw from
+	static std::vector<std::pair<B_Spline*, int> > _splines;
+	static std::vector<MeshShape*> _meshes;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define SIMD_LANES_SSE
+#include <xmmintrin.h>
+#endif
+
+// Four floats, one per item of a batch (curves, texels, ...). With SSE every operation is a
+// single instruction, otherwise the same code runs on plain arrays.
+#ifdef SIMD_LANES_SSE
+typedef __m128 Lanes;
+
+static inline Lanes Splat(float f) { return _mm_set1_ps(f); }
+static inline Lanes Load(const float* f) { return _mm_loadu_ps(f); }
+static inline void Store(float* f, Lanes a) { _mm_storeu_ps(f, a); }
+static inline Lanes Add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes Sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes Mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes Div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+static inline Lanes Max(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+static inline Lanes Min(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes Sqrt(Lanes a) { return _mm_sqrt_ps(a); }
+
+// A bit for each lane below zero, lane 0 in the lowest
+static inline int NegativeLanes(Lanes a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+#else
+struct Lanes
+{
+	float v[4];
+};
+
+static inline Lanes Splat(float f) { Lanes r = { { f, f, f, f } }; return r; }
+static inline Lanes Load(const float* f) { Lanes r = { { f[0], f[1], f[2], f[3] } }; return r; }
+static inline void Store(float* f, Lanes a) { for (int i = 0; i < 4; ++i) f[i] = a.v[i]; }
+static inline Lanes Add(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+static inline Lanes Sub(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+static inline Lanes Mul(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+static inline Lanes Div(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] /= b.v[i]; return a; }
+static inline Lanes Max(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] = std::max(a.v[i], b.v[i]); return a; }
+static inline Lanes Min(Lanes a, Lanes b) { for (int i = 0; i < 4; ++i) a.v[i] = std::min(a.v[i], b.v[i]); return a; }
+static inline Lanes Sqrt(Lanes a) { for (int i = 0; i < 4; ++i) a.v[i] = std::sqrt(a.v[i]); return a; }
+
+static inline int NegativeLanes(Lanes a)
+{
+	int mask = 0;
+	for (int i = 0; i < 4; ++i)
+		mask |= (a.v[i] < 0.0f ? 1 : 0) << i;
+	return mask;
+}
+#endif
+
+// A vec3 per lane, stored as separate x, y and z registers
+struct Lanes3
+{
+	Lanes x, y, z;
+};
+
+static inline Lanes3 Add3(const Lanes3& a, const Lanes3& b) { Lanes3 r = { Add(a.x, b.x), Add(a.y, b.y), Add(a.z, b.z) }; return r; }
+static inline Lanes3 Sub3(const Lanes3& a, const Lanes3& b) { Lanes3 r = { Sub(a.x, b.x), Sub(a.y, b.y), Sub(a.z, b.z) }; return r; }
+static inline Lanes3 Scale3(const Lanes3& a, Lanes s) { Lanes3 r = { Mul(a.x, s), Mul(a.y, s), Mul(a.z, s) }; return r; }
+
+static inline Lanes3 Cross3(const Lanes3& a, const Lanes3& b)
+{
+	Lanes3 r;
+	r.x = Sub(Mul(a.y, b.z), Mul(a.z, b.y));
+	r.y = Sub(Mul(a.z, b.x), Mul(a.x, b.z));
+	r.z = Sub(Mul(a.x, b.y), Mul(a.y, b.x));
+	return r;
+}
+
+static inline Lanes Dot3(const Lanes3& a, const Lanes3& b)
+{
+	return Add(Add(Mul(a.x, b.x), Mul(a.y, b.y)), Mul(a.z, b.z));
+}
+
+static inline Lanes3 Normalize3(const Lanes3& a)
+{
+	Lanes lengthSqr = Dot3(a, a);
+	Lanes length = Max(Sqrt(lengthSqr), Splat(1e-20f));
+	return Scale3(a, Div(Splat(1.0f), length));
+}
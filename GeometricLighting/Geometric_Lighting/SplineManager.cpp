@@ -0,0 +1,165 @@
+#include "SplineManager.h"
+#include "B-Spline.h"
+
+#include <iostream>
+#include <algorithm>
+
+DynamicBVH SplineManager::_tree;
+std::vector<B_Spline*> SplineManager::_splines;
+std::vector<int> SplineManager::_proxies;
+std::unordered_map<B_Spline*, unsigned int> SplineManager::_indices;
+std::vector<int> SplineManager::_visible;
+std::vector<unsigned int> SplineManager::_visibleViews;
+std::vector<std::pair<int, int> > SplineManager::_pairs;
+
+void SplineManager::Add(B_Spline* spline)
+{
+	// Update once so the model matrix the bounds come from is current
+	spline->Update(0.0f);
+
+	glm::vec3 minPos, maxPos;
+	spline->Bounds(minPos, maxPos);
+
+	_indices[spline] = _splines.size();
+	_splines.push_back(spline);
+	_proxies.push_back(_tree.Insert(minPos, maxPos, spline));
+
+	// Hidden until Cull finds it in view
+	spline->SetVisible(false);
+}
+
+void SplineManager::Remove(B_Spline* spline)
+{
+	std::unordered_map<B_Spline*, unsigned int>::iterator found = _indices.find(spline);
+	if (found == _indices.end())
+		return;
+
+	unsigned int index = found->second;
+	int proxy = _proxies[index];
+	_tree.Remove(proxy);
+	_indices.erase(found);
+
+	for (unsigned int i = 0; i < _visible.size(); ++i)
+	{
+		if (_visible[i] == proxy)
+		{
+			_visible[i] = _visible.back();
+			_visible.pop_back();
+			_visibleViews[i] = _visibleViews.back();
+			_visibleViews.pop_back();
+			break;
+		}
+	}
+	spline->SetVisible(true);
+
+	// Move the last spline into the hole
+	if (index + 1 < _splines.size())
+	{
+		_splines[index] = _splines.back();
+		_proxies[index] = _proxies.back();
+		_indices[_splines[index]] = index;
+	}
+	_splines.pop_back();
+	_proxies.pop_back();
+}
+
+void SplineManager::Update(float dt)
+{
+	glm::vec3 minPos, maxPos;
+	unsigned int size = _splines.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		_splines[i]->Update(dt);
+		_splines[i]->Bounds(minPos, maxPos);
+		_tree.Move(_proxies[i], minPos, maxPos, _splines[i]->transform().linearVelocity * dt);
+	}
+}
+
+void SplineManager::Cull(const glm::mat4& viewProjMat)
+{
+	Cull(&viewProjMat, 1);
+}
+
+void SplineManager::Cull(const glm::mat4* viewProjMats, int numViews)
+{
+	Frustum frusta[32];
+	numViews = std::min(numViews, 32);
+	for (int i = 0; i < numViews; ++i)
+	{
+		frusta[i].FromMatrix(viewProjMats[i]);
+	}
+
+	// Switch off what was visible last frame, then switch on what is visible now, so the cost
+	// follows the number of visible splines
+	for (unsigned int i = 0; i < _visible.size(); ++i)
+	{
+		((B_Spline*)_tree.userData(_visible[i]))->SetVisible(false);
+	}
+	_visible.clear();
+	_visibleViews.clear();
+
+	_tree.QueryFrusta(frusta, numViews, _visible, _visibleViews);
+	for (unsigned int i = 0; i < _visible.size(); ++i)
+	{
+		((B_Spline*)_tree.userData(_visible[i]))->SetViewMask(_visibleViews[i]);
+	}
+}
+
+B_Spline* SplineManager::Pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance)
+{
+	float hitDistance;
+	int proxy = _tree.RayCast(origin, direction, maxDistance, hitDistance);
+	if (proxy < 0)
+		return nullptr;
+
+	if (distance)
+		*distance = hitDistance;
+	return (B_Spline*)_tree.userData(proxy);
+}
+
+void SplineManager::OverlappingPairs(std::vector<std::pair<B_Spline*, B_Spline*> >& pairs)
+{
+	_pairs.clear();
+	_tree.QueryPairs(_pairs);
+	for (unsigned int i = 0; i < _pairs.size(); ++i)
+	{
+		pairs.push_back(std::make_pair((B_Spline*)_tree.userData(_pairs[i].first), (B_Spline*)_tree.userData(_pairs[i].second)));
+	}
+}
+
+int SplineManager::numSplines()
+{
+	return (int)_splines.size();
+}
+
+B_Spline* SplineManager::spline(int index)
+{
+	return _splines[index];
+}
+
+const DynamicBVH& SplineManager::tree()
+{
+	return _tree;
+}
+
+int SplineManager::numVisible()
+{
+	return (int)_visible.size();
+}
+
+void SplineManager::PrintStats()
+{
+	std::cout << "Splines: " << _splines.size() << ", " << _visible.size() << " visible in the last frame" << std::endl;
+	DynamicBVH::PrintStats(_tree.Stats());
+}
+
+// Forgets every spline without touching them, as their shapes may already be gone
+void SplineManager::DumpData()
+{
+	_tree = DynamicBVH();
+	_splines.clear();
+	_proxies.clear();
+	_indices.clear();
+	_visible.clear();
+	_visibleViews.clear();
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "DynamicBVH.h"
+
+#include <GLM/glm.hpp>
+#include <vector>
+#include <unordered_map>
+
+class B_Spline;
+
+// Keeps every B_Spline in the scene in a DynamicBVH over its world space bounds, so frustum
+// culling, picking and overlap tests cost time in proportion to what they find rather than to
+// the number of splines. Splines that move or turn have their boxes moved in the tree by Update.
+//
+// The splines stay owned by whoever created them.
+class SplineManager
+{
+public:
+	static void Add(B_Spline* spline);
+	static void Remove(B_Spline* spline);
+
+	// Updates every spline and its box in the tree
+	static void Update(float dt);
+
+	// Leaves only the patches of splines in the view frustum switched on for drawing
+	static void Cull(const glm::mat4& viewProjMat);
+
+	// The same for several views in one walk of the tree, each spline drawn only into the views
+	// it is in
+	static void Cull(const glm::mat4* viewProjMats, int numViews);
+
+	// The spline whose bounds the ray hits first, or nullptr
+	static B_Spline* Pick(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* distance = nullptr);
+
+	// Pairs of splines whose bounds overlap, the broad phase of a collision test
+	static void OverlappingPairs(std::vector<std::pair<B_Spline*, B_Spline*> >& pairs);
+
+	// Every spline in the scene, and the tree over their bounds. The tree's user data are the
+	// B_Spline pointers.
+	static int numSplines();
+	static B_Spline* spline(int index);
+	static const DynamicBVH& tree();
+
+	static int numVisible();
+	static void PrintStats();
+	static void DumpData();
+
+private:
+	static DynamicBVH _tree;
+	static std::vector<B_Spline*> _splines;
+	static std::vector<int> _proxies;
+	static std::unordered_map<B_Spline*, unsigned int> _indices;
+	static std::vector<int> _visible;
+	static std::vector<unsigned int> _visibleViews;
+	static std::vector<std::pair<int, int> > _pairs;
+};
@@ -0,0 +1,434 @@
+#include "Telemetry.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+std::atomic<int> Telemetry::_clients(0);
+std::atomic<bool> Telemetry::_running(false);
+std::thread Telemetry::_thread;
+int Telemetry::_listener = -1;
+int Telemetry::_wakePipe[2] = { -1, -1 };
+char Telemetry::_socketPath[108];
+Clock::time_point Telemetry::_startTime;
+
+Telemetry::FrameSample Telemetry::_current;
+bool Telemetry::_currentDirty = false;
+unsigned long long Telemetry::_frame = 0;
+
+Telemetry::FrameSample Telemetry::_ring[Telemetry::RING_SIZE];
+std::atomic<unsigned int> Telemetry::_ringHead(0);
+std::atomic<unsigned int> Telemetry::_ringTail(0);
+std::atomic<unsigned long long> Telemetry::_dropped(0);
+std::atomic<unsigned long long> Telemetry::_linesSent(0);
+
+// Names as they appear in the JSON
+static const char* COUNTER_NAMES[Telemetry::NUM_COUNTERS] =
+{
+	"visible_splines",
+	"terrain_drawn_nodes",
+	"terrain_resident_nodes",
+	"terrain_gpu_bytes",
+	"paged_resident_bytes",
+	"capture_dropped_frames"
+};
+
+static const char* SCOPE_NAMES[Telemetry::NUM_SCOPES] =
+{
+	"update",
+	"cull",
+	"streaming",
+	"draw",
+	"capture",
+	"swap"
+};
+
+void Telemetry::SetCounter(Counter counter, long long value)
+{
+	if (!enabled())
+		return;
+	_current.counters[counter] = value;
+	_currentDirty = true;
+}
+
+void Telemetry::AddScopeTime(Scope scope, long long nanoseconds)
+{
+	if (!enabled())
+		return;
+	_current.scopeNanoseconds[scope] += nanoseconds;
+	_current.scopeCalls[scope] += 1;
+	_currentDirty = true;
+}
+
+void Telemetry::EndFrame(double frameSeconds)
+{
+	unsigned long long frame = _frame++;
+	if (!enabled())
+	{
+		// Don't let a half collected frame from before the last client left leak into the next one
+		if (_currentDirty)
+		{
+			memset(&_current, 0, sizeof(_current));
+			_currentDirty = false;
+		}
+		return;
+	}
+
+	_current.frame = frame;
+	_current.timeMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _startTime).count();
+	_current.frameMilliseconds = (float)(frameSeconds * 1000.0);
+
+	// A full ring means the telemetry thread is behind; the frame is dropped rather than waited on
+	unsigned int head = _ringHead.load(std::memory_order_relaxed);
+	if (head - _ringTail.load(std::memory_order_acquire) >= (unsigned int)RING_SIZE)
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+	else
+	{
+		_ring[head % RING_SIZE] = _current;
+		_ringHead.store(head + 1, std::memory_order_release);
+	}
+
+	memset(&_current, 0, sizeof(_current));
+	_currentDirty = false;
+}
+
+TelemetryStats Telemetry::Stats()
+{
+	TelemetryStats stats;
+	stats.frames = _ringHead.load();
+	stats.dropped = _dropped.load();
+	stats.linesSent = _linesSent.load();
+	stats.clients = _clients.load();
+	return stats;
+}
+
+#ifdef _WIN32
+
+bool Telemetry::Start(const char* socketPath)
+{
+	std::cout << "Telemetry needs Unix domain sockets, which this build doesn't support" << std::endl;
+	return false;
+}
+
+void Telemetry::Stop()
+{
+}
+
+int Telemetry::Watch(const char* socketPath, const char* command, int maxLines, bool print)
+{
+	std::cout << "Telemetry needs Unix domain sockets, which this build doesn't support" << std::endl;
+	return 0;
+}
+
+void Telemetry::ServerLoop()
+{
+}
+
+#else
+
+bool Telemetry::Start(const char* socketPath)
+{
+	if (_running.load())
+		return true;
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	strncpy(_socketPath, address.sun_path, sizeof(_socketPath));
+	unlink(socketPath);
+
+	_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_listener < 0 || bind(_listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(_listener, 8) != 0 || pipe(_wakePipe) != 0)
+	{
+		std::cout << "Couldn't open the telemetry endpoint on " << socketPath << std::endl;
+		if (_listener >= 0)
+			close(_listener);
+		_listener = -1;
+		return false;
+	}
+
+	_startTime = Clock::now();
+	memset(&_current, 0, sizeof(_current));
+	_running = true;
+	_thread = std::thread(ServerLoop);
+	std::cout << "Telemetry on " << socketPath << std::endl;
+	return true;
+}
+
+void Telemetry::Stop()
+{
+	if (!_running.load())
+		return;
+
+	_running = false;
+	char wake = 0;
+	if (write(_wakePipe[1], &wake, 1) < 0)
+		std::cout << "Couldn't wake the telemetry thread" << std::endl;
+	_thread.join();
+
+	close(_wakePipe[0]);
+	close(_wakePipe[1]);
+	close(_listener);
+	_listener = -1;
+	unlink(_socketPath);
+}
+
+// Resident memory of the whole process, or -1 where /proc isn't there to ask
+static long long ProcessResidentBytes()
+{
+#ifdef __linux__
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return -1;
+	long long pages = 0, resident = 0;
+	int read = fscanf(file, "%lld %lld", &pages, &resident);
+	fclose(file);
+	return read == 2 ? resident * sysconf(_SC_PAGESIZE) : -1;
+#else
+	return -1;
+#endif
+}
+
+// One line of JSON for a frame
+std::string Telemetry::FormatSample(const FrameSample& sample, long long residentBytes)
+{
+	std::ostringstream json;
+	json << "{\"frame\":" << sample.frame << ",\"time_ms\":" << sample.timeMicroseconds / 1000.0
+		<< ",\"frame_ms\":" << sample.frameMilliseconds
+		<< ",\"fps\":" << (sample.frameMilliseconds > 0.0f ? 1000.0f / sample.frameMilliseconds : 0.0f) << ",\"counters\":{";
+	for (int c = 0; c < NUM_COUNTERS; ++c)
+		json << (c ? "," : "") << "\"" << COUNTER_NAMES[c] << "\":" << sample.counters[c];
+	json << "},\"scopes\":{";
+	for (int s = 0; s < NUM_SCOPES; ++s)
+		json << (s ? "," : "") << "\"" << SCOPE_NAMES[s] << "\":{\"ms\":" << sample.scopeNanoseconds[s] / 1.0e6
+			<< ",\"calls\":" << sample.scopeCalls[s] << "}";
+	json << "},\"memory\":{\"process_resident_bytes\":" << residentBytes << "},\"dropped_frames\":" << _dropped.load() << "}\n";
+	return json.str();
+}
+
+// A connected client as the telemetry thread sees it
+struct TelemetryClient
+{
+	int socket;
+	std::string input;
+	std::string output;
+	bool subscribed;
+	int every;
+};
+
+// Clients that stop reading are dropped once this much output has piled up for them
+static const size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+
+void Telemetry::ServerLoop()
+{
+	std::vector<TelemetryClient> clients;
+	std::vector<pollfd> pollSet;
+	FrameSample latest;
+	bool haveLatest = false;
+	long long residentBytes = ProcessResidentBytes();
+	Clock::time_point residentTime = Clock::now();
+	char buffer[4096];
+
+	while (_running.load())
+	{
+		pollSet.clear();
+		pollfd wakePoll = { _wakePipe[0], POLLIN, 0 };
+		pollfd listenPoll = { _listener, POLLIN, 0 };
+		pollSet.push_back(wakePoll);
+		pollSet.push_back(listenPoll);
+		for (size_t i = 0; i < clients.size(); ++i)
+		{
+			pollfd clientPoll = { clients[i].socket, (short)(POLLIN | (clients[i].output.empty() ? 0 : POLLOUT)), 0 };
+			pollSet.push_back(clientPoll);
+		}
+
+		// Without clients there is nothing to drain, so sleep until someone connects
+		if (poll(&pollSet[0], pollSet.size(), clients.empty() ? -1 : 10) < 0)
+			continue;
+		if (!_running.load())
+			break;
+
+		// The ring first, so a poll answered below sees the latest frame
+		unsigned int tail = _ringTail.load(std::memory_order_relaxed);
+		unsigned int head = _ringHead.load(std::memory_order_acquire);
+		for (; tail != head; ++tail)
+		{
+			latest = _ring[tail % RING_SIZE];
+			haveLatest = true;
+
+			bool wanted = false;
+			for (size_t i = 0; i < clients.size(); ++i)
+				wanted = wanted || (clients[i].subscribed && latest.frame % clients[i].every == 0);
+			if (!wanted)
+				continue;
+
+			// Reading /proc costs more than a frame's worth of everything else, so at most ten times a second
+			if (Clock::now() - residentTime > std::chrono::milliseconds(100))
+			{
+				residentBytes = ProcessResidentBytes();
+				residentTime = Clock::now();
+			}
+
+			std::string line = FormatSample(latest, residentBytes);
+
+			for (size_t i = 0; i < clients.size(); ++i)
+			{
+				if (clients[i].subscribed && latest.frame % clients[i].every == 0)
+				{
+					clients[i].output += line;
+					_linesSent.fetch_add(1);
+				}
+			}
+		}
+		_ringTail.store(tail, std::memory_order_release);
+
+		if (pollSet[1].revents & POLLIN)
+		{
+			int socket = accept(_listener, nullptr, nullptr);
+			if (socket >= 0)
+			{
+				TelemetryClient client;
+				client.socket = socket;
+				client.subscribed = false;
+				client.every = 1;
+				clients.push_back(client);
+				_clients.fetch_add(1);
+			}
+		}
+
+		for (size_t i = 0; i < clients.size() && i + 2 < pollSet.size(); ++i)
+		{
+			TelemetryClient& client = clients[i];
+			bool closed = false;
+			if (pollSet[i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				ssize_t received = recv(client.socket, buffer, sizeof(buffer), 0);
+				if (received <= 0)
+					closed = true;
+				else
+					client.input.append(buffer, received);
+			}
+
+			size_t end;
+			while (!closed && (end = client.input.find('\n')) != std::string::npos)
+			{
+				std::string command = client.input.substr(0, end);
+				client.input.erase(0, end + 1);
+				if (!command.empty() && command[command.size() - 1] == '\r')
+					command.erase(command.size() - 1);
+
+				if (command == "poll")
+				{
+					if (!haveLatest)
+						client.output += "{\"error\":\"no frames yet\"}\n";
+					else
+					{
+						client.output += FormatSample(latest, ProcessResidentBytes());
+					}
+				}
+				else if (command.compare(0, 9, "subscribe") == 0)
+				{
+					client.subscribed = true;
+					client.every = command.size() > 10 ? std::max(1, atoi(command.c_str() + 10)) : 1;
+				}
+				else if (command == "unsubscribe")
+					client.subscribed = false;
+				else
+					client.output += "{\"error\":\"unknown command\"}\n";
+			}
+
+			if (!closed && !client.output.empty())
+			{
+				ssize_t sent = send(client.socket, client.output.data(), client.output.size(), MSG_DONTWAIT);
+				if (sent > 0)
+					client.output.erase(0, sent);
+				else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+					closed = true;
+			}
+
+			if (closed || client.output.size() > MAX_PENDING_OUTPUT)
+			{
+				close(client.socket);
+				client.socket = -1;
+			}
+		}
+
+		for (size_t i = 0; i < clients.size();)
+		{
+			if (clients[i].socket < 0)
+			{
+				clients.erase(clients.begin() + i);
+				_clients.fetch_sub(1);
+			}
+			else
+				++i;
+		}
+	}
+
+	for (size_t i = 0; i < clients.size(); ++i)
+		close(clients[i].socket);
+	_clients = 0;
+}
+
+int Telemetry::Watch(const char* socketPath, const char* command, int maxLines, bool print)
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	int socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (socket < 0 || connect(socket, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		std::cout << "Couldn't connect to telemetry on " << socketPath << std::endl;
+		if (socket >= 0)
+			close(socket);
+		return 0;
+	}
+
+	std::string request = std::string(command) + "\n";
+	if (send(socket, request.data(), request.size(), 0) != (ssize_t)request.size())
+	{
+		close(socket);
+		return 0;
+	}
+
+	int lines = 0;
+	std::string input;
+	char buffer[4096];
+	while (maxLines == 0 || lines < maxLines)
+	{
+		ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+		if (received <= 0)
+			break;
+		input.append(buffer, received);
+
+		size_t end;
+		while ((end = input.find('\n')) != std::string::npos && (maxLines == 0 || lines < maxLines))
+		{
+			if (print)
+				std::cout << input.substr(0, end) << std::endl;
+			input.erase(0, end + 1);
+			lines++;
+		}
+	}
+	close(socket);
+	return lines;
+}
+
+#endif
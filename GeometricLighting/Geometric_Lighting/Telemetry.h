@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <string>
+
+struct TelemetryStats
+{
+	unsigned long long frames = 0;
+	unsigned long long dropped = 0;
+	unsigned long long linesSent = 0;
+	int clients = 0;
+};
+
+// Live frame timings, counters and profiler scopes for monitoring a running viewer from another
+// process. A local client connects to a Unix domain socket and sends text commands, one per
+// line, and gets frames back as one line of JSON each:
+//
+//	poll			the most recent frame
+//	subscribe [N]	every Nth frame from now on (every frame if N is left out)
+//	unsubscribe		stop streaming
+//
+// The render thread never blocks or takes a lock. It accumulates the frame in memory only it
+// touches, and EndFrame copies the frame into a single producer, single consumer ring that the
+// telemetry thread drains, formats and sends. While no client is connected the calls come down
+// to a relaxed atomic load and a branch: no clock reads and no copies.
+class Telemetry
+{
+public:
+	enum Counter
+	{
+		VISIBLE_SPLINES,
+		TERRAIN_DRAWN_NODES,
+		TERRAIN_RESIDENT_NODES,
+		TERRAIN_GPU_BYTES,
+		PAGED_RESIDENT_BYTES,
+		CAPTURE_DROPPED_FRAMES,
+		NUM_COUNTERS
+	};
+
+	enum Scope
+	{
+		SCOPE_UPDATE,
+		SCOPE_CULL,
+		SCOPE_STREAMING,
+		SCOPE_DRAW,
+		SCOPE_CAPTURE,
+		SCOPE_SWAP,
+		NUM_SCOPES
+	};
+
+	// Starts listening on socketPath on a thread of its own
+	static bool Start(const char* socketPath);
+	static void Stop();
+
+	// True while at least one client is connected. Everything below does nothing otherwise.
+	static bool enabled()
+	{
+		return _clients.load(std::memory_order_relaxed) > 0;
+	}
+
+	// Render thread only
+	static void SetCounter(Counter counter, long long value);
+	static void AddScopeTime(Scope scope, long long nanoseconds);
+	static void EndFrame(double frameSeconds);
+
+	static TelemetryStats Stats();
+
+	// Connects to a running endpoint, sends command and prints the lines that come back until
+	// maxLines have arrived (0 keeps going until the endpoint goes away). Returns the number of
+	// lines received.
+	static int Watch(const char* socketPath, const char* command, int maxLines, bool print = true);
+
+private:
+	// One frame as the render thread saw it
+	struct FrameSample
+	{
+		unsigned long long frame;
+		long long timeMicroseconds;
+		float frameMilliseconds;
+		long long counters[NUM_COUNTERS];
+		long long scopeNanoseconds[NUM_SCOPES];
+		int scopeCalls[NUM_SCOPES];
+	};
+
+	static void ServerLoop();
+	static std::string FormatSample(const FrameSample& sample, long long residentBytes);
+
+private:
+	static const int RING_SIZE = 256;
+
+	static std::atomic<int> _clients;
+	static std::atomic<bool> _running;
+	static std::thread _thread;
+	static int _listener;
+	static int _wakePipe[2];
+	static char _socketPath[108];
+	static std::chrono::high_resolution_clock::time_point _startTime;
+
+	// Written by the render thread only
+	static FrameSample _current;
+	static bool _currentDirty;
+	static unsigned long long _frame;
+
+	static FrameSample _ring[RING_SIZE];
+	static std::atomic<unsigned int> _ringHead;
+	static std::atomic<unsigned int> _ringTail;
+	static std::atomic<unsigned long long> _dropped;
+	static std::atomic<unsigned long long> _linesSent;
+};
+
+// Adds the time until it goes out of scope to a Telemetry scope. Reads no clock unless a client
+// is connected.
+class TelemetryScope
+{
+public:
+	TelemetryScope(Telemetry::Scope scope)
+	{
+		_scope = scope;
+		_active = Telemetry::enabled();
+		if (_active)
+			_start = std::chrono::high_resolution_clock::now();
+	}
+
+	~TelemetryScope()
+	{
+		if (_active)
+			Telemetry::AddScopeTime(_scope, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::high_resolution_clock::now() - _start).count());
+	}
+
+private:
+	Telemetry::Scope _scope;
+	bool _active;
+	std::chrono::high_resolution_clock::time_point _start;
+};
@@ -0,0 +1,601 @@
+#include "TerrainManager.h"
+#include "GLState.h"
+#include "CameraManager.h"
+#include "PatchEvaluator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cfloat>
+
+typedef std::chrono::high_resolution_clock Clock;
+
+bool TerrainManager::_active = false;
+TerrainSettings TerrainManager::_settings;
+TerrainStore TerrainManager::_store;
+Shader TerrainManager::_shader;
+glm::vec3 TerrainManager::_origin;
+int TerrainManager::_maxLevel = 0;
+
+GLuint TerrainManager::_vao = 0;
+GLuint TerrainManager::_vbo = 0;
+GLuint TerrainManager::_ebo = 0;
+int TerrainManager::_numSlots = 0;
+std::vector<int> TerrainManager::_freeSlots;
+
+std::unordered_map<unsigned long long, TerrainManager::Node> TerrainManager::_nodes;
+unsigned int TerrainManager::_frame = 0;
+
+std::vector<GLint> TerrainManager::_drawBaseVertices;
+std::vector<std::pair<float, unsigned long long> > TerrainManager::_wanted;
+glm::vec3 TerrainManager::_cameraPos;
+Frustum TerrainManager::_frustum;
+
+std::vector<std::thread> TerrainManager::_loaders;
+std::mutex TerrainManager::_mutex;
+std::condition_variable TerrainManager::_requestSignal;
+std::vector<unsigned long long> TerrainManager::_requests;
+std::unordered_set<unsigned long long> TerrainManager::_inFlight;
+std::deque<TerrainManager::NodeBuild*> TerrainManager::_completed;
+std::vector<TerrainManager::NodeBuild*> TerrainManager::_freeBuilds;
+bool TerrainManager::_running = false;
+
+std::deque<TerrainManager::NodeBuild*> TerrainManager::_ready;
+std::unordered_set<unsigned long long> TerrainManager::_readyKeys;
+
+TerrainStats TerrainManager::_stats;
+std::atomic<int> TerrainManager::_drawnNodes(0);
+std::atomic<int> TerrainManager::_residentNodes(0);
+
+static unsigned long long NodeKey(int level, int x, int z)
+{
+	return ((unsigned long long)level << 48) | ((unsigned long long)x << 24) | (unsigned long long)z;
+}
+
+bool TerrainManager::Init(const char* fileName, Shader shader, const TerrainSettings& settings)
+{
+	if (!_store.Open(fileName, settings.pageBudgetBytes))
+		return false;
+
+	_settings = settings;
+	_shader = shader;
+	_frame = 0;
+	_stats = TerrainStats();
+	_drawnNodes.store(0, std::memory_order_relaxed);
+	_residentNodes.store(0, std::memory_order_relaxed);
+
+	int patchesPerSide = _store.patchesPerSide();
+	_maxLevel = 0;
+	while ((1 << _maxLevel) < patchesPerSide)
+		_maxLevel++;
+
+	float halfSize = patchesPerSide * settings.patchSize * 0.5f;
+	float centerHeight = _store.CornerHeight(patchesPerSide / 2, patchesPerSide / 2) * settings.heightScale;
+	_origin = settings.center - glm::vec3(halfSize, centerHeight, halfSize);
+
+	// Every node has the same topology, so one element buffer serves them all and each node
+	// only needs its own range of vertices
+	size_t nodeBytes = NODE_VERTS * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+	_numSlots = std::max(1, (int)(settings.gpuBudgetBytes / nodeBytes));
+	_freeSlots.clear();
+	for (int i = _numSlots - 1; i >= 0; --i)
+		_freeSlots.push_back(i);
+
+	std::vector<GLuint> elements(NODE_ELEMENTS);
+	GenerateElements(elements.data());
+
+	glGenVertexArrays(1, &_vao);
+	GLState::BindVertexArray(_vao);
+
+	glGenBuffers(1, &_vbo);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+	glBufferData(GL_ARRAY_BUFFER, nodeBytes * _numSlots, NULL, GL_DYNAMIC_DRAW);
+
+	glGenBuffers(1, &_ebo);
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * NODE_ELEMENTS, elements.data(), GL_STATIC_DRAW);
+
+	// Bind buffer data to shader values
+	GLint posAttrib = glGetAttribLocation(shader.shaderPointer, "position");
+	glEnableVertexAttribArray(posAttrib);
+	glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+
+	GLint normAttrib = glGetAttribLocation(shader.shaderPointer, "normal");
+	glEnableVertexAttribArray(normAttrib);
+	glVertexAttribPointer(normAttrib, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+
+	GLState::BindVertexArray(0);
+
+	// The root is built right away. It is never evicted, which guarantees the walk in Update
+	// always has a node to fall back on.
+	NodeBuild* root = new NodeBuild();
+	root->key = NodeKey(0, 0, 0);
+	root->level = 0;
+	root->x = 0;
+	root->z = 0;
+	BuildNode(*root);
+	Upload(root);
+
+	_running = true;
+	for (int i = 0; i < std::max(settings.loaderThreads, 1); ++i)
+	{
+		_loaders.push_back(std::thread(&TerrainManager::LoaderLoop));
+	}
+
+	_active = true;
+	return true;
+}
+
+void TerrainManager::Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat)
+{
+	if (!_active)
+		return;
+
+	_frame++;
+	_cameraPos = cameraPos;
+
+	_frustum.FromMatrix(viewProjMat);
+
+	// Collect nodes the loaders have finished and upload a few of them
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		while (!_completed.empty())
+		{
+			_readyKeys.insert(_completed.front()->key);
+			_ready.push_back(_completed.front());
+			_completed.pop_front();
+		}
+	}
+	for (int i = 0; i < _settings.uploadsPerFrame && !_ready.empty(); ++i)
+	{
+		NodeBuild* build = _ready.front();
+		_ready.pop_front();
+		_readyKeys.erase(build->key);
+		Upload(build);
+	}
+
+	_drawBaseVertices.clear();
+	_wanted.clear();
+	_stats.culledNodes = 0;
+	Visit(0, 0, 0);
+
+	// Hand the loaders the nodes this frame wants, most urgent first. The list is replaced
+	// every frame, so nodes the camera has moved away from before they were started are dropped.
+	std::sort(_wanted.begin(), _wanted.end());
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.clear();
+
+		// Popped from the back
+		for (int i = (int)_wanted.size() - 1; i >= 0; --i)
+		{
+			unsigned long long key = _wanted[i].second;
+			if (_inFlight.count(key) == 0 && _readyKeys.count(key) == 0)
+				_requests.push_back(key);
+		}
+		_stats.queuedNodes = (int)_requests.size();
+	}
+	_requestSignal.notify_all();
+
+	_stats.drawnNodes = (int)_drawBaseVertices.size();
+	_stats.residentNodes = _numSlots - (int)_freeSlots.size();
+	_stats.maxResidentNodes = _numSlots;
+	_drawnNodes.store(_stats.drawnNodes, std::memory_order_relaxed);
+	_residentNodes.store(_stats.residentNodes, std::memory_order_relaxed);
+}
+
+void TerrainManager::Visit(int level, int x, int z)
+{
+	std::unordered_map<unsigned long long, Node>::iterator found = _nodes.find(NodeKey(level, x, z));
+	Node& node = found->second;
+	node.lastUsed = _frame;
+
+	float size = (_store.patchesPerSide() >> level) * _settings.patchSize;
+	glm::vec3 boxMin = _origin + glm::vec3(x * size, 0.0f, z * size);
+	boxMin.y = node.minY;
+	glm::vec3 boxMax = glm::vec3(boxMin.x + size, node.maxY, boxMin.z + size);
+
+	if (!_frustum.IntersectsBox(boxMin, boxMax))
+	{
+		_stats.culledNodes++;
+		return;
+	}
+
+	glm::vec3 closest = glm::clamp(_cameraPos, boxMin, boxMax);
+	float distance = glm::length(_cameraPos - closest);
+
+	if (level < _maxLevel && distance < size * _settings.lodFactor)
+	{
+		bool childrenResident = true;
+		for (int i = 0; i < 4; ++i)
+		{
+			int childX = x * 2 + (i & 1);
+			int childZ = z * 2 + (i >> 1);
+			unsigned long long key = NodeKey(level + 1, childX, childZ);
+			if (_nodes.find(key) == _nodes.end())
+			{
+				childrenResident = false;
+				_wanted.push_back(std::make_pair(distance / size, key));
+			}
+		}
+
+		if (childrenResident)
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				Visit(level + 1, x * 2 + (i & 1), z * 2 + (i >> 1));
+			}
+			return;
+		}
+	}
+
+	_drawBaseVertices.push_back(node.slot * NODE_VERTS);
+}
+
+void TerrainManager::Draw()
+{
+	if (!_active || _drawBaseVertices.empty())
+		return;
+
+	glm::mat4 mpMat = CameraManager::DrawProjMat();
+	glm::mat4 mpvMat = CameraManager::DrawProjMat() * CameraManager::DrawViewMat();
+	glm::vec4 color = glm::vec4(0.45f, 0.55f, 0.35f, 1.0f);
+
+	GLState::BindVertexArray(_vao);
+
+	GLState::UniformMatrix4fv(_shader.uMPMat, 1, GL_FALSE, glm::value_ptr(mpMat));
+	GLState::UniformMatrix4fv(_shader.uMPVMat, 1, GL_FALSE, glm::value_ptr(mpvMat));
+	GLState::Uniform4fv(_shader.uColor, 1, glm::value_ptr(color));
+	GLState::Uniform4f(_shader.uNormalMapRect, 0.0f, 0.0f, 0.0f, 0.0f);
+	GLState::Uniform1ui(_shader.uViewMask, ~0u);
+
+	// Every node uses the whole element buffer, offset to its own slot of vertices
+	std::vector<GLsizei> counts(_drawBaseVertices.size(), (GLsizei)NODE_ELEMENTS);
+	std::vector<const GLvoid*> offsets(_drawBaseVertices.size(), (const GLvoid*)0);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), (GLsizei)_drawBaseVertices.size(), _drawBaseVertices.data());
+
+	GLState::BindVertexArray(0);
+}
+
+void TerrainManager::DumpData()
+{
+	if (!_active)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+		_requests.clear();
+	}
+	_requestSignal.notify_all();
+
+	unsigned int size = _loaders.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		_loaders[i].join();
+	}
+	_loaders.clear();
+
+	for (unsigned int i = 0; i < _completed.size(); ++i)
+		delete _completed[i];
+	for (unsigned int i = 0; i < _ready.size(); ++i)
+		delete _ready[i];
+	for (unsigned int i = 0; i < _freeBuilds.size(); ++i)
+		delete _freeBuilds[i];
+	_completed.clear();
+	_ready.clear();
+	_readyKeys.clear();
+	_freeBuilds.clear();
+	_inFlight.clear();
+	_nodes.clear();
+
+	GLState::DeleteBuffers(1, &_vbo);
+	GLState::DeleteBuffers(1, &_ebo);
+	GLState::DeleteVertexArrays(1, &_vao);
+
+	_store.Close();
+	_active = false;
+}
+
+bool TerrainManager::active()
+{
+	return _active;
+}
+
+TerrainStats TerrainManager::Stats()
+{
+	TerrainStats stats;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		stats = _stats;
+	}
+	stats.gpuBytes = (size_t)stats.residentNodes * NODE_VERTS * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+	stats.store = _store.Stats();
+	return stats;
+}
+
+int TerrainManager::drawnNodes()
+{
+	return _drawnNodes.load(std::memory_order_relaxed);
+}
+
+int TerrainManager::residentNodes()
+{
+	return _residentNodes.load(std::memory_order_relaxed);
+}
+
+size_t TerrainManager::gpuBytes()
+{
+	return (size_t)residentNodes() * NODE_VERTS * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+}
+
+void TerrainManager::PrintStats()
+{
+	TerrainStats stats = Stats();
+	double megabyte = 1024.0 * 1024.0;
+	std::cout << "Terrain: " << stats.drawnNodes << " nodes drawn, " << stats.culledNodes << " culled, " << stats.queuedNodes << " queued" << std::endl;
+	std::cout << "  resident " << stats.residentNodes << " / " << stats.maxResidentNodes << " nodes (" << stats.gpuBytes / megabyte << " MB of vertices), "
+		<< stats.store.residentPages << " pages (" << stats.store.residentBytes / megabyte << " MB of control points)" << std::endl;
+	std::cout << "  built " << stats.nodesBuilt << " nodes";
+	if (stats.nodesBuilt > 0)
+		std::cout << " (" << stats.buildSeconds * 1000.0 / stats.nodesBuilt << " ms each)";
+	std::cout << ", uploaded " << stats.uploads << ", evicted " << stats.evictions << ", " << stats.budgetFull << " uploads skipped with the budget full" << std::endl;
+	std::cout << "  pages: " << stats.store.pageHits << " hits, " << stats.store.pageMisses << " misses, " << stats.store.pageEvictions << " evicted, "
+		<< stats.store.bytesRead / megabyte << " MB read" << std::endl;
+}
+
+void TerrainManager::Upload(NodeBuild* build)
+{
+	int slot = AcquireSlot();
+	if (slot >= 0)
+	{
+		size_t nodeBytes = NODE_VERTS * PatchEvaluator::FLOATS_PER_VERT * sizeof(GLfloat);
+		GLState::BindBuffer(GL_ARRAY_BUFFER, _vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, slot * nodeBytes, nodeBytes, build->verts.data());
+
+		Node node;
+		node.level = build->level;
+		node.x = build->x;
+		node.z = build->z;
+		node.slot = slot;
+		node.minY = build->minY;
+		node.maxY = build->maxY;
+		node.lastUsed = _frame;
+		_nodes[build->key] = node;
+		_stats.uploads++;
+	}
+	else
+	{
+		_stats.budgetFull++;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_freeBuilds.push_back(build);
+}
+
+// Takes a free slot, or the slot of the least recently used node. Uploads happen before the
+// walk, so nodes drawn last frame are kept as well as this frame's.
+int TerrainManager::AcquireSlot()
+{
+	if (!_freeSlots.empty())
+	{
+		int slot = _freeSlots.back();
+		_freeSlots.pop_back();
+		return slot;
+	}
+
+	std::unordered_map<unsigned long long, Node>::iterator oldest = _nodes.end();
+	for (std::unordered_map<unsigned long long, Node>::iterator it = _nodes.begin(); it != _nodes.end(); ++it)
+	{
+		if (it->second.level == 0 || it->second.lastUsed + 1 >= _frame)
+			continue;
+		if (oldest == _nodes.end() || it->second.lastUsed < oldest->second.lastUsed
+			|| (it->second.lastUsed == oldest->second.lastUsed && it->second.level > oldest->second.level))
+			oldest = it;
+	}
+	if (oldest == _nodes.end())
+		return -1;
+
+	int slot = oldest->second.slot;
+	_nodes.erase(oldest);
+	_stats.evictions++;
+	return slot;
+}
+
+void TerrainManager::LoaderLoop()
+{
+	while (true)
+	{
+		NodeBuild* build;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (_running && _requests.empty())
+				_requestSignal.wait(lock);
+			if (!_running)
+				return;
+
+			unsigned long long key = _requests.back();
+			_requests.pop_back();
+			_inFlight.insert(key);
+
+			if (_freeBuilds.empty())
+				_freeBuilds.push_back(new NodeBuild());
+			build = _freeBuilds.back();
+			_freeBuilds.pop_back();
+
+			build->key = key;
+			build->level = (int)(key >> 48);
+			build->x = (int)((key >> 24) & 0xFFFFFF);
+			build->z = (int)(key & 0xFFFFFF);
+		}
+
+		Clock::time_point start = Clock::now();
+		BuildNode(*build);
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_inFlight.erase(build->key);
+		_completed.push_back(build);
+		_stats.nodesBuilt++;
+		_stats.buildSeconds += seconds;
+	}
+}
+
+// Fills in the node's vertices: a NODE_QUADS x NODE_QUADS grid followed by a skirt hanging
+// down from its border, which hides the cracks where nodes of different levels meet.
+//
+// Nodes covering at least one patch per grid quad sample the corner heights, which are exact
+// points of the surface. Smaller nodes evaluate the Bezier patches from the store's pages,
+// several grid quads to a patch.
+void TerrainManager::BuildNode(NodeBuild& build)
+{
+	const int side = NODE_QUADS + 1;
+	int patchesPerSide = _store.patchesPerSide();
+	int nodePatches = patchesPerSide >> build.level;
+	int firstX = build.x * nodePatches;
+	int firstZ = build.z * nodePatches;
+	float patchSize = _settings.patchSize;
+	float heightScale = _settings.heightScale;
+
+	build.verts.resize(NODE_VERTS * PatchEvaluator::FLOATS_PER_VERT);
+	float* vert = build.verts.data();
+	float minY = FLT_MAX, maxY = -FLT_MAX;
+
+	if (nodePatches >= NODE_QUADS)
+	{
+		int step = nodePatches / NODE_QUADS;
+		for (int j = 0; j < side; ++j)
+		{
+			for (int i = 0; i < side; ++i, vert += PatchEvaluator::FLOATS_PER_VERT)
+			{
+				int cornerX = firstX + i * step;
+				int cornerZ = firstZ + j * step;
+				float h = _store.CornerHeight(cornerX, cornerZ) * heightScale;
+
+				// Normal from the slopes to the neighboring samples
+				int left = std::max(cornerX - step, 0), right = std::min(cornerX + step, patchesPerSide);
+				int back = std::max(cornerZ - step, 0), front = std::min(cornerZ + step, patchesPerSide);
+				float slopeX = (_store.CornerHeight(right, cornerZ) - _store.CornerHeight(left, cornerZ)) * heightScale / ((right - left) * patchSize);
+				float slopeZ = (_store.CornerHeight(cornerX, front) - _store.CornerHeight(cornerX, back)) * heightScale / ((front - back) * patchSize);
+				glm::vec3 normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+
+				vert[0] = _origin.x + cornerX * patchSize;
+				vert[1] = _origin.y + h;
+				vert[2] = _origin.z + cornerZ * patchSize;
+				vert[3] = normal.x;
+				vert[4] = normal.y;
+				vert[5] = normal.z;
+				minY = std::min(minY, vert[1]);
+				maxY = std::max(maxY, vert[1]);
+			}
+		}
+	}
+	else
+	{
+		// Nodes this small never straddle a page
+		int pagePatches = _store.pagePatches();
+		std::shared_ptr<const TerrainPage> page = _store.Page(firstX / pagePatches, firstZ / pagePatches);
+		int pageFirstX = page->pageX * pagePatches;
+		int pageFirstZ = page->pageZ * pagePatches;
+
+		int quadsPerPatch = NODE_QUADS / nodePatches;
+		for (int j = 0; j < side; ++j)
+		{
+			int patchZ = std::min(j / quadsPerPatch, nodePatches - 1);
+			float v = (float)(j - patchZ * quadsPerPatch) / quadsPerPatch;
+			float bv[4], dv[4];
+			float sv = 1.0f - v;
+			bv[0] = sv * sv * sv; bv[1] = 3.0f * v * sv * sv; bv[2] = 3.0f * v * v * sv; bv[3] = v * v * v;
+			dv[0] = -3.0f * sv * sv; dv[1] = 3.0f * sv * sv - 6.0f * v * sv; dv[2] = 6.0f * v * sv - 3.0f * v * v; dv[3] = 3.0f * v * v;
+
+			for (int i = 0; i < side; ++i, vert += PatchEvaluator::FLOATS_PER_VERT)
+			{
+				int patchX = std::min(i / quadsPerPatch, nodePatches - 1);
+				float u = (float)(i - patchX * quadsPerPatch) / quadsPerPatch;
+				float bu[4], du[4];
+				float su = 1.0f - u;
+				bu[0] = su * su * su; bu[1] = 3.0f * u * su * su; bu[2] = 3.0f * u * u * su; bu[3] = u * u * u;
+				du[0] = -3.0f * su * su; du[1] = 3.0f * su * su - 6.0f * u * su; du[2] = 6.0f * u * su - 3.0f * u * u; du[3] = 3.0f * u * u;
+
+				int globalX = firstX + patchX;
+				int globalZ = firstZ + patchZ;
+				const float* cp = &page->heights[((globalZ - pageFirstZ) * pagePatches + (globalX - pageFirstX)) * 16];
+
+				float h = 0.0f, hu = 0.0f, hv = 0.0f;
+				for (int row = 0; row < 4; ++row)
+				{
+					for (int col = 0; col < 4; ++col)
+					{
+						h += cp[row * 4 + col] * bu[col] * bv[row];
+						hu += cp[row * 4 + col] * du[col] * bv[row];
+						hv += cp[row * 4 + col] * bu[col] * dv[row];
+					}
+				}
+
+				// The surface is (x + u * patchSize, h, z + v * patchSize), so its normal follows
+				// from the height's derivatives scaled to world units
+				float slopeX = hu * heightScale / patchSize;
+				float slopeZ = hv * heightScale / patchSize;
+				glm::vec3 normal = glm::normalize(glm::vec3(-slopeX, 1.0f, -slopeZ));
+
+				vert[0] = _origin.x + (globalX + u) * patchSize;
+				vert[1] = _origin.y + h * heightScale;
+				vert[2] = _origin.z + (globalZ + v) * patchSize;
+				vert[3] = normal.x;
+				vert[4] = normal.y;
+				vert[5] = normal.z;
+				minY = std::min(minY, vert[1]);
+				maxY = std::max(maxY, vert[1]);
+			}
+		}
+	}
+
+	// Skirt: copies of the border vertices, dropped by a fraction of the node's size
+	float skirtDepth = nodePatches * patchSize * 0.25f;
+	const float* grid = build.verts.data();
+	for (int edge = 0; edge < 4; ++edge)
+	{
+		for (int k = 0; k < side; ++k, vert += PatchEvaluator::FLOATS_PER_VERT)
+		{
+			int i = edge < 2 ? k : (edge == 2 ? 0 : NODE_QUADS);
+			int j = edge < 2 ? (edge == 0 ? 0 : NODE_QUADS) : k;
+			const float* source = grid + (j * side + i) * PatchEvaluator::FLOATS_PER_VERT;
+			for (int f = 0; f < PatchEvaluator::FLOATS_PER_VERT; ++f)
+				vert[f] = source[f];
+			vert[1] -= skirtDepth;
+		}
+	}
+
+	build.minY = minY;
+	build.maxY = maxY;
+}
+
+void TerrainManager::GenerateElements(GLuint* elements)
+{
+	const int side = NODE_QUADS + 1;
+	PatchEvaluator::GenerateElements(side, elements);
+
+	// One strip of quads between each border and its skirt
+	GLuint* skirt = elements + NODE_QUADS * NODE_QUADS * 6;
+	for (int edge = 0; edge < 4; ++edge)
+	{
+		for (int k = 0; k < NODE_QUADS; ++k)
+		{
+			int i = edge < 2 ? k : (edge == 2 ? 0 : NODE_QUADS);
+			int j = edge < 2 ? (edge == 0 ? 0 : NODE_QUADS) : k;
+			int step = edge < 2 ? 1 : side;
+
+			GLuint top0 = j * side + i;
+			GLuint top1 = top0 + step;
+			GLuint bottom0 = NODE_GRID_VERTS + edge * side + k;
+			GLuint bottom1 = bottom0 + 1;
+
+			*skirt++ = top0;
+			*skirt++ = bottom0;
+			*skirt++ = top1;
+			*skirt++ = top1;
+			*skirt++ = bottom0;
+			*skirt++ = bottom1;
+		}
+	}
+}
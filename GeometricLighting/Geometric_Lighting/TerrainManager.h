@@ -0,0 +1,158 @@
+#pragma once
+#include "RenderShape.h"
+#include "TerrainStore.h"
+#include "Frustum.h"
+
+#include <GLEW/GL/glew.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+struct TerrainSettings
+{
+	// World size of one patch along x and z, and of one unit of stored height
+	float patchSize = 0.5f;
+	float heightScale = 8.0f;
+
+	// Where the middle of the terrain's surface ends up in the world
+	glm::vec3 center = glm::vec3();
+
+	// A node is split into its children once the camera is closer to it than lodFactor times its size
+	float lodFactor = 2.0f;
+
+	// Memory limits for the node vertex buffer on the GPU and the control point pages in RAM
+	size_t gpuBudgetBytes = 64 * 1024 * 1024;
+	size_t pageBudgetBytes = 32 * 1024 * 1024;
+
+	// Spreads uploads of finished nodes over several frames
+	int uploadsPerFrame = 8;
+	int loaderThreads = 2;
+};
+
+struct TerrainStats
+{
+	int drawnNodes = 0;
+	int residentNodes = 0;
+	int maxResidentNodes = 0;
+	int queuedNodes = 0;
+	int culledNodes = 0;
+	unsigned long long nodesBuilt = 0;
+	unsigned long long uploads = 0;
+	unsigned long long evictions = 0;
+	unsigned long long budgetFull = 0;
+	double buildSeconds = 0.0;
+	size_t gpuBytes = 0;
+	TerrainStoreStats store;
+};
+
+// A quadtree over a large TerrainStore heightfield. The root covers the whole terrain and each
+// level halves the nodes until a leaf covers a single patch; every node is drawn as the same
+// fixed grid of vertices, so nodes further down show more detail over less ground.
+//
+// Each frame the tree is walked from the root, splitting nodes the camera is close to. A node is
+// only replaced by its children once all four of them are on the GPU; until then the node
+// itself is drawn and the children are queued for the loader threads, which tessellate them
+// from the store in the background. Finished nodes are uploaded into slots of one big vertex
+// buffer sized by the GPU budget, reusing the slots of the least recently used nodes when it
+// is full, and all visible nodes go out in a single multi draw call.
+class TerrainManager
+{
+public:
+	// Opens the terrain file and builds the root node, so there is always something to draw
+	static bool Init(const char* fileName, Shader shader, const TerrainSettings& settings);
+
+	static void Update(const glm::vec3& cameraPos, const glm::mat4& viewProjMat);
+	static void Draw();
+	static void DumpData();
+
+	static bool active();
+	static TerrainStats Stats();
+	static void PrintStats();
+
+	// The counters telemetry samples every frame, read without taking the lock
+	static int drawnNodes();
+	static int residentNodes();
+	static size_t gpuBytes();
+
+	// Vertices along one side of a node's grid, not counting the skirt
+	static const int NODE_QUADS = 32;
+	static const int NODE_GRID_VERTS = (NODE_QUADS + 1) * (NODE_QUADS + 1);
+	static const int NODE_VERTS = NODE_GRID_VERTS + 4 * (NODE_QUADS + 1);
+	static const int NODE_ELEMENTS = NODE_QUADS * NODE_QUADS * 6 + 4 * NODE_QUADS * 6;
+
+private:
+	struct Node
+	{
+		int level;
+		int x;
+		int z;
+		int slot;
+		float minY;
+		float maxY;
+		unsigned int lastUsed;
+	};
+
+	struct NodeBuild
+	{
+		unsigned long long key;
+		int level;
+		int x;
+		int z;
+		float minY;
+		float maxY;
+		std::vector<float> verts;
+	};
+
+	static void Visit(int level, int x, int z);
+	static void Upload(NodeBuild* build);
+	static int AcquireSlot();
+	static void BuildNode(NodeBuild& build);
+	static void LoaderLoop();
+	static void GenerateElements(GLuint* elements);
+
+private:
+	static bool _active;
+	static TerrainSettings _settings;
+	static TerrainStore _store;
+	static Shader _shader;
+	static glm::vec3 _origin;
+	static int _maxLevel;
+
+	static GLuint _vao;
+	static GLuint _vbo;
+	static GLuint _ebo;
+	static int _numSlots;
+	static std::vector<int> _freeSlots;
+
+	static std::unordered_map<unsigned long long, Node> _nodes;
+	static unsigned int _frame;
+
+	// Gathered by Update for Draw
+	static std::vector<GLint> _drawBaseVertices;
+	static std::vector<std::pair<float, unsigned long long> > _wanted;
+	static glm::vec3 _cameraPos;
+	static Frustum _frustum;
+
+	// Shared with the loader threads
+	static std::vector<std::thread> _loaders;
+	static std::mutex _mutex;
+	static std::condition_variable _requestSignal;
+	static std::vector<unsigned long long> _requests;
+	static std::unordered_set<unsigned long long> _inFlight;
+	static std::deque<NodeBuild*> _completed;
+	static std::vector<NodeBuild*> _freeBuilds;
+	static bool _running;
+
+	// Built nodes waiting for their upload, only touched by the render thread
+	static std::deque<NodeBuild*> _ready;
+	static std::unordered_set<unsigned long long> _readyKeys;
+
+	static TerrainStats _stats;
+	static std::atomic<int> _drawnNodes;
+	static std::atomic<int> _residentNodes;
+};
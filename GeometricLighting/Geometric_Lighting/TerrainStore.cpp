@@ -0,0 +1,329 @@
+#include "TerrainStore.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+static const char TERRAIN_MAGIC[8] = { 'B', 'P', 'T', 'E', 'R', 'R', '0', '1' };
+
+struct TerrainFileHeader
+{
+	char magic[8];
+	unsigned int patchesPerSide;
+	unsigned int pagePatches;
+	float minHeight;
+	float maxHeight;
+};
+
+static unsigned int HashLattice(int x, int z, unsigned int seed)
+{
+	unsigned int h = (unsigned int)x * 374761393u + (unsigned int)z * 668265263u + seed * 2246822519u;
+	h = (h ^ (h >> 13)) * 1274126177u;
+	return h ^ (h >> 16);
+}
+
+// Smoothly interpolated random values on the integer lattice, in [-1, 1]
+static float ValueNoise(float x, float z, unsigned int seed)
+{
+	float fx = std::floor(x);
+	float fz = std::floor(z);
+	int ix = (int)fx;
+	int iz = (int)fz;
+	float tx = x - fx;
+	float tz = z - fz;
+	tx = tx * tx * (3.0f - 2.0f * tx);
+	tz = tz * tz * (3.0f - 2.0f * tz);
+
+	float scale = 2.0f / 4294967295.0f;
+	float v00 = HashLattice(ix, iz, seed) * scale - 1.0f;
+	float v10 = HashLattice(ix + 1, iz, seed) * scale - 1.0f;
+	float v01 = HashLattice(ix, iz + 1, seed) * scale - 1.0f;
+	float v11 = HashLattice(ix + 1, iz + 1, seed) * scale - 1.0f;
+
+	float a = v00 + (v10 - v00) * tx;
+	float b = v01 + (v11 - v01) * tx;
+	return a + (b - a) * tz;
+}
+
+// Fractal sum of noise octaves at a position measured in patches. The largest features span
+// about 64 patches and the smallest about half of one, so every level of the quadtree has some
+// detail of its own.
+static float FractalHeight(float x, float z, unsigned int seed)
+{
+	float height = 0.0f;
+	float amplitude = 1.0f;
+	float frequency = 1.0f / 64.0f;
+	for (int octave = 0; octave < 8; octave++)
+	{
+		height += amplitude * ValueNoise(x * frequency, z * frequency, seed + octave);
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+	return height;
+}
+
+TerrainStore::TerrainStore()
+{
+	_patchesPerSide = 0;
+	_pagePatches = 0;
+	_pagesPerSide = 0;
+	_minHeight = 0.0f;
+	_maxHeight = 0.0f;
+	_pagesOffset = 0;
+	_pageBudget = 0;
+}
+TerrainStore::~TerrainStore()
+{
+	Close();
+}
+
+bool TerrainStore::Generate(const char* fileName, int patchesPerSide, unsigned int seed, int numThreads)
+{
+	if (patchesPerSide <= 0 || (patchesPerSide & (patchesPerSide - 1)) != 0)
+	{
+		std::cout << "Terrain size must be a power of two" << std::endl;
+		return false;
+	}
+
+	std::ofstream file(fileName, std::ios::binary);
+	if (!file)
+		return false;
+
+	int pagePatches = std::min((int)DEFAULT_PAGE_PATCHES, patchesPerSide);
+	int pagesPerSide = patchesPerSide / pagePatches;
+
+	// Control points lie on a lattice 3 * patchesPerSide + 1 points across, with patch borders
+	// on every third line. The noise is sampled on the lattice, then each border point is set
+	// to the average of the points either side of it, which makes the two patches meeting there
+	// agree on the tangent as well as the position. Doing the x borders before the z borders
+	// keeps the corners consistent in both directions.
+	//
+	// A page only needs its own part of the lattice plus one point around it, so pages are
+	// generated independently.
+	int lattice = pagePatches * 3 + 1;
+	int padded = lattice + 2;
+
+	std::vector<float> corners((patchesPerSide + 1) * (patchesPerSide + 1));
+	std::vector<float> rowPages(pagesPerSide * pagePatches * pagePatches * 16);
+	std::vector<float> rowMin(pagesPerSide), rowMax(pagesPerSide);
+
+	TerrainFileHeader header;
+	memcpy(header.magic, TERRAIN_MAGIC, sizeof(header.magic));
+	header.patchesPerSide = patchesPerSide;
+	header.pagePatches = pagePatches;
+	header.minHeight = FLT_MAX;
+	header.maxHeight = -FLT_MAX;
+
+	// Header and corners are written again at the end, once the height range is known
+	std::streamoff pagesOffset = sizeof(header) + corners.size() * sizeof(float);
+	file.seekp(pagesOffset);
+
+	WorkerPool pool(numThreads);
+	for (int pageZ = 0; pageZ < pagesPerSide; pageZ++)
+	{
+		pool.ParallelFor(pagesPerSide, [&](int begin, int end, int)
+		{
+			std::vector<float> raw(padded * padded);
+			std::vector<float> smoothX(padded * padded);
+
+			for (int pageX = begin; pageX < end; pageX++)
+			{
+				int latticeX = pageX * pagePatches * 3 - 1;
+				int latticeZ = pageZ * pagePatches * 3 - 1;
+
+				for (int z = 0; z < padded; z++)
+					for (int x = 0; x < padded; x++)
+						raw[z * padded + x] = FractalHeight((latticeX + x) / 3.0f, (latticeZ + z) / 3.0f, seed);
+
+				int lastLine = patchesPerSide * 3;
+				for (int z = 0; z < padded; z++)
+				{
+					for (int x = 1; x < padded - 1; x++)
+					{
+						int global = latticeX + x;
+						bool border = global % 3 == 0 && global > 0 && global < lastLine;
+						smoothX[z * padded + x] = border ? 0.5f * (raw[z * padded + x - 1] + raw[z * padded + x + 1]) : raw[z * padded + x];
+					}
+				}
+
+				float* pageHeights = &rowPages[pageX * pagePatches * pagePatches * 16];
+				float low = FLT_MAX, high = -FLT_MAX;
+				for (int patchZ = 0; patchZ < pagePatches; patchZ++)
+				{
+					for (int patchX = 0; patchX < pagePatches; patchX++)
+					{
+						float* patch = pageHeights + (patchZ * pagePatches + patchX) * 16;
+						for (int row = 0; row < 4; row++)
+						{
+							int z = patchZ * 3 + row + 1;
+							int global = latticeZ + z;
+							bool border = global % 3 == 0 && global > 0 && global < lastLine;
+							for (int col = 0; col < 4; col++)
+							{
+								int x = patchX * 3 + col + 1;
+								float h = border ? 0.5f * (smoothX[(z - 1) * padded + x] + smoothX[(z + 1) * padded + x]) : smoothX[z * padded + x];
+								patch[row * 4 + col] = h;
+								low = std::min(low, h);
+								high = std::max(high, h);
+							}
+						}
+
+						int cornerX = pageX * pagePatches + patchX;
+						int cornerZ = pageZ * pagePatches + patchZ;
+						int stride = patchesPerSide + 1;
+						bool lastX = cornerX + 1 == patchesPerSide;
+						bool lastZ = cornerZ + 1 == patchesPerSide;
+
+						// Corners are shared with the neighbors, each patch writes the one it starts at
+						corners[cornerZ * stride + cornerX] = patch[0];
+						if (lastX)
+							corners[cornerZ * stride + cornerX + 1] = patch[3];
+						if (lastZ)
+							corners[(cornerZ + 1) * stride + cornerX] = patch[12];
+						if (lastX && lastZ)
+							corners[(cornerZ + 1) * stride + cornerX + 1] = patch[15];
+					}
+				}
+				rowMin[pageX] = low;
+				rowMax[pageX] = high;
+			}
+		}, 1);
+
+		for (int pageX = 0; pageX < pagesPerSide; pageX++)
+		{
+			header.minHeight = std::min(header.minHeight, rowMin[pageX]);
+			header.maxHeight = std::max(header.maxHeight, rowMax[pageX]);
+		}
+		file.write((const char*)rowPages.data(), rowPages.size() * sizeof(float));
+	}
+
+	file.seekp(0);
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)corners.data(), corners.size() * sizeof(float));
+	return (bool)file;
+}
+
+bool TerrainStore::Open(const char* fileName, size_t pageBudgetBytes)
+{
+	Close();
+
+	_file.open(fileName, std::ios::binary);
+	if (!_file)
+		return false;
+
+	TerrainFileHeader header;
+	_file.read((char*)&header, sizeof(header));
+	if (!_file || memcmp(header.magic, TERRAIN_MAGIC, sizeof(header.magic)) != 0 || header.patchesPerSide == 0
+		|| header.pagePatches == 0 || header.patchesPerSide % header.pagePatches != 0)
+	{
+		std::cout << fileName << " is not a terrain file" << std::endl;
+		Close();
+		return false;
+	}
+
+	_patchesPerSide = header.patchesPerSide;
+	_pagePatches = header.pagePatches;
+	_pagesPerSide = _patchesPerSide / _pagePatches;
+	_minHeight = header.minHeight;
+	_maxHeight = header.maxHeight;
+	_pageBudget = pageBudgetBytes;
+
+	_corners.resize((_patchesPerSide + 1) * (_patchesPerSide + 1));
+	_file.read((char*)_corners.data(), _corners.size() * sizeof(float));
+	_pagesOffset = sizeof(header) + _corners.size() * sizeof(float);
+	if (!_file)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TerrainStore::Close()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_file.is_open())
+		_file.close();
+	_file.clear();
+	_lru.clear();
+	_pages.clear();
+	_corners.clear();
+	_stats = TerrainStoreStats();
+	_patchesPerSide = 0;
+}
+
+std::shared_ptr<const TerrainPage> TerrainStore::Page(int pageX, int pageZ)
+{
+	int key = pageZ * _pagesPerSide + pageX;
+	size_t pageFloats = _pagePatches * _pagePatches * 16;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	std::unordered_map<int, PageList::iterator>::iterator found = _pages.find(key);
+	if (found != _pages.end())
+	{
+		_stats.pageHits++;
+		_lru.splice(_lru.begin(), _lru, found->second);
+		return *found->second;
+	}
+
+	// Reads are done under the lock. The file is read sequentially by a single handle anyway,
+	// and it keeps two threads from loading the same page at once.
+	std::shared_ptr<TerrainPage> page = std::make_shared<TerrainPage>();
+	page->pageX = pageX;
+	page->pageZ = pageZ;
+	page->heights.resize(pageFloats);
+
+	_file.seekg(_pagesOffset + (std::streamoff)key * pageFloats * sizeof(float));
+	_file.read((char*)page->heights.data(), pageFloats * sizeof(float));
+	if (!_file)
+	{
+		_file.clear();
+		std::fill(page->heights.begin(), page->heights.end(), 0.0f);
+	}
+
+	_stats.pageMisses++;
+	_stats.bytesRead += pageFloats * sizeof(float);
+
+	_lru.push_front(page);
+	_pages[key] = _lru.begin();
+	Trim();
+
+	return page;
+}
+
+// Drops least recently used pages until the cache fits its budget again. The page just added
+// is never dropped, so a budget smaller than one page still works.
+void TerrainStore::Trim()
+{
+	size_t pageBytes = _pagePatches * _pagePatches * 16 * sizeof(float);
+	while (_lru.size() > 1 && _lru.size() * pageBytes > _pageBudget)
+	{
+		const TerrainPage& oldest = *_lru.back();
+		_pages.erase(oldest.pageZ * _pagesPerSide + oldest.pageX);
+		_lru.pop_back();
+		_stats.pageEvictions++;
+	}
+}
+
+float TerrainStore::CornerHeight(int x, int z)
+{
+	return _corners[z * (_patchesPerSide + 1) + x];
+}
+
+int TerrainStore::patchesPerSide() { return _patchesPerSide; }
+int TerrainStore::pagePatches() { return _pagePatches; }
+float TerrainStore::minHeight() { return _minHeight; }
+float TerrainStore::maxHeight() { return _maxHeight; }
+
+TerrainStoreStats TerrainStore::Stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	TerrainStoreStats stats = _stats;
+	stats.residentPages = _lru.size();
+	stats.residentBytes = _lru.size() * _pagePatches * _pagePatches * 16 * sizeof(float) + _corners.size() * sizeof(float);
+	return stats;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <cstddef>
+
+// One square block of terrain patches, 16 control point heights per patch. Patches are stored
+// row by row along z, control points as row * 4 + col with col running along x.
+struct TerrainPage
+{
+	int pageX;
+	int pageZ;
+	std::vector<float> heights;
+};
+
+struct TerrainStoreStats
+{
+	unsigned long long pageHits = 0;
+	unsigned long long pageMisses = 0;
+	unsigned long long pageEvictions = 0;
+	unsigned long long bytesRead = 0;
+	size_t residentPages = 0;
+	size_t residentBytes = 0;
+};
+
+// Control points of a heightfield made of a square grid of bicubic Bezier patches, kept on disk
+// and paged in on demand. Only the x and z of every control point follow from its place on the
+// grid, so a patch is just its 16 heights.
+//
+// The file holds a small header, the heights of every patch corner (which lie on the surface,
+// so they make a complete coarse version of the terrain that stays in memory), then the pages.
+// Pages are read into an LRU cache that is trimmed back to the memory budget whenever a new
+// page comes in. Pages handed out stay valid while someone holds on to them, even if evicted.
+class TerrainStore
+{
+public:
+	TerrainStore();
+	~TerrainStore();
+
+	// Writes a procedural fractal terrain of patchesPerSide x patchesPerSide patches (a power of
+	// two). Neighboring patches share their borders and tangents, so the surface is C1.
+	static bool Generate(const char* fileName, int patchesPerSide, unsigned int seed = 1, int numThreads = 0);
+
+	bool Open(const char* fileName, size_t pageBudgetBytes);
+	void Close();
+
+	// Thread safe. Reads the page from disk if it isn't cached.
+	std::shared_ptr<const TerrainPage> Page(int pageX, int pageZ);
+
+	// Height of the patch corner at grid point (x, z), 0 <= x, z <= patchesPerSide
+	float CornerHeight(int x, int z);
+
+	int patchesPerSide();
+	int pagePatches();
+	float minHeight();
+	float maxHeight();
+	TerrainStoreStats Stats();
+
+	static const int DEFAULT_PAGE_PATCHES = 32;
+
+private:
+	void Trim();
+
+private:
+	std::ifstream _file;
+	std::mutex _mutex;
+
+	int _patchesPerSide;
+	int _pagePatches;
+	int _pagesPerSide;
+	float _minHeight;
+	float _maxHeight;
+	std::streamoff _pagesOffset;
+
+	std::vector<float> _corners;
+
+	// Most recently used pages at the front
+	typedef std::list<std::shared_ptr<const TerrainPage> > PageList;
+	PageList _lru;
+	std::unordered_map<int, PageList::iterator> _pages;
+	size_t _pageBudget;
+
+	TerrainStoreStats _stats;
+};
@@ -0,0 +1,206 @@
+#include "TessellationClient.h"
+#include "TessellationService.h"
+#include "PatchEvaluator.h"
+
+#include <iostream>
+#include <vector>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace TessellationProtocol;
+
+TessellationClient::TessellationClient()
+{
+	_socket = -1;
+	_sharedMemory = nullptr;
+	_sharedMemoryBytes = 0;
+	_nextRequestId = 1;
+}
+
+TessellationClient::~TessellationClient()
+{
+	Disconnect();
+}
+
+#ifdef _WIN32
+
+bool TessellationClient::Connect(const char* socketPath)
+{
+	std::cout << "The tessellation client needs Unix domain sockets and POSIX shared memory, which this build doesn't support" << std::endl;
+	return false;
+}
+
+void TessellationClient::Disconnect()
+{
+}
+
+bool TessellationClient::Tessellate(const glm::vec3* controlPoints, int numPatches, int resolution, TessellationResult& result)
+{
+	return false;
+}
+
+void TessellationClient::Release(const TessellationResult& result)
+{
+}
+
+void TessellationClient::Shutdown()
+{
+}
+
+bool TessellationClient::ReadAll(void* data, size_t bytes)
+{
+	return false;
+}
+
+bool TessellationClient::WriteAll(const void* data, size_t bytes)
+{
+	return false;
+}
+
+#else
+
+bool TessellationClient::Connect(const char* socketPath)
+{
+	Disconnect();
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (_socket < 0 || connect(_socket, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		std::cout << "Couldn't connect to the tessellation service on " << socketPath << std::endl;
+		Disconnect();
+		return false;
+	}
+
+	MessageHeader header;
+	Hello hello;
+	if (!ReadAll(&header, sizeof(header)) || header.type != HELLO || header.size != sizeof(hello) || !ReadAll(&hello, sizeof(hello)))
+	{
+		std::cout << "The tessellation service didn't say hello" << std::endl;
+		Disconnect();
+		return false;
+	}
+
+	// Read only: results can't be corrupted by a client, only read
+	int sharedMemory = shm_open(hello.sharedMemoryName, O_RDONLY, 0);
+	void* mapping = sharedMemory < 0 ? MAP_FAILED : mmap(nullptr, (size_t)hello.sharedMemoryBytes, PROT_READ, MAP_SHARED, sharedMemory, 0);
+	if (sharedMemory >= 0)
+		close(sharedMemory);
+	if (mapping == MAP_FAILED)
+	{
+		std::cout << "Couldn't map the tessellation service's shared memory " << hello.sharedMemoryName << std::endl;
+		Disconnect();
+		return false;
+	}
+	_sharedMemory = (const char*)mapping;
+	_sharedMemoryBytes = (size_t)hello.sharedMemoryBytes;
+	return true;
+}
+
+void TessellationClient::Disconnect()
+{
+	if (_sharedMemory)
+		munmap((void*)_sharedMemory, _sharedMemoryBytes);
+	_sharedMemory = nullptr;
+	_sharedMemoryBytes = 0;
+
+	if (_socket >= 0)
+		close(_socket);
+	_socket = -1;
+}
+
+bool TessellationClient::Tessellate(const glm::vec3* controlPoints, int numPatches, int resolution, TessellationResult& result)
+{
+	if (!_sharedMemory || numPatches <= 0)
+		return false;
+
+	TessellateRequest request;
+	request.requestId = _nextRequestId++;
+	request.numPatches = (unsigned int)numPatches;
+	request.resolution = (unsigned int)resolution;
+
+	size_t pointBytes = (size_t)numPatches * 16 * sizeof(glm::vec3);
+	MessageHeader header = { TESSELLATE, (unsigned int)(sizeof(request) + pointBytes) };
+	if (!WriteAll(&header, sizeof(header)) || !WriteAll(&request, sizeof(request)) || !WriteAll(controlPoints, pointBytes))
+		return false;
+
+	TessellateResult reply;
+	if (!ReadAll(&header, sizeof(header)) || header.type != RESULT || header.size != sizeof(reply) || !ReadAll(&reply, sizeof(reply))
+		|| reply.requestId != request.requestId)
+		return false;
+
+	result = TessellationResult();
+	result.status = reply.status;
+	if (reply.status != OK)
+		return false;
+
+	result.numPatches = numPatches;
+	result.resolution = resolution;
+	result.verts = (const float*)(_sharedMemory + reply.vertexOffset);
+	result.elements = (const unsigned int*)(_sharedMemory + reply.indexOffset);
+	result.numElements = (int)(reply.indexBytes / sizeof(unsigned int));
+	result.cacheHit = reply.cacheHit != 0;
+	result.serviceMicroseconds = reply.serviceMicroseconds;
+	result.vertexOffset = reply.vertexOffset;
+	return true;
+}
+
+void TessellationClient::Release(const TessellationResult& result)
+{
+	if (_socket < 0 || !result.verts)
+		return;
+
+	TessellationProtocol::Release release = { result.vertexOffset };
+	MessageHeader header = { RELEASE, sizeof(release) };
+	WriteAll(&header, sizeof(header));
+	WriteAll(&release, sizeof(release));
+}
+
+void TessellationClient::Shutdown()
+{
+	if (_socket < 0)
+		return;
+
+	MessageHeader header = { SHUTDOWN, 0 };
+	WriteAll(&header, sizeof(header));
+}
+
+bool TessellationClient::ReadAll(void* data, size_t bytes)
+{
+	char* p = (char*)data;
+	while (bytes > 0)
+	{
+		ssize_t received = recv(_socket, p, bytes, 0);
+		if (received <= 0)
+			return false;
+		p += received;
+		bytes -= received;
+	}
+	return true;
+}
+
+bool TessellationClient::WriteAll(const void* data, size_t bytes)
+{
+	const char* p = (const char*)data;
+	while (bytes > 0)
+	{
+		ssize_t written = send(_socket, p, bytes, 0);
+		if (written <= 0)
+			return false;
+		p += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+// A tessellated request, read straight out of the service's shared memory. The pointers stay
+// valid until the result is released or the client disconnects.
+struct TessellationResult
+{
+	unsigned int status = 0;
+	int numPatches = 0;
+	int resolution = 0;
+
+	// numPatches * NumVerts(resolution) vertices in the PatchEvaluator layout
+	const float* verts = nullptr;
+
+	// The triangle list of a single patch; patch i's vertices start at i * NumVerts(resolution)
+	const unsigned int* elements = nullptr;
+	int numElements = 0;
+
+	bool cacheHit = false;
+	unsigned int serviceMicroseconds = 0;
+	unsigned long long vertexOffset = 0;
+};
+
+// Talks to a TessellationService over its socket. One client is one connection and is meant to
+// be used from one thread; open a client per thread to have several requests in flight.
+class TessellationClient
+{
+public:
+	TessellationClient();
+	~TessellationClient();
+
+	// Connects and maps the service's shared memory
+	bool Connect(const char* socketPath);
+	void Disconnect();
+
+	// Sends numPatches * 16 control points and waits for the result
+	bool Tessellate(const glm::vec3* controlPoints, int numPatches, int resolution, TessellationResult& result);
+
+	// Lets the service reuse the result's memory once nobody else holds it either
+	void Release(const TessellationResult& result);
+
+	// Asks the service to exit
+	void Shutdown();
+
+private:
+	bool ReadAll(void* data, size_t bytes);
+	bool WriteAll(const void* data, size_t bytes);
+
+private:
+	int _socket;
+	const char* _sharedMemory;
+	size_t _sharedMemoryBytes;
+	unsigned int _nextRequestId;
+};
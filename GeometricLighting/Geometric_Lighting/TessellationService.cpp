@@ -0,0 +1,649 @@
+#include "TessellationService.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <cstring>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+using namespace TessellationProtocol;
+
+LatencyHistogram::LatencyHistogram() : count(0), maximum(0)
+{
+	std::fill(buckets, buckets + NUM_BUCKETS, 0ULL);
+}
+
+// Values below 8 map to themselves; above, the power of two picks a row of 8 buckets and the
+// next three bits below the top one pick the bucket in it
+static int LatencyBucket(unsigned int microseconds)
+{
+	if (microseconds < 8)
+		return (int)microseconds;
+
+	int power = 3;
+	while (power < 31 && microseconds >> (power + 1))
+		power++;
+	return (power - 2) * 8 + (int)((microseconds >> (power - 3)) & 7);
+}
+
+static unsigned long long LatencyBucketEnd(int bucket)
+{
+	if (bucket < 8)
+		return bucket;
+
+	int power = bucket / 8 + 2;
+	unsigned long long first = (unsigned long long)(8 + bucket % 8) << (power - 3);
+	return first + (1ULL << (power - 3)) - 1;
+}
+
+void LatencyHistogram::Add(unsigned int microseconds)
+{
+	buckets[std::min(LatencyBucket(microseconds), NUM_BUCKETS - 1)]++;
+	count++;
+	maximum = std::max(maximum, microseconds);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+		buckets[i] += other.buckets[i];
+	count += other.count;
+	maximum = std::max(maximum, other.maximum);
+}
+
+unsigned int LatencyHistogram::Percentile(double q) const
+{
+	if (count == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long)((count - 1) * q);
+	unsigned long long seen = 0;
+	for (int i = 0; i < NUM_BUCKETS; ++i)
+	{
+		seen += buckets[i];
+		if (seen > rank)
+			return (unsigned int)std::min(LatencyBucketEnd(i), (unsigned long long)maximum);
+	}
+	return maximum;
+}
+
+void PrintLatencyPercentiles(const char* label, const LatencyHistogram& latencies)
+{
+	if (latencies.count == 0)
+		return;
+
+	std::cout << label << " latency (us): p50 " << latencies.Percentile(0.5)
+		<< ", p90 " << latencies.Percentile(0.9)
+		<< ", p99 " << latencies.Percentile(0.99)
+		<< ", max " << latencies.maximum << std::endl;
+}
+
+void TessellationService::PrintStats(const TessellationServiceStats& stats)
+{
+	std::cout << "Tessellation service: " << stats.requests << " requests, " << stats.patches << " patches in "
+		<< stats.seconds << " s" << std::endl;
+	if (stats.requests > 0)
+		std::cout << "Cache hits: " << stats.cacheHits << " (" << 100.0 * stats.cacheHits / stats.requests << "%), evictions: "
+			<< stats.evictions << ", failed: " << stats.failed << std::endl;
+	PrintLatencyPercentiles("Service", stats.latencies);
+}
+
+#ifdef _WIN32
+
+bool TessellationService::Run(const char* socketPath, const TessellationServiceSettings& settings, TessellationServiceStats* stats)
+{
+	std::cout << "The tessellation service needs Unix domain sockets and POSIX shared memory, which this build doesn't support" << std::endl;
+	return false;
+}
+
+#else
+
+// Hands out 64 byte aligned blocks of the shared memory. Free space is kept as a map of
+// offset to size so neighbouring blocks can be merged again when they are freed.
+class ArenaAllocator
+{
+public:
+	ArenaAllocator(size_t bytes)
+	{
+		_free[0] = bytes;
+	}
+
+	static size_t Align(size_t bytes)
+	{
+		return (bytes + 63) & ~(size_t)63;
+	}
+
+	// First fit; returns false when no free block is big enough
+	bool Allocate(size_t bytes, size_t& offset)
+	{
+		bytes = Align(bytes);
+		for (std::map<size_t, size_t>::iterator it = _free.begin(); it != _free.end(); ++it)
+		{
+			if (it->second < bytes)
+				continue;
+
+			offset = it->first;
+			size_t rest = it->second - bytes;
+			_free.erase(it);
+			if (rest > 0)
+				_free[offset + bytes] = rest;
+			return true;
+		}
+		return false;
+	}
+
+	void Free(size_t offset, size_t bytes)
+	{
+		bytes = Align(bytes);
+		std::map<size_t, size_t>::iterator next = _free.lower_bound(offset);
+		if (next != _free.end() && offset + bytes == next->first)
+		{
+			bytes += next->second;
+			next = _free.erase(next);
+		}
+		if (next != _free.begin())
+		{
+			std::map<size_t, size_t>::iterator prev = next;
+			--prev;
+			if (prev->first + prev->second == offset)
+			{
+				prev->second += bytes;
+				return;
+			}
+		}
+		_free[offset] = bytes;
+	}
+
+private:
+	std::map<size_t, size_t> _free;
+};
+
+// One tessellated request in the shared memory
+struct CachedResult
+{
+	unsigned long long hash;
+	int resolution;
+	std::vector<glm::vec3> controlPoints;
+	size_t offset;
+	size_t bytes;
+
+	// Number of results sent for it that haven't been released yet
+	int pins;
+	std::list<size_t>::iterator lru;
+};
+
+// Results by content, with the least recently used one at the back of the list
+class ResultCache
+{
+public:
+	CachedResult* Find(unsigned long long hash, int resolution, const std::vector<glm::vec3>& controlPoints)
+	{
+		std::pair<HashMap::iterator, HashMap::iterator> range = _byHash.equal_range(hash);
+		for (HashMap::iterator it = range.first; it != range.second; ++it)
+		{
+			CachedResult& result = _byOffset[it->second];
+			if (result.resolution == resolution && result.controlPoints.size() == controlPoints.size()
+				&& memcmp(&result.controlPoints[0], &controlPoints[0], controlPoints.size() * sizeof(glm::vec3)) == 0)
+			{
+				Touch(result);
+				return &result;
+			}
+		}
+		return nullptr;
+	}
+
+	CachedResult* Insert(unsigned long long hash, int resolution, const std::vector<glm::vec3>& controlPoints, size_t offset, size_t bytes)
+	{
+		CachedResult& result = _byOffset[offset];
+		result.hash = hash;
+		result.resolution = resolution;
+		result.controlPoints = controlPoints;
+		result.offset = offset;
+		result.bytes = bytes;
+		result.pins = 0;
+		_lru.push_front(offset);
+		result.lru = _lru.begin();
+		_byHash.insert(std::make_pair(hash, offset));
+		return &result;
+	}
+
+	CachedResult* Get(size_t offset)
+	{
+		std::unordered_map<size_t, CachedResult>::iterator it = _byOffset.find(offset);
+		return it == _byOffset.end() ? nullptr : &it->second;
+	}
+
+	// Frees the least recently used result nobody holds. Returns false if every result is pinned.
+	bool EvictOne(ArenaAllocator& arena)
+	{
+		for (std::list<size_t>::reverse_iterator it = _lru.rbegin(); it != _lru.rend(); ++it)
+		{
+			CachedResult& result = _byOffset[*it];
+			if (result.pins > 0)
+				continue;
+
+			std::pair<HashMap::iterator, HashMap::iterator> range = _byHash.equal_range(result.hash);
+			for (HashMap::iterator entry = range.first; entry != range.second; ++entry)
+			{
+				if (entry->second == result.offset)
+				{
+					_byHash.erase(entry);
+					break;
+				}
+			}
+			arena.Free(result.offset, result.bytes);
+			_lru.erase(result.lru);
+			_byOffset.erase(result.offset);
+			return true;
+		}
+		return false;
+	}
+
+private:
+	void Touch(CachedResult& result)
+	{
+		_lru.splice(_lru.begin(), _lru, result.lru);
+	}
+
+private:
+	typedef std::unordered_multimap<unsigned long long, size_t> HashMap;
+
+	std::unordered_map<size_t, CachedResult> _byOffset;
+	HashMap _byHash;
+	std::list<size_t> _lru;
+};
+
+struct Connection
+{
+	int socket;
+	std::vector<char> input;
+
+	// Results sent to this client and not yet released, by vertex offset
+	std::unordered_map<size_t, int> pins;
+	bool closed;
+};
+
+// A request read in this pass of the event loop
+struct PendingRequest
+{
+	Connection* connection;
+	TessellateRequest request;
+	std::vector<glm::vec3> controlPoints;
+	Clock::time_point received;
+};
+
+// FNV-1a over the control points and resolution
+static unsigned long long HashRequest(const std::vector<glm::vec3>& controlPoints, int resolution)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const unsigned char* bytes = (const unsigned char*)&controlPoints[0];
+	size_t count = controlPoints.size() * sizeof(glm::vec3);
+	for (size_t i = 0; i < count; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	return (hash ^ (unsigned long long)resolution) * 1099511628211ULL;
+}
+
+static bool WriteAll(int socket, const void* data, size_t bytes)
+{
+	const char* p = (const char*)data;
+	while (bytes > 0)
+	{
+		ssize_t written = send(socket, p, bytes, 0);
+		if (written <= 0)
+			return false;
+		p += written;
+		bytes -= written;
+	}
+	return true;
+}
+
+static bool SendMessage(int socket, unsigned int type, const void* body, unsigned int size)
+{
+	MessageHeader header = { type, size };
+	return WriteAll(socket, &header, sizeof(header)) && (size == 0 || WriteAll(socket, body, size));
+}
+
+static void Unpin(ResultCache& cache, Connection& connection, size_t offset)
+{
+	std::unordered_map<size_t, int>::iterator pin = connection.pins.find(offset);
+	if (pin == connection.pins.end())
+		return;
+
+	CachedResult* result = cache.Get(offset);
+	if (result)
+		result->pins -= 1;
+	if (--pin->second == 0)
+		connection.pins.erase(pin);
+}
+
+static void CloseConnection(ResultCache& cache, Connection& connection)
+{
+	for (std::unordered_map<size_t, int>::iterator pin = connection.pins.begin(); pin != connection.pins.end(); ++pin)
+	{
+		CachedResult* result = cache.Get(pin->first);
+		if (result)
+			result->pins -= pin->second;
+	}
+	connection.pins.clear();
+	close(connection.socket);
+	connection.closed = true;
+}
+
+// Largest request accepted, so a corrupt size can't make the service allocate without bound
+static const unsigned int MAX_MESSAGE_BYTES = 64 * 1024 * 1024;
+static const unsigned int MAX_RESOLUTION = 256;
+
+// Splits the connection's input into messages. Returns false if the stream is corrupt.
+static bool ParseMessages(ResultCache& cache, Connection& connection, std::vector<PendingRequest>& requests, bool& shutdown)
+{
+	size_t consumed = 0;
+	while (connection.input.size() - consumed >= sizeof(MessageHeader))
+	{
+		MessageHeader header;
+		memcpy(&header, &connection.input[consumed], sizeof(header));
+		if (header.size > MAX_MESSAGE_BYTES)
+			return false;
+		if (connection.input.size() - consumed - sizeof(header) < header.size)
+			break;
+
+		const char* body = &connection.input[consumed + sizeof(header)];
+		if (header.type == TESSELLATE)
+		{
+			if (header.size < sizeof(TessellateRequest))
+				return false;
+
+			PendingRequest pending;
+			pending.connection = &connection;
+			pending.received = Clock::now();
+			memcpy(&pending.request, body, sizeof(TessellateRequest));
+			size_t expected = sizeof(TessellateRequest) + (size_t)pending.request.numPatches * 16 * sizeof(glm::vec3);
+			if (header.size != expected)
+				return false;
+			pending.controlPoints.resize((size_t)pending.request.numPatches * 16);
+			if (!pending.controlPoints.empty())
+				memcpy((char*)&pending.controlPoints[0], body + sizeof(TessellateRequest), pending.controlPoints.size() * sizeof(glm::vec3));
+			requests.push_back(pending);
+		}
+		else if (header.type == RELEASE && header.size == sizeof(Release))
+		{
+			Release release;
+			memcpy(&release, body, sizeof(release));
+			Unpin(cache, connection, (size_t)release.vertexOffset);
+		}
+		else if (header.type == SHUTDOWN)
+			shutdown = true;
+		else
+			return false;
+
+		consumed += sizeof(header) + header.size;
+	}
+	connection.input.erase(connection.input.begin(), connection.input.begin() + consumed);
+	return true;
+}
+
+bool TessellationService::Run(const char* socketPath, const TessellationServiceSettings& settings, TessellationServiceStats* stats)
+{
+	TessellationServiceStats localStats;
+	if (!stats)
+		stats = &localStats;
+
+	// A client that goes away mid reply must not take the service with it
+	signal(SIGPIPE, SIG_IGN);
+
+	char sharedMemoryName[64];
+	sprintf(sharedMemoryName, "/tessellation_%d", (int)getpid());
+	int sharedMemory = shm_open(sharedMemoryName, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (sharedMemory < 0 || ftruncate(sharedMemory, (off_t)settings.sharedMemoryBytes) != 0)
+	{
+		std::cout << "Couldn't create shared memory " << sharedMemoryName << std::endl;
+		if (sharedMemory >= 0)
+		{
+			close(sharedMemory);
+			shm_unlink(sharedMemoryName);
+		}
+		return false;
+	}
+	void* mapping = mmap(nullptr, settings.sharedMemoryBytes, PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemory, 0);
+	close(sharedMemory);
+	if (mapping == MAP_FAILED)
+	{
+		std::cout << "Couldn't map shared memory " << sharedMemoryName << std::endl;
+		shm_unlink(sharedMemoryName);
+		return false;
+	}
+	char* base = (char*)mapping;
+
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+	unlink(socketPath);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 64) != 0)
+	{
+		std::cout << "Couldn't listen on " << socketPath << std::endl;
+		if (listener >= 0)
+			close(listener);
+		munmap(mapping, settings.sharedMemoryBytes);
+		shm_unlink(sharedMemoryName);
+		return false;
+	}
+
+	std::cout << "Tessellation service listening on " << socketPath << " with " << (settings.sharedMemoryBytes >> 20)
+		<< " MB of shared memory" << std::endl;
+
+	Hello hello;
+	memset(&hello, 0, sizeof(hello));
+	sprintf(hello.sharedMemoryName, "%s", sharedMemoryName);
+	hello.sharedMemoryBytes = settings.sharedMemoryBytes;
+
+	WorkerPool pool(settings.numThreads);
+	ArenaAllocator arena(settings.sharedMemoryBytes);
+	ResultCache cache;
+
+	// The triangle list of one patch per resolution, shared by every result and never evicted
+	std::map<int, size_t> indexBlocks;
+
+	std::list<Connection> connections;
+	std::vector<pollfd> pollSet;
+	std::vector<PendingRequest> requests;
+	std::vector<TessellateResult> replies;
+	std::vector<const glm::vec3*> patchSources;
+	std::vector<float*> patchTargets;
+	std::vector<int> patchResolutions;
+	char buffer[64 * 1024];
+
+	Clock::time_point start = Clock::now();
+	bool shutdown = false;
+	while (!shutdown)
+	{
+		pollSet.clear();
+		pollfd listenPoll = { listener, POLLIN, 0 };
+		pollSet.push_back(listenPoll);
+		for (std::list<Connection>::iterator it = connections.begin(); it != connections.end(); ++it)
+		{
+			pollfd connectionPoll = { it->socket, POLLIN, 0 };
+			pollSet.push_back(connectionPoll);
+		}
+		if (poll(&pollSet[0], pollSet.size(), -1) < 0)
+			continue;
+
+		// Read everything that has arrived on every connection, so all of it is tessellated together
+		requests.clear();
+		size_t pollIndex = 1;
+		for (std::list<Connection>::iterator it = connections.begin(); it != connections.end(); ++it, ++pollIndex)
+		{
+			if (!(pollSet[pollIndex].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+
+			ssize_t received = recv(it->socket, buffer, sizeof(buffer), 0);
+			if (received <= 0)
+			{
+				CloseConnection(cache, *it);
+				continue;
+			}
+			it->input.insert(it->input.end(), buffer, buffer + received);
+			if (!ParseMessages(cache, *it, requests, shutdown))
+			{
+				std::cout << "Dropping a client that sent a malformed message" << std::endl;
+				CloseConnection(cache, *it);
+			}
+		}
+
+		if (pollSet[0].revents & POLLIN)
+		{
+			int client = accept(listener, nullptr, nullptr);
+			if (client >= 0)
+			{
+				Connection connection;
+				connection.socket = client;
+				connection.closed = false;
+				connections.push_back(connection);
+				if (!SendMessage(client, HELLO, &hello, sizeof(hello)))
+					CloseConnection(cache, connections.back());
+			}
+		}
+
+		// Resolve every request against the cache, and find space for the ones that miss. A miss
+		// goes in the cache right away, so the same request twice in one pass is tessellated once.
+		replies.assign(requests.size(), TessellateResult());
+		patchSources.clear();
+		patchTargets.clear();
+		patchResolutions.clear();
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			PendingRequest& pending = requests[i];
+			TessellateResult& reply = replies[i];
+			memset(&reply, 0, sizeof(reply));
+			reply.requestId = pending.request.requestId;
+			if (pending.connection->closed)
+				continue;
+
+			int resolution = (int)pending.request.resolution;
+			if (resolution < 2 || resolution > (int)MAX_RESOLUTION || pending.request.numPatches == 0)
+			{
+				reply.status = BAD_REQUEST;
+				continue;
+			}
+
+			std::map<int, size_t>::iterator indexBlock = indexBlocks.find(resolution);
+			size_t indexBytes = (size_t)PatchEvaluator::NumElements(resolution) * sizeof(unsigned int);
+			if (indexBlock == indexBlocks.end())
+			{
+				size_t offset;
+				bool allocated;
+				while (!(allocated = arena.Allocate(indexBytes, offset)) && cache.EvictOne(arena))
+					stats->evictions++;
+				if (!allocated)
+				{
+					reply.status = OUT_OF_MEMORY;
+					continue;
+				}
+				PatchEvaluator::GenerateElements(resolution, (unsigned int*)(base + offset));
+				indexBlock = indexBlocks.insert(std::make_pair(resolution, offset)).first;
+			}
+
+			unsigned long long hash = HashRequest(pending.controlPoints, resolution);
+			CachedResult* result = cache.Find(hash, resolution, pending.controlPoints);
+			if (result)
+				reply.cacheHit = 1;
+			else
+			{
+				int patchVerts = PatchEvaluator::NumVerts(resolution);
+				size_t vertexBytes = (size_t)pending.request.numPatches * patchVerts * PatchEvaluator::FLOATS_PER_VERT * sizeof(float);
+				size_t offset;
+				bool allocated;
+				while (!(allocated = arena.Allocate(vertexBytes, offset)) && cache.EvictOne(arena))
+					stats->evictions++;
+				if (!allocated)
+				{
+					reply.status = OUT_OF_MEMORY;
+					continue;
+				}
+
+				result = cache.Insert(hash, resolution, pending.controlPoints, offset, vertexBytes);
+				for (unsigned int p = 0; p < pending.request.numPatches; ++p)
+				{
+					patchSources.push_back(&pending.controlPoints[p * 16]);
+					patchTargets.push_back((float*)(base + offset) + (size_t)p * patchVerts * PatchEvaluator::FLOATS_PER_VERT);
+					patchResolutions.push_back(resolution);
+				}
+			}
+
+			result->pins += 1;
+			pending.connection->pins[result->offset] += 1;
+			reply.status = OK;
+			reply.vertexOffset = result->offset;
+			reply.vertexBytes = result->bytes;
+			reply.indexOffset = indexBlock->second;
+			reply.indexBytes = indexBytes;
+		}
+
+		// Every patch that missed, from all requests, in one go
+		pool.ParallelFor((int)patchSources.size(), [&](int begin, int end, int)
+		{
+			for (int i = begin; i < end; ++i)
+				PatchEvaluator::Tessellate(patchSources[i], patchResolutions[i], patchTargets[i]);
+		}, 4);
+
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			PendingRequest& pending = requests[i];
+			TessellateResult& reply = replies[i];
+			if (pending.connection->closed)
+				continue;
+
+			unsigned int microseconds = (unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pending.received).count();
+			reply.serviceMicroseconds = microseconds;
+			stats->requests++;
+			stats->latencies.Add(microseconds);
+			if (reply.status == OK)
+			{
+				stats->patches += pending.request.numPatches;
+				stats->cacheHits += reply.cacheHit;
+			}
+			else
+				stats->failed++;
+
+			if (!SendMessage(pending.connection->socket, RESULT, &reply, sizeof(reply)))
+				CloseConnection(cache, *pending.connection);
+		}
+
+		for (std::list<Connection>::iterator it = connections.begin(); it != connections.end();)
+		{
+			if (it->closed)
+				it = connections.erase(it);
+			else
+				++it;
+		}
+	}
+	stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	for (std::list<Connection>::iterator it = connections.begin(); it != connections.end(); ++it)
+		close(it->socket);
+	close(listener);
+	unlink(socketPath);
+	munmap(mapping, settings.sharedMemoryBytes);
+	shm_unlink(sharedMemoryName);
+	return true;
+}
+
+#endif
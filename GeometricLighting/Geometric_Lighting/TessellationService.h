@@ -0,0 +1,132 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+// Wire format between TessellationService and TessellationClient. Every message starts with
+// a MessageHeader; requests are followed by their control points.
+namespace TessellationProtocol
+{
+	enum MessageType
+	{
+		HELLO = 1,			// service -> client on connect, with the shared memory name
+		TESSELLATE = 2,		// client -> service, followed by numPatches * 16 control points
+		RESULT = 3,			// service -> client
+		RELEASE = 4,		// client -> service, the client is done reading a result
+		SHUTDOWN = 5		// client -> service
+	};
+
+	struct MessageHeader
+	{
+		unsigned int type;
+		unsigned int size;		// bytes following the header
+	};
+
+	struct Hello
+	{
+		char sharedMemoryName[64];
+		unsigned long long sharedMemoryBytes;
+	};
+
+	struct TessellateRequest
+	{
+		unsigned int requestId;
+		unsigned int numPatches;
+		unsigned int resolution;
+	};
+
+	// Offsets are into the shared memory. The vertex block holds NumVerts(resolution) vertices
+	// per patch, one patch after another; the index block is the triangle list of one patch,
+	// shared by every result of the same resolution, so patch i's indices are offset by
+	// i * NumVerts(resolution).
+	struct TessellateResult
+	{
+		unsigned int requestId;
+		unsigned int status;	// 0 on success
+		unsigned long long vertexOffset;
+		unsigned long long vertexBytes;
+		unsigned long long indexOffset;
+		unsigned long long indexBytes;
+		unsigned int cacheHit;
+		unsigned int serviceMicroseconds;
+	};
+
+	struct Release
+	{
+		unsigned long long vertexOffset;
+	};
+
+	enum Status
+	{
+		OK = 0,
+		BAD_REQUEST = 1,
+		OUT_OF_MEMORY = 2
+	};
+}
+
+// Latencies in microseconds, counted in log spaced buckets so a service that runs for days
+// keeps the same few KB however many requests it answers. Below 8 us every value has its own
+// bucket; above, every power of two is split in 8, so a percentile is off by at most 1/8.
+struct LatencyHistogram
+{
+	static const int NUM_BUCKETS = 30 * 8;
+
+	unsigned long long buckets[NUM_BUCKETS];
+	unsigned long long count;
+	unsigned int maximum;
+
+	LatencyHistogram();
+
+	void Add(unsigned int microseconds);
+	void Merge(const LatencyHistogram& other);
+
+	// The largest latency of the bucket the fraction q of all latencies falls into, at most maximum
+	unsigned int Percentile(double q) const;
+};
+
+struct TessellationServiceSettings
+{
+	// Size of the shared memory all results are written into
+	size_t sharedMemoryBytes = 256 * 1024 * 1024;
+
+	// 0 uses one thread per core
+	int numThreads = 0;
+};
+
+struct TessellationServiceStats
+{
+	unsigned long long requests = 0;
+	unsigned long long patches = 0;
+	unsigned long long cacheHits = 0;
+	unsigned long long evictions = 0;
+	unsigned long long failed = 0;
+	double seconds = 0.0;
+
+	// Time from reading a request to sending its result, in microseconds
+	LatencyHistogram latencies;
+};
+
+// Tessellation for other processes on the same machine, so tools that can't link the GL app
+// don't have to evaluate Bezier patches themselves. Clients connect to a Unix domain socket
+// and map the service's shared memory read only; results are written straight into it and
+// the reply only says where, so the vertices are never copied through the socket.
+//
+// The service runs a single event loop. Every pass gathers the requests that have arrived on
+// all connections and tessellates the patches of all of them in one ParallelFor, so a burst of
+// small requests still keeps every core busy. Results are kept in a cache keyed by their
+// control points and resolution: asking again for the same patches costs neither work nor
+// memory, and a result stays pinned until every client holding it has released it. Unpinned
+// results are evicted, least recently used first, when the shared memory runs out.
+//
+// POSIX only; on Windows Run reports that it isn't supported.
+class TessellationService
+{
+public:
+	// Serves on socketPath until a client sends SHUTDOWN
+	static bool Run(const char* socketPath, const TessellationServiceSettings& settings, TessellationServiceStats* stats = nullptr);
+
+	static void PrintStats(const TessellationServiceStats& stats);
+};
+
+// Percentiles of a set of latencies in microseconds, shared by the service and its benchmarks
+void PrintLatencyPercentiles(const char* label, const LatencyHistogram& latencies);
@@ -0,0 +1,133 @@
+#include "TileRenderer.h"
+#include "PatchEvaluator.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void TileRenderer::SetPatches(const std::vector<glm::vec3>& controlPoints, int resolution)
+{
+	int numPatches = (int)controlPoints.size() / 16;
+	int patchVerts = PatchEvaluator::NumVerts(resolution);
+	int patchElements = PatchEvaluator::NumElements(resolution);
+
+	_verts.resize((size_t)numPatches * patchVerts * PatchEvaluator::FLOATS_PER_VERT);
+	_elements.resize((size_t)numPatches * patchElements);
+	for (int i = 0; i < numPatches; ++i)
+	{
+		PatchEvaluator::Tessellate(&controlPoints[i * 16], resolution, &_verts[(size_t)i * patchVerts * PatchEvaluator::FLOATS_PER_VERT]);
+
+		unsigned int* elements = &_elements[(size_t)i * patchElements];
+		PatchEvaluator::GenerateElements(resolution, elements);
+		for (int j = 0; j < patchElements; ++j)
+			elements[j] += i * patchVerts;
+	}
+}
+
+// Twice the signed area of the triangle a, b, p
+static float Edge(const glm::vec2& a, const glm::vec2& b, const glm::vec2& p)
+{
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+void TileRenderer::Render(const glm::mat4& modelMat, const glm::mat4& viewMat, const glm::mat4& projMat, const glm::vec4& color,
+	int width, int height, int tileX, int tileY, int tileWidth, int tileHeight, unsigned char* rgba)
+{
+	// The vertex shader's outputs: WorldPos is really the clip space position, and the normal
+	// goes through the projection too. fShader lights with exactly these, so we do as well.
+	glm::mat4 mpMat = projMat * modelMat;
+	glm::mat4 mpvMat = projMat * viewMat * modelMat;
+
+	size_t numVerts = _verts.size() / PatchEvaluator::FLOATS_PER_VERT;
+	_clipPos.resize(numVerts);
+	_normals.resize(numVerts);
+	for (size_t i = 0; i < numVerts; ++i)
+	{
+		const float* vert = &_verts[i * PatchEvaluator::FLOATS_PER_VERT];
+		_clipPos[i] = mpvMat * glm::vec4(vert[0], vert[1], vert[2], 1.0f);
+		_normals[i] = mpMat * glm::vec4(vert[3], vert[4], vert[5], 0.0f);
+	}
+
+	std::fill(rgba, rgba + (size_t)tileWidth * tileHeight * 4, (unsigned char)0);
+	_depth.assign((size_t)tileWidth * tileHeight, FLT_MAX);
+
+	const glm::vec4 lightPos = glm::vec4(8.0f, 0.0f, 0.0f, 1.0f);
+	const float diffusePower = 5.0f;
+	const glm::vec4 ambient = glm::vec4(0.3f, 0.3f, 0.3f, 1.0f);
+
+	for (size_t t = 0; t + 2 < _elements.size(); t += 3)
+	{
+		unsigned int index[3] = { _elements[t], _elements[t + 1], _elements[t + 2] };
+		const glm::vec4& c0 = _clipPos[index[0]];
+		const glm::vec4& c1 = _clipPos[index[1]];
+		const glm::vec4& c2 = _clipPos[index[2]];
+		if (c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f)
+			continue;
+
+		// To window coordinates, with pixel centers at half integers like GL
+		glm::vec2 screen[3];
+		float depth[3], invW[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			const glm::vec4& clip = _clipPos[index[k]];
+			invW[k] = 1.0f / clip.w;
+			screen[k] = glm::vec2((clip.x * invW[k] * 0.5f + 0.5f) * width, (clip.y * invW[k] * 0.5f + 0.5f) * height);
+			depth[k] = clip.z * invW[k];
+		}
+
+		float area = Edge(screen[0], screen[1], screen[2]);
+		if (area == 0.0f)
+			continue;
+
+		int minX = std::max(tileX, (int)floor(std::min(screen[0].x, std::min(screen[1].x, screen[2].x))));
+		int maxX = std::min(tileX + tileWidth - 1, (int)ceil(std::max(screen[0].x, std::max(screen[1].x, screen[2].x))));
+		int minY = std::max(tileY, (int)floor(std::min(screen[0].y, std::min(screen[1].y, screen[2].y))));
+		int maxY = std::min(tileY + tileHeight - 1, (int)ceil(std::max(screen[0].y, std::max(screen[1].y, screen[2].y))));
+
+		for (int y = minY; y <= maxY; ++y)
+		{
+			for (int x = minX; x <= maxX; ++x)
+			{
+				glm::vec2 p((float)x + 0.5f, (float)y + 0.5f);
+				float w0 = Edge(screen[1], screen[2], p) / area;
+				float w1 = Edge(screen[2], screen[0], p) / area;
+				float w2 = Edge(screen[0], screen[1], p) / area;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+
+				float z = w0 * depth[0] + w1 * depth[1] + w2 * depth[2];
+				if (z < -1.0f || z > 1.0f)
+					continue;
+
+				size_t pixel = (size_t)(y - tileY) * tileWidth + (x - tileX);
+				if (z >= _depth[pixel])
+					continue;
+				_depth[pixel] = z;
+
+				// Perspective correct interpolation of the shader inputs
+				float p0 = w0 * invW[0], p1 = w1 * invW[1], p2 = w2 * invW[2];
+				float sum = p0 + p1 + p2;
+				glm::vec4 normal = (_normals[index[0]] * p0 + _normals[index[1]] * p1 + _normals[index[2]] * p2) / sum;
+				glm::vec4 worldPos = (c0 * p0 + c1 * p1 + c2 * p2) / sum;
+
+				// fShader.glsl
+				glm::vec4 lightDir = glm::normalize(worldPos - lightPos);
+				float dis = glm::length(lightDir);
+				float intensity = glm::clamp(glm::dot(normal, lightDir), 0.0f, 1.0f);
+				glm::vec4 diffuse = intensity * glm::vec4(1.0f) * diffusePower / (dis * dis);
+				glm::vec4 outColor = glm::clamp((diffuse + ambient) * color, 0.0f, 1.0f);
+
+				unsigned char* out = &rgba[pixel * 4];
+				out[0] = (unsigned char)(outColor.r * 255.0f + 0.5f);
+				out[1] = (unsigned char)(outColor.g * 255.0f + 0.5f);
+				out[2] = (unsigned char)(outColor.b * 255.0f + 0.5f);
+				out[3] = (unsigned char)(outColor.a * 255.0f + 0.5f);
+			}
+		}
+	}
+}
+
+int TileRenderer::numTriangles() const
+{
+	return (int)_elements.size() / 3;
+}
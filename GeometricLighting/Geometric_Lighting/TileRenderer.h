@@ -0,0 +1,33 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+#include <vector>
+
+// A small CPU rasterizer for rendering images without a GL context, one rectangular tile at a
+// time so the tiles of a frame can be spread over processes. It draws a triangle mesh of
+// position and normal vertices (the PatchEvaluator layout) with a depth buffer and the same
+// lighting as fShader.glsl, so offline frames look like the interactive ones.
+//
+// Triangles that cross behind the camera are dropped rather than clipped.
+class TileRenderer
+{
+public:
+	// Tessellates every patch at the given resolution into one mesh
+	void SetPatches(const std::vector<glm::vec3>& controlPoints, int resolution);
+
+	// Renders the part of a width x height image inside the tile into rgba, tightly packed and
+	// bottom row first like glReadPixels. The tile is cleared to black first.
+	void Render(const glm::mat4& modelMat, const glm::mat4& viewMat, const glm::mat4& projMat, const glm::vec4& color,
+		int width, int height, int tileX, int tileY, int tileWidth, int tileHeight, unsigned char* rgba);
+
+	int numTriangles() const;
+
+private:
+	std::vector<float> _verts;
+	std::vector<unsigned int> _elements;
+
+	// Scratch, kept between tiles
+	std::vector<glm::vec4> _clipPos;
+	std::vector<glm::vec4> _normals;
+	std::vector<float> _depth;
+};
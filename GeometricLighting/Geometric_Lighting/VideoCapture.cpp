@@ -0,0 +1,285 @@
+#include "VideoCapture.h"
+
+#include <chrono>
+#include <iostream>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define VIDEO_CAPTURE_SSE2
+#include <emmintrin.h>
+#endif
+
+VideoCapture::VideoCapture(const char* fileName, int width, int height, int fps, BackpressurePolicy policy, int maxQueuedFrames)
+{
+	_width = width;
+	_height = height;
+	_policy = policy;
+	_maxQueuedFrames = maxQueuedFrames > 0 ? maxQueuedFrames : 1;
+
+	// C420jpeg marks the chroma as full range and centered between the luma samples,
+	// which is what ConvertRGBAToI420 produces
+	_file.open(fileName, std::ios::binary);
+	if (_file)
+	{
+		_file << "YUV4MPEG2 W" << _width << " H" << _height << " F" << fps << ":1 Ip A1:1 C420jpeg\n";
+	}
+
+	_accepting = _file.good();
+	_worker = std::thread(&VideoCapture::WorkerLoop, this);
+}
+VideoCapture::~VideoCapture()
+{
+	Finish();
+
+	while (!_freeBuffers.empty())
+	{
+		delete _freeBuffers.back();
+		_freeBuffers.pop_back();
+	}
+}
+
+void VideoCapture::Consume(const CapturedFrame& frame)
+{
+	if (frame.width != _width || frame.height != _height)
+		return;
+
+	std::vector<unsigned char>* buffer = nullptr;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (!_accepting)
+			return;
+
+		if (_queue.size() >= _maxQueuedFrames)
+		{
+			if (_policy == BackpressurePolicy::DropNewest)
+			{
+				_stats.framesDropped++;
+				return;
+			}
+			else if (_policy == BackpressurePolicy::DropOldest)
+			{
+				_freeBuffers.push_back(_queue.front());
+				_queue.pop_front();
+				_stats.framesDropped++;
+			}
+			else
+			{
+				_spaceSignal.wait(lock, [this] { return _queue.size() < _maxQueuedFrames || !_accepting; });
+				if (!_accepting)
+					return;
+			}
+		}
+
+		if (!_freeBuffers.empty())
+		{
+			buffer = _freeBuffers.back();
+			_freeBuffers.pop_back();
+		}
+	}
+
+	// The copy happens outside the lock so the worker can keep converting meanwhile
+	if (!buffer)
+		buffer = new std::vector<unsigned char>();
+	*buffer = frame.pixels;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	_queue.push_back(buffer);
+	_queueSignal.notify_one();
+}
+
+void VideoCapture::WorkerLoop()
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point start = Clock::now();
+
+	int chromaWidth = (_width + 1) / 2;
+	int chromaHeight = (_height + 1) / 2;
+	std::vector<unsigned char> yuv(_width * _height + chromaWidth * chromaHeight * 2);
+	unsigned char* y = &yuv[0];
+	unsigned char* u = y + _width * _height;
+	unsigned char* v = u + chromaWidth * chromaHeight;
+
+	while (true)
+	{
+		std::vector<unsigned char>* buffer;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_queueSignal.wait(lock, [this] { return !_queue.empty() || !_accepting; });
+			if (_queue.empty())
+				break;
+
+			buffer = _queue.front();
+			_queue.pop_front();
+			_spaceSignal.notify_one();
+		}
+
+		Clock::time_point convertStart = Clock::now();
+		ConvertRGBAToI420(&(*buffer)[0], _width, _height, y, u, v);
+		Clock::time_point writeStart = Clock::now();
+
+		_file.write("FRAME\n", 6);
+		_file.write((const char*)&yuv[0], yuv.size());
+		Clock::time_point writeEnd = Clock::now();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_freeBuffers.push_back(buffer);
+		_stats.framesWritten++;
+		_stats.bytesWritten += yuv.size() + 6;
+		_stats.convertSeconds += std::chrono::duration<double>(writeStart - convertStart).count();
+		_stats.writeSeconds += std::chrono::duration<double>(writeEnd - writeStart).count();
+		_stats.wallSeconds = std::chrono::duration<double>(writeEnd - start).count();
+	}
+}
+
+void VideoCapture::Finish()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_accepting = false;
+		_queueSignal.notify_one();
+		_spaceSignal.notify_all();
+	}
+	if (_worker.joinable())
+		_worker.join();
+
+	if (_file.is_open())
+		_file.close();
+}
+
+bool VideoCapture::isOpen()
+{
+	return _file.is_open();
+}
+
+VideoCaptureStats VideoCapture::Stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+void VideoCapture::PrintStats()
+{
+	VideoCaptureStats stats = Stats();
+	double busy = stats.convertSeconds + stats.writeSeconds;
+
+	std::cout << "Video capture: " << stats.framesWritten << " frames written, " << stats.framesDropped << " dropped" << std::endl;
+	if (stats.framesWritten > 0 && busy > 0.0)
+	{
+		std::cout << "  convert " << (stats.convertSeconds * 1000.0 / stats.framesWritten) << " ms/frame, write "
+			<< (stats.writeSeconds * 1000.0 / stats.framesWritten) << " ms/frame" << std::endl;
+		std::cout << "  encoder throughput " << (stats.framesWritten / busy) << " fps, "
+			<< (stats.bytesWritten / (1024.0 * 1024.0) / busy) << " MB/s" << std::endl;
+	}
+	if (stats.wallSeconds > 0.0)
+		std::cout << "  captured " << (stats.framesWritten / stats.wallSeconds) << " fps over " << stats.wallSeconds << " s" << std::endl;
+}
+
+// Full range BT.601 in 7 bit fixed point, small enough that a pair of products always fits
+// in a signed 16 bit lane for the SSE2 path:
+// Y =  0.299R + 0.587G + 0.114B
+// U = -0.169R - 0.331G + 0.500B + 128
+// V =  0.500R - 0.419G - 0.081B + 128
+static const int kYR = 38, kYG = 75, kYB = 15;
+static const int kUR = -22, kUG = -42, kUB = 64;
+static const int kVR = 64, kVG = -54, kVB = -10;
+
+static inline unsigned char ClampByte(int value)
+{
+	return (unsigned char)(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+#ifdef VIDEO_CAPTURE_SSE2
+// Weighted sum of the RGB channels of four RGBA pixels, returned as four 32 bit lanes scaled by 128
+static inline __m128i WeightedSumSSE2(__m128i pixels, __m128i coeffs)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coeffs);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coeffs);
+	return _mm_madd_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(1));
+}
+
+// Takes the average of each horizontal pair of pixels and packs the four results together
+static inline __m128i PairAverageSSE2(__m128i a, __m128i b)
+{
+	__m128i avgA = _mm_avg_epu8(a, _mm_srli_si128(a, 4));
+	__m128i avgB = _mm_avg_epu8(b, _mm_srli_si128(b, 4));
+	avgA = _mm_shuffle_epi32(avgA, _MM_SHUFFLE(3, 1, 2, 0));
+	avgB = _mm_shuffle_epi32(avgB, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_unpacklo_epi64(avgA, avgB);
+}
+#endif
+
+void VideoCapture::ConvertRGBAToI420(const unsigned char* rgba, int width, int height,
+	unsigned char* y, unsigned char* u, unsigned char* v)
+{
+	int chromaWidth = (width + 1) / 2;
+	int stride = width * 4;
+
+	// Work on pairs of output rows so each 2x2 block of pixels is read once for both luma and chroma
+	for (int row = 0; row < height; row += 2)
+	{
+		// GL hands rows back bottom-up, video expects them top-down
+		const unsigned char* src0 = rgba + (height - 1 - row) * stride;
+		const unsigned char* src1 = row + 1 < height ? src0 - stride : src0;
+		unsigned char* y0 = y + row * width;
+		unsigned char* y1 = row + 1 < height ? y0 + width : y0;
+		unsigned char* uRow = u + (row / 2) * chromaWidth;
+		unsigned char* vRow = v + (row / 2) * chromaWidth;
+
+		int x = 0;
+#ifdef VIDEO_CAPTURE_SSE2
+		const __m128i yCoeffs = _mm_setr_epi16(kYR, kYG, kYB, 0, kYR, kYG, kYB, 0);
+		const __m128i uCoeffs = _mm_setr_epi16(kUR, kUG, kUB, 0, kUR, kUG, kUB, 0);
+		const __m128i vCoeffs = _mm_setr_epi16(kVR, kVG, kVB, 0, kVR, kVG, kVB, 0);
+		const __m128i round = _mm_set1_epi32(64);
+		const __m128i chromaOffset = _mm_set1_epi32(128);
+
+		for (; x + 8 <= width; x += 8)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i*)(src0 + x * 4));
+			__m128i a1 = _mm_loadu_si128((const __m128i*)(src0 + x * 4 + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i*)(src1 + x * 4));
+			__m128i b1 = _mm_loadu_si128((const __m128i*)(src1 + x * 4 + 16));
+
+			__m128i lumaA = _mm_packs_epi32(
+				_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(a0, yCoeffs), round), 7),
+				_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(a1, yCoeffs), round), 7));
+			__m128i lumaB = _mm_packs_epi32(
+				_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(b0, yCoeffs), round), 7),
+				_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(b1, yCoeffs), round), 7));
+			_mm_storel_epi64((__m128i*)(y0 + x), _mm_packus_epi16(lumaA, lumaA));
+			_mm_storel_epi64((__m128i*)(y1 + x), _mm_packus_epi16(lumaB, lumaB));
+
+			// Average each 2x2 block down to one pixel before computing chroma
+			__m128i block = PairAverageSSE2(_mm_avg_epu8(a0, b0), _mm_avg_epu8(a1, b1));
+
+			__m128i chromaU = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(block, uCoeffs), round), 7), chromaOffset);
+			__m128i chromaV = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(WeightedSumSSE2(block, vCoeffs), round), 7), chromaOffset);
+			chromaU = _mm_packs_epi32(chromaU, chromaU);
+			chromaV = _mm_packs_epi32(chromaV, chromaV);
+			*(int*)(uRow + x / 2) = _mm_cvtsi128_si32(_mm_packus_epi16(chromaU, chromaU));
+			*(int*)(vRow + x / 2) = _mm_cvtsi128_si32(_mm_packus_epi16(chromaV, chromaV));
+		}
+#endif
+
+		// Scalar tail, and the whole row when SSE2 isn't available
+		for (; x < width; x += 2)
+		{
+			int next = x + 1 < width ? 4 : 0;
+			const unsigned char* p[4] = { src0 + x * 4, src0 + x * 4 + next, src1 + x * 4, src1 + x * 4 + next };
+
+			y0[x] = ClampByte((kYR * p[0][0] + kYG * p[0][1] + kYB * p[0][2] + 64) >> 7);
+			y1[x] = ClampByte((kYR * p[2][0] + kYG * p[2][1] + kYB * p[2][2] + 64) >> 7);
+			if (next)
+			{
+				y0[x + 1] = ClampByte((kYR * p[1][0] + kYG * p[1][1] + kYB * p[1][2] + 64) >> 7);
+				y1[x + 1] = ClampByte((kYR * p[3][0] + kYG * p[3][1] + kYB * p[3][2] + 64) >> 7);
+			}
+
+			int r = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) / 4;
+			int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) / 4;
+			int b = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) / 4;
+			uRow[x / 2] = ClampByte(((kUR * r + kUG * g + kUB * b + 64) >> 7) + 128);
+			vRow[x / 2] = ClampByte(((kVR * r + kVG * g + kVB * b + 64) >> 7) + 128);
+		}
+	}
+}
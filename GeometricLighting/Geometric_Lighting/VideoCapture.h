@@ -0,0 +1,66 @@
+#pragma once
+#include "FrameCapture.h"
+
+#include <fstream>
+
+// What to do with a new frame when the encoder's queue is already full
+enum class BackpressurePolicy
+{
+	Block,			// wait for the encoder to catch up (never loses frames, may back up the capture thread)
+	DropNewest,		// discard the incoming frame
+	DropOldest		// discard the oldest queued frame to make room for the new one
+};
+
+struct VideoCaptureStats
+{
+	unsigned int framesWritten = 0;
+	unsigned int framesDropped = 0;
+	unsigned long long bytesWritten = 0;
+	double convertSeconds = 0.0;
+	double writeSeconds = 0.0;
+	double wallSeconds = 0.0;
+};
+
+// Streams captured frames to an uncompressed YUV4MPEG2 (.y4m) file. Frames arrive on the
+// FrameCapture encoder thread and are only copied into a bounded queue there, the RGBA to
+// YUV 4:2:0 conversion and file writes happen on this class's own worker thread.
+class VideoCapture : public CaptureSink
+{
+public:
+	VideoCapture(const char* fileName, int width, int height, int fps = 60,
+		BackpressurePolicy policy = BackpressurePolicy::DropOldest, int maxQueuedFrames = 8);
+	~VideoCapture();
+
+	void Consume(const CapturedFrame& frame);
+
+	// Stops accepting frames, writes out everything still queued and closes the file
+	void Finish();
+
+	bool isOpen();
+	VideoCaptureStats Stats();
+	void PrintStats();
+
+	// Converts one bottom-up RGBA image into top-down planar Y, U and V (full range BT.601)
+	static void ConvertRGBAToI420(const unsigned char* rgba, int width, int height,
+		unsigned char* y, unsigned char* u, unsigned char* v);
+
+private:
+	void WorkerLoop();
+
+private:
+	std::ofstream _file;
+	int _width;
+	int _height;
+	BackpressurePolicy _policy;
+	unsigned int _maxQueuedFrames;
+
+	std::deque<std::vector<unsigned char>*> _queue;
+	std::vector<std::vector<unsigned char>*> _freeBuffers;
+	std::mutex _mutex;
+	std::condition_variable _queueSignal;
+	std::condition_variable _spaceSignal;
+	std::thread _worker;
+	bool _accepting;
+
+	VideoCaptureStats _stats;
+};
@@ -0,0 +1,114 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	_func = nullptr;
+	_count = 0;
+	_grainSize = 1;
+	_nextItem = 0;
+	_busyThreads = 0;
+	_generation = 0;
+	_running = true;
+
+	// The thread calling ParallelFor acts as worker 0, so only numThreads - 1 extra threads are needed
+	for (int i = 1; i < numThreads; ++i)
+	{
+		_threads.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+	}
+}
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_workSignal.notify_all();
+
+	unsigned int size = _threads.size();
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		_threads[i].join();
+	}
+}
+
+void WorkerPool::ParallelFor(int count, const std::function<void(int, int, int)>& func, int grainSize)
+{
+	if (count <= 0)
+		return;
+
+	if (grainSize <= 0)
+		grainSize = std::max(1, count / (numThreads() * 4));
+
+	// Nothing to gain from waking threads for a single chunk
+	if (_threads.empty() || count <= grainSize)
+	{
+		func(0, count, 0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_func = &func;
+		_count = count;
+		_grainSize = grainSize;
+		_nextItem = 0;
+		_busyThreads = _threads.size();
+		_generation++;
+	}
+	_workSignal.notify_all();
+
+	RunChunks(0);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_doneSignal.wait(lock, [this] { return _busyThreads == 0; });
+	_func = nullptr;
+}
+
+int WorkerPool::numThreads()
+{
+	return _threads.size() + 1;
+}
+
+void WorkerPool::WorkerLoop(int threadIndex)
+{
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_workSignal.wait(lock, [this, seenGeneration] { return !_running || _generation != seenGeneration; });
+			if (!_running)
+				break;
+			seenGeneration = _generation;
+		}
+
+		RunChunks(threadIndex);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (--_busyThreads == 0)
+			_doneSignal.notify_one();
+	}
+}
+
+void WorkerPool::RunChunks(int threadIndex)
+{
+	while (true)
+	{
+		int begin, end;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			begin = _nextItem;
+			if (begin >= _count)
+				break;
+			end = std::min(begin + _grainSize, _count);
+			_nextItem = end;
+		}
+
+		(*_func)(begin, end, threadIndex);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// A small fixed set of worker threads for splitting CPU work (tessellation, file formatting,
+// baking, ...) across cores. ParallelFor hands each thread a contiguous range of items and
+// blocks until all of them are done, so callers can treat it like an ordinary loop.
+class WorkerPool
+{
+public:
+	// Passing 0 uses one thread per hardware core
+	WorkerPool(int numThreads = 0);
+	~WorkerPool();
+
+	// Calls func(begin, end, threadIndex) over [0, count) split into chunks of at most grainSize
+	// items (0 picks a size that gives each thread a few chunks). The calling thread works too.
+	// threadIndex is in [0, numThreads()) and can be used to pick per thread scratch memory.
+	// Not reentrant: func must not call ParallelFor on the same pool.
+	void ParallelFor(int count, const std::function<void(int, int, int)>& func, int grainSize = 0);
+
+	int numThreads();
+
+private:
+	void WorkerLoop(int threadIndex);
+	void RunChunks(int threadIndex);
+
+private:
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _workSignal;
+	std::condition_variable _doneSignal;
+
+	// State of the ParallelFor currently in flight
+	const std::function<void(int, int, int)>* _func;
+	int _count;
+	int _grainSize;
+	int _nextItem;
+	int _busyThreads;
+	unsigned int _generation;
+	bool _running;
+};
@@ -1,11 +1,169 @@
 #version 440
 
-in vec4 Color;
-in vec4 Normal;
-in vec4 WorldPos;
+in VertexData
+{
+	vec4 Color;
+	vec4 Normal;
+	vec4 WorldPos;
+	vec3 SurfacePos;
+	vec3 SurfaceNormal;
+	vec2 NormalMapUV;
+	flat int ViewIndex;
+};
+
+#define MAX_AREA_LIGHTS 8
+#define MAX_POLYGON_VERTS 8
+#define MAX_VIEWS 4
+
+// One for each view gShader.glsl draws, only the first without it
+uniform vec3 cameraPos[MAX_VIEWS];
+uniform mat4 projMat[MAX_VIEWS];
+
+// Tangent space normals baked by NormalMapBaker, for patches with a normalMapRect
+uniform sampler2D normalMap;
+uniform vec4 normalMapRect;
+
+// Light probe grid from LightProbeGrid: nine spherical harmonic coefficients per color channel
+// spread over seven 3D textures, and the mapping from world space into them
+uniform sampler3D probeSH[7];
+uniform vec3 probeScale;
+uniform vec3 probeOffset;
+uniform bool probesEnabled;
+
+// Area lights from LightManager, each a polygon in world space, and the LTC tables that give
+// the GGX lobe for a roughness and view angle
+uniform int areaLightCount;
+uniform vec3 areaLightVerts[MAX_AREA_LIGHTS * MAX_POLYGON_VERTS];
+uniform int areaLightVertCount[MAX_AREA_LIGHTS];
+uniform bool areaLightTwoSided[MAX_AREA_LIGHTS];
+uniform vec3 areaLightColor[MAX_AREA_LIGHTS];
+uniform float areaRoughness;
+uniform float areaSpecular;
+uniform sampler2D ltcMatrix;
+uniform sampler2D ltcMagnitude;
+uniform float ltcSize;
 
 out vec4 outColor;
 
+// Light bouncing around the scene onto a surface facing n, trilinearly blended from the eight
+// nearest probes. The coefficients are already convolved with the cosine lobe and divided by
+// pi, so evaluating them gives the ambient term directly.
+vec4 probeAmbient(vec3 n)
+{
+	vec3 uvw = SurfacePos * probeScale + probeOffset;
+
+	vec4 basisLow = vec4(0.282095, 0.488603 * n.y, 0.488603 * n.z, 0.488603 * n.x);
+	vec4 basisHigh = vec4(1.092548 * n.x * n.y, 1.092548 * n.y * n.z, 0.315392 * (3.0 * n.z * n.z - 1.0), 1.092548 * n.x * n.z);
+	float basisLast = 0.546274 * (n.x * n.x - n.y * n.y);
+
+	vec3 irradiance = vec3(
+		dot(texture(probeSH[0], uvw), basisLow) + dot(texture(probeSH[1], uvw), basisHigh),
+		dot(texture(probeSH[2], uvw), basisLow) + dot(texture(probeSH[3], uvw), basisHigh),
+		dot(texture(probeSH[4], uvw), basisLow) + dot(texture(probeSH[5], uvw), basisHigh));
+	irradiance += texture(probeSH[6], uvw).rgb * basisLast;
+
+	return vec4(max(irradiance, vec3(0.0)), 1.0);
+}
+
+// Cosine weighted solid angle of the arc between two unit directions, as a vector whose z is
+// the part above the horizon. The rational fit to theta / sin(theta) (divided by 2 pi) stays
+// accurate where the plain formula loses precision.
+vec3 integrateEdge(vec3 v1, vec3 v2)
+{
+	float x = dot(v1, v2);
+	float y = abs(x);
+	float a = 0.8543985 + (0.4965155 + 0.0145206 * y) * y;
+	float b = 3.4175940 + (4.1616724 + y) * y;
+	float v = a / b;
+	float thetaOverSinTheta = x > 0.0 ? v : 0.5 * inversesqrt(max(1.0 - x * x, 1e-7)) - v;
+	return cross(v1, v2) * thetaOverSinTheta;
+}
+
+// Integral of a clamped cosine over a light's polygon after transforming it by Minv. The
+// polygon is clipped to the horizon first, since the closed form assumes it is all above.
+float integratePolygon(mat3 Minv, int light)
+{
+	int count = areaLightVertCount[light];
+	vec3 clipped[MAX_POLYGON_VERTS + 1];
+	int clippedCount = 0;
+
+	vec3 a = Minv * (areaLightVerts[light * MAX_POLYGON_VERTS] - SurfacePos);
+	for (int i = 0; i < count; ++i)
+	{
+		vec3 b = Minv * (areaLightVerts[light * MAX_POLYGON_VERTS + (i + 1) % count] - SurfacePos);
+		if (a.z >= 0.0)
+			clipped[clippedCount++] = a;
+		if ((a.z >= 0.0) != (b.z >= 0.0))
+			clipped[clippedCount++] = mix(a, b, a.z / (a.z - b.z));
+		a = b;
+	}
+	if (clippedCount < 3)
+		return 0.0;
+
+	vec3 sum = vec3(0.0);
+	vec3 first = normalize(clipped[0]);
+	vec3 previous = first;
+	for (int i = 1; i < clippedCount; ++i)
+	{
+		vec3 current = normalize(clipped[i]);
+		sum += integrateEdge(previous, current);
+		previous = current;
+	}
+	sum += integrateEdge(previous, first);
+
+	// The sign says which side of the light is seen
+	return areaLightTwoSided[light] ? abs(sum.z) : max(sum.z, 0.0);
+}
+
+// Bends the interpolated normal by the normal map. The baker stored each normal relative to the
+// triangle's direction of increasing u, which screen space derivatives give back exactly.
+vec3 normalMapped(vec3 n)
+{
+	vec3 dpdx = dFdx(SurfacePos);
+	vec3 dpdy = dFdy(SurfacePos);
+	vec2 duvdx = dFdx(NormalMapUV);
+	vec2 duvdy = dFdy(NormalMapUV);
+	float det = duvdx.x * duvdy.y - duvdy.x * duvdx.y;
+	vec3 t = (dpdx * duvdy.y - dpdy * duvdx.y) * sign(det);
+	t = t - n * dot(n, t);
+	if (dot(t, t) < 1e-12)
+		return n;
+	t = normalize(t);
+	vec3 detail = texture(normalMap, NormalMapUV).xyz * 2.0 - 1.0;
+	return normalize(mat3(t, cross(n, t), n) * detail);
+}
+
+// Diffuse and GGX specular light from the area lights, with linearly transformed cosines
+vec3 areaLighting(vec3 n, vec3 albedo)
+{
+	vec3 v = normalize(cameraPos[ViewIndex] - SurfacePos);
+	if (dot(n, v) < 0.0)
+		n = -n;
+
+	// Tangent frame with the view direction in the xz plane, as the tables are fitted
+	vec3 t1 = v - n * dot(v, n);
+	t1 = dot(t1, t1) > 1e-8 ? normalize(t1) : normalize(cross(n, abs(n.x) < 0.9 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0)));
+	vec3 t2 = cross(n, t1);
+	mat3 toTangent = transpose(mat3(t1, t2, n));
+
+	// Entries sit on texel centers
+	vec2 uv = vec2(areaRoughness, sqrt(1.0 - clamp(dot(n, v), 0.0, 1.0)));
+	uv = uv * (ltcSize - 1.0) / ltcSize + 0.5 / ltcSize;
+	vec4 m = texture(ltcMatrix, uv);
+	vec4 magnitude = texture(ltcMagnitude, uv);
+	mat3 Minv = mat3(vec3(m.x, 0.0, m.y), vec3(0.0, 1.0, 0.0), vec3(m.z, 0.0, m.w)) * toTangent;
+	float specularScale = areaSpecular * magnitude.x + (1.0 - areaSpecular) * magnitude.y;
+
+	vec3 result = vec3(0.0);
+	for (int light = 0; light < areaLightCount; ++light)
+	{
+		float diffuse = integratePolygon(toTangent, light);
+		float specular = integratePolygon(Minv, light);
+		result += areaLightColor[light] * (albedo * diffuse + specularScale * specular);
+	}
+	return result;
+}
+
 void main()
 {
 	vec4 lightPos = vec4(8.0, 0.0, 0.0, 1.0);
@@ -14,13 +172,23 @@ void main()
 	float diffusePower = 5.0;
 
 	vec4 lightDiffuseColor = vec4(1.0, 1.0, 1.0, 1.0);
-	vec4 ambient = vec4(0.3, 0.3, 0.3, 1.0);
+	vec3 surfaceNormal = normalize(SurfaceNormal);
+	vec4 normal = Normal;
+	if (normalMapRect.z > 0.0)
+	{
+		surfaceNormal = normalMapped(surfaceNormal);
+		normal = projMat[ViewIndex] * vec4(surfaceNormal * length(SurfaceNormal), 0.0);
+	}
+
+	vec4 ambient = probesEnabled ? probeAmbient(surfaceNormal) : vec4(0.3, 0.3, 0.3, 1.0);
 	
 	float dis = length(lightDir);
 	
-	float NdotL = dot(Normal, lightDir);
+	float NdotL = dot(normal, lightDir);
 	float intensity = clamp(NdotL, 0.0, 1.0);
 	vec4 diffuse = intensity * lightDiffuseColor * diffusePower / (dis * dis);
 	
 	outColor = (diffuse + ambient) * Color;
+	if (areaLightCount > 0)
+		outColor.rgb += areaLighting(surfaceNormal, Color.rgb);
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#version 440
+
+#define MAX_VIEWS 4
+
+// Draws every triangle into each view at once, one invocation per view, so the vertex shader
+// runs once however many views there are. Linked in only when there is more than one view.
+layout(triangles, invocations = MAX_VIEWS) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// Set by CameraManager::BindViews. The vertex shader's positions and normals come in world
+// space, since the matrices it was given leave out the view and projection.
+uniform int viewCount;
+uniform mat4 viewProjMats[MAX_VIEWS];
+uniform mat4 projMats[MAX_VIEWS];
+
+// The views the shape being drawn was found in by culling, a bit for each
+uniform uint viewMask;
+
+in VertexData
+{
+	vec4 Color;
+	vec4 Normal;
+	vec4 WorldPos;
+	vec3 SurfacePos;
+	vec3 SurfaceNormal;
+	vec2 NormalMapUV;
+	flat int ViewIndex;
+} vertices[];
+
+out VertexData
+{
+	vec4 Color;
+	vec4 Normal;
+	vec4 WorldPos;
+	vec3 SurfacePos;
+	vec3 SurfaceNormal;
+	vec2 NormalMapUV;
+	flat int ViewIndex;
+};
+
+void main()
+{
+	int view = gl_InvocationID;
+	if (view >= viewCount || (viewMask & (1u << view)) == 0u)
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		Color = vertices[i].Color;
+		SurfacePos = vertices[i].SurfacePos;
+		SurfaceNormal = vertices[i].SurfaceNormal;
+		NormalMapUV = vertices[i].NormalMapUV;
+		WorldPos = viewProjMats[view] * vec4(SurfacePos, 1.0);
+		Normal = projMats[view] * vec4(SurfaceNormal, 0.0);
+		ViewIndex = view;
+
+		gl_Position = WorldPos;
+		gl_ViewportIndex = view;
+		EmitVertex();
+	}
+	EndPrimitive();
+}
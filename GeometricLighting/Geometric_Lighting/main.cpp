@@ -59,12 +59,156 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *	Init_Shader
 *	- Contains static functions for reading, compiling and linking shaders.
 *
+*	FrameCapture
+*	- Reads finished frames back from the GPU through a ring of pixel buffer objects. A read back is only mapped once its fence
+*	has signaled a few frames later, so capturing never stalls the render loop. Frames are handed to a background encoder thread
+*	that writes screenshots and feeds any registered CaptureSinks. Press P for a screenshot.
+*
+*	VideoCapture
+*	- A CaptureSink that records every captured frame to a raw .y4m video. Frames are only queued on the capture thread; a worker
+*	thread converts them from RGBA to YUV 4:2:0 with SSE2 and streams them to disk. When the worker can't keep up, frames are
+*	dropped or the queue blocks according to its BackpressurePolicy. Press C to start and stop recording.
+*
+*	MeshExporter
+*	- Streams tessellated patches to OBJ, binary PLY or binary glTF (.glb), optionally welding the vertices along patch seams.
+*	Patches are tessellated and formatted in parallel a batch at a time, so exports of huge models use a fixed amount of memory.
+*	Welding only remembers the seams of the last few batches, so patches far apart in the file keep their own seam vertices.
+*	Run with --export <file> [--res N] [--weld [--weld-window N]] [--copies N] to export the teapot (or N copies of it) without
+*	opening a window.
+*
+*	MeshImporter / MeshShape
+*	- Memory maps OBJ and PLY files, parses them in parallel chunks and builds an indexed, deduplicated vertex buffer in the same
+*	position/normal layout as Patch, which MeshShape uploads so imported meshes are drawn with the same lighting. Run with
+*	--import <file> to show a mesh next to the teapot, or --import-bench <file> to just measure parse throughput.
+*
+*	PatchFitter / BptFile
+*	- Fits bicubic Bezier patches to a dense mesh: faces are grouped by orientation and a grid into height field regions, each
+*	region gets a least squares patch, and neighboring patches are joined with matching tangents. BptFile reads and writes the
+*	same .bpt text format the teapot data comes from. Run with --fit <mesh> <out.bpt> [--cells N] to convert a mesh, and
+*	--bpt <file> to draw a patch file in place of the teapot.
+*
+*	TerrainManager / TerrainStore
+*	- Draws a large heightfield made of a grid of bicubic patches through a quadtree. Nodes near the camera are split into
+*	finer ones, which loader threads tessellate in the background from control point pages read on demand; the node vertex
+*	buffer and the page cache both stay within a fixed memory budget. Run with --terrain <file> [--terrain-size N] to show a
+*	terrain under the teapot (the file is generated first if it doesn't exist), or --terrain-gen <file> to only generate one.
+*
+*	CurveBatch / CurveTessellator
+*	- Tessellates thousands of cubic Bezier curves into camera facing ribbons or tubes, four curves at a time in SIMD lanes on
+*	worker threads, into one vertex buffer drawn with a single call. Run with --curves N [--tubes] to grow N strands around the
+*	teapot, or --curve-bench N to measure tessellation throughput in curves per millisecond.
+*
+*	PagedModel / PatchPager / PatchDatabase
+*	- Draws patch models far larger than memory. The database file groups patches into spatially compact pages along a Morton
+*	curve; each frame the pages in the view frustum are drawn from an LRU cache of resident pages, while I/O threads read and
+*	tessellate nearby ones ahead of the camera. Run with --page-build <file> [--copies N] to write N teapots into a database,
+*	--paged <file> to draw one, or --page-bench <file> to fly over it without a window and report stalls and residency.
+*
+*	SplineManager / DynamicBVH
+*	- Keeps every B_Spline in a bounding volume tree that is updated in place as splines move: leaves are placed by the surface
+*	area heuristic and tree rotations keep it tight. Only splines in the view frustum are drawn, and space picks the spline at
+*	the middle of the screen. Run with --teapots N to add N spinning teapots around the first, or --bvh-bench N to time
+*	inserts, updates, frustum, ray and overlap queries on N moving boxes against a plain loop over all of them.
+*
+*	RenderFarm / TileRenderer
+*	- Renders a turntable of the teapot (or the --bpt file) offline, split into tiles handed out to worker processes through a
+*	job directory: workers steal tiles from each other's queues when they run dry, tiles of workers that die are rendered
+*	again, and the frames are put together as TGA files at the end. Tiles are drawn on the CPU with the same lighting as
+*	fShader.glsl. Run with --farm <dir> [--farm-workers N] [--farm-frames N] [--farm-tile N] [--farm-fail P] [--farm-lease S] to render,
+*	--farm-scale <dir> N to measure throughput with 1 up to N workers, or --farm-worker <dir> <index> to join a job from
+*	another host sharing the directory.
+*
+*	TessellationService / TessellationClient
+*	- Tessellates patches for other processes on the same machine. Clients send control points over a Unix domain socket and
+*	read the vertices straight out of the service's shared memory; requests that arrive together are tessellated together
+*	across all cores, and results are cached by content until memory runs short. Run with --tess-serve <socket> [--tess-memory MB]
+*	to serve, and --tess-bench <socket> [--tess-clients N] [--tess-requests N] to measure latency and throughput from N
+*	client threads (the benchmark stops the service when it is done so it prints its own statistics).
+*
+*	Telemetry
+*	- Serves frame timings, counters, memory use and profiler scopes of the running viewer as JSON lines on a Unix domain
+*	socket, for monitoring from another process. Collection never blocks the render thread and is skipped entirely while
+*	nobody is connected. Run with --telemetry <socket> to serve; --telemetry-poll <socket> prints the latest frame and
+*	--telemetry-watch <socket> [--telemetry-every N] [--telemetry-lines N] streams them. --telemetry-bench <socket> measures
+*	what the instrumentation costs a frame with and without a client connected.
+*
+*	LightProbeGrid
+*	- Lights the splines with the light bouncing between them. A grid of probes traces rays against the splines in the bounding
+*	volume tree on worker threads and keeps what they see as spherical harmonics in 3D textures, which fShader.glsl blends
+*	between in place of its flat ambient light. Probes near splines or lights that change are rebaked a few at a time each frame.
+*	Run with --probes [--probe-rays N] to turn them on (best with --teapots N, so there is something to bounce light off).
+*
+*	LightManager / LTCFitter
+*	- Area lights: rectangles and disks that light the scene with GGX specular and diffuse shading through linearly transformed
+*	cosines. The lookup tables the shader needs are fitted on worker threads the first time and cached in ltc_ggx.bin. Run with
+*	--area-lights [--roughness R] [--ltc <file>] to add a panel beside the teapot and a disk above it, or --ltc-fit <file>
+*	[--ltc-size N] to only fit and save the tables.
+*
+*	NormalMapBaker
+*	- Bakes what a fine tessellation of each patch adds to the coarse one it is drawn with into tangent space normal maps, packed
+*	into an atlas on worker threads four texels at a time. The shaders take each vertex's (u, v) from its index and rebuild the
+*	tangent frame from screen space derivatives, so the vertex format is unchanged. Run with --normal-maps [--normal-tile N]
+*	[--normal-detail N] to bake them for the teapot.
+*
+*	RenderContext
+*	- Creates the GL context: the usual GLFW window, or for machines without a display a surfaceless EGL or an OSMesa context
+*	drawing into a framebuffer object, with input left out. Run with --headless egl|osmesa [--frames N] [--size W H]
+*	[--headless-shot <file>] to render N frames without a window, report the frame rate and optionally save the last frame.
+*
+*	SceneFile / SceneLoader / SceneManager
+*	- Scene descriptions listing models (.bpt, .obj, .ply or the built-in teapot), materials, instances with their transforms,
+*	area lights and cameras. Loader threads stream the models in, those with instances in view and nearest the camera first,
+*	and SceneManager turns a few finished instances into splines and shapes each frame, so drawing starts right away and
+*	the scene fills in around it. Run with --scene <file> [--scene-camera N] [--scene-rate N] [--scene-threads N] to draw a
+*	scene in place of the teapot and report the time to the first frame and to the complete scene, or --scene-gen <file> N to
+*	write a scene of N teapots.
+*
+*	PatchEvaluator / WorkerPool
+*	- The GL-free Bernstein evaluation and bounds used by Patch, and a small thread pool for spreading CPU work across cores.
+*
+*	PatchKernelSelector
+*	- PatchEvaluator can also evaluate a patch from its power basis coefficients, by Horner's rule or by forward differencing
+*	along each row of the grid. Patch draws with the Bernstein kernel unless --eval-select asks for a pick at startup: each
+*	kernel is then timed and checked against the Bernstein sums on the patches about to be drawn (the teapot or the --bpt
+*	file) at the resolution they are drawn at, and Patch uses the fastest one that stays within tolerance. Pages of the
+*	patch database and exports are tessellated in batches instead, four patches at a time in SIMD lanes, which keeps every
+*	lane busy on the small grids of distant geometry. Run with --eval-bench to compare the kernels from 4x4 to 256x256 grids
+*	and the batches against single patches, or --eval-kernel bernstein|power|forward to force a kernel.
+*	PatchEvaluator also bounds how far a grid's triangles can be from the surface, from the second differences of the control
+*	net, and from that picks the smallest resolution each patch needs for a tolerance. Run with --lod-report [tolerance] to
+*	see the levels the teapot's patches get and the triangles saved against one resolution for all of them; without a
+*	tolerance the accuracy of the resolution patches are drawn at is used. Patch_Tessellator --tolerance writes such levels
+*	into mesh assets.
+*
+*	CameraManager views
+*	- With --quad-view the window is split into top, front and side views, orthographic around the camera's target, and the
+*	usual orbiting camera. Culling walks the spline tree once for all four frusta, dropping each view below the nodes it
+*	can't see and testing no further under nodes a view sees whole, and leaves every spline with a mask of the views it is
+*	in. Each shape is still drawn with one call: a geometry shader with an invocation per view takes the world space
+*	triangles into each view's matrices and viewport, skipping the views the mask leaves out. Without --quad-view the
+*	geometry shader isn't linked and drawing is as before.
+*
+*	GLState
+*	- Every bind, uniform and delete goes through a cache of the program, vertex array, buffer and texture bindings and each
+*	program's uniform values, which drops the calls that would set what is already set. Patches of one spline share their
+*	matrices and color, so most of their uniforms never reach the driver. The counts of issued and filtered calls are
+*	printed on exit; run with --no-state-cache to pass every call through for comparison.
+*
+*	geometry_core
+*	- Everything that doesn't touch GL (evaluation, tessellation, bounds, the BVH and frustum queries, the importers, exporters,
+*	fitters and bakers) builds into a static library of its own with the CMakeLists.txt next to the solution, on any platform
+*	with a C++11 compiler. Patch, B_Spline, MeshShape and the other RenderShapes are the GL side on top of it. The same
+*	CMakeLists.txt builds Patch_Tessellator, and this example too where OpenGL, GLEW and GLFW are installed.
+*
 *
 *	SHADERS
 *
 *	vShader.glsl
 *	- Simple through shader, applies transforms to verts and normals before passing them through to the fragment shader.
 *
+*	gShader.glsl
+*	- Only linked in with several views, and draws every triangle into each of them. See CameraManager views above.
+*
 *	fShader.glsl
 *	- Uses a hard-coded point-light to apply the color of the light to the current fragment based on lambert's law of cosines.
 *	see: http://en.wikipedia.org/wiki/Lambert's_cosine_law
@@ -75,16 +219,30 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 *	Since the light expands in a sphere and the area of a sphere equals 4 * pi * radius^2, we can simply say that the intensity of the light
 *	at a given distance from the source equals the base intensity of the light divided by the square of the distance from the light.
 *	So Ldiffuse = clamp(Normal dot L, 0, 1) * diffuseColor * diffusePower / distance^2;
+*	With light probes on, the flat ambient light is replaced by the irradiance from the probe grid for the fragment's world position
+*	and normal.
+*	Patches with a normal map shade with the normal from it in place of the interpolated one.
+*	Area lights add the integral of the BRDF over each light's polygon, computed in closed form in the lookup table's cosine space.
 */
 
-#include <GLEW\GL\glew.h>
-#include <GLFW\glfw3.h>
-#include <GLM\gtc\type_ptr.hpp>
-#include <GLM\gtc\matrix_transform.hpp>
-#include <GLM\gtc\quaternion.hpp>
-#include <GLM\gtc\random.hpp>
+#include <GLEW/GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <GLM/gtc/type_ptr.hpp>
+#include <GLM/gtc/matrix_transform.hpp>
+#include <GLM/gtc/quaternion.hpp>
+#include <GLM/gtc/random.hpp>
 #include <iostream>
 #include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <random>
 
 #include "RenderShape.h"
 #include "Init_Shader.h"
@@ -93,8 +251,30 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "B-Spline.h"
 #include "Patch.h"
 #include "CameraManager.h"
+#include "FrameCapture.h"
+#include "VideoCapture.h"
+#include "MeshExporter.h"
+#include "MeshShape.h"
+#include "PatchFitter.h"
+#include "BptFile.h"
+#include "TerrainManager.h"
+#include "CurveBatch.h"
+#include "PagedModel.h"
+#include "SplineManager.h"
+#include "RenderFarm.h"
+#include "TessellationService.h"
+#include "TessellationClient.h"
+#include "Telemetry.h"
+#include "LightProbeGrid.h"
+#include "LightManager.h"
+#include "NormalMapBaker.h"
+#include "RenderContext.h"
+#include "SceneManager.h"
+#include "PatchEvaluator.h"
+#include "PatchKernelSelector.h"
+#include "WorkerPool.h"
+#include "GLState.h"
 
-GLFWwindow* window;
 
 // Shader buffer pointers
 GLuint vertexShader;
@@ -105,7 +285,21 @@ GLuint shaderProgram;
 GLint uMPMat;
 GLint uMPVMat;
 GLint uColor;
+GLint uNormalMapRect;
+GLint uViewMask;
 
+// The program initShaders built and its uniform locations, for everything drawn with it
+Shader currentShader()
+{
+	Shader shader;
+	shader.shaderPointer = shaderProgram;
+	shader.uMPMat = uMPMat;
+	shader.uMPVMat = uMPVMat;
+	shader.uColor = uColor;
+	shader.uNormalMapRect = uNormalMapRect;
+	shader.uViewMask = uViewMask;
+	return shader;
+}
 
 // Source http://www.holmes3d.net/graphics/teapot/teapotCGA.bpt
 GLfloat teapotControlPoints[] = {
@@ -252,17 +446,90 @@ GLfloat teapotControlPoints[] = {
 #pragma endregion
 };
 
-B_Spline* teapot;
+B_Spline* teapot = nullptr;
+
+// Total time since startup, used to timestamp captured frames
+double elapsedTime = 0.0;
+unsigned int screenshotCount = 0;
+
+// Mesh to load next to the teapot, from the command line
+const char* importFile = nullptr;
+
+// Patch file to draw instead of the teapot, from the command line
+const char* bptFile = nullptr;
+
+// Terrain to draw under the teapot, from the command line
+const char* terrainFile = nullptr;
+int terrainSize = 1024;
+
+// Strands growing around the teapot, from the command line
+CurveBatch* curves = nullptr;
+int numCurves = 0;
+CurveStyle curveStyle = CurveStyle::Ribbon;
+
+// More teapots scattered around the first, from the command line
+std::vector<B_Spline*> teapots;
+int numTeapots = 0;
+
+// Top, front, side and perspective views at once, from the command line
+bool quadView = false;
+
+// Out-of-core patch database to draw, from the command line
+const char* pagedFile = nullptr;
+PagedModel* pagedModel = nullptr;
+
+// Irradiance probes around the teapot, from the command line
+bool lightProbes = false;
+LightProbeSettings probeSettings;
+
+// Area lights beside the teapot, from the command line
+bool areaLights = false;
+AreaLightSettings areaLightSettings;
+
+// The window, or a headless context and what to do with it, from the command line
+RenderContextSettings contextSettings;
+const char* headlessScreenshot = nullptr;
+
+// Normal maps for the teapot's coarse tessellation, from the command line
+bool normalMaps = false;
+NormalMapBakeSettings normalMapSettings;
+GLuint normalMapTexture = 0;
+
+// Follows the LTC tables
+const int NORMAL_MAP_TEXTURE_UNIT = LightManager::LTC_TEXTURE_UNIT + 2;
+
+// Scene to stream in place of the teapot, from the command line
+const char* sceneFile = nullptr;
+SceneSettings sceneSettings;
+
+// Time and check the evaluation kernels at startup and draw with the best, from the command line
+bool evalSelect = false;
+
+// Where to serve live telemetry, from the command line
+const char* telemetrySocket = nullptr;
+VideoCapture* video = nullptr;
 
 
 // Instantiates the teapot b-spline and sends the teapot control point data to it
 void generateTeapot()
 {
-	Shader shader;
-	shader.shaderPointer = shaderProgram;
-	shader.uMPMat = uMPMat;
-	shader.uMPVMat = uMPVMat;
-	shader.uColor = uColor;
+	Shader shader = currentShader();
+
+	std::vector<glm::vec3> controlPoints;
+	if (bptFile)
+	{
+		if (BptFile::Load(bptFile, controlPoints))
+		{
+			int numPatches = (int)controlPoints.size() / 16;
+			teapot = new B_Spline(shader, numPatches);
+			for (int i = 0; i < numPatches; ++i)
+				teapot->SetControlPoints(i, &controlPoints[i * 16]);
+
+			teapot->transform().position = glm::vec3(0.0f, -1.5f, 0.0f);
+			return;
+		}
+		std::cout << "Failed to load " << bptFile << ", drawing the teapot instead" << std::endl;
+	}
 
 	teapot = new B_Spline(shader, 28);
 
@@ -295,51 +562,1306 @@ void generateTeapot()
 	teapot->transform().position = glm::vec3(0.0f, -1.5f, 0.0f);
 }
 
+// Loads the mesh given with --import and sits it next to the teapot, scaled to a similar size
+void importMesh()
+{
+	Shader shader = currentShader();
+
+	ImportedMesh mesh;
+	MeshImportStats stats;
+	if (!MeshImporter::Load(importFile, mesh, &stats))
+	{
+		std::cout << "Failed to import " << importFile << std::endl;
+		return;
+	}
+	MeshShape* shape = MeshShape::Create(mesh, shader, glm::vec4(0.6f, 0.6f, 0.6f, 1.0f));
+	MeshImporter::PrintStats(stats);
+
+	glm::vec3 extent = mesh.maxPos - mesh.minPos;
+	float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+	float scale = largest > 0.0f ? 2.0f / largest : 1.0f;
+	glm::vec3 center = (mesh.minPos + mesh.maxPos) * 0.5f;
+
+	shape->transform().scale = glm::vec3(scale, scale, scale);
+	shape->transform().position = glm::vec3(3.5f, -1.5f + extent.y * scale * 0.5f, 0.0f) - center * scale;
+}
+
+// Fills in the 16 control points of one teapot patch. Patches past the 28th belong to further copies
+// of the teapot laid out on a grid, which makes arbitrarily large models for benchmarking.
+void teapotPatch(int patch, glm::vec3* controlPoints)
+{
+	int copy = patch / 28;
+	int gridSize = (int)ceil(sqrt((double)copy + 1.0));
+	glm::vec3 offset = glm::vec3((copy % gridSize) * 7.0f, 0.0f, (copy / gridSize) * 7.0f);
+
+	int k = (patch % 28) * 48;
+	for (int i = 0; i < 16; ++i, k += 3)
+	{
+		controlPoints[i] = glm::vec3(teapotControlPoints[k], teapotControlPoints[k + 1], teapotControlPoints[k + 2]) + offset;
+	}
+}
+
+// Adds the teapots asked for with --teapots on a ring of rings around the first one, each spinning
+// at its own rate so their bounds keep changing
+void scatterTeapots()
+{
+	Shader shader = currentShader();
+
+	glm::vec3 controlPoints[16];
+	for (int n = 0; n < numTeapots; ++n)
+	{
+		B_Spline* copy = new B_Spline(shader, 28);
+		for (int i = 0; i < 28; ++i)
+		{
+			teapotPatch(i, controlPoints);
+			copy->SetControlPoints(i, controlPoints);
+		}
+
+		float radius = 7.0f + 7.0f * sqrt((float)n);
+		float angle = n * 137.5f;
+		copy->transform().position = glm::vec3(radius * cos(glm::radians(angle)), -1.5f, radius * sin(glm::radians(angle)));
+		copy->transform().rotation = glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+		copy->transform().angularVelocity = glm::angleAxis(glm::linearRand(-90.0f, 90.0f), glm::normalize(glm::vec3(0.3f, 1.0f, 0.0f)));
+
+		SplineManager::Add(copy);
+		teapots.push_back(copy);
+	}
+}
+
+// The models a scene file can name with @
+bool builtinModel(const std::string& name, SceneAsset& asset)
+{
+	if (name != "teapot")
+		return false;
+
+	asset.controlPoints.resize(28 * 16);
+	for (int i = 0; i < 28; ++i)
+		teapotPatch(i, &asset.controlPoints[i * 16]);
+	return true;
+}
+
+// Baked once every spline is in place
+void bakeLightProbes()
+{
+	LightProbeGrid::Init(probeSettings, std::vector<ProbeLight>(1));
+	std::cout << "Baked " << LightProbeGrid::Stats().probes << " light probes in " << LightProbeGrid::Stats().fullBakeSeconds * 1000.0 << " ms" << std::endl;
+}
+
+// Bakes normal maps for the teapot against the resolution patches are drawn at and points every
+// patch at its tile. The scattered teapots have the same patches, so they share the maps.
+void bakeNormalMaps()
+{
+	std::vector<glm::vec3> controlPoints(teapot->numPatches() * 16);
+	for (int i = 0; i < teapot->numPatches(); ++i)
+		std::copy(teapot->patch(i)->controlPoints(), teapot->patch(i)->controlPoints() + 16, &controlPoints[i * 16]);
+
+	normalMapSettings.lowResolution = Patch::NUM_VERTS;
+	NormalMapAtlas atlas;
+	NormalMapBakeStats stats;
+	if (!NormalMapBaker::Bake(&controlPoints[0], teapot->numPatches(), normalMapSettings, atlas, &stats))
+		return;
+	NormalMapBaker::PrintStats(stats);
+
+	GLState::ActiveTexture(GL_TEXTURE0 + NORMAL_MAP_TEXTURE_UNIT);
+	glGenTextures(1, &normalMapTexture);
+	GLState::BindTexture(GL_TEXTURE_2D, normalMapTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas.width, atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &atlas.texels[0]);
+	GLState::ActiveTexture(GL_TEXTURE0);
+
+	GLState::UseProgram(shaderProgram);
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "normalMapResolution"), Patch::NUM_VERTS);
+
+	for (int i = 0; i < teapot->numPatches(); ++i)
+		teapot->patch(i)->shape()->normalMapRect() = atlas.TileRect(i);
+	for (size_t t = 0; t < teapots.size() && !bptFile; ++t)
+		for (int i = 0; i < teapots[t]->numPatches(); ++i)
+			teapots[t]->patch(i)->shape()->normalMapRect() = atlas.TileRect(i);
+}
+
+// Writes a procedural terrain of terrainSize x terrainSize patches
+bool generateTerrain(const char* fileName)
+{
+	std::cout << "Generating a " << terrainSize << " x " << terrainSize << " patch terrain in " << fileName << std::endl;
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	if (!TerrainStore::Generate(fileName, terrainSize))
+		return false;
+	std::cout << "  done in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << " s" << std::endl;
+	return true;
+}
+
+// Opens the terrain given with --terrain, generating it first if the file doesn't exist yet
+void loadTerrain()
+{
+	Shader shader = currentShader();
+
+	std::ifstream existing(terrainFile, std::ios::binary);
+	bool exists = existing.good();
+	existing.close();
+	if (!exists && !generateTerrain(terrainFile))
+	{
+		std::cout << "Failed to generate " << terrainFile << std::endl;
+		return;
+	}
+
+	TerrainSettings settings;
+	settings.center = glm::vec3(0.0f, -2.0f, 0.0f);
+	if (!TerrainManager::Init(terrainFile, shader, settings))
+		std::cout << "Failed to load " << terrainFile << std::endl;
+}
+
+// Fills in a strand rising from a random point on a ring around the teapot and bending over
+void strandCurve(glm::vec3* controlPoints, float* radii)
+{
+	float angle = glm::linearRand(0.0f, 360.0f);
+	float distance = glm::linearRand(2.0f, 3.5f);
+	float height = glm::linearRand(0.4f, 1.2f);
+	glm::quat around = glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::vec3 bend = around * glm::vec3(0.0f, 0.0f, glm::linearRand(-0.6f, 0.6f));
+
+	glm::vec3 root = around * glm::vec3(distance, 0.0f, 0.0f) + glm::vec3(0.0f, -1.5f, 0.0f);
+	controlPoints[0] = root;
+	controlPoints[1] = root + glm::vec3(0.0f, height * 0.4f, 0.0f);
+	controlPoints[2] = root + glm::vec3(0.0f, height * 0.8f, 0.0f) + bend * 0.5f;
+	controlPoints[3] = root + glm::vec3(0.0f, height, 0.0f) + bend;
+	radii[0] = 0.01f;
+	radii[1] = 0.002f;
+}
+
+// Adds the strands asked for with --curves
+void generateCurves()
+{
+	Shader shader = currentShader();
+
+	CurveTessellationOptions options;
+	options.style = curveStyle;
+	curves = new CurveBatch(shader, numCurves, options, glm::vec4(0.4f, 0.6f, 0.3f, 1.0f));
+
+	glm::vec3 controlPoints[4];
+	float radii[2];
+	for (int i = 0; i < numCurves; ++i)
+	{
+		strandCurve(controlPoints, radii);
+		curves->SetCurve(i, controlPoints[0], controlPoints[1], controlPoints[2], controlPoints[3], radii[0], radii[1]);
+	}
+}
+
+// Times tessellating count strands as ribbons and tubes, on one thread and on all of them
+void benchmarkCurves(int count)
+{
+	std::vector<glm::vec3> controlPoints(count * 4);
+	std::vector<float> radii(count * 2);
+	for (int i = 0; i < count; ++i)
+		strandCurve(&controlPoints[i * 4], &radii[i * 2]);
+
+	WorkerPool pool;
+	CurveStyle styles[] = { CurveStyle::Ribbon, CurveStyle::Tube };
+	for (int s = 0; s < 2; ++s)
+	{
+		CurveTessellationOptions options;
+		options.style = styles[s];
+		options.cameraPos = glm::vec3(0.0f, 0.0f, -5.0f);
+		std::vector<float> verts((size_t)count * CurveTessellator::NumVerts(options) * PatchEvaluator::FLOATS_PER_VERT);
+
+		for (int threaded = 0; threaded < 2; ++threaded)
+		{
+			const int runs = 10;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; ++run)
+			{
+				if (threaded)
+					CurveTessellator::Tessellate(pool, controlPoints.data(), radii.data(), count, options, verts.data());
+				else
+					CurveTessellator::Tessellate(controlPoints.data(), radii.data(), count, options, verts.data());
+			}
+			double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+			std::cout << (s == 0 ? "Ribbons" : "Tubes") << ", " << (threaded ? pool.numThreads() : 1) << " thread(s): "
+				<< count * runs / (seconds * 1000.0) << " curves/ms (" << CurveTessellator::NumVerts(options) << " vertices each)" << std::endl;
+		}
+	}
+}
+// Opens the patch database given with --paged
+void loadPagedModel()
+{
+	Shader shader = currentShader();
+
+	pagedModel = new PagedModel();
+	if (!pagedModel->Open(pagedFile, shader, PatchPagerSettings()))
+	{
+		std::cout << "Failed to load " << pagedFile << std::endl;
+		delete pagedModel;
+		pagedModel = nullptr;
+	}
+}
+
+// Flies a camera across a patch database without drawing anything, to see how well paging
+// keeps up: once with pages loaded on demand, once with misses skipped until they arrive
+void benchmarkPaging(const char* fileName)
+{
+	bool stallModes[] = { true, false };
+	for (int m = 0; m < 2; ++m)
+	{
+		PatchPagerSettings settings;
+		settings.stallOnMiss = stallModes[m];
+		settings.budgetBytes = 64 * 1024 * 1024;
+
+		PatchPager pager;
+		if (!pager.Open(fileName, settings))
+		{
+			std::cout << "Failed to open " << fileName << std::endl;
+			return;
+		}
+
+		// Low over the model from one corner to the other, looking ahead and down
+		glm::vec3 minPos = pager.database().minPos();
+		glm::vec3 maxPos = pager.database().maxPos();
+		glm::vec3 start = glm::vec3(minPos.x, maxPos.y + 4.0f, minPos.z);
+		glm::vec3 end = glm::vec3(maxPos.x, maxPos.y + 4.0f, maxPos.z);
+		glm::mat4 projMat = glm::perspective(60.0f, 800.0f / 600.0f, 0.1f, 150.0f);
+
+		const int frames = 600;
+		std::vector<std::shared_ptr<const ResidentPage> > visible;
+		std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+		double worstFrame = 0.0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			std::chrono::high_resolution_clock::time_point frameStart = std::chrono::high_resolution_clock::now();
+
+			float t = frame / (float)(frames - 1);
+			glm::vec3 eye = glm::mix(start, end, t);
+			glm::vec3 ahead = eye + glm::normalize(end - start) * 10.0f - glm::vec3(0.0f, 4.0f, 0.0f);
+			glm::mat4 viewMat = glm::lookAt(eye, ahead, glm::vec3(0.0f, 1.0f, 0.0f));
+			pager.Update(eye, projMat * viewMat, visible);
+
+			// Pretend to render at 60 frames per second so the loaders get time to work
+			std::this_thread::sleep_until(frameStart + std::chrono::microseconds(16667));
+			worstFrame = std::max(worstFrame, std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - frameStart).count());
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - begin).count();
+
+		std::cout << (stallModes[m] ? "Stalling on misses: " : "Skipping misses: ") << frames << " frames in " << seconds << " s, worst frame "
+			<< worstFrame * 1000.0 << " ms" << std::endl;
+		pager.PrintStats();
+	}
+}
+// Times the scene tree on count boxes drifting through a cube, against looping over all of them
+void benchmarkBVH(int count)
+{
+	typedef std::chrono::high_resolution_clock Clock;
+	float worldSize = 10.0f * pow((float)count, 1.0f / 3.0f);
+
+	srand(1);
+	std::vector<glm::vec3> centers(count), halfSizes(count), velocities(count);
+	for (int i = 0; i < count; ++i)
+	{
+		centers[i] = glm::linearRand(glm::vec3(0.0f), glm::vec3(worldSize));
+		halfSizes[i] = glm::linearRand(glm::vec3(0.5f), glm::vec3(2.0f));
+		velocities[i] = glm::linearRand(glm::vec3(-0.3f), glm::vec3(0.3f));
+	}
+
+	DynamicBVH* tree = nullptr;
+	std::vector<int> proxies(count);
+	bool rotateModes[] = { false, true };
+	for (int m = 0; m < 2; ++m)
+	{
+		delete tree;
+		tree = new DynamicBVH(0.1f, rotateModes[m]);
+		std::vector<glm::vec3> positions = centers;
+
+		Clock::time_point start = Clock::now();
+		for (int i = 0; i < count; ++i)
+			proxies[i] = tree->Insert(positions[i] - halfSizes[i], positions[i] + halfSizes[i], nullptr);
+		double insertSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		DynamicBVHStats built = tree->Stats();
+
+		const int frames = 20;
+		start = Clock::now();
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				positions[i] += velocities[i];
+				tree->Move(proxies[i], positions[i] - halfSizes[i], positions[i] + halfSizes[i], velocities[i]);
+			}
+		}
+		double moveSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+		DynamicBVHStats moved = tree->Stats();
+
+		std::cout << (rotateModes[m] ? "With rotations: " : "Without rotations: ") << count << " inserts in " << insertSeconds * 1000.0 << " ms ("
+			<< insertSeconds * 1e6 / count << " us each), height " << built.height << ", SAH cost " << built.sahCost << std::endl;
+		std::cout << "  " << frames << " frames moving every box, " << moveSeconds * 1000.0 / frames << " ms per frame, then height "
+			<< moved.height << ", SAH cost " << moved.sahCost << std::endl;
+		DynamicBVH::PrintStats(moved);
+	}
+
+	// Queries on the tree with rotations, checked against a loop over every leaf box
+	glm::mat4 projMat = glm::perspective(60.0f, 800.0f / 600.0f, 0.1f, 100.0f);
+	const int views = 100;
+	std::vector<int> found;
+	double treeSeconds = 0.0, loopSeconds = 0.0;
+	size_t treeVisible = 0, loopVisible = 0;
+	for (int v = 0; v < views; ++v)
+	{
+		glm::vec3 eye = glm::linearRand(glm::vec3(0.0f), glm::vec3(worldSize));
+		glm::vec3 target = eye + glm::sphericalRand(1.0f);
+		Frustum frustum;
+		frustum.FromMatrix(projMat * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+		found.clear();
+		Clock::time_point start = Clock::now();
+		tree->QueryFrustum(frustum, found);
+		treeSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+		treeVisible += found.size();
+
+		start = Clock::now();
+		for (int i = 0; i < count; ++i)
+		{
+			const BVHNode& leaf = tree->node(proxies[i]);
+			if (frustum.IntersectsBox(leaf.minPos, leaf.maxPos))
+				loopVisible++;
+		}
+		loopSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	std::cout << "Frustum: " << treeSeconds * 1e6 / views << " us per query against " << loopSeconds * 1e6 / views << " us looping, "
+		<< treeVisible / views << " visible on average" << (treeVisible == loopVisible ? "" : " (MISMATCH)") << std::endl;
+
+	// Four views of the same spot from different sides, as the quad layout has, in one walk of
+	// the tree against one walk for each. Each way goes through every view before the other
+	// starts, so neither finds the nodes already in cache.
+	std::vector<Frustum> frusta(views * 4);
+	for (int v = 0; v < views; ++v)
+	{
+		glm::vec3 target = glm::linearRand(glm::vec3(0.0f), glm::vec3(worldSize));
+		for (int f = 0; f < 4; ++f)
+		{
+			glm::vec3 eye = target + glm::sphericalRand(worldSize * 0.1f);
+			frusta[v * 4 + f].FromMatrix(projMat * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+		}
+	}
+
+	std::vector<unsigned int> masks;
+	size_t oneWalkVisible = 0, fourWalkVisible = 0, unionVisible = 0;
+	Clock::time_point start = Clock::now();
+	for (int v = 0; v < views; ++v)
+	{
+		found.clear();
+		masks.clear();
+		tree->QueryFrusta(&frusta[v * 4], 4, found, masks);
+		unionVisible += found.size();
+		for (size_t i = 0; i < masks.size(); ++i)
+			for (int f = 0; f < 4; ++f)
+				oneWalkVisible += (masks[i] >> f) & 1;
+	}
+	double oneWalkSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	start = Clock::now();
+	for (int f = 0; f < views * 4; ++f)
+	{
+		found.clear();
+		tree->QueryFrustum(frusta[f], found);
+		fourWalkVisible += found.size();
+	}
+	double fourWalkSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << "Four frusta: " << oneWalkSeconds * 1e6 / views << " us in one walk against " << fourWalkSeconds * 1e6 / views << " us in four, "
+		<< unionVisible / views << " visible in any on average" << (oneWalkVisible == fourWalkVisible ? "" : " (MISMATCH)") << std::endl;
+
+	const int rays = 200;
+	treeSeconds = loopSeconds = 0.0;
+	int mismatches = 0, hits = 0;
+	for (int r = 0; r < rays; ++r)
+	{
+		glm::vec3 origin = glm::linearRand(glm::vec3(0.0f), glm::vec3(worldSize));
+		glm::vec3 direction = glm::sphericalRand(1.0f);
+
+		float distance;
+		Clock::time_point start = Clock::now();
+		int hit = tree->RayCast(origin, direction, worldSize, distance);
+		treeSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+		// The nearest box entered along the ray
+		start = Clock::now();
+		float nearest = worldSize;
+		glm::vec3 invDirection = 1.0f / direction;
+		for (int i = 0; i < count; ++i)
+		{
+			const BVHNode& leaf = tree->node(proxies[i]);
+			glm::vec3 t0 = (leaf.minPos - origin) * invDirection, t1 = (leaf.maxPos - origin) * invDirection;
+			glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+			float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+			float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, nearest));
+			if (enter <= exit && enter < nearest)
+				nearest = enter;
+		}
+		loopSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+		if (hit >= 0)
+			hits++;
+		if ((hit >= 0) != (nearest < worldSize) || (hit >= 0 && fabs(distance - nearest) > 1e-4f))
+			mismatches++;
+	}
+	std::cout << "Rays: " << treeSeconds * 1e6 / rays << " us per ray against " << loopSeconds * 1e6 / rays << " us looping, " << hits << " of "
+		<< rays << " hit, " << mismatches << " mismatches" << std::endl;
+
+	std::vector<std::pair<int, int> > pairs;
+	start = Clock::now();
+	tree->QueryPairs(pairs);
+	std::cout << "Pairs: " << pairs.size() << " overlapping in " << std::chrono::duration<double>(Clock::now() - start).count() * 1000.0 << " ms" << std::endl;
+
+	start = Clock::now();
+	for (int i = 0; i < count; i += 2)
+		tree->Remove(proxies[i]);
+	std::cout << "Removed " << (count + 1) / 2 << " in " << std::chrono::duration<double>(Clock::now() - start).count() * 1000.0 << " ms" << std::endl;
+	DynamicBVH::PrintStats(tree->Stats());
+	delete tree;
+}
+
+// The patches the render farm draws: the --bpt file if there is one, the teapot otherwise
+std::vector<glm::vec3> farmScene()
+{
+	std::vector<glm::vec3> controlPoints;
+	if (bptFile && BptFile::Load(bptFile, controlPoints))
+		return controlPoints;
+
+	controlPoints.resize(28 * 16);
+	for (int i = 0; i < 28; ++i)
+		teapotPatch(i, &controlPoints[i * 16]);
+	return controlPoints;
+}
+
+// Times every evaluation kernel on the teapot (or the --bpt file) from coarse to fine grids and
+// reports how far each is from the Bernstein sums, along with the one picked at each resolution,
+// then times batched Bernstein evaluation on the small grids
+void benchmarkEvaluation()
+{
+	std::vector<glm::vec3> controlPoints = farmScene();
+	int resolutions[] = { 4, 8, 16, Patch::NUM_VERTS, 32, 64, 128, 256 };
+	for (int i = 0; i < 8; ++i)
+		PatchKernelSelector::Select(controlPoints, resolutions[i]);
+	PatchKernelSelector::PrintResults();
+
+	// Far away patches are drawn from small grids, where evaluating several patches side by side
+	// in SIMD lanes pays off most
+	int numPatches = (int)controlPoints.size() / 16;
+	for (int i = 0; i < 4; ++i)
+	{
+		int resolution = resolutions[i];
+		size_t patchFloats = (size_t)PatchEvaluator::NumVerts(resolution) * PatchEvaluator::FLOATS_PER_VERT;
+		std::vector<float> verts(patchFloats * numPatches);
+		double seconds[2];
+		for (int batched = 0; batched < 2; ++batched)
+		{
+			const int runs = 2000;
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; ++run)
+			{
+				if (batched)
+					PatchEvaluator::TessellateBatch(controlPoints.data(), numPatches, resolution, verts.data());
+				else
+				{
+					for (int p = 0; p < numPatches; ++p)
+						PatchEvaluator::Tessellate(&controlPoints[p * 16], resolution, &verts[p * patchFloats]);
+				}
+			}
+			seconds[batched] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+		}
+		double vertices = (double)numPatches * PatchEvaluator::NumVerts(resolution);
+		std::cout << resolution << "x" << resolution << " in batches of " << PatchEvaluator::BATCH_PATCHES << " patches: " << seconds[1] * 1e9 / vertices
+			<< " ns/vertex against " << seconds[0] * 1e9 / vertices << " one patch at a time (" << seconds[0] / seconds[1] << "x)" << std::endl;
+	}
+}
+
+// Largest distance between a patch's triangles at a resolution and its surface at the same (u, v),
+// sampled a few times across every triangle, to hold ErrorBound up against
+float measuredError(const glm::vec3* controlPoints, int resolution)
+{
+	std::vector<float> verts(PatchEvaluator::NumVerts(resolution) * PatchEvaluator::FLOATS_PER_VERT);
+	PatchEvaluator::Tessellate(controlPoints, resolution, &verts[0]);
+	glm::vec3 coefficients[16];
+	PatchEvaluator::ToPowerBasis(controlPoints, coefficients);
+
+	const int samples = 4;
+	float h = 1.0f / (resolution - 1);
+	float worst = 0.0f;
+	for (int i = 0; i < resolution - 1; ++i)
+	{
+		for (int j = 0; j < resolution - 1; ++j)
+		{
+			// The cell's corners, laid out and split into triangles like GenerateElements does
+			int stride = PatchEvaluator::FLOATS_PER_VERT;
+			glm::vec3 p00 = glm::make_vec3(&verts[(j + i * resolution) * stride]);
+			glm::vec3 p01 = glm::make_vec3(&verts[(j + 1 + i * resolution) * stride]);
+			glm::vec3 p10 = glm::make_vec3(&verts[(j + (i + 1) * resolution) * stride]);
+			glm::vec3 p11 = glm::make_vec3(&verts[(j + 1 + (i + 1) * resolution) * stride]);
+			for (int a = 0; a <= samples; ++a)
+			{
+				for (int b = 0; b <= samples; ++b)
+				{
+					float x = (float)b / samples, y = (float)a / samples;
+					glm::vec3 linear = x + y <= 1.0f ? p00 + x * (p01 - p00) + y * (p10 - p00) : p11 + (1.0f - x) * (p10 - p11) + (1.0f - y) * (p01 - p11);
+
+					// coefficients[r * 4 + c] multiplies v^c u^r, u stepping along j
+					float u = (j + x) * h, v = (i + y) * h;
+					glm::vec3 row[4];
+					for (int r = 0; r < 4; ++r)
+						row[r] = ((coefficients[r * 4 + 3] * v + coefficients[r * 4 + 2]) * v + coefficients[r * 4 + 1]) * v + coefficients[r * 4];
+					glm::vec3 surface = ((row[3] * u + row[2]) * u + row[1]) * u + row[0];
+					worst = std::max(worst, glm::length(surface - linear));
+				}
+			}
+		}
+	}
+	return worst;
+}
+
+// Picks the smallest resolution each patch of the teapot (or the --bpt file) needs to stay within
+// tolerance, and compares the triangles against one resolution for all of them. Without a
+// tolerance, the accuracy Patch::NUM_VERTS gives the worst patch is used, so both come out equally
+// accurate.
+void reportErrorBounds(float tolerance)
+{
+	std::vector<glm::vec3> controlPoints = farmScene();
+	int numPatches = (int)controlPoints.size() / 16;
+	const int maxResolution = 256;
+
+	if (tolerance <= 0.0f)
+	{
+		for (int p = 0; p < numPatches; ++p)
+			tolerance = std::max(tolerance, PatchEvaluator::ErrorBound(&controlPoints[p * 16], Patch::NUM_VERTS));
+		std::cout << "Tolerance " << tolerance << ", the worst bound at " << Patch::NUM_VERTS << "x" << Patch::NUM_VERTS << std::endl;
+	}
+	else
+		std::cout << "Tolerance " << tolerance << std::endl;
+
+	unsigned long long triangles = 0;
+	int uniform = 2;
+	float worstBound = 0.0f, worstMeasured = 0.0f;
+	std::cout << "Resolutions:";
+	for (int p = 0; p < numPatches; ++p)
+	{
+		const glm::vec3* patch = &controlPoints[p * 16];
+		int resolution = PatchEvaluator::MinResolution(patch, tolerance, maxResolution);
+		triangles += PatchEvaluator::NumElements(resolution) / 3;
+		uniform = std::max(uniform, resolution);
+		worstBound = std::max(worstBound, PatchEvaluator::ErrorBound(patch, resolution));
+		worstMeasured = std::max(worstMeasured, measuredError(patch, resolution));
+		std::cout << " " << resolution;
+	}
+	std::cout << std::endl;
+
+	unsigned long long uniformTriangles = (unsigned long long)numPatches * PatchEvaluator::NumElements(uniform) / 3;
+	std::cout << "Per patch: " << triangles << " triangles, bound " << worstBound << ", measured " << worstMeasured << std::endl;
+	std::cout << "Uniform " << uniform << "x" << uniform << ": " << uniformTriangles << " triangles, per patch levels save "
+		<< 100.0 * (1.0 - (double)triangles / uniformTriangles) << "%" << std::endl;
+}
+
+// Renders the same job with more and more workers and reports how throughput scales
+void scaleRenderFarm(const char* exe, const char* dir, int maxWorkers, const RenderJob& job, RenderFarmSettings settings)
+{
+	std::vector<glm::vec3> controlPoints = farmScene();
+	double baseline = 0.0;
+	std::cout << "Workers\tSeconds\tFrames/s\tSpeedup\tEfficiency" << std::endl;
+	for (int workers = 1; workers <= maxWorkers; workers = workers < maxWorkers ? std::min(workers * 2, maxWorkers) : workers + 1)
+	{
+		settings.workers = workers;
+		RenderFarmStats stats;
+		std::string workerDir = std::string(dir) + "/workers_" + std::to_string(workers);
+		if (!RenderFarm::Run(exe, workerDir.c_str(), job, controlPoints, settings, &stats))
+		{
+			std::cout << "Render with " << workers << " workers failed" << std::endl;
+			return;
+		}
+
+		if (workers == 1)
+			baseline = stats.renderSeconds;
+		double speedup = baseline / stats.renderSeconds;
+		std::cout << workers << "\t" << stats.renderSeconds << "\t" << stats.framesWritten / stats.renderSeconds << "\t" << speedup << "\t"
+			<< speedup / workers << std::endl;
+	}
+}
+
+// Sends teapot patches to a running tessellation service from several client threads at once and
+// reports round trip latency and throughput. Half of the requests repeat earlier ones, so both
+// cache hits and misses are measured, and every few results are checked against tessellating
+// locally.
+void benchmarkTessellationService(const char* socketPath, int numClients, int numRequests)
+{
+	std::vector<glm::vec3> teapot(28 * 16);
+	for (int i = 0; i < 28; ++i)
+		teapotPatch(i, &teapot[i * 16]);
+
+	std::mutex mutex;
+	LatencyHistogram latencies;
+	unsigned long long patches = 0;
+	int hits = 0, failed = 0, mismatches = 0;
+
+	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+	std::vector<std::thread> threads;
+	for (int c = 0; c < numClients; ++c)
+	{
+		threads.push_back(std::thread([&, c]()
+		{
+			TessellationClient client;
+			if (!client.Connect(socketPath))
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				failed += numRequests;
+				return;
+			}
+
+			std::mt19937 random(c + 1);
+			std::vector<glm::vec3> controlPoints;
+			std::vector<float> expected;
+			LatencyHistogram clientLatencies;
+			unsigned long long clientPatches = 0;
+			int clientHits = 0, clientFailed = 0, clientMismatches = 0;
+			const int resolutions[] = { 8, 16, 24 };
+			for (int r = 0; r < numRequests; ++r)
+			{
+				int first = random() % 28;
+				int count = 1 + random() % (28 - first);
+				int resolution = resolutions[random() % 3];
+				controlPoints.assign(teapot.begin() + first * 16, teapot.begin() + (first + count) * 16);
+				if (random() % 2)
+				{
+					// A model nobody has asked for before
+					glm::vec3 offset = glm::vec3((float)(c * numRequests + r), 0.0f, 0.0f);
+					for (size_t i = 0; i < controlPoints.size(); ++i)
+						controlPoints[i] += offset;
+				}
+
+				std::chrono::high_resolution_clock::time_point sent = std::chrono::high_resolution_clock::now();
+				TessellationResult result;
+				if (!client.Tessellate(&controlPoints[0], count, resolution, result))
+				{
+					clientFailed++;
+					continue;
+				}
+				clientLatencies.Add((unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(
+					std::chrono::high_resolution_clock::now() - sent).count());
+				clientPatches += count;
+				clientHits += result.cacheHit ? 1 : 0;
+
+				if (r % 8 == 0)
+				{
+					int last = count - 1;
+					int floats = PatchEvaluator::NumVerts(resolution) * PatchEvaluator::FLOATS_PER_VERT;
+					expected.resize(floats);
+					PatchEvaluator::Tessellate(&controlPoints[last * 16], resolution, &expected[0]);
+					if (memcmp(&expected[0], result.verts + (size_t)last * floats, floats * sizeof(float)) != 0
+						|| result.numElements != PatchEvaluator::NumElements(resolution))
+						clientMismatches++;
+				}
+				client.Release(result);
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			latencies.Merge(clientLatencies);
+			patches += clientPatches;
+			hits += clientHits;
+			failed += clientFailed;
+			mismatches += clientMismatches;
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+	std::cout << numClients << " clients sent " << latencies.count << " requests (" << patches << " patches) in " << seconds << " s: "
+		<< latencies.count / seconds << " requests/s, " << patches / seconds << " patches/s" << std::endl;
+	std::cout << "Cache hits: " << hits << ", failed: " << failed << ", mismatches against local tessellation: " << mismatches << std::endl;
+	PrintLatencyPercentiles("Round trip", latencies);
+
+	TessellationClient client;
+	if (client.Connect(socketPath))
+		client.Shutdown();
+}
+
+// Times the per-frame instrumentation of step() with nobody connected and with a client streaming
+// every frame, against the same frame loop without any instrumentation
+void benchmarkTelemetry(const char* socketPath, int frames)
+{
+	if (!Telemetry::Start(socketPath))
+		return;
+
+	// Stand-in for the work of a frame, so the scopes measure something
+	glm::vec3 controlPoints[16];
+	teapotPatch(0, controlPoints);
+	std::vector<float> verts(PatchEvaluator::NumVerts(8) * PatchEvaluator::FLOATS_PER_VERT);
+
+	const Telemetry::Scope scopes[] = { Telemetry::SCOPE_UPDATE, Telemetry::SCOPE_CULL, Telemetry::SCOPE_STREAMING,
+		Telemetry::SCOPE_DRAW, Telemetry::SCOPE_CAPTURE, Telemetry::SCOPE_SWAP };
+	float checksum = 0.0f;
+	auto runFrames = [&](bool instrumented) -> double
+	{
+		std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+		for (int f = 0; f < frames; ++f)
+		{
+			for (int s = 0; s < Telemetry::NUM_SCOPES; ++s)
+			{
+				if (instrumented)
+				{
+					TelemetryScope scope(scopes[s]);
+					PatchEvaluator::Tessellate(controlPoints, 8, &verts[0]);
+				}
+				else
+					PatchEvaluator::Tessellate(controlPoints, 8, &verts[0]);
+				checksum += verts[f % verts.size()];
+			}
+			if (instrumented)
+			{
+				if (Telemetry::enabled())
+				{
+					for (int c = 0; c < Telemetry::NUM_COUNTERS; ++c)
+						Telemetry::SetCounter((Telemetry::Counter)c, f + c);
+				}
+				Telemetry::EndFrame(1.0 / 60.0);
+			}
+		}
+		return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() * 1.0e9 / frames;
+	};
+
+	// Best of a few runs each, interleaved, to keep clock drift and scheduling noise out of the difference
+	double baseline = 1.0e30, idle = 1.0e30;
+	for (int run = 0; run < 3; ++run)
+	{
+		baseline = std::min(baseline, runFrames(false));
+		idle = std::min(idle, runFrames(true));
+	}
+
+	int lines = 0;
+	std::thread watcher([&]()
+	{
+		lines = Telemetry::Watch(socketPath, "subscribe", 0, false);
+	});
+	while (!Telemetry::enabled())
+		std::this_thread::yield();
+	double watched = runFrames(true);
+
+	// Let the telemetry thread catch up before counting what it sent
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	TelemetryStats stats = Telemetry::Stats();
+	Telemetry::Stop();
+	watcher.join();
+
+	std::cout << frames << " frames, " << baseline << " ns each without instrumentation (checksum " << checksum << ")" << std::endl;
+	std::cout << "No client connected: " << idle << " ns per frame, " << idle - baseline << " ns of instrumentation" << std::endl;
+	std::cout << "One client streaming every frame: " << watched << " ns per frame, " << watched - baseline << " ns of instrumentation" << std::endl;
+	std::cout << "Frames collected: " << stats.frames << ", dropped: " << stats.dropped << ", lines sent: " << stats.linesSent
+		<< ", lines received: " << lines << std::endl;
+}
+
+// Handles command line tools that run without a window. Returns true if one ran, with the
+// process exit code in exitCode.
+bool runCommandLine(int argc, char** argv, int& exitCode)
+{
+	const char* exportFile = nullptr;
+	const char* importBenchFile = nullptr;
+	const char* fitMeshFile = nullptr;
+	const char* fitOutFile = nullptr;
+	PatchFitOptions fitOptions;
+	const char* terrainGenFile = nullptr;
+	int curveBenchCount = 0;
+	bool evalBench = false;
+	bool lodReport = false;
+	float lodTolerance = 0.0f;
+	const char* pageBuildFile = nullptr;
+	const char* pageBenchFile = nullptr;
+	int bvhBenchCount = 0;
+	const char* farmDir = nullptr;
+	const char* farmWorkerDir = nullptr;
+	int farmWorkerIndex = 0;
+	int farmScaleWorkers = 0;
+	RenderJob farmJob;
+	RenderFarmSettings farmSettings;
+	const char* tessServeSocket = nullptr;
+	const char* tessBenchSocket = nullptr;
+	TessellationServiceSettings tessSettings;
+	int tessClients = 4;
+	int tessRequests = 1000;
+	const char* telemetryPollSocket = nullptr;
+	const char* telemetryWatchSocket = nullptr;
+	const char* telemetryBenchSocket = nullptr;
+	const char* ltcFitFile = nullptr;
+	const char* sceneGenFile = nullptr;
+	int sceneGenCount = 0;
+	int telemetryEvery = 1;
+	int telemetryLines = 0;
+	MeshExportOptions options;
+	int copies = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--export") && i + 1 < argc)
+			exportFile = argv[++i];
+		else if (!strcmp(argv[i], "--res") && i + 1 < argc)
+			options.resolution = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--copies") && i + 1 < argc)
+			copies = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--weld"))
+			options.weld = true;
+		else if (!strcmp(argv[i], "--weld-window") && i + 1 < argc)
+			options.weldWindow = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--import") && i + 1 < argc)
+			importFile = argv[++i];
+		else if (!strcmp(argv[i], "--import-bench") && i + 1 < argc)
+			importBenchFile = argv[++i];
+		else if (!strcmp(argv[i], "--fit") && i + 2 < argc)
+		{
+			fitMeshFile = argv[++i];
+			fitOutFile = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--cells") && i + 1 < argc)
+			fitOptions.cellsAcross = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--bpt") && i + 1 < argc)
+			bptFile = argv[++i];
+		else if (!strcmp(argv[i], "--terrain") && i + 1 < argc)
+			terrainFile = argv[++i];
+		else if (!strcmp(argv[i], "--terrain-gen") && i + 1 < argc)
+			terrainGenFile = argv[++i];
+		else if (!strcmp(argv[i], "--terrain-size") && i + 1 < argc)
+			terrainSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--curves") && i + 1 < argc)
+			numCurves = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--tubes"))
+			curveStyle = CurveStyle::Tube;
+		else if (!strcmp(argv[i], "--curve-bench") && i + 1 < argc)
+			curveBenchCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--eval-bench"))
+			evalBench = true;
+		else if (!strcmp(argv[i], "--lod-report"))
+		{
+			lodReport = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				lodTolerance = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--eval-select"))
+			evalSelect = true;
+		else if (!strcmp(argv[i], "--eval-kernel") && i + 1 < argc)
+		{
+			PatchKernel kernel;
+			if (!PatchKernelSelector::FromName(argv[++i], kernel))
+			{
+				std::cout << "Unknown evaluation kernel " << argv[i] << ", expected bernstein, power or forward" << std::endl;
+				exitCode = 1;
+				return true;
+			}
+			PatchKernelSelector::Force(kernel);
+		}
+		else if (!strcmp(argv[i], "--page-build") && i + 1 < argc)
+			pageBuildFile = argv[++i];
+		else if (!strcmp(argv[i], "--paged") && i + 1 < argc)
+			pagedFile = argv[++i];
+		else if (!strcmp(argv[i], "--page-bench") && i + 1 < argc)
+			pageBenchFile = argv[++i];
+		else if (!strcmp(argv[i], "--teapots") && i + 1 < argc)
+			numTeapots = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--bvh-bench") && i + 1 < argc)
+			bvhBenchCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--quad-view"))
+			quadView = true;
+		else if (!strcmp(argv[i], "--no-state-cache"))
+			GLState::SetFiltering(false);
+		else if (!strcmp(argv[i], "--probes"))
+			lightProbes = true;
+		else if (!strcmp(argv[i], "--probe-rays") && i + 1 < argc)
+			probeSettings.raysPerProbe = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--headless") && i + 1 < argc)
+		{
+			if (!RenderContext::ParseBackend(argv[++i], contextSettings.backend))
+				std::cout << "Unknown context backend " << argv[i] << ", opening a window" << std::endl;
+		}
+		else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			contextSettings.frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--size") && i + 2 < argc)
+		{
+			contextSettings.width = atoi(argv[++i]);
+			contextSettings.height = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--headless-shot") && i + 1 < argc)
+			headlessScreenshot = argv[++i];
+		else if (!strcmp(argv[i], "--normal-maps"))
+			normalMaps = true;
+		else if (!strcmp(argv[i], "--normal-tile") && i + 1 < argc)
+			normalMapSettings.tileSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--normal-detail") && i + 1 < argc)
+			normalMapSettings.highResolution = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--area-lights"))
+			areaLights = true;
+		else if (!strcmp(argv[i], "--roughness") && i + 1 < argc)
+			areaLightSettings.roughness = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--ltc") && i + 1 < argc)
+			areaLightSettings.cacheFile = argv[++i];
+		else if (!strcmp(argv[i], "--ltc-fit") && i + 1 < argc)
+			ltcFitFile = argv[++i];
+		else if (!strcmp(argv[i], "--ltc-size") && i + 1 < argc)
+			areaLightSettings.fit.size = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scene") && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (!strcmp(argv[i], "--scene-camera") && i + 1 < argc)
+			sceneSettings.camera = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scene-rate") && i + 1 < argc)
+			sceneSettings.instancesPerFrame = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scene-threads") && i + 1 < argc)
+			sceneSettings.loader.loaderThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scene-gen") && i + 2 < argc)
+		{
+			sceneGenFile = argv[++i];
+			sceneGenCount = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--farm") && i + 1 < argc)
+			farmDir = argv[++i];
+		else if (!strcmp(argv[i], "--farm-workers") && i + 1 < argc)
+			farmSettings.workers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--farm-frames") && i + 1 < argc)
+			farmJob.frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--farm-tile") && i + 1 < argc)
+			farmJob.tileSize = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--farm-fail") && i + 1 < argc)
+			farmSettings.failRate = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--farm-lease") && i + 1 < argc)
+			farmSettings.leaseSeconds = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--farm-worker") && i + 2 < argc)
+		{
+			farmWorkerDir = argv[++i];
+			farmWorkerIndex = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--farm-scale") && i + 2 < argc)
+		{
+			farmDir = argv[++i];
+			farmScaleWorkers = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "--tess-serve") && i + 1 < argc)
+			tessServeSocket = argv[++i];
+		else if (!strcmp(argv[i], "--tess-memory") && i + 1 < argc)
+			tessSettings.sharedMemoryBytes = (size_t)atoi(argv[++i]) << 20;
+		else if (!strcmp(argv[i], "--tess-bench") && i + 1 < argc)
+			tessBenchSocket = argv[++i];
+		else if (!strcmp(argv[i], "--tess-clients") && i + 1 < argc)
+			tessClients = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--tess-requests") && i + 1 < argc)
+			tessRequests = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc)
+			telemetrySocket = argv[++i];
+		else if (!strcmp(argv[i], "--telemetry-poll") && i + 1 < argc)
+			telemetryPollSocket = argv[++i];
+		else if (!strcmp(argv[i], "--telemetry-watch") && i + 1 < argc)
+			telemetryWatchSocket = argv[++i];
+		else if (!strcmp(argv[i], "--telemetry-every") && i + 1 < argc)
+			telemetryEvery = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--telemetry-lines") && i + 1 < argc)
+			telemetryLines = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--telemetry-bench") && i + 1 < argc)
+			telemetryBenchSocket = argv[++i];
+	}
+
+	if (sceneGenFile)
+	{
+		exitCode = SceneManager::GenerateTeapots(sceneGenFile, std::max(sceneGenCount, 1)) ? 0 : 1;
+		if (exitCode == 0)
+			std::cout << "Wrote a scene of " << std::max(sceneGenCount, 1) << " teapots to " << sceneGenFile << std::endl;
+		return true;
+	}
+
+	// Only the description is read up front; the models it names stream in once drawing starts
+	if (sceneFile)
+	{
+		std::string error;
+		if (!SceneManager::Load(sceneFile, sceneSettings, &error))
+		{
+			std::cout << "Failed to load the scene: " << error << std::endl;
+			exitCode = 1;
+			return true;
+		}
+	}
+
+	if (ltcFitFile)
+	{
+		LTCTable table;
+		LTCFitStats stats;
+		exitCode = LTCFitter::Fit(areaLightSettings.fit, table, &stats) && LTCFitter::Save(ltcFitFile, areaLightSettings.fit, table) ? 0 : 1;
+		LTCFitter::PrintStats(stats);
+		return true;
+	}
+
+	if (telemetryPollSocket)
+	{
+		exitCode = Telemetry::Watch(telemetryPollSocket, "poll", 1) == 1 ? 0 : 1;
+		return true;
+	}
+
+	if (telemetryWatchSocket)
+	{
+		std::string command = "subscribe " + std::to_string(telemetryEvery);
+		Telemetry::Watch(telemetryWatchSocket, command.c_str(), telemetryLines);
+		return true;
+	}
+
+	if (telemetryBenchSocket)
+	{
+		benchmarkTelemetry(telemetryBenchSocket, 200000);
+		return true;
+	}
+
+	if (tessServeSocket)
+	{
+		TessellationServiceStats stats;
+		exitCode = TessellationService::Run(tessServeSocket, tessSettings, &stats) ? 0 : 1;
+		TessellationService::PrintStats(stats);
+		return true;
+	}
+
+	if (tessBenchSocket)
+	{
+		benchmarkTessellationService(tessBenchSocket, tessClients, tessRequests);
+		return true;
+	}
+
+	if (farmWorkerDir)
+	{
+		exitCode = RenderFarm::Work(farmWorkerDir, farmWorkerIndex, farmSettings.failRate);
+		return true;
+	}
+
+	if (farmDir && farmScaleWorkers > 0)
+	{
+		scaleRenderFarm(argv[0], farmDir, farmScaleWorkers, farmJob, farmSettings);
+		return true;
+	}
+
+	if (farmDir)
+	{
+		RenderFarmStats stats;
+		if (!RenderFarm::Run(argv[0], farmDir, farmJob, farmScene(), farmSettings, &stats))
+			std::cout << "Render farm job in " << farmDir << " failed" << std::endl;
+		RenderFarm::PrintStats(stats);
+		return true;
+	}
+
+	if (bvhBenchCount > 0)
+	{
+		benchmarkBVH(bvhBenchCount);
+		return true;
+	}
+
+	if (pageBuildFile)
+	{
+		PatchDatabaseBuildStats stats;
+		if (!PatchDatabase::Build(pageBuildFile, 28 * copies, teapotPatch, PatchDatabase::DEFAULT_PAGE_PATCHES, 0, &stats))
+		{
+			std::cout << "Failed to build " << pageBuildFile << std::endl;
+			return true;
+		}
+		std::cout << "Wrote " << stats.patches << " patches in " << stats.pages << " pages (" << stats.bytesWritten / (1024.0 * 1024.0)
+			<< " MB) in " << stats.seconds * 1000.0 << " ms" << std::endl;
+		return true;
+	}
+
+	if (pageBenchFile)
+	{
+		benchmarkPaging(pageBenchFile);
+		return true;
+	}
+
+	if (lodReport)
+	{
+		reportErrorBounds(lodTolerance);
+		return true;
+	}
+
+	if (evalBench)
+	{
+		benchmarkEvaluation();
+		return true;
+	}
+
+	if (curveBenchCount > 0)
+	{
+		benchmarkCurves(curveBenchCount);
+		return true;
+	}
+
+	if (terrainGenFile)
+	{
+		if (!generateTerrain(terrainGenFile))
+			std::cout << "Failed to generate " << terrainGenFile << std::endl;
+		return true;
+	}
+
+	if (fitMeshFile)
+	{
+		ImportedMesh mesh;
+		MeshImportStats importStats;
+		if (!MeshImporter::Load(fitMeshFile, mesh, &importStats))
+		{
+			std::cout << "Failed to import " << fitMeshFile << std::endl;
+			return true;
+		}
+
+		std::vector<glm::vec3> controlPoints;
+		PatchFitStats fitStats;
+		if (!PatchFitter::Fit(mesh, controlPoints, fitOptions, &fitStats))
+		{
+			std::cout << "Failed to fit " << fitMeshFile << std::endl;
+			return true;
+		}
+		PatchFitter::PrintStats(fitStats);
+
+		if (!BptFile::Save(fitOutFile, controlPoints))
+			std::cout << "Failed to write " << fitOutFile << std::endl;
+		return true;
+	}
+
+	if (importBenchFile)
+	{
+		ImportedMesh mesh;
+		MeshImportStats stats;
+		if (!MeshImporter::Load(importBenchFile, mesh, &stats))
+			std::cout << "Failed to import " << importBenchFile << std::endl;
+		MeshImporter::PrintStats(stats);
+		return true;
+	}
+
+	if (exportFile)
+	{
+		options.format = MeshExporter::FormatFromFileName(exportFile);
+
+		MeshExportStats stats;
+		if (!MeshExporter::Export(28 * copies, teapotPatch, exportFile, options, &stats))
+		{
+			std::cout << "Failed to export " << exportFile << std::endl;
+			return true;
+		}
+		MeshExporter::PrintStats(stats);
+		return true;
+	}
+
+	return false;
+}
+
 void initShaders()
 {
-	char* shaders[] = { "fshader.glsl", "vshader.glsl" };
-	GLenum types[] = { GL_FRAGMENT_SHADER, GL_VERTEX_SHADER };
-	int numShaders = 2;
+	// The geometry shader only when there are several views to draw each triangle into
+	char* shaders[] = { "fShader.glsl", "vShader.glsl", "gShader.glsl" };
+	GLenum types[] = { GL_FRAGMENT_SHADER, GL_VERTEX_SHADER, GL_GEOMETRY_SHADER };
+	int numShaders = quadView ? 3 : 2;
 	
 	shaderProgram = initShaders(shaders, types, numShaders);
 
 	uMPMat = glGetUniformLocation(shaderProgram, "mpMat");
 	uMPVMat = glGetUniformLocation(shaderProgram, "mpvMat");
 	uColor = glGetUniformLocation(shaderProgram, "color");
+	uNormalMapRect = glGetUniformLocation(shaderProgram, "normalMapRect");
+	uViewMask = glGetUniformLocation(shaderProgram, "viewMask");
+
+	// Like every sampler, on its own unit whether or not anything is bound there
+	GLState::Uniform1i(glGetUniformLocation(shaderProgram, "normalMap"), NORMAL_MAP_TEXTURE_UNIT);
 }
 
 void init()
 {
-	if (!glfwInit()) exit(EXIT_FAILURE);
+	//Create the window, or a headless context
+	if (!RenderContext::Init(contextSettings)) exit(EXIT_FAILURE);
 
-	//Create window
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+	initShaders();
 
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	RenderContext::ResetTime();
 
-	window = glfwCreateWindow(800, 600, "Geometric_Lighting-GLFW", NULL, NULL); // Windowed
+	time_t timer;
+	time(&timer);
+	srand((unsigned int)timer);
 
-	//Activate window
-	glfwMakeContextCurrent(window);
+	// Forward differencing rounds off more the further patches are from the origin, so a kernel is
+	// only picked on the patches that will actually be drawn with it. A scene's stream in later.
+	if (evalSelect && sceneFile)
+		std::cout << "A scene's patches aren't loaded yet, so --eval-select can't check the kernels on them" << std::endl;
+	else if (evalSelect)
+	{
+		PatchKernelSettings kernelSettings;
+		kernelSettings.minSeconds = 0.002;
+		PatchKernelSelector::Select(farmScene(), Patch::NUM_VERTS, kernelSettings);
+	}
+	std::cout << "Evaluating patches with the " << PatchKernelSelector::Name(PatchKernelSelector::Kernel(Patch::NUM_VERTS)) << " kernel" << std::endl;
 
-	glewExperimental = true;
-	glewInit();
+	if (!sceneFile)
+	{
+		generateTeapot();
+		SplineManager::Add(teapot);
+	}
 
-	initShaders();
+	if (numTeapots > 0)
+		scatterTeapots();
 
-	glfwSetTime(0.0);
+	if (importFile)
+		importMesh();
 
-	time_t timer;
-	time(&timer);
-	srand((unsigned int)timer);
+	if (terrainFile)
+		loadTerrain();
+
+	if (numCurves > 0)
+		generateCurves();
+
+	if (pagedFile)
+		loadPagedModel();
 
-	generateTeapot();
+	if (normalMaps && teapot)
+		bakeNormalMaps();
 
-	InputManager::Init(window);
-	CameraManager::Init(800.0f / 600.0f, 60.0f, 0.1f, 100.0f);
+	// A streamed scene bakes them once it is complete
+	if (lightProbes && !sceneFile)
+		bakeLightProbes();
+
+	if (sceneFile && !SceneManager::scene().lights.empty() && LightManager::Init(areaLightSettings))
+	{
+		SceneManager::AddLights();
+		LightManager::PrintStats();
+	}
+	else if (areaLights && !sceneFile && LightManager::Init(areaLightSettings))
+	{
+		// A warm panel to the left of the teapot, facing it, and a cool disk overhead
+		AreaLight panel;
+		panel.center = glm::vec3(-4.0f, 1.0f, 0.0f);
+		panel.right = glm::vec3(0.0f, 1.0f, 0.0f);
+		panel.up = glm::vec3(0.0f, 0.0f, 1.5f);
+		panel.color = glm::vec3(1.0f, 0.8f, 0.6f);
+		panel.intensity = 4.0f;
+		LightManager::areaLights().push_back(panel);
+
+		AreaLight disk;
+		disk.shape = AreaLightShape::Disk;
+		disk.center = glm::vec3(0.0f, 5.0f, 0.0f);
+		disk.right = glm::vec3(1.0f, 0.0f, 0.0f);
+		disk.up = glm::vec3(0.0f, 0.0f, 1.0f);
+		disk.color = glm::vec3(0.6f, 0.8f, 1.0f);
+		disk.intensity = 4.0f;
+		LightManager::areaLights().push_back(disk);
+
+		LightManager::PrintStats();
+	}
+
+	if (RenderContext::window())
+		InputManager::Init(RenderContext::window());
+	float fov = 60.0f;
+	float farPlane = terrainFile || pagedFile ? 1000.0f : 100.0f;
+	if (sceneFile && SceneManager::camera())
+	{
+		fov = SceneManager::camera()->fov;
+		farPlane = std::max(farPlane, SceneManager::camera()->farPlane);
+	}
+	CameraManager::Init((float)RenderContext::width() / RenderContext::height(), fov, 0.1f, farPlane);
+	CameraManager::SetLayout(quadView ? CameraLayout::Quad : CameraLayout::Single);
+	FrameCapture::Init(RenderContext::width(), RenderContext::height());
 
 	glEnable(GL_DEPTH_TEST);
+
+	if (sceneFile)
+		SceneManager::Start(currentShader(), builtinModel);
+
+	if (telemetrySocket)
+		Telemetry::Start(telemetrySocket);
 }
 
 void step()
@@ -351,50 +1873,219 @@ void step()
 	InputManager::Update();
 
 	// Get delta time since the last frame
-	float dt = (float)glfwGetTime();
-	glfwSetTime(0.0);
+	float dt = (float)RenderContext::Time();
+	RenderContext::ResetTime();
+	elapsedTime += dt;
 
 	// Apply a rotation to the teapot if the user presses the right or left arrow keys
 	float dTheta = 45.0f * InputManager::rightKey();
 	dTheta -= 45.0f * InputManager::leftKey();
 
-	teapot->transform().angularVelocity = glm::angleAxis(dTheta, glm::vec3(0.0f, 1.0f, 0.0f));
+	if (teapot)
+		teapot->transform().angularVelocity = glm::angleAxis(dTheta, glm::vec3(0.0f, 1.0f, 0.0f));
 
 	// Update all components
-	CameraManager::Update(dt);
+	{
+		TelemetryScope scope(Telemetry::SCOPE_UPDATE);
+		CameraManager::Update(dt);
 
-	RenderManager::Update(dt);
+		if (sceneFile)
+			SceneManager::Update(glm::vec3(CameraManager::CamPos()), CameraManager::ProjMat() * CameraManager::ViewMat());
 
-	teapot->Update(dt);
+		RenderManager::Update(dt);
+
+		SplineManager::Update(dt);
+
+		LightProbeGrid::Update();
+	}
+	{
+		TelemetryScope scope(Telemetry::SCOPE_CULL);
+		glm::mat4 viewProjMats[CameraManager::MAX_VIEWS];
+		for (int i = 0; i < CameraManager::numViews(); ++i)
+			viewProjMats[i] = CameraManager::ViewProjMat(i);
+		SplineManager::Cull(viewProjMats, CameraManager::numViews());
+	}
+
+	// Report the spline at the middle of the screen
+	if (InputManager::spaceKey() && !InputManager::spaceKey(true))
+	{
+		glm::vec3 camPos = glm::vec3(CameraManager::CamPos());
+		float distance;
+		B_Spline* picked = SplineManager::Pick(camPos, glm::normalize(-camPos), 1000.0f, &distance);
+		int sceneInstance = SceneManager::InstanceOf(picked);
+		if (!picked)
+			std::cout << "Nothing to pick" << std::endl;
+		else if (picked == teapot)
+			std::cout << "Picked the teapot " << distance << " away" << std::endl;
+		else if (sceneInstance >= 0)
+			std::cout << "Picked scene instance " << sceneInstance << " " << distance << " away" << std::endl;
+		else
+			std::cout << "Picked teapot " << std::find(teapots.begin(), teapots.end(), picked) - teapots.begin() + 1 << " " << distance << " away" << std::endl;
+	}
+
+	{
+		TelemetryScope scope(Telemetry::SCOPE_STREAMING);
+		TerrainManager::Update(glm::vec3(CameraManager::CamPos()), CameraManager::ProjMat() * CameraManager::ViewMat());
+
+		if (curves)
+			curves->Update(glm::vec3(CameraManager::CamPos()));
+
+		if (pagedModel)
+			pagedModel->Update(glm::vec3(CameraManager::CamPos()), CameraManager::ProjMat() * CameraManager::ViewMat());
+	}
 
 	// Draw the display list
-	RenderManager::Draw();
+	{
+		TelemetryScope scope(Telemetry::SCOPE_DRAW);
+		LightManager::Bind(shaderProgram, CameraManager::DrawProjMat(), CameraManager::DrawViewMat());
+		if (CameraManager::numViews() > 1)
+			CameraManager::BindViews(shaderProgram, RenderContext::width(), RenderContext::height());
+		LightProbeGrid::Bind(shaderProgram);
+		RenderManager::Draw();
+		TerrainManager::Draw();
+		if (pagedModel)
+			pagedModel->Draw();
+	}
+
+	// Queue a read back of the finished frame if a screenshot was asked for
+	if (InputManager::pKey() && !InputManager::pKey(true))
+	{
+		char fileName[64];
+		sprintf(fileName, "screenshot_%03u.tga", screenshotCount++);
+		FrameCapture::Screenshot(fileName);
+	}
+
+	// Toggle recording the session to a video file
+	if (InputManager::cKey() && !InputManager::cKey(true))
+	{
+		if (!video)
+		{
+			video = new VideoCapture("capture.y4m", RenderContext::width(), RenderContext::height());
+			FrameCapture::AddSink(video);
+			FrameCapture::StartCapture();
+		}
+		else
+		{
+			FrameCapture::StopCapture();
+			FrameCapture::RemoveSink(video);
+			video->Finish();
+			video->PrintStats();
+			delete video;
+			video = nullptr;
+		}
+	}
+	{
+		TelemetryScope scope(Telemetry::SCOPE_CAPTURE);
+		FrameCapture::Update(elapsedTime);
+	}
+
+	// Counters are only gathered while someone is watching. Every one is a relaxed atomic its
+	// subsystem keeps up to date, so the frame never waits on another thread's lock here.
+	if (Telemetry::enabled())
+	{
+		Telemetry::SetCounter(Telemetry::VISIBLE_SPLINES, SplineManager::numVisible());
+		if (TerrainManager::active())
+		{
+			Telemetry::SetCounter(Telemetry::TERRAIN_DRAWN_NODES, TerrainManager::drawnNodes());
+			Telemetry::SetCounter(Telemetry::TERRAIN_RESIDENT_NODES, TerrainManager::residentNodes());
+			Telemetry::SetCounter(Telemetry::TERRAIN_GPU_BYTES, (long long)TerrainManager::gpuBytes());
+		}
+		if (pagedModel)
+			Telemetry::SetCounter(Telemetry::PAGED_RESIDENT_BYTES, (long long)pagedModel->pager().residentBytes());
+		Telemetry::SetCounter(Telemetry::CAPTURE_DROPPED_FRAMES, FrameCapture::droppedFrames());
+	}
 
 	// Swap buffers
-	glfwSwapBuffers(window);
+	{
+		TelemetryScope scope(Telemetry::SCOPE_SWAP);
+		RenderContext::Present();
+	}
+
+	// A streamed scene bakes the light probes once it is complete
+	if (sceneFile && SceneManager::EndFrame() && lightProbes)
+		bakeLightProbes();
+
+	Telemetry::EndFrame(dt);
 }
 
 void cleanUp()
 {
-	glDeleteProgram(shaderProgram);
+	// Before anything the loader threads could still be reading
+	SceneManager::Stop();
+
+	GLState::DeleteProgram(shaderProgram);
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
 
+	FrameCapture::DumpData();
+	if (video)
+	{
+		video->Finish();
+		video->PrintStats();
+		delete video;
+	}
+
+	if (LightProbeGrid::active())
+	{
+		LightProbeGrid::PrintStats();
+		LightProbeGrid::DumpData();
+	}
+	LightManager::DumpData();
+	GLState::DeleteTextures(1, &normalMapTexture);
+
+	SplineManager::PrintStats();
+	SplineManager::DumpData();
+
+	GLState::PrintStats();
+
 	RenderManager::DumpData();
 
+	if (TerrainManager::active())
+	{
+		TerrainManager::PrintStats();
+		TerrainManager::DumpData();
+	}
+
+	if (curves)
+	{
+		curves->PrintStats();
+		delete curves;
+	}
+
+	if (pagedModel)
+	{
+		pagedModel->PrintStats();
+		delete pagedModel;
+	}
+
 	delete teapot;
+	for (unsigned int i = 0; i < teapots.size(); ++i)
+		delete teapots[i];
+	SceneManager::DumpData();
+
+	Telemetry::Stop();
 
-	glfwTerminate();
+	if (RenderContext::headless())
+		RenderContext::PrintStats();
+	RenderContext::DumpData();
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	int exitCode = 0;
+	if (runCommandLine(argc, argv, exitCode))
+		return exitCode;
+
 	init();
 
-	while (!glfwWindowShouldClose(window))
+	while (!RenderContext::ShouldClose())
 	{
+		// Headless runs can't press P, so they can ask for their last frame up front
+		if (headlessScreenshot && RenderContext::Stats().frames + 1 == (unsigned long long)contextSettings.frames)
+			FrameCapture::Screenshot(headlessScreenshot);
+
 		step();
-		glfwPollEvents();
+		RenderContext::PollEvents();
 	}
 
 	cleanUp();
@@ -7,9 +7,26 @@ uniform mat4 mpvMat;
 uniform mat4 mpMat;
 uniform vec4 color;
 
-out vec4 Color;
-out vec4 Normal;
-out vec4 WorldPos;
+// Set by LightManager to take positions and normals back to world space
+uniform mat4 invViewProj;
+uniform mat4 invProj;
+
+// Where this patch's map is in the normal map atlas (zero size without one), and how many vertices
+// along each side patches are tessellated with
+uniform vec4 normalMapRect;
+uniform int normalMapResolution;
+
+// Passed straight on to the fragment shader, or through gShader.glsl once for each view
+out VertexData
+{
+	vec4 Color;
+	vec4 Normal;
+	vec4 WorldPos;
+	vec3 SurfacePos;
+	vec3 SurfaceNormal;
+	vec2 NormalMapUV;
+	flat int ViewIndex;
+};
 
 void main()
 {
@@ -17,4 +34,13 @@ void main()
 	Normal = mpMat * vec4(normal, 0.0);
 	WorldPos = mpvMat * vec4(position, 1.0);
 	gl_Position = WorldPos;
+
+	SurfacePos = (invViewProj * WorldPos).xyz;
+	SurfaceNormal = (invProj * Normal).xyz;
+
+	// Patch vertices come in rows with u varying fastest, so the index alone gives (u, v)
+	int resolution = max(normalMapResolution, 2);
+	vec2 uv = vec2(gl_VertexID % resolution, gl_VertexID / resolution) / float(resolution - 1);
+	NormalMapUV = normalMapRect.xy + uv * normalMapRect.zw;
+	ViewIndex = 0;
 }
\ No newline at end of file
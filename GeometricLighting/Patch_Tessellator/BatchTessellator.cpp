@@ -0,0 +1,618 @@
+#include "BatchTessellator.h"
+#include "PatchEvaluator.h"
+#include "WorkerPool.h"
+#include "BptFile.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <glob.h>
+#endif
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// File system helpers, the only parts that differ between platforms
+
+// Creates the directory and any missing parents
+static void MakeDirectory(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); ++i)
+	{
+		if (i < path.size() && path[i] != '/' && path[i] != '\\')
+			continue;
+		std::string prefix = path.substr(0, i);
+#ifdef _WIN32
+		_mkdir(prefix.c_str());
+#else
+		mkdir(prefix.c_str(), 0755);
+#endif
+	}
+}
+
+// Size and modification time, or false if there is no such file
+static bool FileInfo(const std::string& path, unsigned long long& size, long long& modified, bool* directory = nullptr)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	modified = (long long)(((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+	if (directory)
+		*directory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+	size = (unsigned long long)info.st_size;
+	modified = (long long)info.st_mtime;
+	if (directory)
+		*directory = S_ISDIR(info.st_mode);
+#endif
+	return true;
+}
+
+// Files matching a wildcard pattern
+static void MatchFiles(const std::string& pattern, std::vector<std::string>& files)
+{
+#ifdef _WIN32
+	size_t slash = pattern.find_last_of("/\\");
+	std::string dir = slash == std::string::npos ? "" : pattern.substr(0, slash + 1);
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA(pattern.c_str(), &data);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+				files.push_back(dir + data.cFileName);
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+	}
+#else
+	glob_t matches;
+	if (glob(pattern.c_str(), 0, nullptr, &matches) == 0)
+	{
+		for (size_t i = 0; i < matches.gl_pathc; ++i)
+			files.push_back(matches.gl_pathv[i]);
+	}
+	globfree(&matches);
+#endif
+}
+
+static bool ReplaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Writes at an absolute offset, which can be past 2 GB
+static bool WriteAt(FILE* file, unsigned long long offset, const void* data, size_t bytes)
+{
+#ifdef _WIN32
+	if (_fseeki64(file, (long long)offset, SEEK_SET) != 0)
+#else
+	if (fseeko(file, (off_t)offset, SEEK_SET) != 0)
+#endif
+		return false;
+	return bytes == 0 || fwrite(data, 1, bytes, file) == bytes;
+}
+
+static void ExpandInput(const std::string& argument, std::vector<std::string>& files)
+{
+	if (argument.empty())
+		return;
+
+	if (argument[0] == '@')
+	{
+		std::ifstream list(argument.c_str() + 1);
+		if (!list)
+		{
+			std::cout << "Couldn't read the input list " << argument.c_str() + 1 << std::endl;
+			return;
+		}
+		std::string line;
+		while (std::getline(list, line))
+		{
+			if (!line.empty() && line[line.size() - 1] == '\r')
+				line.erase(line.size() - 1);
+			if (!line.empty() && line[0] != '#')
+				ExpandInput(line, files);
+		}
+		return;
+	}
+
+	if (argument.find_first_of("*?") != std::string::npos)
+	{
+		MatchFiles(argument, files);
+		return;
+	}
+
+	unsigned long long size;
+	long long modified;
+	bool directory = false;
+	if (FileInfo(argument, size, modified, &directory) && directory)
+		MatchFiles(argument + "/*.bpt", files);
+	else
+		files.push_back(argument);
+}
+
+std::vector<std::string> BatchTessellator::ExpandInputs(const std::vector<std::string>& arguments)
+{
+	std::vector<std::string> files;
+	for (unsigned int i = 0; i < arguments.size(); ++i)
+		ExpandInput(arguments[i], files);
+
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+	return files;
+}
+
+// An input and where its asset goes
+struct BatchFile
+{
+	std::string input;
+	std::string output;
+	unsigned long long size;
+	long long modified;
+};
+
+// Where the patches of a batch go: each one's resolution, and its first vertex and index in the
+// batch, with the batch's totals one past the last patch
+struct LevelLayout
+{
+	std::vector<int> resolutions;
+	std::vector<unsigned long long> firstVertex;
+	std::vector<unsigned long long> firstIndex;
+
+	size_t bytes() const
+	{
+		return resolutions.capacity() * sizeof(int) + (firstVertex.capacity() + firstIndex.capacity()) * sizeof(unsigned long long);
+	}
+};
+
+// Per thread buffers, which only ever grow to the size of one batch
+struct BatchScratch
+{
+	std::vector<glm::vec3> controlPoints;
+	LevelLayout layout;
+	std::vector<MeshAssetPatch> patches;
+	std::vector<float> verts;
+	std::vector<unsigned char> converted;
+	std::vector<unsigned int> patchElements;
+	std::vector<unsigned char> indices;
+
+	size_t bytes() const
+	{
+		return controlPoints.capacity() * sizeof(glm::vec3) + layout.bytes() + patches.capacity() * sizeof(MeshAssetPatch)
+			+ verts.capacity() * sizeof(float) + converted.capacity() + patchElements.capacity() * sizeof(unsigned int) + indices.capacity();
+	}
+};
+
+struct BatchFileResult
+{
+	int patches = 0;
+	unsigned long long vertices = 0;
+	unsigned long long triangles = 0;
+	unsigned long long bytesWritten = 0;
+};
+
+static bool WriteZeros(FILE* file, unsigned long long from, unsigned long long to)
+{
+	static const char zeros[16] = { 0 };
+	return WriteAt(file, from, zeros, (size_t)(to - from));
+}
+
+// resolution 0 picks each patch's own from the tolerance
+static void LayOutLevel(const std::vector<glm::vec3>& controlPoints, int resolution, const BatchSettings& settings, LevelLayout& layout)
+{
+	int numPatches = (int)controlPoints.size() / 16;
+	layout.resolutions.resize(numPatches);
+	layout.firstVertex.resize(numPatches + 1);
+	layout.firstIndex.resize(numPatches + 1);
+	layout.firstVertex[0] = 0;
+	layout.firstIndex[0] = 0;
+	for (int p = 0; p < numPatches; ++p)
+	{
+		int patchResolution = resolution > 0 ? resolution : PatchEvaluator::MinResolution(&controlPoints[(size_t)p * 16], settings.tolerance, settings.maxResolution);
+		layout.resolutions[p] = patchResolution;
+		layout.firstVertex[p + 1] = layout.firstVertex[p] + PatchEvaluator::NumVerts(patchResolution);
+		layout.firstIndex[p + 1] = layout.firstIndex[p] + PatchEvaluator::NumElements(patchResolution);
+	}
+}
+
+// Tessellates one input into a temporary file next to its output and renames it into place.
+// With a pool, each batch is split across its threads; without one the calling thread does all
+// the work.
+//
+// Control points are read a batch at a time, so memory stays bounded by the batch size however
+// large the input. A first pass over the file finds the bounds and the size of every level,
+// which fixes the whole layout; then every level is one more pass, each batch writing its part
+// of the level's patch table, vertices and indices where the layout puts them.
+static bool TessellateFile(const BatchFile& file, const BatchSettings& settings, BatchScratch& scratch, WorkerPool* pool, BatchFileResult& result)
+{
+	BptReader reader;
+	if (!reader.Open(file.input.c_str()) || reader.numPatches() == 0)
+		return false;
+
+	std::vector<int> resolutions = settings.resolutions;
+	if (settings.tolerance > 0.0f)
+		resolutions.push_back(0);
+	std::vector<MeshAssetLod> lods(resolutions.size());
+
+	// A Bezier patch lies inside the hull of its control points, so their bounds hold the surface
+	int numPatches = reader.numPatches();
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX), boundsMax = glm::vec3(-FLT_MAX);
+	for (int start = 0; start < numPatches; start += settings.patchesPerBatch)
+	{
+		if (!reader.Read(settings.patchesPerBatch, scratch.controlPoints))
+			return false;
+		for (unsigned int i = 0; i < scratch.controlPoints.size(); ++i)
+		{
+			boundsMin = glm::min(boundsMin, scratch.controlPoints[i]);
+			boundsMax = glm::max(boundsMax, scratch.controlPoints[i]);
+		}
+
+		int count = (int)scratch.controlPoints.size() / 16;
+		for (unsigned int l = 0; l < lods.size(); ++l)
+		{
+			if (resolutions[l] > 0)
+			{
+				lods[l].vertexCount += (unsigned long long)count * PatchEvaluator::NumVerts(resolutions[l]);
+				lods[l].indexCount += (unsigned long long)count * PatchEvaluator::NumElements(resolutions[l]);
+				continue;
+			}
+			LayOutLevel(scratch.controlPoints, 0, settings, scratch.layout);
+			lods[l].vertexCount += scratch.layout.firstVertex[count];
+			lods[l].indexCount += scratch.layout.firstIndex[count];
+		}
+	}
+
+	MeshAssetHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "GLMESH1", 8);
+	header.version = MeshAsset::VERSION;
+	header.vertexFormat = (unsigned int)settings.format;
+	header.numPatches = (unsigned int)numPatches;
+	header.numLods = (unsigned int)resolutions.size();
+	for (int k = 0; k < 3; ++k)
+	{
+		header.boundsMin[k] = boundsMin[k];
+		header.boundsMax[k] = boundsMax[k];
+	}
+
+	// Every size is known now, so the whole layout is too and each part can be written in place
+	int vertexBytes = MeshAsset::VertexBytes(settings.format);
+	unsigned long long offset = sizeof(header) + lods.size() * sizeof(MeshAssetLod);
+	for (unsigned int l = 0; l < lods.size(); ++l)
+	{
+		MeshAssetLod& lod = lods[l];
+		lod.resolution = (unsigned int)resolutions[l];
+		lod.indexBytes = lod.vertexCount <= 65536 ? 2 : 4;
+		lod.patchOffset = 0;
+		if (lod.resolution == 0)
+		{
+			lod.patchOffset = MeshAsset::Align(offset);
+			offset = lod.patchOffset + numPatches * sizeof(MeshAssetPatch);
+		}
+		lod.vertexOffset = MeshAsset::Align(offset);
+		lod.indexOffset = MeshAsset::Align(lod.vertexOffset + lod.vertexCount * vertexBytes);
+		offset = lod.indexOffset + lod.indexCount * lod.indexBytes;
+	}
+
+	std::string tempName = file.output + ".tmp";
+	FILE* out = fopen(tempName.c_str(), "wb");
+	if (!out)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(&lods[0], sizeof(MeshAssetLod), lods.size(), out) == lods.size();
+	unsigned long long written = sizeof(header) + lods.size() * sizeof(MeshAssetLod);
+	for (unsigned int l = 0; l < lods.size() && ok; ++l)
+	{
+		const MeshAssetLod& lod = lods[l];
+		const LevelLayout& layout = scratch.layout;
+
+		// The alignment gaps between the level's parts
+		if (lod.patchOffset)
+		{
+			ok = WriteZeros(out, written, lod.patchOffset);
+			written = lod.patchOffset + numPatches * sizeof(MeshAssetPatch);
+		}
+		ok = ok && WriteZeros(out, written, lod.vertexOffset);
+		ok = ok && WriteZeros(out, lod.vertexOffset + lod.vertexCount * vertexBytes, lod.indexOffset);
+		written = lod.indexOffset + lod.indexCount * lod.indexBytes;
+
+		// Where the batch starts in the level
+		unsigned long long levelVertex = 0, levelIndex = 0;
+		int elementsResolution = 0;
+		reader.Rewind();
+		for (int start = 0; start < numPatches && ok; start += settings.patchesPerBatch)
+		{
+			ok = reader.Read(settings.patchesPerBatch, scratch.controlPoints);
+			if (!ok)
+				break;
+			int count = (int)scratch.controlPoints.size() / 16;
+			LayOutLevel(scratch.controlPoints, resolutions[l], settings, scratch.layout);
+
+			if (lod.patchOffset)
+			{
+				scratch.patches.resize(count);
+				for (int p = 0; p < count; ++p)
+				{
+					scratch.patches[p].resolution = (unsigned int)layout.resolutions[p];
+					scratch.patches[p].padding = 0;
+					scratch.patches[p].firstVertex = levelVertex + layout.firstVertex[p];
+					scratch.patches[p].firstIndex = levelIndex + layout.firstIndex[p];
+				}
+				ok = WriteAt(out, lod.patchOffset + (unsigned long long)start * sizeof(MeshAssetPatch), &scratch.patches[0], count * sizeof(MeshAssetPatch));
+			}
+
+			size_t batchVerts = (size_t)layout.firstVertex[count];
+			scratch.verts.resize(batchVerts * PatchEvaluator::FLOATS_PER_VERT);
+			scratch.converted.resize(batchVerts * vertexBytes);
+
+			std::function<void(int, int, int)> work = [&](int begin, int end, int)
+			{
+				for (int p = begin; p < end; ++p)
+				{
+					size_t first = (size_t)layout.firstVertex[p];
+					int patchVerts = (int)(layout.firstVertex[p + 1] - layout.firstVertex[p]);
+					float* verts = &scratch.verts[first * PatchEvaluator::FLOATS_PER_VERT];
+					PatchEvaluator::Tessellate(&scratch.controlPoints[(size_t)p * 16], layout.resolutions[p], verts);
+					MeshAsset::ConvertVertices(verts, patchVerts, settings.format, boundsMin, boundsMax, &scratch.converted[first * vertexBytes]);
+				}
+			};
+			if (pool)
+				pool->ParallelFor(count, work);
+			else
+				work(0, count, 0);
+
+			ok = ok && WriteAt(out, lod.vertexOffset + levelVertex * vertexBytes, &scratch.converted[0], scratch.converted.size());
+
+			// Indices are the triangle list for the patch's resolution, moved along to its vertices
+			scratch.indices.resize((size_t)layout.firstIndex[count] * lod.indexBytes);
+			for (int p = 0; p < count; ++p)
+			{
+				int resolution = layout.resolutions[p];
+				if (resolution != elementsResolution)
+				{
+					scratch.patchElements.resize(PatchEvaluator::NumElements(resolution));
+					PatchEvaluator::GenerateElements(resolution, &scratch.patchElements[0]);
+					elementsResolution = resolution;
+				}
+
+				int patchElements = (int)scratch.patchElements.size();
+				size_t first = (size_t)layout.firstIndex[p];
+				unsigned int base = (unsigned int)(levelVertex + layout.firstVertex[p]);
+				if (lod.indexBytes == 2)
+				{
+					unsigned short* indices = (unsigned short*)&scratch.indices[0] + first;
+					for (int j = 0; j < patchElements; ++j)
+						indices[j] = (unsigned short)(base + scratch.patchElements[j]);
+				}
+				else
+				{
+					unsigned int* indices = (unsigned int*)&scratch.indices[0] + first;
+					for (int j = 0; j < patchElements; ++j)
+						indices[j] = base + scratch.patchElements[j];
+				}
+			}
+			ok = ok && WriteAt(out, lod.indexOffset + levelIndex * lod.indexBytes, &scratch.indices[0], scratch.indices.size());
+
+			levelVertex += layout.firstVertex[count];
+			levelIndex += layout.firstIndex[count];
+		}
+
+		result.vertices += lod.vertexCount;
+		result.triangles += lod.indexCount / 3;
+	}
+
+	ok = fclose(out) == 0 && ok;
+	if (!ok || !ReplaceFile(tempName, file.output))
+	{
+		remove(tempName.c_str());
+		return false;
+	}
+
+	result.patches = numPatches;
+	result.bytesWritten = written;
+	return true;
+}
+
+// What the journal knows about a finished input
+struct JournalEntry
+{
+	unsigned long long size;
+	long long modified;
+	std::string settings;
+};
+
+// Journal lines are size, modification time, settings and input path, separated by tabs. A
+// torn last line from a crash just fails to match and its input is done again.
+static void LoadJournal(const std::string& path, std::unordered_map<std::string, JournalEntry>& entries)
+{
+	std::ifstream journal(path.c_str());
+	std::string line;
+	while (std::getline(journal, line))
+	{
+		size_t first = line.find('\t');
+		size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+		size_t third = second == std::string::npos ? second : line.find('\t', second + 1);
+		if (third == std::string::npos)
+			continue;
+
+		JournalEntry entry;
+		entry.size = strtoull(line.c_str(), nullptr, 10);
+		entry.modified = strtoll(line.c_str() + first + 1, nullptr, 10);
+		entry.settings = line.substr(second + 1, third - second - 1);
+		entries[line.substr(third + 1)] = entry;
+	}
+}
+
+bool BatchTessellator::Run(const std::vector<std::string>& inputs, const BatchSettings& settings, BatchStats* stats)
+{
+	BatchStats localStats;
+	if (!stats)
+		stats = &localStats;
+	Clock::time_point start = Clock::now();
+
+	if ((settings.resolutions.empty() && settings.tolerance <= 0.0f) || settings.patchesPerBatch <= 0 || settings.maxResolution < 2)
+		return false;
+	for (unsigned int i = 0; i < settings.resolutions.size(); ++i)
+	{
+		if (settings.resolutions[i] < 2)
+			return false;
+	}
+
+	// The journal only vouches for assets made with the same settings
+	std::ostringstream key;
+	key << MeshAsset::FormatName(settings.format) << " res";
+	for (unsigned int i = 0; i < settings.resolutions.size(); ++i)
+		key << (i ? "," : " ") << settings.resolutions[i];
+	if (settings.tolerance > 0.0f)
+		key << " tolerance " << settings.tolerance << " up to " << settings.maxResolution;
+	std::string settingsKey = key.str();
+
+	MakeDirectory(settings.outputDir);
+	std::string journalPath = settings.outputDir + "/tessellate.journal";
+	std::unordered_map<std::string, JournalEntry> journal;
+	if (!settings.force)
+		LoadJournal(journalPath, journal);
+
+	// Outputs are named after their inputs; inputs with the same name in different directories
+	// get a number so they don't overwrite each other
+	std::unordered_map<std::string, int> names;
+	std::vector<BatchFile> small, large;
+	for (unsigned int i = 0; i < inputs.size(); ++i)
+	{
+		BatchFile file;
+		file.input = inputs[i];
+		if (!FileInfo(file.input, file.size, file.modified))
+		{
+			std::cout << "Missing input " << file.input << std::endl;
+			stats->failed++;
+			continue;
+		}
+
+		size_t slash = file.input.find_last_of("/\\");
+		std::string name = file.input.substr(slash == std::string::npos ? 0 : slash + 1);
+		size_t dot = name.find_last_of('.');
+		if (dot != std::string::npos && dot > 0)
+			name = name.substr(0, dot);
+		int uses = names[name]++;
+		if (uses > 0)
+			name += "_" + std::to_string(uses);
+		file.output = settings.outputDir + "/" + name + ".mesh";
+
+		unsigned long long outputSize;
+		long long outputModified;
+		std::unordered_map<std::string, JournalEntry>::iterator done = journal.find(file.input);
+		if (done != journal.end() && done->second.size == file.size && done->second.modified == file.modified
+			&& done->second.settings == settingsKey && FileInfo(file.output, outputSize, outputModified))
+		{
+			stats->skipped++;
+			continue;
+		}
+
+		if (file.size > settings.largeFileBytes)
+			large.push_back(file);
+		else
+			small.push_back(file);
+	}
+
+	int total = (int)(small.size() + large.size());
+	std::cout << "Tessellating " << total << " of " << inputs.size() << " inputs (" << stats->skipped << " already done) at "
+		<< settingsKey << " into " << settings.outputDir << std::endl;
+
+	FILE* journalFile = fopen(journalPath.c_str(), settings.force ? "w" : "a");
+	if (!journalFile)
+	{
+		std::cout << "Couldn't open the journal " << journalPath << std::endl;
+		return false;
+	}
+
+	WorkerPool pool(settings.numThreads);
+	std::vector<BatchScratch> scratch(pool.numThreads());
+	std::mutex mutex;
+	int completed = 0;
+
+	auto process = [&](const BatchFile& file, BatchScratch& threadScratch, WorkerPool* filePool)
+	{
+		Clock::time_point fileStart = Clock::now();
+		BatchFileResult result;
+		bool ok = TessellateFile(file, settings, threadScratch, filePool, result);
+		double seconds = std::chrono::duration<double>(Clock::now() - fileStart).count();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		completed++;
+		std::cout << "[" << completed << "/" << total << "] " << file.input;
+		if (!ok)
+		{
+			std::cout << ": failed" << std::endl;
+			stats->failed++;
+			return;
+		}
+		std::cout << ": " << result.patches << " patches, " << result.triangles << " triangles, " << result.bytesWritten / (1024.0 * 1024.0)
+			<< " MB in " << seconds * 1000.0 << " ms (" << result.patches / seconds << " patches/s)" << std::endl;
+
+		// Only once the asset is in place, so the journal never claims an asset that isn't there
+		fprintf(journalFile, "%llu\t%lld\t%s\t%s\n", file.size, file.modified, settingsKey.c_str(), file.input.c_str());
+		fflush(journalFile);
+
+		stats->files++;
+		stats->patches += result.patches;
+		stats->vertices += result.vertices;
+		stats->triangles += result.triangles;
+		stats->bytesRead += file.size;
+		stats->bytesWritten += result.bytesWritten;
+	};
+
+	pool.ParallelFor((int)small.size(), [&](int begin, int end, int thread)
+	{
+		for (int i = begin; i < end; ++i)
+			process(small[i], scratch[thread], nullptr);
+	}, 1);
+
+	for (unsigned int i = 0; i < large.size(); ++i)
+		process(large[i], scratch[0], &pool);
+
+	fclose(journalFile);
+
+	for (unsigned int i = 0; i < scratch.size(); ++i)
+		stats->scratchBytes += scratch[i].bytes();
+	stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	return stats->failed == 0;
+}
+
+void BatchTessellator::PrintStats(const BatchStats& stats)
+{
+	std::cout << "Done: " << stats.files << " files, " << stats.skipped << " skipped, " << stats.failed << " failed in " << stats.seconds << " s" << std::endl;
+	std::cout << stats.patches << " patches, " << stats.vertices << " vertices, " << stats.triangles << " triangles" << std::endl;
+	std::cout << stats.bytesRead / (1024.0 * 1024.0) << " MB read, " << stats.bytesWritten / (1024.0 * 1024.0) << " MB written, "
+		<< stats.scratchBytes / 1024.0 << " KB of scratch" << std::endl;
+	if (stats.seconds > 0.0)
+		std::cout << stats.files / stats.seconds << " files/s, " << stats.patches / stats.seconds << " patches/s, "
+			<< stats.bytesWritten / (1024.0 * 1024.0) / stats.seconds << " MB/s" << std::endl;
+}
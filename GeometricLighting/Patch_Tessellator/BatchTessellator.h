@@ -0,0 +1,70 @@
+#pragma once
+#include "MeshAsset.h"
+
+#include <vector>
+#include <string>
+
+struct BatchSettings
+{
+	// One level of detail per resolution, in this order
+	std::vector<int> resolutions;
+
+	// Adds a last level where every patch gets the smallest resolution, up to maxResolution,
+	// whose triangles are sure to be within tolerance of its surface. 0 for none.
+	float tolerance = 0.0f;
+	int maxResolution = 64;
+	VertexFormat format = VertexFormat::Float;
+
+	// Assets and the journal go here
+	std::string outputDir = ".";
+
+	// 0 uses one thread per core
+	int numThreads = 0;
+
+	// Patches tessellated at a time. Together with the thread count this bounds the memory
+	// used, however large the inputs are.
+	int patchesPerBatch = 256;
+
+	// Inputs larger than this are done one at a time with every thread working on their
+	// batches; smaller ones are spread over the threads a whole file each
+	size_t largeFileBytes = 8 * 1024 * 1024;
+
+	// Redo every input, even those the journal says are done
+	bool force = false;
+};
+
+struct BatchStats
+{
+	int files = 0;
+	int skipped = 0;
+	int failed = 0;
+	unsigned long long patches = 0;
+	unsigned long long vertices = 0;
+	unsigned long long triangles = 0;
+	unsigned long long bytesRead = 0;
+	unsigned long long bytesWritten = 0;
+	size_t scratchBytes = 0;
+	double seconds = 0.0;
+};
+
+// Tessellates .bpt patch files into mesh assets for an asset pipeline. Small inputs are spread
+// across threads a file each; large ones are done one after another, every batch of their
+// patches split across the threads. Either way patches are read from the input and streamed to
+// disk a batch at a time.
+//
+// Each asset is written to a temporary file and renamed into place once complete, and then its
+// input is recorded in a journal in the output directory along with its size, modification
+// time and the settings used. A run that is interrupted can be started again with the same
+// arguments and skips every input that is already done and unchanged.
+class BatchTessellator
+{
+public:
+	// Turns the command line inputs into a sorted list of files. Each argument is a file, a
+	// directory (meaning every .bpt file in it), a wildcard pattern, or @list for a text file
+	// naming one input per line.
+	static std::vector<std::string> ExpandInputs(const std::vector<std::string>& arguments);
+
+	static bool Run(const std::vector<std::string>& inputs, const BatchSettings& settings, BatchStats* stats = nullptr);
+
+	static void PrintStats(const BatchStats& stats);
+};
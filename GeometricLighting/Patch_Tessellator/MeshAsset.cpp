@@ -0,0 +1,101 @@
+#include "MeshAsset.h"
+#include "PatchEvaluator.h"
+
+#include <cstring>
+#include <cmath>
+
+int MeshAsset::VertexBytes(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Float:
+		return 24;
+	case VertexFormat::OctNormal:
+		return 16;
+	default:
+		return 12;
+	}
+}
+
+const char* MeshAsset::FormatName(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Float:
+		return "float";
+	case VertexFormat::OctNormal:
+		return "oct";
+	default:
+		return "quantized";
+	}
+}
+
+bool MeshAsset::ParseFormat(const char* name, VertexFormat& format)
+{
+	if (!strcmp(name, "float"))
+		format = VertexFormat::Float;
+	else if (!strcmp(name, "oct"))
+		format = VertexFormat::OctNormal;
+	else if (!strcmp(name, "quantized"))
+		format = VertexFormat::Quantized;
+	else
+		return false;
+	return true;
+}
+
+// Maps a unit vector onto the octahedron and unfolds it into the square [-1, 1]^2, then stores
+// it as two snorm16. Error stays under a hundredth of a degree everywhere on the sphere.
+static void OctEncode(const float* normal, short* out)
+{
+	float sum = fabs(normal[0]) + fabs(normal[1]) + fabs(normal[2]);
+	float x = sum > 0.0f ? normal[0] / sum : 0.0f;
+	float y = sum > 0.0f ? normal[1] / sum : 0.0f;
+	if (normal[2] < 0.0f)
+	{
+		float foldedX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	out[0] = (short)floor(glm::clamp(x, -1.0f, 1.0f) * 32767.0f + 0.5f);
+	out[1] = (short)floor(glm::clamp(y, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+void MeshAsset::ConvertVertices(const float* verts, int count, VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+	unsigned char* out)
+{
+	if (format == VertexFormat::Float)
+	{
+		memcpy(out, verts, (size_t)count * PatchEvaluator::FLOATS_PER_VERT * sizeof(float));
+		return;
+	}
+
+	glm::vec3 extent = boundsMax - boundsMin;
+	glm::vec3 scale = glm::vec3(extent.x > 0.0f ? 65535.0f / extent.x : 0.0f, extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+		extent.z > 0.0f ? 65535.0f / extent.z : 0.0f);
+
+	for (int i = 0; i < count; ++i, verts += PatchEvaluator::FLOATS_PER_VERT)
+	{
+		if (format == VertexFormat::OctNormal)
+		{
+			memcpy(out, verts, 3 * sizeof(float));
+			OctEncode(verts + 3, (short*)(out + 12));
+			out += 16;
+		}
+		else
+		{
+			unsigned short position[4];
+			for (int k = 0; k < 3; ++k)
+				position[k] = (unsigned short)glm::clamp((float)floor((verts[k] - boundsMin[k]) * scale[k] + 0.5f), 0.0f, 65535.0f);
+			position[3] = 0;
+			memcpy(out, position, sizeof(position));
+			OctEncode(verts + 3, (short*)(out + 8));
+			out += 12;
+		}
+	}
+}
+
+unsigned long long MeshAsset::Align(unsigned long long offset)
+{
+	return (offset + 15) & ~15ULL;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <GLM/glm.hpp>
+
+// Vertex layouts a mesh asset can be written in
+enum class VertexFormat
+{
+	// Position and normal as 32 bit floats, the PatchEvaluator layout (24 bytes)
+	Float,
+
+	// 32 bit float position, normal octahedron encoded into two snorm16 (16 bytes)
+	OctNormal,
+
+	// Position as unorm16 inside the mesh bounds plus a padding short, then the octahedron
+	// encoded normal (12 bytes)
+	Quantized
+};
+
+// GPU ready tessellated patches: one level of detail per resolution, each a vertex buffer and
+// a triangle list that can be uploaded as they are. The file is
+//
+//	MeshAssetHeader
+//	MeshAssetLod[numLods]
+//	for each level: a MeshAssetPatch[numPatches] table if it has one, vertices, then indices,
+//	each starting on a 16 byte boundary
+//
+// Patch i's vertices in a level start at i * resolution^2 and the indices refer to vertices of
+// the whole level, so a level draws with one call. Indices are 16 bit when the level has at
+// most 65536 vertices and 32 bit otherwise.
+//
+// A level with resolution 0 was tessellated to a tolerance instead: each patch at its own
+// resolution, listed with where its vertices and indices start in the patch table.
+struct MeshAssetHeader
+{
+	char magic[8];				// "GLMESH1"
+	unsigned int version;
+	unsigned int vertexFormat;	// VertexFormat
+	unsigned int numPatches;
+	unsigned int numLods;
+
+	// Bounds of the control points, which contain the surface. Quantized positions map
+	// 0..65535 onto them.
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+struct MeshAssetLod
+{
+	unsigned int resolution;	// 0 for a resolution per patch
+	unsigned int indexBytes;	// 2 or 4
+	unsigned long long vertexCount;
+	unsigned long long indexCount;
+	unsigned long long vertexOffset;
+	unsigned long long indexOffset;
+	unsigned long long patchOffset;	// 0 unless the resolution is per patch
+};
+
+struct MeshAssetPatch
+{
+	unsigned int resolution;
+	unsigned int padding;
+	unsigned long long firstVertex;
+	unsigned long long firstIndex;
+};
+
+class MeshAsset
+{
+public:
+	static const unsigned int VERSION = 2;
+
+	static int VertexBytes(VertexFormat format);
+	static const char* FormatName(VertexFormat format);
+	static bool ParseFormat(const char* name, VertexFormat& format);
+
+	// Converts count PatchEvaluator vertices into format. Quantized positions are placed in the
+	// box from boundsMin to boundsMax.
+	static void ConvertVertices(const float* verts, int count, VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+		unsigned char* out);
+
+	// Rounds a file offset up to where the next block starts
+	static unsigned long long Align(unsigned long long offset);
+};
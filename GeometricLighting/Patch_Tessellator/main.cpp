@@ -0,0 +1,128 @@
+/*
+Patch Tessellator
+(c) 2015
+original authors: Benjamin Robbins
+Written under the supervision of David I. Schwartz, Ph.D., and
+supported by a professional development seed grant from the B. Thomas
+Golisano College of Computing & Information Sciences
+(https://www.rit.edu/gccis) at the Rochester Institute of Technology.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*	A command line tool that turns .bpt patch files into GPU ready meshes without opening a window, for asset pipelines that
+*	convert many files at once. It evaluates the patches with the same PatchEvaluator code the Geometric_Lighting example draws
+*	them with, so the meshes match what the example shows.
+*
+*	BatchTessellator
+*	- Expands the inputs (files, directories, wildcard patterns and @list files), then tessellates them in parallel a batch of
+*	patches at a time, so memory stays bounded however large the inputs are. Finished inputs are recorded in a journal in the
+*	output directory, so an interrupted run picks up where it left off when started again with the same arguments.
+*
+*	MeshAsset
+*	- The binary mesh format: one vertex buffer and triangle list per requested resolution, in one of three vertex formats
+*	(float positions and normals, float positions with octahedron encoded normals, or quantized positions with octahedron
+*	encoded normals). A --tolerance level picks each patch's resolution from a bound on its second derivatives, so small or flat
+*	patches get coarse grids and only strongly curved ones fine grids, and lists them in a table ahead of its vertices.
+*
+*	Usage: Patch_Tessellator [options] inputs...
+*	--out <dir>			where to write the .mesh assets and the journal (default: the current directory)
+*	--res <list>		resolutions to write, comma separated, one level of detail each (default: 16, or none with --tolerance)
+*	--tolerance <t>		adds a level with each patch at the smallest resolution whose triangles are sure to be within t of it
+*	--max-res <n>		finest resolution --tolerance may pick (default: 64)
+*	--format <name>		float, oct or quantized (default: float)
+*	--threads <n>		worker threads, 0 for one per core (default: 0)
+*	--batch <n>			patches tessellated at a time (default: 256)
+*	--force				redo every input, ignoring the journal
+*/
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+#include "BatchTessellator.h"
+
+void printUsage()
+{
+	std::cout << "Usage: Patch_Tessellator [--out dir] [--res 8,16,32] [--tolerance t] [--max-res n] [--format float|oct|quantized] [--threads n] [--batch n] [--force] inputs..." << std::endl;
+	std::cout << "Inputs are .bpt files, directories of them, wildcard patterns, or @file for a list of inputs one per line." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	BatchSettings settings;
+	std::vector<std::string> arguments;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--out") && i + 1 < argc)
+			settings.outputDir = argv[++i];
+		else if (!strcmp(argv[i], "--res") && i + 1 < argc)
+		{
+			settings.resolutions.clear();
+			for (const char* p = argv[++i]; *p; )
+			{
+				char* end;
+				long resolution = strtol(p, &end, 10);
+				if (end == p)
+					break;
+				settings.resolutions.push_back((int)resolution);
+				p = *end == ',' ? end + 1 : end;
+			}
+		}
+		else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+			settings.tolerance = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "--max-res") && i + 1 < argc)
+			settings.maxResolution = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--format") && i + 1 < argc)
+		{
+			if (!MeshAsset::ParseFormat(argv[++i], settings.format))
+			{
+				std::cout << "Unknown vertex format " << argv[i] << std::endl;
+				printUsage();
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+			settings.numThreads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--batch") && i + 1 < argc)
+			settings.patchesPerBatch = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--force"))
+			settings.force = true;
+		else if (argv[i][0] == '-' && argv[i][1] == '-')
+		{
+			std::cout << "Unknown option " << argv[i] << std::endl;
+			printUsage();
+			return 1;
+		}
+		else
+			arguments.push_back(argv[i]);
+	}
+
+	if (settings.resolutions.empty() && settings.tolerance <= 0.0f)
+		settings.resolutions.push_back(16);
+
+	std::vector<std::string> inputs = BatchTessellator::ExpandInputs(arguments);
+	if (inputs.empty())
+	{
+		printUsage();
+		return 1;
+	}
+
+	BatchStats stats;
+	bool ok = BatchTessellator::Run(inputs, settings, &stats);
+	BatchTessellator::PrintStats(stats);
+	return ok ? 0 : 1;
+}